@@ -9,6 +9,7 @@
 #include "cjson.h"
 #include <iomanip>
 #include <cstdio>
+#include "jsonindex.h"
 #include "../file/file.h"
 #include "../sba/sba.h"
 #include <string>
@@ -75,7 +76,7 @@ Member functions for cjson
 */
 
 cjson::cjson() :
-	mem(new HeapStack()),
+	mem(new HeapStack(MemConstants::HeapStackSmallBlockSize)),
 	nodeType(cjsonType::VOIDED),
 	nodeName(nullptr),
 	nodeData(nullptr),
@@ -110,6 +111,12 @@ cjson::cjson(std::string jsonText, size_t length):
 	Parse(jsonText, this);
 };
 
+cjson::cjson(const char* jsonText, size_t length):
+	cjson()
+{
+	Parse(jsonText, length, this);
+};
+
 
 
 cjson::cjson(HeapStack* MemObj, cjson* RootObj) :
@@ -917,18 +924,88 @@ bool cjson::getBool() const
 
 cjson* cjson::Parse(const char* JSON, cjson* root, bool embedded)
 {
-	auto cursor = const_cast<char*>(JSON);
-	return cjson::ParseBranch(root, cursor, embedded);
+	return cjson::Parse(JSON, strlen(JSON), root, embedded);
 }
 
 cjson* cjson::Parse(std::string JSON, cjson* root, bool embedded)
 {
-	return cjson::Parse(JSON.c_str(), root, embedded);
+	return cjson::Parse(JSON.c_str(), JSON.length(), root, embedded);
 };
 
+cjson* cjson::Parse(const char* JSON, size_t length, cjson* root, bool embedded)
+{
+	// reused by every parse on the thread, an index over this many entries is released after use
+	const size_t MaxKeptIndex = 1 << 20;
+	thread_local std::vector<uint32_t> index;
+
+	if (!jsonIndex::build(JSON, length, index))
+		return cjson::ParseSerial(std::string(JSON, length).c_str(), root, embedded);
+
+	const uint32_t* token = index.data();
+	const uint32_t* end = index.data() + index.size() - 1; // the last entry is the length
+
+	// no document to index (leading bytes the serial parser skips as junk, like
+	// a UTF-8 BOM, or none at all), leave it to the serial parser
+	if (token == end || (JSON[*token] != '{' && JSON[*token] != '['))
+		return cjson::ParseSerial(std::string(JSON, length).c_str(), root, embedded);
+
+	auto N = root ? root : cjson::MakeDocument();
+
+	// so a document that isn't well formed can be undone
+	const auto type = N->nodeType;
+	const auto tail = N->membersTail;
+	const auto count = N->memberCount;
+
+	const auto close = JSON[*token] == '{' ? '}' : ']';
+
+	if (!embedded)
+		N->nodeType = close == '}' ? cjsonType::OBJECT : cjsonType::ARRAY;
+
+	++token;
+	const auto wellFormed = cjson::ParseMembers(N, close, JSON, token, end);
+
+	if (index.capacity() > MaxKeptIndex)
+		std::vector<uint32_t>().swap(index);
+
+	if (wellFormed)
+		return N;
+
+	if (!root)
+	{
+		cjson::DisposeDocument(N);
+		return cjson::ParseSerial(std::string(JSON, length).c_str(), nullptr, embedded);
+	}
+
+	// drop whatever was added, the nodes stay in the HeapStack until the document is released
+	root->nodeType = type;
+	root->membersTail = tail;
+	root->memberCount = count;
+
+	if (tail)
+		tail->siblingNext = nullptr;
+	else
+		root->membersHead = nullptr;
+
+	return cjson::ParseSerial(std::string(JSON, length).c_str(), root, embedded);
+}
+
+cjson* cjson::ParseSerial(const char* JSON, cjson* root, bool embedded)
+{
+	auto cursor = const_cast<char*>(JSON);
+	return cjson::ParseBranch(root, cursor, embedded);
+}
+
+// the writer reused by every Stringify on the thread
+static HeapStack& stringifyWriter()
+{
+	thread_local HeapStack mem(MemConstants::HeapStackSmallBlockSize);
+	mem.reset();
+	return mem;
+}
+
 char* cjson::StringifyCstr(const cjson* N, int64_t& length, bool pretty)
 {
-	HeapStack mem;	
+	auto& mem = stringifyWriter();
 	N->Stringify_worker(N, mem, (pretty) ? 0 : -1, N);
 	
 	auto end = mem.newPtr(1);
@@ -952,7 +1029,7 @@ HeapStack* cjson::StringifyHeapStack(cjson* N, int64_t& length, bool pretty)
 
 std::string cjson::Stringify(cjson* N, bool pretty)
 {
-	HeapStack mem;
+	auto& mem = stringifyWriter();
 
 	N->Stringify_worker(N, mem, (pretty) ? 0 : -1, N);
 	auto end = mem.newPtr(1);
@@ -986,7 +1063,11 @@ void cjson::DisposeDocument(cjson* Document)
 
 cjson* cjson::MakeDocument()
 {
-	auto mem = new HeapStack();
+	return MakeDocument(new HeapStack(MemConstants::HeapStackSmallBlockSize));
+}
+
+cjson* cjson::MakeDocument(HeapStack* mem)
+{
 	void* Data = mem->newPtr(sizeof(cjson));
 
 	// we are going to allocate this node using "placement new"
@@ -1562,7 +1643,9 @@ cjson* cjson::ParseBranch(cjson* N, char* & readPtr, bool embedding)
 
 			Name = accumulator;
 
-			++readPtr;
+			// an unterminated string stops at the end of the document
+			if (*readPtr)
+				++readPtr;
 
 			SkipJunk(readPtr);
 
@@ -1682,7 +1765,9 @@ cjson* cjson::ParseBranch(cjson* N, char* & readPtr, bool embedding)
 
 					N->set(Name, TF);
 				}
-				++readPtr;
+
+				if (*readPtr)
+					++readPtr;
 			}
 		}
 		else
@@ -1694,3 +1779,352 @@ cjson* cjson::ParseBranch(cjson* N, char* & readPtr, bool embedding)
 	return N;
 }
 
+namespace
+{
+	// four hex digits at `read`, false if there aren't four before `end`
+	bool readHex(const char* read, const char* end, uint32_t& value)
+	{
+		if (end - read < 4)
+			return false;
+
+		value = 0;
+
+		for (auto i = 0; i < 4; ++i)
+		{
+			const auto c = read[i];
+			value <<= 4;
+
+			if (c >= '0' && c <= '9')
+				value |= c - '0';
+			else if (c >= 'a' && c <= 'f')
+				value |= c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F')
+				value |= c - 'A' + 10;
+			else
+				return false;
+		}
+
+		return true;
+	}
+
+	char* emitUTF8(char* write, const uint32_t code)
+	{
+		if (code < 0x80)
+		{
+			*write++ = static_cast<char>(code);
+		}
+		else if (code < 0x800)
+		{
+			*write++ = static_cast<char>(0xC0 | (code >> 6));
+			*write++ = static_cast<char>(0x80 | (code & 0x3F));
+		}
+		else if (code < 0x10000)
+		{
+			*write++ = static_cast<char>(0xE0 | (code >> 12));
+			*write++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+			*write++ = static_cast<char>(0x80 | (code & 0x3F));
+		}
+		else
+		{
+			*write++ = static_cast<char>(0xF0 | (code >> 18));
+			*write++ = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+			*write++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+			*write++ = static_cast<char>(0x80 | (code & 0x3F));
+		}
+
+		return write;
+	}
+
+	// true if the scalar between `read` and `stop` is `literal` (any case) followed by whitespace
+	bool isLiteral(const char* read, const char* stop, const char* literal)
+	{
+		for (; *literal; ++literal, ++read)
+			if (read == stop || tolower(static_cast<unsigned char>(*read)) != *literal)
+				return false;
+
+		while (read < stop && static_cast<uint8_t>(*read) <= 32)
+			++read;
+
+		return read == stop;
+	}
+
+	// `undefined` members and elements are left out, the same as the serial parser
+	bool isUndefined(const char* text, const uint32_t* token, const uint32_t* end)
+	{
+		return token < end &&
+			(text[*token] == 'u' || text[*token] == 'U') &&
+			isLiteral(text + *token, text + token[1], "undefined");
+	}
+
+	// decodes the string between `read` and `end` (the closing quote) into
+	// `write`, which has room for end - read + 1 bytes (decoding never grows
+	// a string), the result is null terminated and its length is returned
+	size_t decodeString(const char* read, const char* end, char* write)
+	{
+		const auto escape = static_cast<const char*>(memchr(read, '\\', end - read));
+
+		if (!escape)
+		{
+			memcpy(write, read, end - read);
+			write[end - read] = 0;
+			return end - read;
+		}
+
+		const auto start = write;
+
+		memcpy(write, read, escape - read);
+		write += escape - read;
+		read = escape;
+
+		while (read < end)
+		{
+			if (*read != '\\')
+			{
+				*write++ = *read++;
+				continue;
+			}
+
+			++read; // the closing quote isn't escaped, so there is always a character here
+
+			switch (*read++)
+			{
+				case 'r':
+					*write++ = '\r';
+					break;
+				case 'n':
+					*write++ = '\n';
+					break;
+				case 't':
+					*write++ = '\t';
+					break;
+				case 'f':
+					*write++ = '\f';
+					break;
+				case 'b':
+					*write++ = '\b';
+					break;
+				case 'v':
+					*write++ = '\v';
+					break;
+				case 'u':
+				{
+					uint32_t code;
+
+					if (!readHex(read, end, code))
+					{
+						*write++ = 'u';
+						break;
+					}
+
+					read += 4;
+
+					// surrogate pair
+					uint32_t low;
+					if (code >= 0xD800 && code < 0xDC00 &&
+						end - read >= 6 && read[0] == '\\' && read[1] == 'u' &&
+						readHex(read + 2, end, low) && low >= 0xDC00 && low < 0xE000)
+					{
+						code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+						read += 6;
+					}
+
+					write = emitUTF8(write, code);
+				}
+				break;
+				default: // \" \\ \/ \' and anything unknown are the character itself
+					*write++ = read[-1];
+					break;
+			}
+		}
+
+		*write = 0;
+		return write - start;
+	}
+}
+
+bool cjson::ParseMembers(cjson* N, const char close, const char* text, const uint32_t* & token, const uint32_t* end)
+{
+	if (token < end && text[*token] == close)
+	{
+		++token;
+		return true;
+	}
+
+	const auto isObject = close == '}';
+
+	// names seen so far as a bit each (from their length and ends), a repeated
+	// name is only searched for if its bit is already set, or N had members to start with
+	const auto hadMembers = N->memberCount != 0;
+	uint64_t seen = 0;
+
+	while (token < end)
+	{
+		cjson* node = nullptr;
+
+		if (isObject)
+		{
+			// "name" : - both quotes are in the index
+			if (end - token < 3 || text[token[0]] != '"' || text[token[2]] != ':')
+				return false;
+
+			const auto name = N->mem->newPtr(token[1] - token[0]);
+			const auto length = decodeString(text + token[0] + 1, text + token[1], name);
+			token += 3;
+
+			if (!isUndefined(text, token, end))
+			{
+				const auto bit = 1ULL << ((length * 31 + (length ? name[0] + name[length - 1] * 7 : 0)) & 63);
+
+				// a repeated name updates the member, the same as set
+				node = hadMembers || (seen & bit) ? N->find(name) : nullptr;
+				seen |= bit;
+
+				if (!node)
+				{
+					node = N->createNode();
+					node->nodeName = name;
+					N->Link(node);
+				}
+			}
+		}
+		else if (!isUndefined(text, token, end))
+		{
+			node = N->createNode();
+			N->Link(node);
+		}
+
+		if (token >= end)
+			return false;
+
+		if (!node)
+			++token; // skipped `undefined`
+		else if (!cjson::ParseValue(node, text, token, end))
+			return false;
+
+		if (token >= end)
+			return false;
+
+		const auto next = text[*token];
+		++token;
+
+		if (next == close)
+			return true;
+
+		if (next != ',')
+			return false;
+	}
+
+	return false;
+}
+
+bool cjson::ParseValue(cjson* N, const char* text, const uint32_t* & token, const uint32_t* end)
+{
+	const auto start = text + *token;
+
+	// a scalar runs up to the next structural character (or the end of the document)
+	const auto stop = text + token[1];
+
+	switch (*start)
+	{
+		case '{':
+		case '[':
+			N->nodeType = *start == '{' ? cjsonType::OBJECT : cjsonType::ARRAY;
+			++token;
+			return cjson::ParseMembers(N, *start == '{' ? '}' : ']', text, token, end);
+
+		case '"':
+		{
+			const auto data = N->mem->newPtr(token[1] - token[0]);
+			decodeString(start + 1, stop, data);
+			N->nodeType = cjsonType::STR;
+			N->nodeData = reinterpret_cast<dataUnion*>(data);
+			token += 2;
+			return true;
+		}
+
+		case 't':
+		case 'T':
+		case 'f':
+		case 'F':
+		{
+			const auto value = tolower(*start) == 't';
+
+			if (!isLiteral(start, stop, value ? "true" : "false"))
+				return false;
+
+			N->replace(value);
+			++token;
+			return true;
+		}
+
+		case 'n':
+		case 'N':
+		case 'u':
+		case 'U':
+			if (!isLiteral(start, stop, tolower(*start) == 'n' ? "null" : "undefined"))
+				return false;
+
+			N->replace();
+			++token;
+			return true;
+
+		default:
+			break;
+	}
+
+	// numbers, INT unless there is a fraction or exponent (like the serial parser)
+	auto read = start;
+
+	if (*read == '-')
+		++read;
+
+	const auto digits = read;
+	uint64_t value = 0;
+
+	while (read < stop && static_cast<unsigned>(*read - '0') <= 9)
+	{
+		value = value * 10 + (*read - '0');
+		++read;
+	}
+
+	if (read == digits)
+		return false;
+
+	const auto isDouble = read < stop && (*read == '.' || *read == 'e' || *read == 'E');
+
+	if (isDouble || read - digits > 18)
+	{
+		// strtod and strtoll want a terminated string, the document might not be
+		char buffer[64];
+		const auto length = stop - start;
+
+		if (length >= static_cast<int64_t>(sizeof(buffer)))
+			return false;
+
+		memcpy(buffer, start, length);
+		buffer[length] = 0;
+
+		char* endp;
+
+		if (isDouble)
+			N->replace(strtod(buffer, &endp));
+		else
+			N->replace(static_cast<int64_t>(strtoll(buffer, &endp, 10)));
+
+		read = start + (endp - buffer);
+	}
+	else
+	{
+		N->replace(*start == '-' ? -static_cast<int64_t>(value) : static_cast<int64_t>(value));
+	}
+
+	// only whitespace can follow
+	while (read < stop && static_cast<uint8_t>(*read) <= 32)
+		++read;
+
+	if (read != stop)
+		return false;
+
+	++token;
+	return true;
+}
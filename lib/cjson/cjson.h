@@ -19,6 +19,10 @@ Features:
     On my Core i7 I was able to parse a heavily nest 185MB JSON file in 
 	3891ms. I was able to serialize it out to a non-pretified 124MB JSON
 	file in 3953ms. 
+  - Parse works in two stages, the structure of the document is found 64
+    bytes at a time (see jsonindex.h) and nodes are built by walking that
+	index. Documents that aren't well formed are handed to the original
+	character at a time parser (ParseSerial), which makes what it can of them.
   - Easily incorporated into code that must call REST endpoints or where
     you want configuration in JSON rather than CONF formats.
 
@@ -209,6 +213,7 @@ public:
 	explicit cjson(cjsonType docType);
 	explicit cjson(std::string fileName);
 	cjson(std::string jsonText, size_t length);
+	cjson(const char* jsonText, size_t length);
 	cjson(HeapStack* MemObj, cjson* RootObj);
 
 	cjson(const cjson&) = delete; // can't copy - actually we could... but..
@@ -442,6 +447,11 @@ public:
 	*/
 	static cjson* Parse(const char* JSON, cjson* root = nullptr, bool embedded = false);
 	static cjson* Parse(std::string JSON, cjson* root = nullptr, bool embedded = false);
+	// JSON does not need to be null terminated
+	static cjson* Parse(const char* JSON, size_t length, cjson* root = nullptr, bool embedded = false);
+
+	// the original character at a time parser
+	static cjson* ParseSerial(const char* JSON, cjson* root = nullptr, bool embedded = false);
 
 	// returns char* you must call delete[] on the result
 	// memory is allocated with pooled memory, call releaseStringifyPtr to release
@@ -462,6 +472,9 @@ public:
 	static void DisposeDocument(cjson* Document);
 	// create a root node (with heapstack object).
 	static cjson* MakeDocument();
+	// create a root node in a caller's HeapStack, don't DisposeDocument
+	// it, the document goes away when the HeapStack is reset
+	static cjson* MakeDocument(HeapStack* mem);
 
 	static cjson* fromFile(std::string fileName, cjson* root = nullptr);
 	static bool toFile(std::string fileName, cjson* root, bool pretty = true);
@@ -574,6 +587,11 @@ private:
 	void Link(cjson* newNode);
 	static cjson* ParseBranch(cjson* N, char* & readPtr, bool embedding = false);
 
+	// stage two of Parse, `token` walks the structural index (see jsonindex.h),
+	// these return false if the document isn't well formed
+	static bool ParseMembers(cjson* N, char close, const char* text, const uint32_t* & token, const uint32_t* end);
+	static bool ParseValue(cjson* N, const char* text, const uint32_t* & token, const uint32_t* end);
+
 	// function used by xPath functions
 	cjson* GetNodeByPath(std::string Path) const;
 
@@ -0,0 +1,194 @@
+#include "jsonindex.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define JSONINDEX_SSE2
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+	const size_t BlockSize = 64;
+
+	// bit `i` is set if byte `i` of the block is one of these
+	struct block_s
+	{
+		uint64_t quote;
+		uint64_t backslash;
+		uint64_t structural; // { } [ ] : ,
+		uint64_t whitespace; // anything <= 32, the same as the serial parser skips
+	};
+
+#ifdef JSONINDEX_SSE2
+	void classify(const char* data, block_s& block)
+	{
+		const auto quote = _mm_set1_epi8('"');
+		const auto backslash = _mm_set1_epi8('\\');
+		const auto open = _mm_set1_epi8('{');
+		const auto close = _mm_set1_epi8('}');
+		const auto colon = _mm_set1_epi8(':');
+		const auto comma = _mm_set1_epi8(',');
+		const auto space = _mm_set1_epi8(' ');
+		const auto lowerCase = _mm_set1_epi8(0x20);
+
+		block = { 0, 0, 0, 0 };
+
+		for (auto i = 0; i < 4; ++i)
+		{
+			const auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 16));
+
+			// [ and ] are { and } without the 0x20 bit
+			const auto folded = _mm_or_si128(chunk, lowerCase);
+
+			const auto structural = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)),
+				_mm_or_si128(_mm_cmpeq_epi8(chunk, colon), _mm_cmpeq_epi8(chunk, comma)));
+
+			// unsigned chunk <= 32
+			const auto whitespace = _mm_cmpeq_epi8(_mm_max_epu8(chunk, space), space);
+
+			const auto shift = i * 16;
+			block.quote |= static_cast<uint64_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, quote)) & 0xFFFF) << shift;
+			block.backslash |= static_cast<uint64_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, backslash)) & 0xFFFF) << shift;
+			block.structural |= static_cast<uint64_t>(_mm_movemask_epi8(structural) & 0xFFFF) << shift;
+			block.whitespace |= static_cast<uint64_t>(_mm_movemask_epi8(whitespace) & 0xFFFF) << shift;
+		}
+	}
+#else
+	void classify(const char* data, block_s& block)
+	{
+		block = { 0, 0, 0, 0 };
+
+		for (size_t i = 0; i < BlockSize; ++i)
+		{
+			const auto c = static_cast<uint8_t>(data[i]);
+			const auto bit = 1ULL << i;
+
+			switch (c)
+			{
+				case '"':
+					block.quote |= bit;
+					break;
+				case '\\':
+					block.backslash |= bit;
+					break;
+				case '{':
+				case '}':
+				case '[':
+				case ']':
+				case ':':
+				case ',':
+					block.structural |= bit;
+					break;
+				default:
+					if (c <= 32)
+						block.whitespace |= bit;
+			}
+		}
+	}
+#endif
+
+	inline int lowestBit(const uint64_t bits)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward64(&index, bits);
+		return static_cast<int>(index);
+#else
+		return __builtin_ctzll(bits);
+#endif
+	}
+
+	// bit `i` of the result is the xor of bits 0 to `i`, which turns the
+	// quotes into a mask of the inside of strings (opening quote included)
+	inline uint64_t prefixXor(uint64_t bits)
+	{
+		bits ^= bits << 1;
+		bits ^= bits << 2;
+		bits ^= bits << 4;
+		bits ^= bits << 8;
+		bits ^= bits << 16;
+		bits ^= bits << 32;
+		return bits;
+	}
+}
+
+bool jsonIndex::build(const char* text, const size_t length, std::vector<uint32_t>& index)
+{
+	index.clear();
+
+	if (length >= UINT32_MAX)
+		return false;
+
+	index.reserve(length / 4 + 2);
+
+	// carried from one block to the next
+	uint64_t prevEscaped = 0; // 1 if the first byte of the block is escaped
+	uint64_t prevInString = 0; // all ones if the last block ended inside a string
+	uint64_t prevScalar = 0; // 1 if the last block ended inside a number, true, etc.
+
+	char tail[BlockSize];
+
+	for (size_t offset = 0; offset < length; offset += BlockSize)
+	{
+		auto data = text + offset;
+
+		// the last partial block is padded with spaces
+		if (length - offset < BlockSize)
+		{
+			memset(tail, ' ', BlockSize);
+			memcpy(tail, data, length - offset);
+			data = tail;
+		}
+
+		block_s block;
+		classify(data, block);
+
+		// a character is escaped if it follows an odd run of backslashes,
+		// backslashes are rare enough that walking them one at a time is fine
+		auto escaped = prevEscaped;
+		auto backslash = block.backslash & ~escaped;
+		prevEscaped = 0;
+
+		while (backslash)
+		{
+			const auto bit = lowestBit(backslash);
+
+			if (bit == 63)
+				prevEscaped = 1;
+			else
+				escaped |= 2ULL << bit;
+
+			// the escaped character can't start an escape of its own
+			backslash &= ~(3ULL << bit);
+		}
+
+		const auto quote = block.quote & ~escaped;
+		const auto inString = prefixXor(quote) ^ prevInString;
+		prevInString = static_cast<uint64_t>(static_cast<int64_t>(inString) >> 63);
+
+		// numbers, true, false and null are runs of anything else, the index gets where they start
+		const auto scalar = ~(block.structural | block.whitespace | block.quote | inString);
+		const auto scalarStart = scalar & ~((scalar << 1) | prevScalar);
+		prevScalar = scalar >> 63;
+
+		auto bits = (block.structural & ~inString) | quote | scalarStart;
+
+		while (bits)
+		{
+			index.push_back(static_cast<uint32_t>(offset + lowestBit(bits)));
+			bits &= bits - 1;
+		}
+	}
+
+	if (prevInString)
+		return false;
+
+	index.push_back(static_cast<uint32_t>(length));
+	return true;
+}
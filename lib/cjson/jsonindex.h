@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+	jsonIndex - stage one of cjson::Parse
+
+	Finds the structure of a JSON document 64 bytes at a time (SSE2
+	compares and movemask, with a portable fallback) without looking at
+	characters one by one. Quotes, backslashes, brackets and whitespace
+	become bitmasks, escaped characters and the inside of strings are
+	worked out with bit math, and what is left is flattened into a list of
+	offsets. cjson::Parse then builds nodes by walking the offsets.
+
+	The index holds the offset of:
+
+	  - { } [ ] : and , outside of strings
+	  - both quotes of every string, so a string's length is known
+	    without scanning it
+	  - the first character of every number, true, false and null
+
+	and ends with the document length, which ends the last value.
+*/
+
+namespace jsonIndex
+{
+	// false if the document has an unterminated string or is too large to index
+	bool build(const char* text, size_t length, std::vector<uint32_t>& index);
+}
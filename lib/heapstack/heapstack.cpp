@@ -1,13 +1,163 @@
 #include "heapstack.h"
 #include <cstring>
+#include <new>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
 
 #include "../sba/sba.h"
 
 using namespace std;
 
+void* HeapStackBlockPool::allocBlock()
+{
+	const auto blockSize = MemConstants::HeapStackBlockSize;
+
+#ifdef _MSC_VER
+	auto block = _aligned_malloc(blockSize, blockSize);
+	if (!block)
+		throw std::bad_alloc();
+	return block;
+#else
+	// map twice the size, then unmap the slack on either side of the aligned block
+	const auto raw = mmap(nullptr, blockSize * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (raw == MAP_FAILED)
+		throw std::bad_alloc();
+
+	const auto start = reinterpret_cast<uintptr_t>(raw);
+	const auto aligned = (start + blockSize - 1) & ~static_cast<uintptr_t>(blockSize - 1);
+
+	if (aligned > start)
+		munmap(raw, aligned - start);
+	if (start + blockSize * 2 > aligned + blockSize)
+		munmap(reinterpret_cast<void*>(aligned + blockSize), start + blockSize * 2 - (aligned + blockSize));
+
+	return reinterpret_cast<void*>(aligned);
+#endif
+}
+
+void HeapStackBlockPool::releaseBlock(void* block)
+{
+#ifdef _MSC_VER
+	_aligned_free(block);
+#else
+	munmap(block, MemConstants::HeapStackBlockSize);
+#endif
+}
+
+void* HeapStackBlockPool::Get()
+{
+	{ // scope the lock
+		csLock lock(poolLock);
+
+		++inUse;
+
+		if (!pool.empty())
+		{
+			auto block = pool.back();
+			pool.pop_back();
+
+			if (static_cast<int64_t>(pool.size()) < lowWater)
+				lowWater = pool.size();
+
+			return block;
+		}
+
+		lowWater = 0;
+	}
+	return allocBlock();
+}
+
+void HeapStackBlockPool::Put(void* item)
+{
+	{ // scope the lock
+		csLock lock(poolLock);
+
+		--inUse;
+
+		if (static_cast<int64_t>(pool.size()) < maxRetained)
+		{
+			pool.push_back(item);
+			return;
+		}
+
+		++released;
+	}
+	releaseBlock(item);
+}
+
+void HeapStackBlockPool::setMaxRetained(const int64_t blocks)
+{
+	std::vector<void*> release;
+
+	{ // scope the lock
+		csLock lock(poolLock);
+
+		maxRetained = blocks < 0 ? 0 : blocks;
+
+		while (static_cast<int64_t>(pool.size()) > maxRetained)
+		{
+			release.push_back(pool.back());
+			pool.pop_back();
+		}
+
+		released += release.size();
+		if (lowWater > static_cast<int64_t>(pool.size()))
+			lowWater = pool.size();
+	}
+
+	for (auto block : release)
+		releaseBlock(block);
+}
+
+int64_t HeapStackBlockPool::trim()
+{
+	std::vector<void*> release;
+
+	{ // scope the lock
+		csLock lock(poolLock);
+
+		// blocks below the low water mark sat unused for the whole interval
+		auto count = lowWater < static_cast<int64_t>(pool.size()) ? lowWater : static_cast<int64_t>(pool.size());
+
+		while (count-- > 0)
+		{
+			release.push_back(pool.back());
+			pool.pop_back();
+		}
+
+		released += release.size();
+		lowWater = pool.size();
+	}
+
+	for (auto block : release)
+		releaseBlock(block);
+
+	return static_cast<int64_t>(release.size());
+}
+
+HeapStackBlockPool::Stats_s HeapStackBlockPool::getStats()
+{
+	csLock lock(poolLock);
+	return {
+		MemConstants::HeapStackBlockSize,
+		inUse,
+		static_cast<int64_t>(pool.size()),
+		maxRetained,
+		released
+	};
+}
+
 HeapStack::HeapStack() 
 {}
 
+HeapStack::HeapStack(const int64_t initialBlockSize) :
+	growSize(initialBlockSize)
+{}
+
 HeapStack::~HeapStack()
 {
 	Release();
@@ -28,6 +178,7 @@ void HeapStack::Release()
 		while (block)
 		{
 			--blocks;
+			allocated -= block->capacity + headerSize;
 			auto t = block->nextBlock;
 			if (block->nonpooled)
 				delete[] reinterpret_cast<char*>(block);
@@ -55,7 +206,27 @@ void HeapStack::Release()
 
 void HeapStack::reset()
 {
+	const auto used = bytes;
+	const auto outgrown = head && head->nextBlock && head->capacity < dataSize;
+
 	Release();
+
+	if (!outgrown)
+		return;
+
+	// replace the first block with one that holds everything this round
+	// did, the next allocation makes it
+	auto capacity = head->capacity;
+	while (capacity <= used && capacity < dataSize)
+		capacity *= 2;
+
+	delete[] reinterpret_cast<char*>(head);
+
+	head = nullptr;
+	tail = nullptr;
+	blocks = 0;
+	allocated = 0;
+	growSize = (capacity < dataSize) ? capacity : blockSize;
 }
 
 char* HeapStack::currentData() const
@@ -83,7 +254,7 @@ int64_t HeapStack::getBytes() const
 
 int64_t HeapStack::getAllocated() const
 {
-	return blocks * blockSize;
+	return allocated;
 }
 
 int64_t HeapStack::getBlocks() const
@@ -123,15 +294,44 @@ void HeapStack::releaseFlatPtr(char* flatPtr)
 	PoolMem::getPool().freePtr(flatPtr);
 }
 
-void HeapStack::newBlock()
+void HeapStack::newBlock(const int64_t size)
 {
-	auto block = reinterpret_cast<block_s*>(HeapStackBlockPool::getPool().Get());//reinterpret_cast<block_s*>(__HeapStackBlockPool->Get());
+	block_s* block;
+
+	if (growSize && growSize < dataSize)
+	{
+		// small blocks come from the heap, double until `size` fits
+		auto capacity = growSize;
+		while (capacity <= size)
+			capacity *= 2;
+
+		growSize = capacity * 2;
+
+		if (capacity < dataSize)
+		{
+			block = reinterpret_cast<block_s*>(new char[capacity + headerSize]);
+			block->capacity = capacity;
+			block->nonpooled = true;
+		}
+		else
+		{
+			block = reinterpret_cast<block_s*>(HeapStackBlockPool::getPool().Get());
+			block->capacity = dataSize;
+			block->nonpooled = false;
+		}
+	}
+	else
+	{
+		block = reinterpret_cast<block_s*>(HeapStackBlockPool::getPool().Get());//reinterpret_cast<block_s*>(__HeapStackBlockPool->Get());
+		block->capacity = dataSize;
+		block->nonpooled = false;
+	}
 
 	block->nextBlock = nullptr;
 	block->endOffset = 0;
-	block->nonpooled = false;
 
 	++blocks;
+	allocated += block->capacity + headerSize;
 
 	// link up the blocks, assign the head if needed, move the tail along
 	if (tail)
@@ -149,9 +349,11 @@ void HeapStack::newNonpooledBlock(int64_t size)
 
 	block->nextBlock = nullptr;
 	block->endOffset = 0;
+	block->capacity = size;
 	block->nonpooled = true;
 
 	++blocks;
+	allocated += size + headerSize;
 
 	// link up the blocks, assign the head if needed, move the tail along
 	if (tail)
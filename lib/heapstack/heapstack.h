@@ -39,16 +39,48 @@ using namespace std;
 namespace MemConstants
 {
 	const int64_t HeapStackBlockSize = 256LL * 1024LL;
+	const int64_t HeapStackSmallBlockSize = 4LL * 1024LL; // first block of a small HeapStack
+	const int64_t HeapStackDefaultRetained = 256; // blocks (64MB)
 }
 
+/* HeapStackBlockPool - pooled HeapStack blocks
+ *
+ * Blocks are aligned to their size (so the block an address belongs to
+ * can be found by masking, see PoolMem) and are mapped directly so
+ * releasing one returns it to the OS.
+ *
+ * Put keeps at most `maxRetained` free blocks, any beyond that are
+ * released. `trim` releases the retained blocks that were not needed since
+ * the previous trim (the low water mark of the free list), so a spike in
+ * usage is returned gradually rather than kept forever.
+ */
 class HeapStackBlockPool
 {
+public:
+
+	struct Stats_s
+	{
+		int64_t blockSize;
+		int64_t inUse; // blocks held by HeapStacks
+		int64_t retained; // free blocks kept for reuse
+		int64_t maxRetained;
+		int64_t released; // blocks returned to the OS (lifetime)
+	};
+
 private:
 	std::vector<void*> pool;
 	CriticalSection poolLock;
 
+	int64_t maxRetained{ MemConstants::HeapStackDefaultRetained };
+	int64_t lowWater{ 0 }; // smallest free list size since the last trim
+	int64_t inUse{ 0 };
+	int64_t released{ 0 };
+
     HeapStackBlockPool() = default;
 
+	static void* allocBlock();
+	static void releaseBlock(void* block);
+
 public:
 
 	// singlton
@@ -58,27 +90,16 @@ public:
 		return globalPool;
 	}
 
-	inline void* Get()
-	{
-		{ // scope the lock
-			csLock lock(poolLock);
-
-			if (!pool.empty())
-			{
-				auto block = pool.back();
-				pool.pop_back();
-				return block;
-			}
-		}
-		return new char[MemConstants::HeapStackBlockSize];
-	}
+	void* Get();
+	void Put(void* item);
 
-	inline void Put(void* item)
-	{
-		csLock lock(poolLock);
-		pool.push_back(item);
-	}
+	// set the number of free blocks to keep, releases any beyond it
+	void setMaxRetained(int64_t blocks);
+
+	// release retained blocks unused since the last call, returns the number released
+	int64_t trim();
 
+	Stats_s getStats();
 
 	int32_t blockCount() const
 	{
@@ -100,6 +121,7 @@ private:
 	{
 		block_s* nextBlock{ nullptr };
 		int64_t endOffset{ 0 };
+		int64_t capacity{ 0 }; // bytes of `data`
 		bool nonpooled{ false };
 		char data[1]; // fake size, we will be casting this over a buffer
 	};
@@ -111,14 +133,29 @@ private:
 
 	int64_t blocks{ 0 };
 	int64_t bytes{ 0 };
+	int64_t allocated{ 0 };
+
+	// data size of the next block when blocks start small, blocks double
+	// until they reach dataSize and come from the pool (0 is pooled only)
+	int64_t growSize{ 0 };
 
 	block_s* head{ nullptr };
 	block_s* tail{ nullptr };
 
 public:
 
-	// constructor, default allocates 4 meg blocks. 
+	// constructor, default allocates pooled blocks of HeapStackBlockSize
 	HeapStack();
+
+	/* a HeapStack that starts with a small heap allocated block and doubles
+	 * from there (a handful of bytes shouldn't cost a pooled block).
+	 *
+	 * Meant to be reused as an arena, reset keeps the first block, and if
+	 * the stack outgrew it the first block is replaced with one big enough
+	 * for everything it held, so the next round fits in one block.
+	 */
+	explicit HeapStack(int64_t initialBlockSize);
+
 	~HeapStack();
 
 private:
@@ -130,8 +167,8 @@ public:
 	{
 		if (size >= dataSize)
 			newNonpooledBlock(size);
-		else if (!tail || tail->endOffset + size >= dataSize)
-			newBlock();
+		else if (!tail || tail->endOffset + size >= tail->capacity)
+			newBlock(size);
 
 		char* insertPtr = tail->data + tail->endOffset;
 		tail->endOffset += size;
@@ -170,6 +207,6 @@ public:
 
 private:
 	// newBlock - adds a new block to the list of blocks, updates the block links.
-	void newBlock();
+	void newBlock(int64_t size);
 	void newNonpooledBlock(int64_t size);
 };
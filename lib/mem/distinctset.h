@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vector>
+#include "../include/libcommon.h"
+
+/*
+	DistinctSet - a flat, open addressing set of four int64 keys.
+
+	Used to track "have we already counted this value" while tallying.
+
+	- linear probing over a power of two table, no pointers or chains
+	- clear() is O(1), every slot carries the generation it was written in,
+	  slots from an older generation are treated as empty. This matters because
+	  the set is cleared for every person (and every exec).
+	- the table only grows, once warmed up there are no allocations
+*/
+class DistinctSet
+{
+	struct Entry_s
+	{
+		int64_t a;
+		int64_t b;
+		int64_t c;
+		int64_t d;
+		uint32_t generation;
+	};
+
+	std::vector<Entry_s> table;
+	uint64_t mask{ 0 };
+	int64_t count{ 0 };
+	uint32_t generation{ 1 };
+
+	static uint64_t hash(const int64_t a, const int64_t b, const int64_t c, const int64_t d)
+	{
+		// multiply and rotate mix of each word, then fold (murmur style finalizer)
+		auto h = static_cast<uint64_t>(a) * 0x9E3779B97F4A7C15ULL;
+		h = (h ^ (h >> 29) ^ static_cast<uint64_t>(b)) * 0xBF58476D1CE4E5B9ULL;
+		h = (h ^ (h >> 31) ^ static_cast<uint64_t>(c)) * 0x94D049BB133111EBULL;
+		h = (h ^ (h >> 29) ^ static_cast<uint64_t>(d)) * 0x9E3779B97F4A7C15ULL;
+		return h ^ (h >> 32);
+	}
+
+	void grow()
+	{
+		const auto newSize = table.size() ? table.size() * 2 : 256;
+
+		std::vector<Entry_s> old;
+		old.swap(table);
+
+		table.resize(newSize, Entry_s{ 0, 0, 0, 0, 0 });
+		mask = newSize - 1;
+		count = 0;
+
+		for (auto& e : old)
+			if (e.generation == generation)
+				insert(e.a, e.b, e.c, e.d);
+	}
+
+public:
+
+	DistinctSet()
+	{
+		grow();
+	}
+
+	// returns true if the key was added, false if it was already in the set
+	bool insert(const int64_t a, const int64_t b, const int64_t c, const int64_t d)
+	{
+		// keep load under 50%
+		if ((count + 1) * 2 > static_cast<int64_t>(table.size()))
+			grow();
+
+		auto idx = hash(a, b, c, d) & mask;
+
+		while (true)
+		{
+			auto& e = table[idx];
+
+			if (e.generation != generation)
+			{
+				e = Entry_s{ a, b, c, d, generation };
+				++count;
+				return true;
+			}
+
+			if (e.a == a && e.b == b && e.c == c && e.d == d)
+				return false;
+
+			idx = (idx + 1) & mask;
+		}
+	}
+
+	void clear()
+	{
+		count = 0;
+		++generation;
+
+		// generation wrapped, really clear the table
+		if (generation == 0)
+		{
+			for (auto& e : table)
+				e.generation = 0;
+			generation = 1;
+		}
+	}
+
+	int64_t size() const
+	{
+		return count;
+	}
+};
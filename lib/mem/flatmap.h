@@ -0,0 +1,641 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <utility>
+
+#include "bigring.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define FLATMAP_SSE2
+#endif
+
+/*
+	flatMap - a flat, open addressing hash map (Swiss table style).
+
+	Drop in for bigRing on hot lookups (same get/set/emplace/find/iterate
+	interface, returns std::pair<K, V>* items).
+
+	- one byte of metadata per slot: empty, deleted or the low 7 bits of
+	  the hash. A probe compares 16 metadata bytes at once (SSE2) and only
+	  touches the slots whose 7 bits match, a miss stops at the first group
+	  with an empty slot.
+	- power of two capacity, kept under 7/8 full
+	- resizing is incremental, the old table is kept and each insert or
+	  update moves a few of its slots to the new one. Lookups check both
+	  while a resize is in progress, so no single insert pays for copying
+	  the whole table.
+
+	Notes:
+	- item pointers are valid until the next insert (an insert can move
+	  items during a resize)
+	- const lookups never move items, they are safe from many readers as
+	  long as nothing is writing
+	- erase does not move items, so `it = erase(it)` loops are fine
+*/
+
+namespace flatConf
+{
+	const int GroupWidth = 16;
+	const int8_t Empty = -128; // 0b10000000
+	const int8_t Deleted = -2; // 0b11111110, full slots are 0b0xxxxxxx
+	const int64_t MigrateStep = 64; // old slots moved per insert during a resize
+	const int64_t MinCapacity = 16;
+
+	// bigRing size hints start at the size of their first page
+	inline int64_t initialCapacity(const ringHint_e hint)
+	{
+		const int64_t first = bigConf::big_info[static_cast<int>(hint)].powers[0];
+		int64_t capacity = MinCapacity;
+		while (capacity < first)
+			capacity <<= 1;
+		return capacity;
+	}
+
+	// std::hash is the identity for integers, the metadata byte needs well mixed bits
+	inline uint64_t mix(uint64_t h)
+	{
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDULL;
+		h ^= h >> 33;
+		h *= 0xC4CEB9FE1A85EC53ULL;
+		h ^= h >> 33;
+		return h;
+	}
+
+	// bit `i` is set if byte `i` of the group matches
+	class Group
+	{
+#ifdef FLATMAP_SSE2
+		__m128i ctrl;
+	public:
+		explicit Group(const int8_t* pos) :
+			ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos)))
+		{}
+
+		uint32_t match(const int8_t h2) const
+		{
+			return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2))));
+		}
+
+		uint32_t matchEmpty() const
+		{
+			return match(Empty);
+		}
+
+		uint32_t matchEmptyOrDeleted() const
+		{
+			// both have the high bit set
+			return static_cast<uint32_t>(_mm_movemask_epi8(ctrl));
+		}
+#else
+		const int8_t* ctrl;
+	public:
+		explicit Group(const int8_t* pos) :
+			ctrl(pos)
+		{}
+
+		uint32_t match(const int8_t h2) const
+		{
+			uint32_t bits = 0;
+			for (auto i = 0; i < GroupWidth; ++i)
+				if (ctrl[i] == h2)
+					bits |= 1u << i;
+			return bits;
+		}
+
+		uint32_t matchEmpty() const
+		{
+			return match(Empty);
+		}
+
+		uint32_t matchEmptyOrDeleted() const
+		{
+			uint32_t bits = 0;
+			for (auto i = 0; i < GroupWidth; ++i)
+				if (ctrl[i] < 0)
+					bits |= 1u << i;
+			return bits;
+		}
+#endif
+	};
+
+	inline int lowestBit(const uint32_t bits)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward(&index, bits);
+		return static_cast<int>(index);
+#else
+		return __builtin_ctz(bits);
+#endif
+	}
+}
+
+template <typename K, typename V>
+class flatMap
+{
+public:
+	using Item = std::pair<K, V>;
+
+private:
+
+	struct table_s
+	{
+		int8_t* ctrl{ nullptr }; // capacity + GroupWidth, the tail mirrors the first group
+		Item* slots{ nullptr };
+		uint64_t mask{ 0 };
+		int64_t size{ 0 }; // full slots
+		int64_t used{ 0 }; // full + deleted slots
+
+		int64_t capacity() const
+		{
+			return ctrl ? static_cast<int64_t>(mask) + 1 : 0;
+		}
+
+		void allocate(const int64_t capacity)
+		{
+			ctrl = new int8_t[capacity + flatConf::GroupWidth];
+			memset(ctrl, flatConf::Empty, capacity + flatConf::GroupWidth);
+			slots = static_cast<Item*>(::operator new(sizeof(Item) * capacity));
+			mask = capacity - 1;
+			size = 0;
+			used = 0;
+		}
+
+		void release()
+		{
+			if (!ctrl)
+				return;
+
+			for (int64_t i = 0; i < capacity(); ++i)
+				if (ctrl[i] >= 0)
+					slots[i].~Item();
+
+			delete[] ctrl;
+			::operator delete(slots);
+
+			ctrl = nullptr;
+			slots = nullptr;
+			mask = 0;
+			size = 0;
+			used = 0;
+		}
+
+		void setCtrl(const uint64_t index, const int8_t value)
+		{
+			ctrl[index] = value;
+			// keep the mirrored tail in sync so a group read near the end wraps
+			if (index < static_cast<uint64_t>(flatConf::GroupWidth))
+				ctrl[capacity() + index] = value;
+		}
+
+		Item* find(const K& key, const uint64_t hash) const
+		{
+			const auto h2 = static_cast<int8_t>(hash & 0x7F);
+			auto pos = (hash >> 7) & mask;
+			uint64_t step = 0;
+
+			while (true)
+			{
+				const flatConf::Group group(ctrl + pos);
+
+				for (auto bits = group.match(h2); bits; bits &= bits - 1)
+				{
+					const auto index = (pos + flatConf::lowestBit(bits)) & mask;
+					if (slots[index].first == key)
+						return slots + index;
+				}
+
+				if (group.matchEmpty())
+					return nullptr;
+
+				step += flatConf::GroupWidth;
+				pos = (pos + step) & mask;
+			}
+		}
+
+		// index of the first empty or deleted slot for `hash`, the key must not be present
+		uint64_t findFree(const uint64_t hash) const
+		{
+			auto pos = (hash >> 7) & mask;
+			uint64_t step = 0;
+
+			while (true)
+			{
+				const flatConf::Group group(ctrl + pos);
+
+				if (const auto bits = group.matchEmptyOrDeleted(); bits)
+					return (pos + flatConf::lowestBit(bits)) & mask;
+
+				step += flatConf::GroupWidth;
+				pos = (pos + step) & mask;
+			}
+		}
+
+		// claims a slot for a key known not to be in the table, caller constructs the item
+		Item* claim(const uint64_t hash)
+		{
+			const auto index = findFree(hash);
+
+			if (ctrl[index] == flatConf::Empty)
+				++used;
+			++size;
+
+			setCtrl(index, static_cast<int8_t>(hash & 0x7F));
+			return slots + index;
+		}
+
+		void erase(Item* item)
+		{
+			item->~Item();
+			setCtrl(item - slots, flatConf::Deleted);
+			--size;
+		}
+	};
+
+	std::hash<K> hasher;
+
+	table_s current;
+	table_s old; // the table being migrated away from during a resize
+	uint64_t migrated{ 0 }; // slots of `old` already moved
+
+	uint64_t hashOf(const K& key) const
+	{
+		return flatConf::mix(static_cast<uint64_t>(hasher(key)));
+	}
+
+	void migrate(const int64_t count)
+	{
+		if (!old.ctrl)
+			return;
+
+		const auto end = migrated + count > static_cast<uint64_t>(old.capacity()) ?
+			static_cast<uint64_t>(old.capacity()) : migrated + count;
+
+		for (; migrated < end; ++migrated)
+		{
+			if (old.ctrl[migrated] < 0)
+				continue;
+
+			auto& item = old.slots[migrated];
+			new (current.claim(hashOf(item.first))) Item(std::move(item));
+			old.erase(&item);
+		}
+
+		if (migrated == static_cast<uint64_t>(old.capacity()))
+		{
+			old.release();
+			migrated = 0;
+		}
+	}
+
+	// make room for one more item
+	void reserveOne()
+	{
+		migrate(flatConf::MigrateStep);
+
+		if ((current.used + 1) * 8 <= current.capacity() * 7)
+			return;
+
+		// a second resize before the first finished, finish the first
+		migrate(old.capacity());
+
+		// mostly deleted slots rebuild at the same size, otherwise double
+		const auto capacity = current.size * 2 >= current.capacity() ?
+			current.capacity() * 2 :
+			current.capacity();
+
+		old = current;
+		current = table_s{};
+		current.allocate(capacity);
+		migrated = 0;
+
+		migrate(flatConf::MigrateStep);
+	}
+
+	Item* lookup(const K& key, const uint64_t hash) const
+	{
+		if (const auto item = current.find(key, hash); item)
+			return item;
+		return old.ctrl ? old.find(key, hash) : nullptr;
+	}
+
+public:
+
+	explicit flatMap(const ringHint_e sizeHint = ringHint_e::gt_25_million)
+	{
+		current.allocate(flatConf::initialCapacity(sizeHint));
+	}
+
+	flatMap(flatMap<K, V>&& other) noexcept :
+		current(other.current),
+		old(other.old),
+		migrated(other.migrated)
+	{
+		other.current = table_s{};
+		other.old = table_s{};
+		other.migrated = 0;
+		other.current.allocate(flatConf::MinCapacity);
+	}
+
+	flatMap& operator=(flatMap<K, V>&& other) noexcept
+	{
+		if (this != &other)
+		{
+			current.release();
+			old.release();
+
+			current = other.current;
+			old = other.old;
+			migrated = other.migrated;
+
+			other.current = table_s{};
+			other.old = table_s{};
+			other.migrated = 0;
+			other.current.allocate(flatConf::MinCapacity);
+		}
+		return *this;
+	}
+
+	// delete copy operators
+	flatMap(const flatMap& other) = delete;
+	flatMap& operator=(flatMap const&) = delete;
+
+	~flatMap()
+	{
+		current.release();
+		old.release();
+	}
+
+	Item* set(const K key, const V value)
+	{
+		const auto hash = hashOf(key);
+
+		if (auto item = lookup(key, hash); item)
+		{
+			item->second = value;
+			return item;
+		}
+
+		reserveOne();
+		return new (current.claim(hash)) Item(key, value);
+	}
+
+	template <class... Args>
+	Item* emplace(const K key, Args&&... params)
+	{
+		const auto hash = hashOf(key);
+
+		if (auto item = lookup(key, hash); item)
+		{
+			item->second.~V();
+			new (&item->second) V(std::forward<Args>(params)...);
+			return item;
+		}
+
+		reserveOne();
+		return new (current.claim(hash)) Item(std::piecewise_construct,
+			std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(params)...));
+	}
+
+	Item* emplace(std::pair<K, V>&& p)
+	{
+		const auto hash = hashOf(p.first);
+
+		if (auto item = lookup(p.first, hash); item)
+		{
+			item->second = std::move(p.second);
+			return item;
+		}
+
+		reserveOne();
+		return new (current.claim(hash)) Item(std::move(p));
+	}
+
+	template <class... Args>
+	bool emplaceTry(const K key, Args&&... params)
+	{
+		const auto hash = hashOf(key);
+
+		if (lookup(key, hash))
+			return false;
+
+		reserveOne();
+		new (current.claim(hash)) Item(std::piecewise_construct,
+			std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(params)...));
+		return true;
+	}
+
+	bool get(const K key, V& value) const
+	{
+		if (const auto item = lookup(key, hashOf(key)); item)
+		{
+			value = item->second;
+			return true;
+		}
+		return false;
+	}
+
+	Item* get(const K key) const
+	{
+		return lookup(key, hashOf(key));
+	}
+
+	/**
+	 * [] will return a reference to the Value if key is found,
+	 * otherwise it will insert key and return a reference to
+	 * a new value.
+	 */
+	V& operator[](const K& key)
+	{
+		const auto hash = hashOf(key);
+
+		if (auto item = lookup(key, hash); item)
+			return item->second;
+
+		reserveOne();
+		return (new (current.claim(hash)) Item(key, V{}))->second;
+	}
+
+	class iterator
+	{
+	private:
+
+		friend class flatMap<K, V>;
+
+		const flatMap<K, V>* dict;
+		int tableIndex{ 0 }; // 0 = current, 1 = old, 2 = end
+		int64_t index{ -1 };
+
+		const table_s& table() const
+		{
+			return tableIndex == 0 ? dict->current : dict->old;
+		}
+
+		void __incr()
+		{
+			while (tableIndex < 2)
+			{
+				++index;
+
+				if (index >= table().capacity())
+				{
+					++tableIndex;
+					index = -1;
+					continue;
+				}
+
+				if (table().ctrl[index] >= 0)
+					return;
+			}
+		}
+
+	public:
+
+		typedef iterator                   self_type;
+		typedef Item                       value_type;
+		typedef int                        difference_type;
+		typedef std::forward_iterator_tag  iterator_category;
+		typedef Item*                      pointer;
+		typedef Item&                      reference;
+
+		explicit iterator(const flatMap* dict) :
+			dict(dict)
+		{
+			__incr();
+		}
+
+		iterator(const flatMap* dict, const int tableIndex, const int64_t index) :
+			dict(dict),
+			tableIndex(tableIndex),
+			index(index)
+		{}
+
+		self_type operator++(int)
+		{
+			self_type i = *this;
+			__incr();
+			return i;
+		}
+
+		self_type& operator++()
+		{
+			__incr();
+			return *this;
+		}
+
+		Item& operator*() const
+		{
+			return table().slots[index];
+		}
+
+		Item* operator->() const
+		{
+			return table().slots + index;
+		}
+
+		Item* obj() const
+		{
+			return table().slots + index;
+		}
+
+		bool operator==(const self_type& rhs) const
+		{
+			return tableIndex == rhs.tableIndex && index == rhs.index;
+		}
+
+		bool operator!=(const self_type& rhs) const
+		{
+			return !(*this == rhs);
+		}
+	};
+
+	iterator begin() const
+	{
+		return iterator(this);
+	}
+
+	iterator end() const
+	{
+		return iterator(this, 2, -1);
+	}
+
+	iterator find(const K key) const
+	{
+		const auto hash = hashOf(key);
+
+		if (const auto item = current.find(key, hash); item)
+			return iterator(this, 0, item - current.slots);
+
+		if (old.ctrl)
+			if (const auto item = old.find(key, hash); item)
+				return iterator(this, 1, item - old.slots);
+
+		return end();
+	}
+
+	iterator erase(const iterator position)
+	{
+		auto next = position;
+
+		if (position != end())
+		{
+			++next;
+			(position.tableIndex == 0 ? current : old).erase(position.obj());
+		}
+
+		return next;
+	}
+
+	size_t erase(const K& key)
+	{
+		const auto it = find(key);
+
+		if (it != end())
+		{
+			erase(it);
+			return 1;
+		}
+
+		return 0;
+	}
+
+	bool empty() const
+	{
+		return size() == 0;
+	}
+
+	size_t size() const
+	{
+		return static_cast<size_t>(current.size + old.size);
+	}
+
+	size_t count(const K& key) const
+	{
+		return lookup(key, hashOf(key)) ? 1 : 0;
+	}
+
+	// bytes used by the tables
+	int64_t getBytes() const
+	{
+		return (current.capacity() + old.capacity()) * static_cast<int64_t>(sizeof(Item) + 1) +
+			(old.ctrl ? 2 : 1) * flatConf::GroupWidth;
+	}
+
+	// removes all items, keeps the current capacity
+	void clear()
+	{
+		const auto capacity = current.capacity();
+
+		current.release();
+		old.release();
+		migrated = 0;
+
+		current.allocate(capacity ? capacity : flatConf::MinCapacity);
+	}
+};
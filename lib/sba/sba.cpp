@@ -1,19 +1,57 @@
 #include "sba.h"
 #include <cmath>
+#include <cassert>
+#include <cstring>
+
+#ifndef _MSC_VER
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
+namespace
+{
+	int64_t pageSize()
+	{
+#ifdef _MSC_VER
+		return 4096;
+#else
+		static const int64_t size = sysconf(_SC_PAGESIZE);
+		return size;
+#endif
+	}
+
+	// bytes of a block trim can give back - everything after the page holding the block header
+	int64_t reclaimableBytes()
+	{
+		return MemConstants::HeapStackBlockSize - pageSize();
+	}
+}
+
 PoolMem::PoolMem()
 {
+	// the buckets return their blocks to the block pool when the PoolMem is
+	// destroyed, so the block pool has to be constructed first (and so
+	// destroyed last)
+	HeapStackBlockPool::getPool();
 
 	// set indexes in bucket objects
 	auto idx = 0;
 	for (auto &b : breakPoints)
 	{
 		b.index = idx;
+
+		// smaller buckets cache more entries, but never more than PoolCacheMaxBytes
+		const auto fit = MemConstants::PoolCacheMaxBytes / b.maxSize;
+		b.cacheSize = static_cast<int32_t>(
+			fit < 2 ? 2 : (fit > MemConstants::PoolCacheMaxItems ? MemConstants::PoolCacheMaxItems : fit));
+
 		++idx;
 	}
 
+	assert(breakPoints.size() <= MemConstants::PoolCacheBuckets);
+
 	// build the reverse lookup - once
 	auto bits = 0;
 	while (true)
@@ -38,18 +76,220 @@ PoolMem::PoolMem()
 PoolMem::~PoolMem()
 {}
 
-void* PoolMem::getPtr(int64_t size)
+PoolMem::ThreadCache_s::~ThreadCache_s()
+{
+	// thread is exiting, give back anything it was holding
+	auto& pool = PoolMem::getPool();
+	for (auto& mem : pool.breakPoints)
+	{
+		auto& magazine = magazines[mem.index];
+		if (magazine.count || magazine.gets || magazine.frees)
+			pool.flush(mem, magazine, magazine.count);
+	}
+}
+
+PoolMem::ThreadCache_s& PoolMem::getThreadCache()
+{
+	thread_local ThreadCache_s cache;
+	return cache;
+}
+
+PoolMem::blockUse_s& PoolMem::getBlockUse(memory_s& mem, const alloc_s* alloc)
+{
+	const auto block = blockOf(alloc);
+
+	if (block != mem.lastBlock || !mem.lastUse)
+	{
+		mem.lastBlock = block;
+		mem.lastUse = &mem.blocks[block]; // references survive a rehash
+	}
+
+	return *mem.lastUse;
+}
+
+void PoolMem::addLive(memory_s& mem, const alloc_s* alloc)
+{
+	auto& use = getBlockUse(mem, alloc);
+
+	// pages fault back in when the allocation is written
+	if (use.reclaimed)
+	{
+		use.reclaimed = false;
+		mem.reclaimedBytes -= reclaimableBytes();
+	}
+
+	++use.live;
+}
+
+void PoolMem::removeLive(memory_s& mem, const alloc_s* alloc)
+{
+	--getBlockUse(mem, alloc).live;
+}
+
+void PoolMem::resetBucket(memory_s& mem)
+{
+	mem.freed.clear();
+	mem.blocks.clear();
+	mem.lastBlock = 0;
+	mem.lastUse = nullptr;
+	mem.reclaimedBytes = 0;
+	mem.heap.reset();
+}
+
+int PoolMem::getBucket(const int64_t size) const
 {
 	// give us the starting bucket for iteration
 	int64_t bucket = std::sqrt(size);
 
 	// will iterate through bucekts of matching sqrt until one fits or we hit the end
-	const auto lookupSize = bucketLookup.size();
+	const auto lookupSize = static_cast<int64_t>(bucketLookup.size());
 	while (bucket < lookupSize && size > breakPoints[bucketLookup[bucket]].maxSize)
 		++bucket;
 
+	// -1 means beyond lookup, so this is made on the heap
+	return bucket >= lookupSize ? -1 : bucketLookup[bucket];
+}
+
+void PoolMem::refill(memory_s& mem, ThreadCache_s::Magazine_s& magazine)
+{
+	// fill half the magazine, leaving room for frees before the next flush
+	const auto count = mem.cacheSize / 2 ? mem.cacheSize / 2 : 1;
+
+	csLock lock(mem.memLock);
+
+	++mem.refills;
+	mem.cachedGets += magazine.gets;
+	mem.cachedFrees += magazine.frees;
+	magazine.gets = 0;
+	magazine.frees = 0;
+
+	// cached allocations are counted as allocated, so the heap is never
+	// reset out from under a thread cache
+	mem.allocated += count;
+
+	while (magazine.count < count && mem.freed.size())
+	{
+		magazine.items[magazine.count++] = mem.freed.back();
+		mem.freed.pop_back();
+	}
+
+	while (magazine.count < count)
+		magazine.items[magazine.count++] = reinterpret_cast<alloc_s*>(
+			mem.heap.newPtr(mem.maxSize + MemConstants::PoolMemHeaderSize));
+
+	for (auto i = 0; i < count; ++i)
+		addLive(mem, magazine.items[i]);
+}
+
+void PoolMem::flush(memory_s& mem, ThreadCache_s::Magazine_s& magazine, int32_t count)
+{
+	csLock lock(mem.memLock);
+
+	++mem.flushes;
+	mem.cachedGets += magazine.gets;
+	mem.cachedFrees += magazine.frees;
+	magazine.gets = 0;
+	magazine.frees = 0;
+
+	// return the oldest entries, the most recently freed stay hot in the cache
+	for (auto i = 0; i < count; ++i)
+		removeLive(mem, magazine.items[i]);
+
+	mem.freed.insert(mem.freed.end(), magazine.items, magazine.items + count);
+	magazine.count -= count;
+	if (magazine.count)
+		memmove(magazine.items, magazine.items + count, magazine.count * sizeof(alloc_s*));
+
+	mem.allocated -= count;
+
+	if (!mem.allocated)
+		resetBucket(mem);
+}
+
+void PoolMem::flushThreadCache()
+{
+	auto& cache = getThreadCache();
+	for (auto& mem : breakPoints)
+	{
+		auto& magazine = cache.magazines[mem.index];
+		if (magazine.count || magazine.gets || magazine.frees)
+			flush(mem, magazine, magazine.count);
+	}
+}
+
+std::vector<PoolMem::BucketStats_s> PoolMem::getStats()
+{
+	std::vector<BucketStats_s> result;
+	result.reserve(breakPoints.size());
+
+	for (auto& mem : breakPoints)
+	{
+		csLock lock(mem.memLock);
+
+		int64_t freeBlocks = 0;
+		for (const auto& block : mem.blocks)
+			if (!block.second.live)
+				++freeBlocks;
+
+		result.push_back({
+			mem.maxSize,
+			mem.allocated,
+			static_cast<int64_t>(mem.freed.size()),
+			mem.heap.getBytes(),
+			mem.heap.getAllocated(),
+			static_cast<int64_t>(mem.blocks.size()),
+			freeBlocks,
+			mem.reclaimedBytes,
+			mem.refills,
+			mem.flushes,
+			mem.cachedGets,
+			mem.cachedFrees
+		});
+	}
+
+	return result;
+}
+
+int64_t PoolMem::trim()
+{
+	int64_t reclaimed = 0;
+
+	for (auto& mem : breakPoints)
+	{
+		csLock lock(mem.memLock);
+
+		for (auto& block : mem.blocks)
+		{
+			if (block.second.live || block.second.reclaimed)
+				continue;
+
+			// the first page holds the HeapStack block header, the rest is only free
+			// allocations. Free allocations in the released pages lose their
+			// `poolIndex` (it reads back as 0 rather than -2), which is harmless
+			// unless something frees them twice.
+#ifndef _MSC_VER
+			if (madvise(
+				reinterpret_cast<void*>(block.first + pageSize()),
+				reclaimableBytes(),
+				MADV_DONTNEED) != 0)
+				continue;
+
+			block.second.reclaimed = true;
+			mem.reclaimedBytes += reclaimableBytes();
+			reclaimed += reclaimableBytes();
+#endif
+		}
+	}
+
+	return reclaimed;
+}
+
+void* PoolMem::getPtr(int64_t size)
+{
+	const auto bucket = getBucket(size);
+
 	// bucket index beyond lookup, so this is made on the heap
-	if (bucket >= bucketLookup.size())
+	if (bucket == -1)
 	{
 		// this is a big allocation (outside our bucket sizes), so grab it from heap
 		auto alloc = reinterpret_cast<alloc_s*>(new char[size + MemConstants::PoolMemHeaderSize]);
@@ -58,21 +298,38 @@ void* PoolMem::getPtr(int64_t size)
 	}
 
 	// figure out which bucket size (if any) this allocation will fit
-	auto &mem = breakPoints[bucketLookup[bucket]];
+	auto &mem = breakPoints[bucket];
+
+	if (threadCaching)
+	{
+		auto& magazine = getThreadCache().magazines[bucket];
+
+		if (!magazine.count)
+			refill(mem, magazine);
+
+		++magazine.gets;
+		auto alloc = magazine.items[--magazine.count];
+		alloc->poolIndex = mem.index;
+		return alloc->data;
+	}
 
 	csLock lock(mem.memLock);
 
 	++mem.allocated;
 
+	alloc_s* alloc;
+
 	if (mem.freed.size())
 	{
-		auto alloc = mem.freed.back();
+		alloc = mem.freed.back();
 		mem.freed.pop_back();
-		alloc->poolIndex = mem.index;
-		return alloc->data;
+	}
+	else
+	{
+		alloc = reinterpret_cast<alloc_s*>(mem.heap.newPtr(mem.maxSize + MemConstants::PoolMemHeaderSize));
 	}
 
-	auto alloc = reinterpret_cast<alloc_s*>(mem.heap.newPtr(mem.maxSize + MemConstants::PoolMemHeaderSize));
+	addLive(mem, alloc);
 	alloc->poolIndex = mem.index;
 	return alloc->data;
 }
@@ -93,18 +350,30 @@ void PoolMem::freePtr(void* ptr)
 
 	auto& mem = breakPoints[alloc->poolIndex];
 
+	if (threadCaching)
+	{
+		auto& magazine = getThreadCache().magazines[mem.index];
+
+		// full - return half to the shared bucket in one batch
+		if (magazine.count == mem.cacheSize)
+			flush(mem, magazine, mem.cacheSize / 2 ? mem.cacheSize / 2 : 1);
+
+		++magazine.frees;
+		alloc->poolIndex = -2;
+		magazine.items[magazine.count++] = alloc;
+		return;
+	}
+
 	csLock lock(mem.memLock);
 
 	--mem.allocated;
 	
+	removeLive(mem, alloc);
 	alloc->poolIndex = -2;
 	mem.freed.push_back(alloc);
 
 	if (!mem.allocated)
-	{
-		mem.freed.clear();
-		mem.heap.reset();
-	}
+		resetBucket(mem);
 }
 
 //PoolMem* POOL = new PoolMem();
@@ -1,6 +1,8 @@
 #pragma once
 #include <vector>
 #include <mutex>
+#include <atomic>
+#include <unordered_map>
 #include "threads/locks.h"
 #include "../heapstack/heapstack.h"
 
@@ -10,6 +12,11 @@ namespace MemConstants
 	const int PoolBuckets = 257;
 	const int PoolBucketOffset = 4;
 	const int PoolBucketAlign = 8;
+
+	// per thread caches (magazines) in front of each bucket
+	const int PoolCacheBuckets = 64; // must be >= breakPoints
+	const int PoolCacheMaxItems = 32; // per thread, per bucket
+	const int64_t PoolCacheMaxBytes = 128 * 1024; // per thread, per bucket
 }
 
 class PoolMem
@@ -24,21 +31,83 @@ private:
 	};
 #pragma pack(pop)
 
+	// live allocations (including those in thread caches) in a HeapStack block
+	struct blockUse_s
+	{
+		int32_t live{ 0 };
+		bool reclaimed{ false }; // pages handed back to the OS by trim
+	};
+
 	struct memory_s
 	{
 		CriticalSection memLock;
 		int32_t index{ 0 };
-		int64_t allocated{ 0 };
+		int64_t allocated{ 0 }; // includes allocations sitting in thread caches
 		const int64_t maxSize;
+		int32_t cacheSize{ 0 }; // thread cache capacity for this bucket
 		HeapStack heap;
 		vector<alloc_s*> freed;
 
+		// occupancy by block (keyed on the aligned block address)
+		std::unordered_map<uintptr_t, blockUse_s> blocks;
+		uintptr_t lastBlock{ 0 }; // consecutive allocations usually share a block
+		blockUse_s* lastUse{ nullptr };
+		int64_t reclaimedBytes{ 0 };
+
+		// stats (guarded by memLock)
+		int64_t refills{ 0 };
+		int64_t flushes{ 0 };
+		int64_t cachedGets{ 0 };
+		int64_t cachedFrees{ 0 };
+
 		memory_s(const int64_t maxSize) :
 			index(0),
 			maxSize(maxSize)
 		{}
 	};
 
+public:
+
+	/* ThreadCache_s - a small stack (magazine) of free allocations per bucket
+	 * for each thread. getPtr/freePtr only lock the shared bucket when the
+	 * magazine is empty (refill) or full (flush), and then move half a
+	 * magazine at once. Memory freed by a thread other than the one that
+	 * allocated it goes into the freeing thread's magazine and returns to
+	 * the shared bucket in batches.
+	 */
+	struct ThreadCache_s
+	{
+		struct Magazine_s
+		{
+			int32_t count{ 0 };
+			int64_t gets{ 0 }; // served from the magazine since the last refill/flush
+			int64_t frees{ 0 };
+			alloc_s* items[MemConstants::PoolCacheMaxItems];
+		};
+
+		Magazine_s magazines[MemConstants::PoolCacheBuckets];
+
+		~ThreadCache_s();
+	};
+
+	struct BucketStats_s
+	{
+		int64_t maxSize;
+		int64_t allocated; // live, including those in thread caches
+		int64_t free; // in the shared free list
+		int64_t heapBytes; // carved out of the heap
+		int64_t heapAllocated; // held in heap blocks
+		int64_t blocks;
+		int64_t freeBlocks; // blocks with no live allocations
+		int64_t reclaimedBytes; // in free blocks, returned to the OS by trim
+		int64_t refills; // trips to the shared bucket to fill a thread cache
+		int64_t flushes; // trips to the shared bucket to empty a thread cache
+		int64_t cachedGets; // served by thread caches (counted when a cache visits the bucket)
+		int64_t cachedFrees;
+	};
+
+private:
+
 	vector<memory_s> breakPoints = {
 		{ 16 },
 		{ 20 },
@@ -93,9 +162,26 @@ private:
 
 	vector<int> bucketLookup;
 
+	std::atomic<bool> threadCaching{ true };
+
 	PoolMem();
 	~PoolMem();
 
+	int getBucket(int64_t size) const;
+	static ThreadCache_s& getThreadCache();
+	void refill(memory_s& mem, ThreadCache_s::Magazine_s& magazine);
+	void flush(memory_s& mem, ThreadCache_s::Magazine_s& magazine, int32_t count);
+
+	static uintptr_t blockOf(const alloc_s* alloc)
+	{
+		return reinterpret_cast<uintptr_t>(alloc) & ~static_cast<uintptr_t>(MemConstants::HeapStackBlockSize - 1);
+	}
+
+	static blockUse_s& getBlockUse(memory_s& mem, const alloc_s* alloc);
+	static void addLive(memory_s& mem, const alloc_s* alloc);
+	static void removeLive(memory_s& mem, const alloc_s* alloc);
+	static void resetBucket(memory_s& mem);
+
 public:
 
 	// singlton 
@@ -107,6 +193,23 @@ public:
 
 	void* getPtr(int64_t size);
 	void freePtr(void* ptr);
+
+	// thread caching is on by default, turning it off makes every call
+	// go to the shared bucket (allocations already cached stay cached)
+	void setThreadCaching(const bool enabled)
+	{
+		threadCaching = enabled;
+	}
+
+	// returns everything in the calling thread's cache to the shared buckets
+	void flushThreadCache();
+
+	std::vector<BucketStats_s> getStats();
+
+	// hands the pages of blocks with no live allocations back to the OS (the
+	// address range stays valid, touching it again faults in zeroed pages),
+	// returns bytes reclaimed
+	int64_t trim();
 };
 
 //extern PoolMem* POOL;
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cmath>
+#include "../include/libcommon.h"
+
+/*
+	HyperLogLog - approximate distinct counting in fixed memory.
+
+	The sketch is just `Size` bytes of registers, it does not own memory. This
+	lets sketches live in whatever block the caller wants (i.e. a ResultSet
+	HeapStack, or an internode buffer) and be copied or merged with memcpy/max.
+
+	Precision 12 gives 4096 registers with a standard error of ~1.6%.
+
+	Sketches merge associatively (register wise max), so partitions and nodes
+	can be combined in any order and give the same estimate.
+*/
+namespace openset::sketch
+{
+	class HyperLogLog
+	{
+	public:
+		static const int Precision = 12;
+		static const int Size = 1 << Precision; // register count, one byte each
+
+		static void init(uint8_t* registers)
+		{
+			memset(registers, 0, Size);
+		}
+
+		// splitmix64 finalizer, values are often small ints or already hashed
+		// text, either way we want all 64 bits well mixed
+		static uint64_t mix(uint64_t value)
+		{
+			value += 0x9E3779B97F4A7C15ULL;
+			value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+			return value ^ (value >> 31);
+		}
+
+		static void add(uint8_t* registers, const int64_t value)
+		{
+			const auto hash = mix(static_cast<uint64_t>(value));
+
+			// top bits pick the register, the rest are used for the rank
+			const auto index = hash >> (64 - Precision);
+			const auto rest = (hash << Precision) | (1ULL << (Precision - 1)); // guard bit, rank is never > 64 - p + 1
+
+#ifdef _MSC_VER
+			const auto rank = static_cast<uint8_t>(__lzcnt64(rest) + 1);
+#else
+			const auto rank = static_cast<uint8_t>(__builtin_clzll(rest) + 1);
+#endif
+
+			if (registers[index] < rank)
+				registers[index] = rank;
+		}
+
+		static void merge(uint8_t* dest, const uint8_t* source)
+		{
+			for (auto i = 0; i < Size; ++i)
+				if (dest[i] < source[i])
+					dest[i] = source[i];
+		}
+
+		static int64_t estimate(const uint8_t* registers)
+		{
+			const auto m = static_cast<double>(Size);
+			const auto alpha = 0.7213 / (1.0 + 1.079 / m);
+
+			auto sum = 0.0;
+			auto zeros = 0;
+
+			for (auto i = 0; i < Size; ++i)
+			{
+				sum += std::ldexp(1.0, -registers[i]);
+				if (!registers[i])
+					++zeros;
+			}
+
+			auto estimate = alpha * m * m / sum;
+
+			// small range correction (linear counting), with 64 bit hashes
+			// there is no need for a large range correction
+			if (estimate <= 2.5 * m && zeros)
+				estimate = m * std::log(m / static_cast<double>(zeros));
+
+			return static_cast<int64_t>(estimate + 0.5);
+		}
+	};
+}
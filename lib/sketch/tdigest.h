@@ -0,0 +1,243 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include "../include/libcommon.h"
+
+/*
+	TDigest - mergeable quantile sketch in fixed memory.
+
+	A merging t-digest (Dunning) using the k1 (arcsine) scale function. Like
+	HyperLogLog this works on a caller provided block of `Size` bytes so it
+	can live in a HeapStack or an internode buffer, and be copied with memcpy.
+
+	Incoming values go into a buffer, when the buffer fills it is sorted and
+	merged with the centroids. With a compression of 100 there can never be
+	more than 101 centroids, so the block is a fixed size no matter how
+	many values are added. Accuracy is best near the tails (p1, p99) which
+	is usually where the interesting percentiles are.
+
+	The requested quantile is stored in the header so a sketch carries
+	everything needed to render it.
+*/
+namespace openset::sketch
+{
+	class TDigest
+	{
+	public:
+		struct Centroid_s
+		{
+			double mean;
+			double weight;
+		};
+
+		struct Header_s
+		{
+			double quantile; // 0 to 1, the quantile to report
+			double totalWeight;
+			double min;
+			double max;
+			int32_t centroidCount;
+			int32_t bufferCount;
+		};
+
+		static constexpr double Compression = 100.0;
+		static const int MaxCentroids = 128; // never more than Compression + 1 after compress
+		static const int MaxBuffer = 128;
+		static const int Size = sizeof(Header_s) + sizeof(Centroid_s) * (MaxCentroids + MaxBuffer);
+
+	private:
+		static Header_s* header(uint8_t* block)
+		{
+			return reinterpret_cast<Header_s*>(block);
+		}
+
+		static const Header_s* header(const uint8_t* block)
+		{
+			return reinterpret_cast<const Header_s*>(block);
+		}
+
+		static Centroid_s* centroids(uint8_t* block)
+		{
+			return reinterpret_cast<Centroid_s*>(block + sizeof(Header_s));
+		}
+
+		static const Centroid_s* centroids(const uint8_t* block)
+		{
+			return reinterpret_cast<const Centroid_s*>(block + sizeof(Header_s));
+		}
+
+		static Centroid_s* buffer(uint8_t* block)
+		{
+			return centroids(block) + MaxCentroids;
+		}
+
+		// k1 scale function, centroids may not span more than 1 unit of k
+		static double scale(const double q)
+		{
+			return (Compression / (2.0 * 3.14159265358979323846)) * std::asin(2.0 * q - 1.0);
+		}
+
+		static void compress(uint8_t* block)
+		{
+			const auto head = header(block);
+
+			if (!head->bufferCount)
+				return;
+
+			Centroid_s all[MaxCentroids + MaxBuffer];
+			auto count = 0;
+
+			for (auto i = 0; i < head->centroidCount; ++i)
+				all[count++] = centroids(block)[i];
+			for (auto i = 0; i < head->bufferCount; ++i)
+				all[count++] = buffer(block)[i];
+
+			std::sort(all, all + count, [](const Centroid_s& left, const Centroid_s& right)
+			{
+				return left.mean < right.mean;
+			});
+
+			const auto total = head->totalWeight;
+			const auto out = centroids(block);
+			auto outCount = 0;
+
+			auto current = all[0];
+			auto weightSoFar = 0.0; // weight to the left of current
+			auto kLeft = scale(0.0);
+
+			for (auto i = 1; i < count; ++i)
+			{
+				const auto proposed = current.weight + all[i].weight;
+				const auto kRight = scale((weightSoFar + proposed) / total);
+
+				if (kRight - kLeft <= 1.0)
+				{
+					// fold into current centroid (weighted mean)
+					current.mean += (all[i].mean - current.mean) * all[i].weight / proposed;
+					current.weight = proposed;
+				}
+				else
+				{
+					weightSoFar += current.weight;
+					kLeft = scale(weightSoFar / total);
+					out[outCount++] = current;
+					current = all[i];
+				}
+			}
+
+			out[outCount++] = current;
+
+			head->centroidCount = outCount;
+			head->bufferCount = 0;
+		}
+
+		static void addWeighted(uint8_t* block, const double value, const double weight)
+		{
+			const auto head = header(block);
+
+			if (head->bufferCount == MaxBuffer)
+				compress(block);
+
+			buffer(block)[head->bufferCount++] = Centroid_s{ value, weight };
+
+			if (!head->totalWeight || value < head->min)
+				head->min = value;
+			if (!head->totalWeight || value > head->max)
+				head->max = value;
+
+			head->totalWeight += weight;
+		}
+
+	public:
+
+		// quantile is 0 to 1 (i.e. 0.95 for p95)
+		static void init(uint8_t* block, const double quantile)
+		{
+			memset(block, 0, Size);
+			header(block)->quantile = quantile;
+		}
+
+		static void add(uint8_t* block, const double value)
+		{
+			addWeighted(block, value, 1.0);
+		}
+
+		static void merge(uint8_t* dest, uint8_t* source)
+		{
+			compress(source);
+
+			const auto head = header(source);
+			const auto destHead = header(dest);
+
+			const auto min = head->min;
+			const auto max = head->max;
+
+			for (auto i = 0; i < head->centroidCount; ++i)
+				addWeighted(dest, centroids(source)[i].mean, centroids(source)[i].weight);
+
+			// centroid means are inside the source range, keep the true extremes
+			if (head->totalWeight)
+			{
+				destHead->min = std::min(destHead->min, min);
+				destHead->max = std::max(destHead->max, max);
+			}
+		}
+
+		static double getQuantile(const uint8_t* block)
+		{
+			return header(block)->quantile;
+		}
+
+		// compresses the sketch in place, then interpolates between centroid centers
+		static double quantile(uint8_t* block, const double q)
+		{
+			compress(block);
+
+			const auto head = header(block);
+			const auto cents = centroids(block);
+			const auto count = head->centroidCount;
+
+			if (!count)
+				return 0;
+
+			if (count == 1 || q <= 0)
+				return q <= 0 ? head->min : cents[0].mean;
+
+			if (q >= 1)
+				return head->max;
+
+			const auto target = q * head->totalWeight;
+
+			// left of the first centroid center, interpolate from min
+			if (target < cents[0].weight / 2.0)
+				return head->min + (cents[0].mean - head->min) * (target / (cents[0].weight / 2.0));
+
+			auto weightSoFar = cents[0].weight / 2.0; // position of the current center
+
+			for (auto i = 0; i < count - 1; ++i)
+			{
+				const auto gap = (cents[i].weight + cents[i + 1].weight) / 2.0;
+
+				if (weightSoFar + gap >= target)
+				{
+					const auto t = (target - weightSoFar) / gap;
+					return cents[i].mean + t * (cents[i + 1].mean - cents[i].mean);
+				}
+
+				weightSoFar += gap;
+			}
+
+			// right of the last center, interpolate to max
+			const auto last = cents[count - 1];
+			const auto remaining = last.weight / 2.0;
+			const auto t = remaining ? (target - weightSoFar) / remaining : 1.0;
+			return last.mean + std::min(1.0, t) * (head->max - last.mean);
+		}
+
+		static double estimate(uint8_t* block)
+		{
+			return quantile(block, header(block)->quantile);
+		}
+	};
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "include/libcommon.h"
+#include <chrono>
+#include <thread>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+	CycleClock - a cheap clock for checking time slices.
+
+	Time slice checks happen between every person a cell iterates, so the
+	clock needs to be cheap. On x86 this reads the time stamp counter (tens
+	of cycles, no syscall or vDSO call). Elsewhere it falls back to
+	steady_clock in nanoseconds.
+
+	Ticks are only meaningful relative to each other on the same machine,
+	use ticksPerMilli() to convert a budget in milliseconds into ticks.
+*/
+class CycleClock
+{
+public:
+
+	static int64_t ticks()
+	{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+		return static_cast<int64_t>(__rdtsc());
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	// measured once (a few milliseconds) on first call
+	static int64_t ticksPerMilli()
+	{
+		static const auto perMilli = calibrate();
+		return perMilli;
+	}
+
+private:
+
+	static int64_t calibrate()
+	{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+		const auto startTime = std::chrono::steady_clock::now();
+		const auto startTicks = ticks();
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+		const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - startTime).count();
+		const auto perMilli = (ticks() - startTicks) * 1000 / (elapsed ? elapsed : 1);
+
+		return perMilli > 0 ? perMilli : 1'000'000;
+#else
+		return 1'000'000; // nanoseconds
+#endif
+	}
+};
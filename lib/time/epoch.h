@@ -2,11 +2,33 @@
 
 #include "include/libcommon.h"
 #include <ctime>
+#include <vector>
+
+/*
+	Calendar math is done with days-from-civil arithmetic (see daysFromCivil
+	and civilFromDays) rather than gmtime/timegm. Days between 1970 and 2100
+	are looked up in a table built on first use, anything outside that range
+	is calculated.
+*/
 
 class Epoch
 {
 public:
 
+	// a day on the (proleptic Gregorian) calendar
+	struct civil_s
+	{
+		int16_t year;
+		uint8_t month; // 1 to 12
+		uint8_t day; // 1 to 31
+		uint8_t weekDay; // 0 is Sunday
+		uint8_t pad;
+		uint16_t yearDay; // 0 is January 1st
+	};
+
+	// days covered by the lookup table (1970-01-01 up to 2100-01-01)
+	static const int64_t CalendarDays = 47482;
+
 	// ensure a stamp is milliseconds since epoch
 	static constexpr int64_t fixMilli(int64_t stamp)
 	{
@@ -26,6 +48,66 @@ public:
 		return fixMilli(stamp) % 1000;
 	}
 
+	// days since 1970-01-01, rounded down for stamps before it
+	static constexpr int64_t dayNumber(const int64_t unixStamp)
+	{
+		return unixStamp >= 0 ? unixStamp / 86400 : (unixStamp - 86399) / 86400;
+	}
+
+	// days since 1970-01-01 for year/month/day (month 1 to 12)
+	static constexpr int64_t daysFromCivil(int64_t year, const int64_t month, const int64_t day)
+	{
+		year -= month <= 2;
+		const auto era = (year >= 0 ? year : year - 399) / 400;
+		const auto yearOfEra = year - era * 400;
+		const auto dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1; // from March 1st
+		const auto dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+		return era * 146097 + dayOfEra - 719468;
+	}
+
+	static civil_s civilFromDays(const int64_t days)
+	{
+		const auto z = days + 719468;
+		const auto era = (z >= 0 ? z : z - 146096) / 146097;
+		const auto dayOfEra = z - era * 146097;
+		const auto yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+		const auto dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100); // from March 1st
+		const auto mp = (5 * dayOfYear + 2) / 153;
+		const auto month = mp < 10 ? mp + 3 : mp - 9;
+		const auto year = yearOfEra + era * 400 + (month <= 2);
+
+		civil_s result;
+		result.year = static_cast<int16_t>(year);
+		result.month = static_cast<uint8_t>(month);
+		result.day = static_cast<uint8_t>(dayOfYear - (153 * mp + 2) / 5 + 1);
+		result.weekDay = static_cast<uint8_t>(((days % 7) + 11) % 7); // 1970-01-01 was a Thursday
+		result.pad = 0;
+		result.yearDay = static_cast<uint16_t>(days - daysFromCivil(year, 1, 1));
+		return result;
+	}
+
+	// the calendar day for a day number (see dayNumber)
+	static civil_s civilDay(const int64_t days)
+	{
+		static const std::vector<civil_s> table = []()
+		{
+			std::vector<civil_s> days(CalendarDays);
+			for (auto i = 0; i < CalendarDays; ++i)
+				days[i] = civilFromDays(i);
+			return days;
+		}();
+
+		if (days >= 0 && days < CalendarDays)
+			return table[days];
+
+		return civilFromDays(days);
+	}
+
+	static civil_s civilDate(const int64_t stamp)
+	{
+		return civilDay(dayNumber(fixUnix(stamp)));
+	}
+
 	// standard time functions use a global structure and are not thread safe
 	static inline void stampToTimeStruct(struct tm* timeStruct, int64_t stamp)
 	{
@@ -39,9 +121,7 @@ public:
 	static int64_t epochSecondNumber(int64_t stamp)
 	{
 		stamp = fixUnix(stamp);
-		struct tm time;
-		stampToTimeStruct(&time, stamp);
-		return time.tm_sec;
+		return (stamp - dayNumber(stamp) * 86400) % 60;
 	}
 
 	static int64_t epochSecondDate(int64_t stamp)
@@ -59,17 +139,13 @@ public:
 	static int64_t epochMinuteNumber(int64_t stamp)
 	{
 		stamp = fixUnix(stamp);
-		struct tm time;
-		stampToTimeStruct(&time, stamp);
-		return time.tm_min;
+		return ((stamp - dayNumber(stamp) * 86400) / 60) % 60;
 	}
 
 	static int64_t epochHourNumber(int64_t stamp)
 	{
 		stamp = fixUnix(stamp);
-		struct tm time;
-		stampToTimeStruct(&time, stamp);
-		return time.tm_hour;
+		return (stamp - dayNumber(stamp) * 86400) / 3600;
 	}
 
 	static int64_t epochHourDate(int64_t stamp)
@@ -87,173 +163,136 @@ public:
 
 	static int64_t epochWeekDate(int64_t stamp)
 	{
-		stamp = fixUnix(stamp);
-		struct tm time;
-		stampToTimeStruct(&time, stamp);
-		stamp = static_cast<int64_t>(stamp / 86400) * 86400;
-		stamp -= time.tm_wday * 86400;
-		return stamp;
+		const auto days = dayNumber(fixUnix(stamp));
+		return (days - civilDay(days).weekDay) * 86400;
 	}
 
 	static inline int64_t epochMonthNumber(int64_t stamp)
 	{
-		stamp = fixUnix(stamp);
-		struct tm time;
-		stampToTimeStruct(&time, stamp);
-		return time.tm_mon + 1;
+		return civilDate(stamp).month;
 	}
 
 	static int64_t epochMonthDate(int64_t stamp)
 	{
-		stamp = fixUnix(stamp);
-		struct tm time;
-		stampToTimeStruct(&time, stamp);
-		stamp = static_cast<int64_t>(stamp / 86400) * 86400;
-		stamp -= (time.tm_mday - 1) * 86400;
-		return stamp;
+		const auto days = dayNumber(fixUnix(stamp));
+		return (days - (civilDay(days).day - 1)) * 86400;
 	}
 
 	static int64_t epochQuarterNumber(int64_t stamp)
 	{
-		stamp = fixUnix(stamp);
-		struct tm time;
-		stampToTimeStruct(&time, stamp);
-		auto q = static_cast<int64_t>(time.tm_mon / 3) * 3;
-		return q + 1;
+		return ((civilDate(stamp).month - 1) / 3) * 3 + 1;
 	}
 
+	// first day of the quarter
 	static int64_t epochQuarterDate(int64_t stamp)
 	{
-		stamp = fixUnix(stamp);
-		struct tm time;
-		stampToTimeStruct(&time, stamp);
-		auto SOY = static_cast<int64_t>(stamp / 86400) * 86400;
-		SOY -= time.tm_yday * 86400;
-
-		stampToTimeStruct(&time, stamp);
-		auto q = static_cast<int64_t>(time.tm_mon / 3) * 3;
-		q *= (86400 * 31);
-
-		stamp = SOY + q;
-		stampToTimeStruct(&time, stamp + q);
-
-		stamp -= (time.tm_mday - 1) * 86400;
-		return stamp;
+		const auto date = civilDate(stamp);
+		return daysFromCivil(date.year, ((date.month - 1) / 3) * 3 + 1, 1) * 86400;
 	}
 
 	static int64_t epochDayOfWeek(int64_t stamp)
 	{
-		stamp = fixUnix(stamp);
-		struct tm time;
-		stampToTimeStruct(&time, stamp);
-		return time.tm_wday + 1;
+		return civilDate(stamp).weekDay + 1;
 	}
 
 	static int64_t epochDayOfMonth(int64_t stamp)
 	{
-		stamp = fixUnix(stamp);
-		struct tm time;
-		stampToTimeStruct(&time, stamp);
-		return time.tm_mday;
+		return civilDate(stamp).day;
 	}
 
 	static int64_t epochDayOfYear(int64_t stamp)
 	{
-		stamp = fixUnix(stamp);
-		struct tm time;
-		stampToTimeStruct(&time, stamp);
-		return time.tm_yday + 1;
+		return civilDate(stamp).yearDay + 1;
 	}
 
 	static int64_t epochYearNumber(int64_t stamp)
 	{
-		struct tm time;
-		stampToTimeStruct(&time, stamp);
-		return time.tm_year + 1900;
+		return civilDate(stamp).year;
 	}
 
 	static int64_t epochYearDate(int64_t stamp)
 	{
-		stamp = fixUnix(stamp);
-		struct tm time;
-		stampToTimeStruct(&time, stamp);
-		stamp = static_cast<int64_t>(stamp / 86400) * 86400;
-		stamp -= time.tm_yday * 86400;
-		return stamp;
+		const auto days = dayNumber(fixUnix(stamp));
+		return (days - civilDay(days).yearDay) * 86400;
 	}
 
 	/*  ISO8601 date parser
-	 * 
+	 *
 	 *  Supported formats:
-	 *		 
-	 *		yyyy-mm-ddThh:mm:ssZ          - GMT/UTC/Zulu time 
+	 *
+	 *		yyyy-mm-ddThh:mm:ssZ          - GMT/UTC/Zulu time
 	 *      yyyy-mm-ddThh:mm:ss+00:00     - Zone offset
 	 *      yyyy-mm-ddThh:mm:ss.mmm+00:00 - Zone offset and decimial milliseconds
 	 *
 	 *  specifying future (in milliseconds) cause ISO8601ToEpoch to fail if
 	 *  a date is the specified milliseconds into the future.
-	 *	
+	 *
 	 *	returns -1 on error
-	 */ 
+	 */
 
-	static int64_t ISO8601ToEpoch(std::string time, int64_t future = 0)
+	static int64_t ISO8601ToEpoch(const std::string& time, int64_t future = 0)
 	{
-		// parse the date...
-		std::string temp;
-
 		if (time.length() < 19)
 			return -1;
-		
-		// if there is no Z or null terminate
-		auto zonePos = time.find("+",19);
-		if (zonePos == time.npos)
-			zonePos = time.find("-", 19);
 
+		const auto text = time.c_str();
 
 		// look for punctuation
-		if (time[4] != '-' || time[7] != '-' || time[13] != ':' ||
-			time[16] != ':')
+		if (text[4] != '-' || text[7] != '-' || text[13] != ':' ||
+			text[16] != ':')
 			return -1;
 
-		int milli = 0, zone_hours = 0, zone_minutes = 0;
+		// fixed width number at `offset`, -1 if it isn't all digits
+		const auto digits = [text](const int offset, const int length) -> int64_t
+		{
+			int64_t value = 0;
+			for (auto i = offset; i < offset + length; ++i)
+			{
+				const auto digit = static_cast<unsigned>(text[i] - '0');
+				if (digit > 9)
+					return -1;
+				value = value * 10 + digit;
+			}
+			return value;
+		};
+
+		const auto year = digits(0, 4);
+		const auto month = digits(5, 2);
+		const auto day = digits(8, 2);
+		const auto hour = digits(11, 2);
+		const auto minute = digits(14, 2);
+		const auto second = digits(17, 2);
+
+		if (year < 0 || month < 0 || day < 0 || hour < 0 || minute < 0 || second < 0)
+			return -1;
 
-		auto year = stoi(time.substr(0, 4));
-		auto month = stoi(time.substr(5, 2));
-		auto day = stoi(time.substr(8, 2));
-		auto hour = stoi(time.substr(11, 2));
-		auto minute = stoi(time.substr(14, 2));
-		auto second = stoi(time.substr(17, 2));
+		int64_t milli = 0;
+		auto pos = 19;
 
 		// we have millis
-		if (time[19] == '.')
-			milli = stoi(time.substr(20, time.npos - 20));
+		if (text[pos] == '.')
+			for (++pos; static_cast<unsigned>(text[pos] - '0') <= 9; ++pos)
+				milli = milli * 10 + (text[pos] - '0');
 
-		auto negative = false;
+		auto stamp = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
 
-		if (zonePos != time.npos) // we have zone
+		// if there is no Z or null terminate
+		auto zonePos = time.find('+', 19);
+		if (zonePos == std::string::npos)
+			zonePos = time.find('-', 19);
+
+		// add zone
+		if (zonePos != std::string::npos && zonePos + 6 <= time.length())
 		{
-			negative = (time[zonePos] == '-');
-			zone_hours = stoi(time.substr(zonePos+1, 2));
-			zone_minutes = stoi(time.substr(zonePos +4, 2));
-		}
+			const auto negative = (text[zonePos] == '-');
+			const auto zoneHours = digits(static_cast<int>(zonePos) + 1, 2);
+			const auto zoneMinutes = digits(static_cast<int>(zonePos) + 4, 2);
 
-		struct tm t = { 0 };
-		t.tm_sec = second;
-		t.tm_min = minute;
-		t.tm_hour = hour;
-		t.tm_mday = day;
-		t.tm_mon = month - 1;
-		t.tm_year = year - 1900;
+			if (zoneHours < 0 || zoneMinutes < 0)
+				return -1;
 
-#ifdef _MSC_VER
-		auto stamp = static_cast<int64_t>(_mkgmtime64(&t));
-#else
-		auto stamp = static_cast<int64_t>(timegm(&t));
-#endif
-	
-		// add zone
-		if (zone_hours || zone_minutes)
-			stamp -= (negative ? -1 : 1) * ((zone_hours * 3600) + (zone_minutes * 60));
+			stamp -= (negative ? -1 : 1) * ((zoneHours * 3600) + (zoneMinutes * 60));
+		}
 
 		stamp = (stamp * 1000) + milli; // milliseconds
 
@@ -286,23 +325,24 @@ public:
 		auto millis = epoch % 1000;
 
 		epoch = fixUnix(epoch);
-		struct tm time;
-		stampToTimeStruct(&time, epoch);
-		
+		const auto days = dayNumber(epoch);
+		const auto date = civilDay(days);
+		const auto seconds = static_cast<int>(epoch - days * 86400);
+
 		auto iso =
-			std::to_string(time.tm_year + 1900) + '-' +
-			pad2(time.tm_mon + 1) + '-' +
-			pad2(time.tm_mday) + 'T' +
-			pad2(time.tm_hour) + ':' +
-			pad2(time.tm_min) + ':' +
-			pad2(time.tm_sec);
+			std::to_string(date.year) + '-' +
+			pad2(date.month) + '-' +
+			pad2(date.day) + 'T' +
+			pad2(seconds / 3600) + ':' +
+			pad2((seconds / 60) % 60) + ':' +
+			pad2(seconds % 60);
 
 		if (millis)
 			iso += "." + padMilli(millis);
 
 		iso += "Z";
 
-		return iso;		
+		return iso;
 	}
 
 
@@ -0,0 +1,382 @@
+#include "timezone.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <unordered_map>
+
+#include "epoch.h"
+
+namespace
+{
+	// rules are rolled forward to cover every stamp Epoch::fixMilli accepts
+	const int LastRuleYear = 2100;
+
+	std::mutex zoneLock;
+	std::unordered_map<std::string, TimeZone*> zones;
+
+	int64_t readBigEndian(const unsigned char* data, const int bytes)
+	{
+		uint64_t value = 0;
+		for (auto i = 0; i < bytes; ++i)
+			value = (value << 8) | data[i];
+
+		// sign extend 32 bit values
+		if (bytes == 4)
+			return static_cast<int32_t>(value);
+
+		return static_cast<int64_t>(value);
+	}
+
+	// [+|-]hh[:mm[:ss]] in seconds, advances `pos`, false if there are no digits
+	bool parseClock(const std::string& text, size_t& pos, int32_t& seconds)
+	{
+		auto sign = 1;
+
+		if (pos < text.length() && (text[pos] == '+' || text[pos] == '-'))
+		{
+			sign = text[pos] == '-' ? -1 : 1;
+			++pos;
+		}
+
+		int32_t parts[3] = { 0, 0, 0 };
+		auto part = 0;
+		auto digits = 0;
+
+		for (; pos < text.length() && part < 3; ++pos)
+		{
+			if (text[pos] >= '0' && text[pos] <= '9')
+			{
+				parts[part] = parts[part] * 10 + (text[pos] - '0');
+				++digits;
+			}
+			else if (text[pos] == ':' && digits)
+				++part;
+			else
+				break;
+		}
+
+		seconds = sign * (parts[0] * 3600 + parts[1] * 60 + parts[2]);
+		return digits != 0;
+	}
+
+	// POSIX zone abbreviation, either <...> or letters
+	bool skipAbbreviation(const std::string& text, size_t& pos)
+	{
+		if (pos < text.length() && text[pos] == '<')
+		{
+			const auto end = text.find('>', pos);
+			if (end == std::string::npos)
+				return false;
+			pos = end + 1;
+			return true;
+		}
+
+		const auto start = pos;
+		while (pos < text.length() && isalpha(static_cast<unsigned char>(text[pos])))
+			++pos;
+
+		return pos - start >= 3;
+	}
+
+	// a `Mm.w.d[/time]` rule, day number and seconds into that day
+	struct rule_s
+	{
+		int month{ 0 };
+		int week{ 0 };
+		int weekDay{ 0 };
+		int32_t time{ 7200 }; // 02:00 unless given
+
+		bool parse(const std::string& text, size_t& pos)
+		{
+			if (pos >= text.length() || text[pos] != 'M')
+				return false; // Jn and n forms are not used by the tz database
+
+			if (sscanf(text.c_str() + pos, "M%d.%d.%d", &month, &week, &weekDay) != 3 ||
+				month < 1 || month > 12 || week < 1 || week > 5 || weekDay < 0 || weekDay > 6)
+				return false;
+
+			while (pos < text.length() && text[pos] != '/' && text[pos] != ',')
+				++pos;
+
+			if (pos < text.length() && text[pos] == '/')
+			{
+				++pos;
+				if (!parseClock(text, pos, time))
+					return false;
+			}
+
+			return true;
+		}
+
+		// local seconds (from 1970) this rule lands on in `year`
+		int64_t localTime(const int year) const
+		{
+			const auto first = Epoch::daysFromCivil(year, month, 1);
+			const auto next = month == 12 ? Epoch::daysFromCivil(year + 1, 1, 1) : Epoch::daysFromCivil(year, month + 1, 1);
+
+			auto day = first + (weekDay - Epoch::civilDay(first).weekDay + 7) % 7 + (week - 1) * 7;
+			while (day >= next) // week 5 means the last one
+				day -= 7;
+
+			return day * 86400 + time;
+		}
+	};
+}
+
+TimeZone::TimeZone(std::string name) :
+	name(std::move(name))
+{}
+
+const TimeZone* TimeZone::get(const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(zoneLock);
+
+	if (const auto iter = zones.find(name); iter != zones.end())
+		return iter->second;
+
+	auto zone = new TimeZone(name);
+
+	if (!zone->parseFixed(name))
+	{
+		// tz database names are letters, digits and _-+/ and never climb out of the directory
+		const auto valid = name.length() &&
+			name[0] != '/' &&
+			name.find("..") == std::string::npos &&
+			std::all_of(name.begin(), name.end(), [](const char c) {
+				return isalnum(static_cast<unsigned char>(c)) || c == '/' || c == '_' || c == '-' || c == '+';
+			});
+
+		const auto dir = getenv("TZDIR");
+
+		if (!valid || !zone->loadZoneInfo(std::string(dir ? dir : "/usr/share/zoneinfo") + "/" + name))
+		{
+			delete zone;
+			return nullptr;
+		}
+	}
+
+	zones.emplace(name, zone);
+	return zone;
+}
+
+TimeZone::span_s TimeZone::spanAt(const int64_t unixStamp) const
+{
+	// last transition at or before the stamp, the first is INT64_MIN so there always is one
+	const auto index = (std::upper_bound(transitions.begin(), transitions.end(), unixStamp) - transitions.begin()) - 1;
+
+	return {
+		transitions[index],
+		index + 1 < static_cast<int64_t>(transitions.size()) ? transitions[index + 1] : INT64_MAX,
+		offsets[index]
+	};
+}
+
+void TimeZone::addTransition(const int64_t stamp, const int32_t offset)
+{
+	// a change in dst or abbreviation alone doesn't move the clock
+	if (offsets.size() && offsets.back() == offset)
+		return;
+
+	if (transitions.size() && stamp <= transitions.back())
+		return;
+
+	transitions.push_back(transitions.empty() ? INT64_MIN : stamp);
+	offsets.push_back(offset);
+}
+
+bool TimeZone::parseFixed(const std::string& text)
+{
+	if (text == "UTC" || text == "GMT" || text == "Z")
+	{
+		addTransition(INT64_MIN, 0);
+		return true;
+	}
+
+	if (text.length() < 2 || (text[0] != '+' && text[0] != '-'))
+		return false;
+
+	size_t pos = 0;
+	int32_t offset;
+
+	if (!parseClock(text, pos, offset) || pos != text.length() || offset <= -86400 || offset >= 86400)
+		return false;
+
+	addTransition(INT64_MIN, offset);
+	return true;
+}
+
+bool TimeZone::loadZoneInfo(const std::string& fileName)
+{
+	const auto file = fopen(fileName.c_str(), "rb");
+
+	if (!file)
+		return false;
+
+	std::vector<unsigned char> data;
+	unsigned char buffer[4096];
+
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		data.insert(data.end(), buffer, buffer + read);
+
+	fclose(file);
+
+	/* TZif (RFC 8536):
+	 *
+	 *   header (44 bytes) - "TZif", version, 15 reserved, six big endian counts
+	 *   data block - transition times, their type indexes, type records, ...
+	 *   v2+ repeats header and data with 64 bit times, then "\n<rule>\n"
+	 */
+	const size_t headerSize = 44;
+
+	struct header_s
+	{
+		int64_t isUtCount, isStdCount, leapCount, timeCount, typeCount, charCount;
+	};
+
+	const auto readHeader = [&data](const size_t offset, header_s& header) -> bool
+	{
+		if (offset + headerSize > data.size() || memcmp(data.data() + offset, "TZif", 4) != 0)
+			return false;
+
+		const auto counts = data.data() + offset + 20;
+		header.isUtCount = readBigEndian(counts, 4);
+		header.isStdCount = readBigEndian(counts + 4, 4);
+		header.leapCount = readBigEndian(counts + 8, 4);
+		header.timeCount = readBigEndian(counts + 12, 4);
+		header.typeCount = readBigEndian(counts + 16, 4);
+		header.charCount = readBigEndian(counts + 20, 4);
+
+		return header.typeCount > 0;
+	};
+
+	const auto blockSize = [](const header_s& header, const int timeSize) -> size_t
+	{
+		return header.timeCount * timeSize +
+			header.timeCount +
+			header.typeCount * 6 +
+			header.charCount +
+			header.leapCount * (timeSize + 4) +
+			header.isStdCount +
+			header.isUtCount;
+	};
+
+	header_s header;
+
+	if (!readHeader(0, header))
+		return false;
+
+	auto offset = headerSize;
+	auto timeSize = 4;
+
+	// version 2 and up, use the 64 bit copy
+	if (data[4] >= '2')
+	{
+		offset += blockSize(header, 4);
+
+		if (!readHeader(offset, header))
+			return false;
+
+		offset += headerSize;
+		timeSize = 8;
+	}
+
+	if (offset + blockSize(header, timeSize) > data.size())
+		return false;
+
+	const auto times = data.data() + offset;
+	const auto indexes = times + header.timeCount * timeSize;
+	const auto types = indexes + header.timeCount;
+
+	const auto typeOffset = [&](const int64_t type) -> int32_t {
+		return static_cast<int32_t>(readBigEndian(types + type * 6, 4));
+	};
+
+	// type 0 is in effect before the first transition
+	addTransition(INT64_MIN, typeOffset(0));
+
+	for (auto i = 0; i < header.timeCount; ++i)
+	{
+		if (indexes[i] >= header.typeCount)
+			return false;
+		addTransition(readBigEndian(times + i * timeSize, timeSize), typeOffset(indexes[i]));
+	}
+
+	// the rule for times after the last transition
+	if (timeSize == 8)
+	{
+		const auto footer = offset + blockSize(header, timeSize);
+
+		if (footer < data.size() && data[footer] == '\n')
+		{
+			const auto end = std::find(data.begin() + footer + 1, data.end(), '\n');
+			const std::string rule(data.begin() + footer + 1, end);
+
+			const auto fromYear = header.timeCount ?
+				Epoch::civilDay(Epoch::dayNumber(transitions.back())).year :
+				1970;
+
+			if (rule.length())
+				applyRule(rule, fromYear);
+		}
+	}
+
+	return true;
+}
+
+bool TimeZone::applyRule(const std::string& rule, const int fromYear)
+{
+	// std offset [dst [offset] [,start[/time],end[/time]]]
+	size_t pos = 0;
+	int32_t standard;
+
+	if (!skipAbbreviation(rule, pos) || !parseClock(rule, pos, standard))
+		return false;
+
+	standard = -standard; // POSIX offsets are west of UTC
+
+	if (pos == rule.length())
+	{
+		addTransition(transitions.empty() ? INT64_MIN : transitions.back() + 1, standard);
+		return true;
+	}
+
+	if (!skipAbbreviation(rule, pos))
+		return false;
+
+	auto daylight = standard + 3600;
+
+	if (pos < rule.length() && rule[pos] != ',')
+	{
+		if (!parseClock(rule, pos, daylight))
+			return false;
+		daylight = -daylight;
+	}
+
+	rule_s start, end;
+
+	if (pos >= rule.length() || rule[pos] != ',' || !start.parse(rule, ++pos) ||
+		pos >= rule.length() || rule[pos] != ',' || !end.parse(rule, ++pos))
+		return false;
+
+	for (auto year = fromYear; year <= LastRuleYear; ++year)
+	{
+		// rule times are local, daylight starts on standard time and ends on daylight time
+		const auto daylightFrom = start.localTime(year) - standard;
+		const auto daylightTo = end.localTime(year) - daylight;
+
+		if (daylightFrom < daylightTo)
+		{
+			addTransition(daylightFrom, daylight);
+			addTransition(daylightTo, standard);
+		}
+		else // southern hemisphere, daylight time runs over new year
+		{
+			addTransition(daylightTo, standard);
+			addTransition(daylightFrom, daylight);
+		}
+	}
+
+	return true;
+}
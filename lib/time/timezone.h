@@ -0,0 +1,71 @@
+#pragma once
+
+#include "include/libcommon.h"
+#include <string>
+#include <vector>
+
+/*
+	TimeZone - UTC offsets for a time zone as a table of transitions
+
+	Zones are loaded once (see TimeZone::get) from the tz database
+	(TZif files under $TZDIR or /usr/share/zoneinfo) and the rule at the
+	end of the file is rolled forward to 2100, after that finding the
+	offset for a stamp is a binary search. Callers converting many stamps
+	keep the span_s from the last lookup and only search again when a
+	stamp falls outside it.
+
+	Names can be "UTC", a fixed offset ("+05:30", "-08:00") or a tz
+	database name ("America/New_York").
+*/
+
+class TimeZone
+{
+public:
+
+	// [from, to) in UTC seconds, where the zone is `offset` seconds from UTC
+	struct span_s
+	{
+		int64_t from;
+		int64_t to;
+		int32_t offset;
+
+		bool contains(const int64_t unixStamp) const
+		{
+			return unixStamp >= from && unixStamp < to;
+		}
+	};
+
+	// nullptr if the zone isn't known, zones live for the life of the process
+	static const TimeZone* get(const std::string& name);
+
+	span_s spanAt(const int64_t unixStamp) const;
+
+	int32_t offsetAt(const int64_t unixStamp) const
+	{
+		return spanAt(unixStamp).offset;
+	}
+
+	const std::string& getName() const
+	{
+		return name;
+	}
+
+	// transitions in the table (including the open ended first one)
+	size_t size() const
+	{
+		return transitions.size();
+	}
+
+private:
+	std::string name;
+	std::vector<int64_t> transitions; // UTC seconds, the first is INT64_MIN
+	std::vector<int32_t> offsets; // offsets[i] applies from transitions[i]
+
+	explicit TimeZone(std::string name);
+
+	void addTransition(const int64_t stamp, const int32_t offset);
+
+	bool parseFixed(const std::string& text);
+	bool loadZoneInfo(const std::string& fileName);
+	bool applyRule(const std::string& rule, int fromYear);
+};
@@ -1,5 +1,7 @@
 #include "asyncloop.h"
 #include "asyncpool.h"
+#include <algorithm>
+#include <limits>
 
 using namespace openset::async;
 
@@ -10,7 +12,9 @@ AsyncLoop::AsyncLoop(AsyncPool* asyncPool, int partitionId, int workerId) :
 	runTime(50),
 	partition(partitionId),
 	worker(workerId)
-{}
+{
+	runningWorker = workerId;
+}
 
 AsyncLoop::~AsyncLoop()
 {
@@ -36,6 +40,16 @@ void AsyncLoop::release()
 		delete active.back();
 		active.pop_back();
 	}
+
+	while (shared.size())
+	{
+		shared.back()->partitionRemoved();
+		delete shared.back();
+		shared.pop_back();
+	}
+
+	activeSize = 0;
+	sharedSize = 0;
 }
 
 // uses locks - may be called from other threads
@@ -45,6 +59,7 @@ void AsyncLoop::queueCell(OpenLoop* work)
 		csLock lock(pendLock);
 		// assign this loop to the cell
 		work->assignLoop(this);
+		work->queuedAt = Now();
 		queued.push_back(work);
 		++queueSize;
 	}
@@ -54,6 +69,24 @@ void AsyncLoop::queueCell(OpenLoop* work)
 	asyncPool->workerInfo[worker].conditional.notify_one();
 }
 
+void AsyncLoop::queueSharedCell(OpenLoop* work)
+{
+	{
+		csLock lock(pendLock);
+		work->assignLoop(this);
+		work->queuedAt = Now();
+		shared.push_back(work);
+		++sharedSize;
+	}
+
+	// any worker can run a shared cell
+	for (auto w = 0; w < asyncPool->workerMax; ++w)
+	{
+		asyncPool->workerInfo[w].triggered = true;
+		asyncPool->workerInfo[w].conditional.notify_one();
+	}
+}
+
 // this will add any queued jobs to the
 // active Loop. This is particularly useful 
 // because a job Cell can spawn more job cells
@@ -70,15 +103,35 @@ void AsyncLoop::scheduleQueued()
 	queueSize -= queued.size();
 	active.insert(active.end(), make_move_iterator(queued.begin()), make_move_iterator(queued.end()));
 	queued.clear();	
+
+	// highest priority first, otherwise in the order they were queued
+	std::stable_sort(active.begin(), active.end(), [](const OpenLoop* left, const OpenLoop* right)
+	{
+		return left->priority > right->priority;
+	});
+
+	activeSize = active.size();
 }
 
 // moves a Cell to the cleanup queue
 void AsyncLoop::markForCleanup(OpenLoop* work)
 {
+	asyncPool->recordLatency(work->priority, Now() - work->queuedAt);
 	completed.push_back(work);
 	work->state = oloopState_e::clear;
 }
 
+// returns true if the cell is past its deadline and has been ended
+bool AsyncLoop::expire(OpenLoop* work, const int64_t now)
+{
+	if (work->state != oloopState_e::running || !work->deadlinePassed(now))
+		return false;
+
+	work->deadlineExceeded();
+	work->suicide();
+	return true;
+}
+
 // this runs one iteration of the main Loop
 bool AsyncLoop::Run(int64_t &nextRun)
 {
@@ -91,56 +144,143 @@ bool AsyncLoop::Run(int64_t &nextRun)
 
 	// nothing to do
 	if (!active.size())
+	{
+		busy = false;
 		return false;
+	}
 
 	vector<OpenLoop*> rerun;
+	auto earliest = std::numeric_limits<int64_t>::max();
+	auto realtimeRan = false;
 
 	// this is the inside of our open ended Loop
-	// it will call each job that is ready to run
+	// it will call each job that is ready to run, active
+	// is sorted so realtime cells go first
 	for (auto w : active)
 	{
 		const auto now = Now();
 
-		if (!w->prepared)
-		{
-			w->prepare();
-			w->prepared = true;
-		}
+		w->workerId = runningWorker;
 
-		if (w->checkCondition() &&
-			w->checkTimer(now) &&
-			w->state == oloopState_e::running) // check - some cells will complete in prepare
+		// background cells sit out passes where realtime cells ran,
+		// unless they have been waiting too long
+		const auto deferred = 
+			realtimeRan &&
+			w->priority == oloopPriority_e::background &&
+			now - w->lastRun < BACKGROUND_MAX_WAIT;
+
+		if (!deferred && !expire(w, now))
 		{
-			w->runStart = now;
-			w->run();
-
-			// look for next scheduled (future) run operation
-			if (w->state == oloopState_e::running && 
-				w->runAt > now && (nextRun == -1 || w->runAt < nextRun))
-				nextRun = w->runAt;
-			
-			++runCount;
+			if (!w->prepared)
+			{
+				w->prepare();
+				w->prepared = true;
+			}
+
+			if (w->checkCondition() &&
+				w->checkTimer(now) &&
+				w->state == oloopState_e::running) // check - some cells will complete in prepare
+			{
+				w->beginSlice(now);
+				w->run();
+
+				if (w->priority == oloopPriority_e::realtime)
+					realtimeRan = true;
+
+				// look for next scheduled (future) run operation
+				if (w->state == oloopState_e::running && 
+					w->runAt > now && (nextRun == -1 || w->runAt < nextRun))
+					nextRun = w->runAt;
+				
+				++runCount;
+			}
 		}
 
 		if (w->state == oloopState_e::done)
 			markForCleanup(w);
 		else
+		{
 			rerun.push_back(w); // reschedule jobs that have more to do
+			if (w->runAt < earliest)
+				earliest = w->runAt;
+		}
 
 		//this_thread::yield(); // cooperate
 	}
 
 	// swap rerun queue to active queue
 	active = std::move(rerun);
+	activeSize = active.size();
+	readyAt = earliest;
 
 	// cleanup objects every 10 runs - low tech garbage collection
 	if (++loopCount % 10 == 0 && completed.size())
 		cleanup();
 
+	busy = runCount != 0;
+
 	// nothing to do
 	return (!runCount) ? false : true;
 }
 
+bool AsyncLoop::RunShared(int workerId)
+{
+	if (!sharedSize || !trySharedClaim())
+		return false;
+
+	OpenLoop* cell = nullptr;
+
+	{
+		csLock lock(pendLock);
+		if (shared.size())
+		{
+			cell = shared.front();
+			shared.pop_front();
+		}
+	}
+
+	if (!cell)
+	{
+		unclaimShared();
+		return false;
+	}
+
+	cell->workerId = workerId;
+
+	const auto now = Now();
+
+	if (!expire(cell, now))
+	{
+		if (!cell->prepared)
+		{
+			cell->prepare();
+			cell->prepared = true;
+		}
+
+		if (cell->state == oloopState_e::running)
+		{
+			cell->beginSlice(now);
+			cell->run();
+		}
+	}
+
+	if (cell->state == oloopState_e::done)
+	{
+		asyncPool->recordLatency(cell->priority, Now() - cell->queuedAt);
+		delete cell;
+		--sharedSize;
+	}
+	else
+	{
+		csLock lock(pendLock);
+		shared.push_back(cell);
+	}
+
+	unclaimShared();
+
+	return true;
+}
+
 // clean up - run every 50 loops, but could be run 
 // on a timer
 void AsyncLoop::cleanup()
@@ -2,6 +2,7 @@
 
 #include "common.h"
 #include <vector>
+#include <deque>
 #include <mutex>
 #include <atomic>
 
@@ -27,10 +28,29 @@ namespace openset
 			vector<OpenLoop*> completed;
 			// the active worker live
 			vector<OpenLoop*> active;
-			
+			atomic<int32_t> activeSize{ 0 };
+			// earliest runAt of the active cells (after the last Run)
+			atomic<int64_t> readyAt{ 0 };
+
+			// read-only cells, any number of workers may run these at
+			// the same time, each cell is only ever run by one worker
+			std::deque<OpenLoop*> shared;
+			atomic<int32_t> sharedSize{ 0 }; // includes cells being run
 
 			int64_t loopCount;
 
+			// set while an async worker is running this loop, a partition
+			// can be run (or stolen) by any worker, but only one at a time
+			atomic<bool> claimed{ false };
+			// workers running shared cells
+			atomic<int32_t> readers{ 0 };
+			// an exclusive claim failed because of readers, hold off new readers
+			atomic<bool> exclusiveWaiting{ false };
+			// true if the last Run did work, used to decide if it's worth stealing
+			atomic<bool> busy{ false };
+			// the worker currently running this loop
+			int runningWorker;
+
 		public:
 
 			AsyncPool* asyncPool;
@@ -48,6 +68,9 @@ namespace openset
 			// uses locks - may be called from other threads
 			void queueCell(OpenLoop* work);
 
+			// queue a read-only cell, wakes all workers so idle ones can help
+			void queueSharedCell(OpenLoop* work);
+
 			// this will add any queued jobs to the
 			// active Loop. This is particularly useful 
 			// because a job Cell can spawn more job cells
@@ -57,9 +80,79 @@ namespace openset
 			// moves a Cell to the cleanup queue
 			void markForCleanup(OpenLoop* work);
 
+			// ends a cell that is past its deadline
+			bool expire(OpenLoop* work, int64_t now);
+
+			// the worker running this loop right now. This is not always
+			// `worker` (the home worker), idle workers may steal partitions.
 			int64_t getWorkerId() const
 			{
-				return worker;
+				return runningWorker;
+			}
+
+			// try to take exclusive ownership of this loop for a worker
+			bool tryClaim(int workerId)
+			{
+				auto expected = false;
+				if (!claimed.compare_exchange_strong(expected, true))
+					return false;
+
+				// shared cells are running, let them finish their slices
+				if (readers)
+				{
+					exclusiveWaiting = true;
+					claimed = false;
+					return false;
+				}
+
+				exclusiveWaiting = false;
+				runningWorker = workerId;
+				return true;
+			}
+
+			void unclaim()
+			{
+				claimed = false;
+			}
+
+			// shared claims can be held by many workers, but not while
+			// the loop is claimed exclusively
+			bool trySharedClaim()
+			{
+				if (exclusiveWaiting || claimed)
+					return false;
+
+				++readers;
+
+				if (claimed)
+				{
+					--readers;
+					return false;
+				}
+
+				return true;
+			}
+
+			void unclaimShared()
+			{
+				--readers;
+			}
+
+			// queued cells, shared cells, or cells that did work on the last pass
+			bool hasWork() const
+			{
+				return queueSize || busy || sharedSize;
+			}
+
+			// are there queued cells, or active cells ready to run at `now`
+			bool hasExclusiveWork(const int64_t now) const
+			{
+				return queueSize || (activeSize && readyAt <= now);
+			}
+
+			int64_t getReadyAt() const
+			{
+				return activeSize ? readyAt.load() : -1;
 			}
 
 			int getPartitionId() const
@@ -71,6 +164,10 @@ namespace openset
 			// short, sweet and called frequently
 			bool Run(int64_t &nextRun);
 
+			// runs one slice of one shared cell, returns false if there was
+			// nothing to run or the loop is claimed exclusively
+			bool RunShared(int workerId);
+
 			// clean up 
 			void cleanup();
 		};
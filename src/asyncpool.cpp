@@ -240,6 +240,17 @@ void AsyncPool::realtimeDec(int32_t shardNumber)
 		--partitions[shardNumber]->realtimeCells;
 }
 
+int64_t AsyncPool::getRealtimeTotal() const
+{
+	int64_t total = 0;
+
+	for (auto i = 0; i < partitionMax; ++i)
+		if (partitions[i])
+			total += partitions[i]->realtimeCells;
+
+	return total;
+}
+
 int32_t AsyncPool::getRealtimeRunning(int32_t shardNumber) const
 {
 	if (partitions[shardNumber])
@@ -248,6 +259,126 @@ int32_t AsyncPool::getRealtimeRunning(int32_t shardNumber) const
 		return 0;
 }
 
+std::vector<AsyncPool::WorkerStats_s> AsyncPool::getWorkerStats() const
+{
+	std::vector<WorkerStats_s> stats;
+
+	for (auto w = 0; w < workerMax; ++w)
+		stats.push_back(WorkerStats_s{
+			w,
+			static_cast<int64_t>(workerInfo[w].jobs.size()),
+			workerInfo[w].busyMicros,
+			workerInfo[w].idleMicros,
+			workerInfo[w].runs,
+			workerInfo[w].steals
+		});
+
+	return stats;
+}
+
+void AsyncPool::recordLatency(const oloopPriority_e priority, const int64_t millis)
+{
+	auto bucket = 0;
+	while (bucket < LATENCY_BUCKETS - 1 && millis >= (1LL << bucket))
+		++bucket;
+
+	++latency[static_cast<int>(priority)][bucket];
+}
+
+std::vector<int64_t> AsyncPool::getLatencyHistogram(const oloopPriority_e priority) const
+{
+	std::vector<int64_t> counts;
+
+	for (auto& bucket : latency[static_cast<int>(priority)])
+		counts.push_back(bucket);
+
+	return counts;
+}
+
+bool AsyncPool::runPartition(partitionInfo_s* partition, int32_t workerId, int64_t& nextRun)
+{
+	if (partition->markedForDeletion || !partition->ooLoop)
+		return false;
+
+	if (!openset::globals::mapper->getPartitionMap()->isMapped(
+			partition->ooLoop->getPartitionId(),
+			openset::globals::running->nodeId))
+		return false;
+
+	const auto loop = partition->ooLoop;
+	const auto now = Now();
+	auto didWork = false;
+
+	const auto scheduleAt = [&nextRun](const int64_t at)
+	{
+		if (at != -1 && (nextRun == -1 || at < nextRun))
+			nextRun = at;
+	};
+
+	if (loop->hasExclusiveWork(now))
+	{
+		// partitions contain open ended loops
+		// we are going to run those loops here.
+		if (loop->tryClaim(workerId))
+		{
+			didWork = loop->Run(nextRun);
+			loop->unclaim();
+		}
+		else // another worker has it, check back shortly
+		{
+			scheduleAt(now + 1);
+		}
+	}
+	else
+	{
+		// only future scheduled cells, wake up for them
+		scheduleAt(loop->getReadyAt());
+	}
+
+	// read-only cells (i.e. query morsels) can run here while other
+	// workers run other cells from the same list
+	if (loop->RunShared(workerId))
+		didWork = true;
+
+	if (didWork)
+		++workerInfo[workerId].runs;
+
+	return didWork;
+}
+
+bool AsyncPool::steal(int32_t workerId)
+{
+	/*
+	This worker has nothing to do. Look at the other workers for a
+	partition with pending work that isn't running and run one pass of it.
+
+	The jobs lists only change while workers are suspended, so they are
+	safe to walk here. The partition claim guarantees the cells in
+	a partition never run on two threads at once.
+	*/
+	for (auto offset = 1; offset < workerMax; ++offset)
+	{
+		auto& victim = workerInfo[(workerId + offset) % workerMax];
+
+		for (auto s : victim.jobs)
+		{
+			if (s->markedForDeletion || !s->ooLoop || !s->ooLoop->hasWork())
+				continue;
+
+			// timers in a stolen partition are left to its home worker
+			auto stolenNextRun = int64_t(-1);
+
+			if (runPartition(s, workerId, stolenNextRun))
+			{
+				++workerInfo[workerId].steals;
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
 void AsyncPool::runner(int32_t workerId) noexcept
 {
 	/*
@@ -273,6 +404,12 @@ void AsyncPool::runner(int32_t workerId) noexcept
 	auto worker = &workerInfo[workerId];
 	auto runAgain = 0;
 
+	const auto micros = []() -> int64_t
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	};
+
 	int64_t nextRun = -1;
 
 	auto cleanup = [&]() -> bool
@@ -328,6 +465,8 @@ void AsyncPool::runner(int32_t workerId) noexcept
 
 			if (delay && !worker->triggered)
 			{
+				const auto idleStart = micros();
+
 				// using a C++11 conditional lock (eventing) so that if
 				// we aren't tasked up, we can wait for a cell to be added, or 250ms
 
@@ -336,6 +475,8 @@ void AsyncPool::runner(int32_t workerId) noexcept
 				{
 					return (worker->triggered || globalAsyncInitSuspend);
 				}); //std::chrono::milliseconds(delay) );
+
+				worker->idleMicros += micros() - idleStart;
 			}
 			worker->triggered = false;
 		}
@@ -350,21 +491,18 @@ void AsyncPool::runner(int32_t workerId) noexcept
 
 		nextRun = -1;
 
+		const auto busyStart = micros();
+
 		for (auto s : worker->jobs)
-		{
-			if (s->markedForDeletion)
-				continue;
-			
-			if (!openset::globals::mapper->getPartitionMap()->isMapped(
-					s->ooLoop->getPartitionId(),
-					openset::globals::running->nodeId))
-				continue;
+			if (runPartition(s, workerId, nextRun))
+				++runAgain;
 
-			// partitions contain open ended loops
-			// we are going to run those loops here.
-			if (s->ooLoop && s->ooLoop->Run(nextRun))
-				++runAgain;			
-		}
+		// nothing of our own to run, help out a worker that is busy
+		if (!runAgain && workerMax > 1 && steal(workerId))
+			++runAgain;
+
+		if (runAgain)
+			worker->busyMicros += micros() - busyStart;
 
 		if (runAgain)
 			nextRun = 0;
@@ -28,6 +28,8 @@ namespace openset
 
 		const int32_t PARTITION_WORKERS = 40; // default worker count
 		const int32_t IDLE_MAX = 100; // idle if we get this many no-work cells
+		const int32_t PRIORITY_CLASSES = 3; // see oloopPriority_e
+		const int32_t LATENCY_BUCKETS = 16; // log2 milliseconds, last bucket is 16s+
 
 
 		class AsyncPool
@@ -77,6 +79,22 @@ namespace openset
 				std::condition_variable conditional;
 				vector<partitionInfo_s*> jobs;
 				atomic<int> queued;
+
+				// utilization, in microseconds
+				atomic<int64_t> busyMicros{ 0 };
+				atomic<int64_t> idleMicros{ 0 };
+				atomic<int64_t> runs{ 0 }; // partition loop passes that did work
+				atomic<int64_t> steals{ 0 }; // ... of those, how many were stolen from another worker
+			};
+
+			struct WorkerStats_s
+			{
+				int worker;
+				int64_t partitions;
+				int64_t busyMicros;
+				int64_t idleMicros;
+				int64_t runs;
+				int64_t steals;
 			};
 
 			
@@ -97,6 +115,9 @@ namespace openset
 			workerInfo_s workerInfo[PARTITION_WORKERS];
 			partitionInfo_s* partitions[PARTITION_MAX];
 
+			// queued to completed latency of cells, by priority class
+			atomic<int64_t> latency[PRIORITY_CLASSES][LATENCY_BUCKETS];
+
 			AsyncPool(int32_t ShardMax, int32_t WorkerMax) :
 				partitionMax(ShardMax),
 				workerMax(WorkerMax),
@@ -109,6 +130,10 @@ namespace openset
 
 				for (auto &wInfo : workerInfo)
 					wInfo.queued = 0;
+
+				for (auto &priorityClass : latency)
+					for (auto &bucket : priorityClass)
+						bucket = 0;
 			}
 
 			~AsyncPool()
@@ -141,6 +166,8 @@ namespace openset
 			void realtimeInc(int32_t shardNumber);
 			void realtimeDec(int32_t shardNumber);
 			int32_t getRealtimeRunning(int32_t shardNumber) const;
+			// realtime (query) cells queued or running on this node, reported to other nodes as its load
+			int64_t getRealtimeTotal() const;
 
 			bool isRunning() const 			
 			{
@@ -162,8 +189,20 @@ namespace openset
 				partitionMax = maxPartitions;
 			}
 
+			std::vector<WorkerStats_s> getWorkerStats() const;
+
+			void recordLatency(oloopPriority_e priority, int64_t millis);
+			// counts for each log2 millisecond bucket (bucket 0 is < 1ms, bucket N is < 2^N ms)
+			std::vector<int64_t> getLatencyHistogram(oloopPriority_e priority) const;
+
 			void runner(int32_t workerId) noexcept;
 
+		private:
+			bool runPartition(partitionInfo_s* partition, int32_t workerId, int64_t& nextRun);
+			bool steal(int32_t workerId);
+
+		public:
+
 			void startAsync();
 		};
 	};
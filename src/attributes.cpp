@@ -3,6 +3,54 @@
 
 using namespace openset::db;
 
+namespace
+{
+	// applies a tail linked list of changes to an attribute, returns the replacement
+	Attr_s* applyChanges(Attr_s* attr, Attr_changes_s* changes)
+	{
+		IndexBits bits;
+
+		bits.mount(attr->index, attr->ints, attr->linId);
+
+		auto t = changes;
+
+		while (t)
+		{
+			if (t->state)
+				bits.bitSet(t->linId);
+			else
+				bits.bitClear(t->linId);
+			const auto prev = t->prev;
+			PoolMem::getPool().freePtr(t);
+			t = prev;
+		}
+
+		int64_t compBytes = 0; // OUT value via reference
+		int32_t linId;
+
+		// compress the data, get it back in a pool ptr
+		const auto compData = bits.store(compBytes, linId);
+		const auto destAttr = recast<Attr_s*>(PoolMem::getPool().getPtr(sizeof(Attr_s) + compBytes));
+
+		// copy header
+		memcpy(destAttr, attr, sizeof(Attr_s));
+		if (compData)
+		{
+			memcpy(destAttr->index, compData, compBytes);
+			// return work buffer from bits.store to the pool
+			PoolMem::getPool().freePtr(compData);
+		}
+
+		destAttr->ints = bits.ints;//(isList) ? 0 : bits.ints;
+		destAttr->comp = compBytes;
+		destAttr->linId = linId;
+
+		PoolMem::getPool().freePtr(attr);
+
+		return destAttr;
+	}
+}
+
 IndexBits* Attr_s::getBits()
 {
 	auto bits = new IndexBits();
@@ -90,10 +138,32 @@ void Attributes::setDirty(const int32_t linId, const int32_t column, const int64
 	addChange(column, value, linId, true);
 }
 
-void Attributes::clearDirty()
+void Attributes::setDirty(const int32_t linId, const int32_t column, const int64_t value, const int64_t bucket)
 {
-	IndexBits bits;
+	// dropped layers are never queried
+	if (bucket < cullBucket)
+		return;
+
+	const attr_bucket_key_s key{ column, value, bucket };
+
+	if (!bucketIndex.get(key))
+		bucketIndex.emplace(key, new(PoolMem::getPool().getPtr(sizeof(Attr_s)))Attr_s());
+
+	const auto changeRecord = bucketChanges.get(key);
+	Attr_changes_s* changeTail = changeRecord ? changeRecord->second : nullptr;
+
+	const auto change =
+		new(PoolMem::getPool().getPtr(sizeof(Attr_changes_s)))
+		Attr_changes_s(linId, 1, changeTail);
+
+	bucketChanges.set(key, change);
 
+	oldestBucket = std::min(oldestBucket, bucket);
+	newestBucket = std::max(newestBucket, bucket);
+}
+
+void Attributes::clearDirty()
+{
 	for (auto& change : changeIndex)
 	{
 		const auto attrPair = columnIndex.get({ change.first.column, change.first.value });
@@ -101,51 +171,64 @@ void Attributes::clearDirty()
 		if (!attrPair || !attrPair->second)
 			continue;
 
-		const auto attr = attrPair->second;
+		// second is the tail pointer for our changes, update the Attr
+		// pointer directly in the index
+		attrPair->second = applyChanges(attrPair->second, change.second);
+	}
+	changeIndex.clear();
 
-		bits.mount(attr->index, attr->ints, attr->linId);
+	for (auto& change : bucketChanges)
+	{
+		const auto attrPair = bucketIndex.get(change.first);
 
-		auto t = change.second; // second is the tail pointer for our changes
+		if (!attrPair || !attrPair->second)
+			continue;
 
-		while (t)
-		{
-			if (t->state)
-				bits.bitSet(t->linId);
-			else
-				bits.bitClear(t->linId);
-			const auto prev = t->prev;
-			PoolMem::getPool().freePtr(t);
-			t = prev;
-		}
+		attrPair->second = applyChanges(attrPair->second, change.second);
+	}
+	bucketChanges.clear();
+}
 
-		int64_t compBytes = 0; // OUT value via reference
-		int32_t linId;
+void Attributes::cullBuckets(const int64_t bucket)
+{
+	if (bucket <= cullBucket)
+		return;
 
-		// compress the data, get it back in a pool ptr
-		const auto compData = bits.store(compBytes, linId);
-		const auto destAttr = recast<Attr_s*>(PoolMem::getPool().getPtr(sizeof(Attr_s) + compBytes));
+	cullBucket = bucket;
 
-		// copy header
-		memcpy(destAttr, attr, sizeof(Attr_s));
-		if (compData)
+	if (oldestBucket >= bucket)
+		return;
+
+	for (auto iter = bucketIndex.begin(); iter != bucketIndex.end();)
+	{
+		if (iter->first.bucket < bucket)
 		{
-			memcpy(destAttr->index, compData, compBytes);
-			// return work buffer from bits.store to the pool
-			PoolMem::getPool().freePtr(compData);
+			PoolMem::getPool().freePtr(iter->second);
+			iter = bucketIndex.erase(iter);
 		}
+		else
+			++iter;
+	}
 
-		destAttr->ints = bits.ints;//(isList) ? 0 : bits.ints;
-		destAttr->comp = compBytes;
-		destAttr->linId = linId;
+	oldestBucket = bucket;
+}
 
-		// if we made a new destination, we have to update the 
-		// index to point to it, and free the old one up.
-		// update the Attr pointer directly in the index
-		attrPair->second = destAttr;
-		PoolMem::getPool().freePtr(attr);
+void Attributes::getBucketBits(const int32_t column, const int64_t value, int64_t fromBucket, int64_t toBucket, IndexBits& bits) const
+{
+	fromBucket = std::max(fromBucket, oldestBucket);
+	toBucket = std::min(toBucket, newestBucket);
+
+	for (auto bucket = fromBucket; bucket <= toBucket; ++bucket)
+	{
+		const auto attrPair = bucketIndex.get({ column, value, bucket });
+
+		if (!attrPair)
+			continue;
 
+		const auto layer = attrPair->second->getBits();
+		bits.opOr(*layer);
+		delete layer;
 	}
-	changeIndex.clear();
 }
 
 void Attributes::swap(const int32_t column, const int64_t value, IndexBits* newBits) const
@@ -307,6 +390,39 @@ void Attributes::serialize(HeapStack* mem)
 			blockHeader->textSize +
 			blockHeader->compSize;
 	}
+
+	serializeBuckets(mem);
+}
+
+void Attributes::serializeBuckets(HeapStack* mem)
+{
+	// block type, then the length of the section, then the cull point
+	*recast<serializedBlockType_e*>(mem->newPtr(sizeof(int64_t))) = serializedBlockType_e::attributeBuckets;
+
+	const auto sectionLength = recast<int64_t*>(mem->newPtr(sizeof(int64_t)));
+	(*sectionLength) = sizeof(int64_t);
+
+	*recast<int64_t*>(mem->newPtr(sizeof(int64_t))) = cullBucket;
+
+	for (auto& kv : bucketIndex)
+	{
+		const auto blockHeader = recast<serializedBucket_s*>(mem->newPtr(sizeof(serializedBucket_s)));
+
+		blockHeader->column = kv.first.column;
+		blockHeader->hashValue = kv.first.value;
+		blockHeader->bucket = kv.first.bucket;
+		blockHeader->ints = kv.second->ints;
+		blockHeader->linId = kv.second->linId;
+		blockHeader->compSize = kv.second->comp;
+
+		if (blockHeader->compSize)
+		{
+			const auto blockData = recast<char*>(mem->newPtr(blockHeader->compSize));
+			memcpy(blockData, kv.second->index, blockHeader->compSize);
+		}
+
+		(*sectionLength) += sizeof(serializedBucket_s) + blockHeader->compSize;
+	}
 }
 
 int64_t Attributes::deserialize(char* mem)
@@ -320,13 +436,10 @@ int64_t Attributes::deserialize(char* mem)
 
 	const auto blockSize = *recast<int64_t*>(read);
 
+	read += sizeof(int64_t);
+
 	if (blockSize == 0)
-	{
 		Logger::get().info("no attributes to deserialize for partition " + to_string(partition));
-		return 16;
-	}
-
-	read += sizeof(int64_t);
 
 	// end is the length of the block after the 16 bytes of header
 	const auto end = read + blockSize;
@@ -363,5 +476,47 @@ int64_t Attributes::deserialize(char* mem)
 		read += blockLength;
 	}
 
+	return blockSize + 16 + deserializeBuckets(end);
+}
+
+int64_t Attributes::deserializeBuckets(char* mem)
+{
+	auto read = mem;
+
+	// older nodes don't send bucketed layers
+	if (*recast<serializedBlockType_e*>(read) != serializedBlockType_e::attributeBuckets)
+		return 0;
+
+	read += sizeof(int64_t);
+
+	const auto blockSize = *recast<int64_t*>(read);
+	read += sizeof(int64_t);
+
+	const auto end = read + blockSize;
+
+	cullBucket = *recast<int64_t*>(read);
+	read += sizeof(int64_t);
+
+	while (read < end)
+	{
+		const auto blockHeader = recast<serializedBucket_s*>(read);
+		const auto dataPtr = read + sizeof(serializedBucket_s);
+
+		const auto attr = recast<Attr_s*>(PoolMem::getPool().getPtr(sizeof(Attr_s) + blockHeader->compSize));
+		attr->text = nullptr;
+		attr->ints = blockHeader->ints;
+		attr->comp = blockHeader->compSize;
+		attr->linId = blockHeader->linId;
+
+		memcpy(attr->index, dataPtr, blockHeader->compSize);
+
+		bucketIndex.set({ blockHeader->column, blockHeader->hashValue, blockHeader->bucket }, attr);
+
+		oldestBucket = std::min(oldestBucket, blockHeader->bucket);
+		newestBucket = std::max(newestBucket, blockHeader->bucket);
+
+		read += sizeof(serializedBucket_s) + blockHeader->compSize;
+	}
+
 	return blockSize + 16;
 }
\ No newline at end of file
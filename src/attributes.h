@@ -2,7 +2,8 @@
 
 #include <vector>
 #include <unordered_set>
-#include "mem/bigring.h"
+#include <limits>
+#include "mem/flatmap.h"
 #include "heapstack/heapstack.h"
 
 #include "dbtypes.h"
@@ -102,8 +103,21 @@ namespace openset::db
 			int32_t textSize;
 			int32_t compSize;
 		};
+
+		struct serializedBucket_s
+		{
+			int32_t column;
+			int64_t hashValue;
+			int64_t bucket;
+			int32_t ints;
+			int32_t linId; // the only person when compSize is 0
+			int32_t compSize;
+		};
 #pragma pack(pop)
 
+		void serializeBuckets(HeapStack* mem);
+		int64_t deserializeBuckets(char* mem);
+
 	public:
 
 		enum class listMode_e : int32_t
@@ -121,13 +135,26 @@ namespace openset::db
     	using AttrList = vector<Attr_s*>;
 
 		// value and attribute info
-		using ColumnIndex = bigRing<attr_key_s, Attr_s*>;
+		using ColumnIndex = flatMap<attr_key_s, Attr_s*>;
 		using ChangeIndex = bigRing<attr_key_s, Attr_changes_s*>;
 		using AttrPair = pair<attr_key_s, Attr_s*>;
 
 		ColumnIndex columnIndex{ ringHint_e::lt_1_million };
 		ChangeIndex changeIndex{ ringHint_e::lt_compact };
-		
+
+		/* Time bucketed layers - the same bits as columnIndex but only for
+		 * people with a row holding the value within a bucket of time (see
+		 * Table::indexBucket). Only kept for `action` and bucketed columns.
+		 */
+		using BucketIndex = flatMap<attr_bucket_key_s, Attr_s*>;
+		using BucketChangeIndex = bigRing<attr_bucket_key_s, Attr_changes_s*>;
+
+		BucketIndex bucketIndex{ ringHint_e::lt_compact };
+		BucketChangeIndex bucketChanges{ ringHint_e::lt_compact };
+
+		int64_t oldestBucket{ std::numeric_limits<int64_t>::max() };
+		int64_t newestBucket{ std::numeric_limits<int64_t>::min() };
+		int64_t cullBucket{ std::numeric_limits<int64_t>::min() }; // buckets before this have been dropped
 
 		AttributeBlob* blob;
 		Columns* columns;
@@ -145,8 +172,15 @@ namespace openset::db
 		Attr_s* get(const int32_t column, const string value) const;
 
 		void setDirty(const int32_t linId, const int32_t column, const int64_t value);
+		void setDirty(const int32_t linId, const int32_t column, const int64_t value, const int64_t bucket);
 		void clearDirty();
 
+		// drops bucketed layers older than `bucket`
+		void cullBuckets(const int64_t bucket);
+
+		// ORs the layers for `value` from `fromBucket` to `toBucket` (inclusive) into `bits`
+		void getBucketBits(const int32_t column, const int64_t value, int64_t fromBucket, int64_t toBucket, IndexBits& bits) const;
+
 		// replace an indexes bits with new ones, used when generating segments
 		void swap(const int32_t column, const int64_t value, IndexBits* newBits) const;
 
@@ -51,7 +51,8 @@ void Columns::setColumn(
     const string name, 
     const columnTypes_e type, 
     const bool isSet, 
-    const bool deleted)
+    const bool deleted,
+    const bool bucketed)
 {
 	csLock _lck(lock);
 
@@ -73,6 +74,7 @@ void Columns::setColumn(
 	columns[index].type = type;
 	columns[index].isProp = isSet;
 	columns[index].deleted = deleted;
+	columns[index].bucketed = bucketed;
 
 	columnCount = 0;
 	for (auto c : columns)
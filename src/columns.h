@@ -32,6 +32,7 @@ namespace openset
 				columnTypes_e type{ columnTypes_e::freeColumn };
 				bool isProp{false};
 				bool deleted{ false };
+				bool bucketed{ false }; // has time bucketed index layers (see Table::indexBucket)
 			};
 
 			// shared lock (uses spin locks)
@@ -61,7 +62,8 @@ namespace openset
                 const string name, 
                 const columnTypes_e type, 
                 const bool isSet, 
-                const bool deleted = false);
+                const bool deleted = false,
+                const bool bucketed = false);
 
             static bool validColumnName(std::string name);
 
@@ -22,7 +22,8 @@ const int32_t MAXCOLUMNS = 4096;
 enum class serializedBlockType_e : int64_t
 {
 	attributes = 1,
-	people = 2
+	people = 2,
+	attributeBuckets = 3
 };
 
 /*
@@ -26,6 +26,7 @@ namespace openset
 			std::string hostExternal = "127.0.0.1";
 			int portExternal = 8080;
 			std::string path = "./";
+			int64_t retainMB = 64; // free HeapStack blocks kept for reuse
 
 			void fix()
 			{
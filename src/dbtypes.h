@@ -109,6 +109,26 @@ namespace openset
 			}
 
 		};
+
+		// key type used by the time bucketed layers in Attributes
+		struct attr_bucket_key_s
+		{
+			int32_t column;
+			int64_t value;
+			int64_t bucket; // stamp / Table::indexBucket
+
+			bool operator==(const attr_bucket_key_s& other) const
+			{
+				return (column == other.column
+					&& value == other.value
+					&& bucket == other.bucket);
+			}
+
+			bool operator!=(const attr_bucket_key_s& other) const
+			{
+				return !(*this == other);
+			}
+		};
 #pragma pack(pop)
 	};
 };
@@ -123,4 +143,13 @@ namespace std
 			return (uint64_t(x.column) << 32) + x.value;
 		}
 	};
+
+	template <>
+	struct hash<openset::db::attr_bucket_key_s>
+	{
+		size_t operator()(const openset::db::attr_bucket_key_s& x) const
+		{
+			return (uint64_t(x.column) << 32) + x.value + x.bucket * 0x9E3779B97F4A7C15ULL;
+		}
+	};
 };
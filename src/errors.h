@@ -52,7 +52,8 @@ namespace openset::errors
 		break_depth_to_deep,
 		partition_migrated,
 		route_error,
-        item_not_found
+        item_not_found,
+		deadline_exceeded
 	};
 };
 
@@ -119,7 +120,8 @@ namespace openset::errors
 		{ errorCode_e::break_depth_to_deep, "break ## to deep for current nest level"},
 		{ errorCode_e::partition_migrated, "parition migrated. Task could not be completed."},
 		{ errorCode_e::route_error, "route not found (node down?)"},
-        { errorCode_e::item_not_found, "item not found"}	
+        { errorCode_e::item_not_found, "item not found"},
+		{ errorCode_e::deadline_exceeded, "deadline exceeded. Task did not complete in the time allowed."}
 	};
 
 	class Error
@@ -1,4 +1,7 @@
 #include "grid.h"
+
+#include <algorithm>
+
 #include "table.h"
 #include "lz4.h"
 #include "time/epoch.h"
@@ -6,6 +9,54 @@
 
 using namespace openset::db;
 
+namespace
+{
+	// finds an action in a directory built by Grid::buildDirectory
+	const ActionDir_s* findAction(const char* directory, const int64_t action)
+	{
+		const auto actionCount = *reinterpret_cast<const int32_t*>(directory);
+		const auto first = reinterpret_cast<const ActionDir_s*>(directory + sizeof(int32_t));
+		const auto last = first + actionCount;
+
+		const auto iter = std::lower_bound(first, last, action, [](const ActionDir_s& entry, const int64_t value) {
+			return entry.action < value;
+		});
+
+		return (iter != last && iter->action == action) ? iter : nullptr;
+	}
+
+	const int32_t* directoryRows(const char* directory)
+	{
+		const auto actionCount = *reinterpret_cast<const int32_t*>(directory);
+		return reinterpret_cast<const int32_t*>(directory + sizeof(int32_t) + actionCount * sizeof(ActionDir_s));
+	}
+}
+
+bool PersonData_s::mayHold(const vector<int64_t>& actions, const int64_t from, const int64_t to)
+{
+	if (!eventCount || lastStamp < from || firstStamp > to)
+		return false;
+
+	if (actions.empty())
+		return true;
+
+	const auto directory = getDirectory();
+
+	for (const auto action : actions)
+	{
+		const auto bits = actionBloomBits(action);
+
+		if ((actionBloom & bits) != bits)
+			continue;
+
+		// the bloom filter can't rule this action out, the directory is exact
+		if (!directory || findAction(directory, action))
+			return true;
+	}
+
+	return false;
+}
+
 Grid::Grid()
 {
 	memset(columnMap, 0, sizeof(columnMap)); // all zeros
@@ -21,6 +72,9 @@ void Grid::reset()
 	rows.clear(); // release the rows - likely to not free vector internals
 	mem.reset(); // release the memory to the pool - will always leave one page
 	rawData = nullptr;
+	filtered = false;
+	rowsChanged = false;
+	firstChangedRow = INT32_MAX;
 }
 
 void Grid::reinit()
@@ -29,6 +83,7 @@ void Grid::reinit()
 	table = nullptr;
 	blob = nullptr;
 	attributes = nullptr;
+	actionFilter = nullptr;
 	memset(columnMap, 0, sizeof(columnMap)); // all zeros
 	memset(isSet, 0, sizeof(isSet)); // all false
 }
@@ -549,12 +604,37 @@ void Grid::prepare()
 	if (!rawData || !rawData->bytes || !columnCount)
 		return;
 
+	// rows holding the filtered actions (sessions are counted over every
+	// row, so those are always expanded in full)
+	candidates.clear();
+
+	if (actionFilter && rawData->dirBytes && sessionColumn == -1)
+	{
+		const auto directory = rawData->getDirectory();
+		const auto rowList = directoryRows(directory);
+
+		for (const auto action : *actionFilter)
+			if (const auto entry = findAction(directory, action); entry)
+				for (auto i = 0; i < entry->count; ++i)
+					candidates.emplace_back(rowList[entry->first + i], action);
+
+		sort(candidates.begin(), candidates.end());
+		candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+	}
+
+	// nothing to filter on, expand the lot
+	filtered = candidates.size() != 0;
+
 	const auto output = cast<char*>(PoolMem::getPool().getPtr(rawData->bytes));
 	LZ4_decompress_fast(rawData->getComp(), output, rawData->bytes);
 
 	// make a blank row
 	auto row = newRow();
 
+	auto rowNumber = 0;
+	auto candidate = candidates.begin();
+	auto skipRow = filtered && candidate->first != 0;
+
 	// read pointer - will increment through the compacted set
 	auto read = output;
 	// end pointer - when we get here we are done
@@ -577,6 +657,28 @@ void Grid::prepare()
 
 		if (cursor->columnNum == -1) // -1 is new row
 		{
+			read += sizeOfCastHeader;
+			++rowNumber;
+
+			if (filtered)
+			{
+				if (skipRow)
+				{
+					skipRow = candidate->first != rowNumber;
+					continue;
+				}
+
+				rows.push_back(row);
+
+				// no more candidates, nothing left worth expanding
+				if (++candidate == candidates.end())
+					break;
+
+				row = newRow();
+				skipRow = candidate->first != rowNumber;
+				continue;
+			}
+
 			if (sessionColumn != -1)
 			{
 				if (row->cols[COL_STAMP] - lastSessionTime > sessionTime)
@@ -587,11 +689,16 @@ void Grid::prepare()
 			
 			rows.push_back(row);
 			row = newRow();
-			read += sizeOfCastHeader;
 			continue;
 
 		} // skip non-mapped columns
 
+		if (skipRow)
+		{
+			read += sizeOfCast;
+			continue;
+		}
+
 		const int32_t gridColumn = reverseMap[cursor->columnNum];
 
 		if (gridColumn < 0 || gridColumn >= columnCount)
@@ -606,6 +713,110 @@ void Grid::prepare()
 	}
 
 	PoolMem::getPool().freePtr(output);
+
+	if (!filtered)
+		return;
+
+	// directory for the rows we kept, renumbered to their position in `rows`
+	filteredDir.clear();
+	filteredRows.clear();
+
+	for (auto i = 0; i < static_cast<int>(candidates.size()); ++i)
+		candidates[i].first = i;
+
+	sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
+		return a.second < b.second || (a.second == b.second && a.first < b.first);
+	});
+
+	for (const auto& c : candidates)
+	{
+		if (filteredDir.empty() || filteredDir.back().action != c.second)
+			filteredDir.push_back(ActionDir_s{ c.second, static_cast<int32_t>(filteredRows.size()), 0 });
+		++filteredDir.back().count;
+		filteredRows.push_back(c.first);
+	}
+}
+
+bool Grid::getActionRows(const int64_t action, const int32_t*& actionRows, int32_t& count) const
+{
+	actionRows = nullptr;
+	count = 0;
+
+	if (!rawData || rowsChanged)
+		return false;
+
+	if (filtered)
+	{
+		const auto iter = std::lower_bound(filteredDir.begin(), filteredDir.end(), action, [](const ActionDir_s& entry, const int64_t value) {
+			return entry.action < value;
+		});
+
+		if (iter != filteredDir.end() && iter->action == action)
+		{
+			actionRows = filteredRows.data() + iter->first;
+			count = iter->count;
+		}
+
+		return true;
+	}
+
+	// records committed before action directories existed have none
+	if (!rawData->dirBytes)
+		return false;
+
+	const auto directory = rawData->getDirectory();
+
+	if (const auto entry = findAction(directory, action); entry)
+	{
+		actionRows = directoryRows(directory) + entry->first;
+		count = entry->count;
+	}
+
+	return true;
+}
+
+char* Grid::buildDirectory(int32_t& dirBytes) const
+{
+	vector<pair<int64_t, int32_t>> actionRows;
+	actionRows.reserve(rows.size());
+
+	for (auto i = 0; i < static_cast<int>(rows.size()); ++i)
+		actionRows.emplace_back(rows[i]->cols[COL_ACTION], i);
+
+	// by action, then row
+	sort(actionRows.begin(), actionRows.end());
+
+	auto actionCount = 0;
+	for (auto i = 0; i < static_cast<int>(actionRows.size()); ++i)
+		if (!i || actionRows[i].first != actionRows[i - 1].first)
+			++actionCount;
+
+	dirBytes = static_cast<int32_t>(
+		sizeof(int32_t) + 
+		actionCount * sizeof(ActionDir_s) + 
+		actionRows.size() * sizeof(int32_t));
+
+	const auto directory = recast<char*>(PoolMem::getPool().getPtr(dirBytes));
+
+	*recast<int32_t*>(directory) = actionCount;
+	auto entry = recast<ActionDir_s*>(directory + sizeof(int32_t)) - 1;
+	auto rowList = recast<int32_t*>(directory + sizeof(int32_t) + actionCount * sizeof(ActionDir_s));
+
+	for (auto i = 0; i < static_cast<int>(actionRows.size()); ++i)
+	{
+		if (!i || actionRows[i].first != actionRows[i - 1].first)
+		{
+			++entry;
+			entry->action = actionRows[i].first;
+			entry->first = i;
+			entry->count = 0;
+		}
+
+		++entry->count;
+		rowList[i] = actionRows[i].second;
+	}
+
+	return directory;
 }
 
 PersonData_s* Grid::addFlag(const flagType_e flagType, const int64_t reference, const int64_t context, const int64_t value)
@@ -654,6 +865,9 @@ PersonData_s* Grid::addFlag(const flagType_e flagType, const int64_t reference,
 	// copy old compressed events
 	if (rawData->comp)
 		memcpy(newPerson->getComp(), rawData->getComp(), static_cast<size_t>(rawData->comp));
+	// copy old action directory
+	if (rawData->dirBytes)
+		memcpy(newPerson->getDirectory(), rawData->getDirectory(), static_cast<size_t>(rawData->dirBytes));
 	
 	PoolMem::getPool().freePtr(newFlags);
 
@@ -670,8 +884,11 @@ PersonData_s* Grid::clearFlag(const flagType_e flagType, const int64_t reference
 	if (!rawData->flagRecords)
 		return rawData;
 
+	// flags are counted, there is no feature_eof record after the last one
+	const auto flagsEnd = rawData->getFlags() + rawData->flagRecords;
+
 	auto found = false;
-	for (auto iter = rawData->getFlags(); iter->flagType != flagType_e::feature_eof; ++iter)
+	for (auto iter = rawData->getFlags(); iter != flagsEnd; ++iter)
 	{
 		if (iter->flagType == flagType && 
 			iter->reference == reference &&
@@ -686,7 +903,7 @@ PersonData_s* Grid::clearFlag(const flagType_e flagType, const int64_t reference
 	const auto newFlags = recast<Flags_s*>(PoolMem::getPool().getPtr(rawData->flagBytes() - sizeof(Flags_s)));
 
 	auto writer = newFlags;
-	for (auto iter = rawData->getFlags(); iter->flagType != flagType_e::feature_eof; ++iter)
+	for (auto iter = rawData->getFlags(); iter != flagsEnd; ++iter)
 	{
 		if (iter->flagType == flagType &&
 			iter->reference == reference &&
@@ -719,6 +936,9 @@ PersonData_s* Grid::clearFlag(const flagType_e flagType, const int64_t reference
 	// copy old compressed events
 	if (rawData->comp)
 		memcpy(newPerson->getComp(), rawData->getComp(), static_cast<size_t>(rawData->comp));
+	// copy old action directory
+	if (rawData->dirBytes)
+		memcpy(newPerson->getDirectory(), rawData->getDirectory(), static_cast<size_t>(rawData->dirBytes));
 
 	PoolMem::getPool().freePtr(newFlags);
 
@@ -730,8 +950,90 @@ PersonData_s* Grid::clearFlag(const flagType_e flagType, const int64_t reference
 	return newPerson;
 }
 
+bool Grid::getFlag(const flagType_e flagType, const int64_t reference, const int64_t context, int64_t& value) const
+{
+	const auto flags = rawData->getFlags();
+
+	for (auto i = 0; i < rawData->flagRecords; ++i)
+		if (flags[i].flagType == flagType &&
+			flags[i].reference == reference &&
+			flags[i].context == context)
+		{
+			value = flags[i].value;
+			return true;
+		}
+
+	return false;
+}
+
+PersonData_s* Grid::setFlag(const flagType_e flagType, const int64_t reference, const int64_t context, const int64_t value)
+{
+	const auto flags = rawData->getFlags();
+
+	for (auto i = 0; i < rawData->flagRecords; ++i)
+		if (flags[i].flagType == flagType &&
+			flags[i].reference == reference &&
+			flags[i].context == context)
+		{
+			flags[i].value = value;
+			return rawData;
+		}
+
+	return addFlag(flagType, reference, context, value);
+}
+
+PersonData_s* Grid::clearFlags(const flagType_e flagType, const int64_t reference)
+{
+	const auto flags = rawData->getFlags();
+
+	auto kept = 0;
+	for (auto i = 0; i < rawData->flagRecords; ++i)
+		if (flags[i].flagType != flagType || flags[i].reference != reference)
+			++kept;
+
+	if (kept == rawData->flagRecords)
+		return rawData;
+
+	const auto newFlagBytes = kept * sizeof(Flags_s);
+	const auto newPerson = recast<PersonData_s*>(
+		PoolMem::getPool().getPtr(rawData->size() - rawData->flagBytes() + newFlagBytes));
+
+	// copy old header
+	memcpy(newPerson, rawData, sizeof(PersonData_s));
+	newPerson->flagRecords = static_cast<int16_t>(kept);
+
+	// copy old id bytes
+	if (rawData->idBytes)
+		memcpy(newPerson->getIdPtr(), rawData->getIdPtr(), static_cast<size_t>(rawData->idBytes));
+	// copy the flags we are keeping
+	auto writer = newPerson->getFlags();
+	for (auto i = 0; i < rawData->flagRecords; ++i)
+		if (flags[i].flagType != flagType || flags[i].reference != reference)
+			*(writer++) = flags[i];
+	// copy old props
+	if (rawData->propBytes)
+		memcpy(newPerson->getProps(), rawData->getProps(), static_cast<size_t>(rawData->propBytes));
+	// copy old compressed events
+	if (rawData->comp)
+		memcpy(newPerson->getComp(), rawData->getComp(), static_cast<size_t>(rawData->comp));
+	// copy old action directory
+	if (rawData->dirBytes)
+		memcpy(newPerson->getDirectory(), rawData->getDirectory(), static_cast<size_t>(rawData->dirBytes));
+
+	// release the original
+	PoolMem::getPool().freePtr(rawData);
+
+	rawData = newPerson;
+
+	return newPerson;
+}
+
 PersonData_s* Grid::commit()
 {
+	// a filtered prepare only expanded some of the rows, committing would lose the rest
+	if (filtered)
+		return rawData;
+
 	if (!rows.size())
 	{
 		cout << "no rows" << endl;
@@ -756,8 +1058,6 @@ PersonData_s* Grid::commit()
 
 	// make an intermediate buffer that is fully uncompresed
 	const auto intermediateBuffer = recast<char*>(PoolMem::getPool().getPtr(bytesNeeded));
-	// copy over header and ID text
-	memcpy(intermediateBuffer, rawData, sizeof(PersonData_s) + rawData->idBytes);
 
 	auto write = intermediateBuffer;
 	Cast_s* cursor;
@@ -796,13 +1096,25 @@ PersonData_s* Grid::commit()
 		maxBytes,
 		2);
 
-	const auto newPersonSize = rawData->size() - oldCompBytes + newCompBytes;
+	int32_t newDirBytes;
+	const auto directory = buildDirectory(newDirBytes);
+
+	const auto newPersonSize = rawData->size() - oldCompBytes - rawData->dirBytes + newCompBytes + newDirBytes;
 	const auto newPerson = recast<PersonData_s*>(PoolMem::getPool().getPtr(newPersonSize));
 
 	// copy old header
 	memcpy(newPerson, rawData, sizeof(PersonData_s));
 	newPerson->comp = newCompBytes; // adjust offsets
 	newPerson->bytes = bytesNeeded;
+	newPerson->dirBytes = newDirBytes;
+
+	// summary
+	newPerson->eventCount = static_cast<int32_t>(rows.size());
+	newPerson->firstStamp = rows.size() ? rows.front()->cols[COL_STAMP] : 0;
+	newPerson->lastStamp = rows.size() ? rows.back()->cols[COL_STAMP] : 0;
+	newPerson->actionBloom = 0;
+	for (auto r : rows)
+		newPerson->actionBloom |= PersonData_s::actionBloomBits(r->cols[COL_ACTION]);
 									
 	// copy old id bytes											 
 	if (rawData->idBytes)
@@ -816,16 +1128,21 @@ PersonData_s* Grid::commit()
 	// copy old compressed events
 	if (newCompBytes)
 		memcpy(newPerson->getComp(), compBuffer, static_cast<size_t>(newCompBytes));
+	// copy NEW action directory
+	memcpy(newPerson->getDirectory(), directory, static_cast<size_t>(newDirBytes));
 
 	// get rid of the intermediate copy
 	PoolMem::getPool().freePtr(intermediateBuffer);
 	PoolMem::getPool().freePtr(compBuffer);
+	PoolMem::getPool().freePtr(directory);
 	
 	// release the original
 	PoolMem::getPool().freePtr(rawData);
 
 	// it probably got longer!
 	rawData = newPerson;
+	rowsChanged = false;
+	firstChangedRow = INT32_MAX;
 	
 	return rawData;
 }
@@ -937,172 +1254,22 @@ Grid::ExpandedRows Grid::iterate_expand(cjson* json) const
 
 void Grid::insert(cjson* rowData)
 {
-	// ensure we have ms on the time stamp
-	const auto stampNode = rowData->xPath("/stamp");
-
-	if (!stampNode)
-		return;
-
-	auto stamp = (stampNode->type() == cjsonType::STR) ?
-		Epoch::ISO8601ToEpoch(stampNode->getString()) :
-		stampNode->getInt();
-
-	stamp = Epoch::fixMilli(stamp);
-
-	if (stamp < 0)
-		return;
-
-	auto action = rowData->xPathString("/action", "");
-	auto attrNode = rowData->xPath("/attr");
-	auto rowCount = rows.size();
-	decltype(newRow()) row = nullptr;
-
-	if (!attrNode || !action.length())
-		return;
-
-	// cull on insert
-	if (rowCount > table->rowCull)
-	{
-		const auto numToErase = rowCount - table->rowCull;
-		rows.erase(rows.begin(), rows.begin() + numToErase);
-		rowCount = rows.size();
-	}
-
-	// move the action into the attrs so it will be integrated into the row set
-	attrNode->set("__action", action);
+	insertBatch({ rowData });
+}
 
+void Grid::expandEvent(cjson* attrNode, const int64_t stamp, Rows& added, vector<attr_bucket_key_s>& dirty)
+{
 	auto columns = table->getColumns();
 
-	auto insertBefore = -1; // where a new row will be inserted if needed
-
-	const auto hashedAction = MakeHash(action);
-	const auto insertRowGroup = HashPair(stamp, hashedAction); //MakeHash(recast<const char*>(&pkValues.front()), 8 * pkValues.size());
-
-	const auto zOrderInts = table->getZOrderInts();
-
-	auto getZOrder = [zOrderInts](int64_t value) -> int {
-		auto iter = zOrderInts->find(value);
-
-		if (iter != zOrderInts->end())
-			return (*iter).second;
-
-		return 99;
-	};
-
-	auto insertZOrder = getZOrder(hashedAction);
-
-	auto findInsert = [&]() -> int {
-		int first = 0;
-		int last = static_cast<int>(rowCount - 1);
-		int mid = last >> 1;
-
-		while (first <= last)
-		{
-			if (stamp > rows[mid]->cols[COL_STAMP])
-				first = mid + 1; // search bottom of list
-			else if (stamp < rows[mid]->cols[COL_STAMP])
-				last = mid - 1; // search top of list
-			else
-				return mid;
-
-			mid = (first + last) >> 1; // usually written like first + ((last - first) / 2)			
-		}
-
-		return -(first + 1);
-	};
-
-	
-	auto i = rowCount ? findInsert() : 0;
-
-	if (i < 0) // negative value (made positive - 1) is the insert position
-		i = -i - 1;
-
-	if (i != rowCount) // if they are equal skip all this, we are appending
-	{
-		// walk back to the beginning of all rows sharing this time stamp
-		if (rowCount)
-			while (i > 0 && rows[i]->cols[COL_STAMP] == stamp)
-				--i;
-
-		// walk forward to find our insertion point
-		for (; i < rowCount; i++)
-		{
-			// we have found rows with same stamp
-			if (rows[i]->cols[0] == stamp)
-			{
-				auto zOrder = getZOrder(rows[i]->cols[COL_ACTION]);				
-
-				// we have found rows in this stamp with the same zOrder
-				if (zOrder == insertZOrder)
-				{
-					// look this date range and zorder to see if we have a row group
-					// match (as in, we are replacing a row)
-					for (; i < rowCount; i++)
-					{
-						auto rowGroup = HashPair(rows[i]->cols[COL_STAMP], rows[i]->cols[COL_ACTION]);
-						zOrder = getZOrder(rows[i]->cols[COL_ACTION]);
-
-						// we have moved passed replacable rows, so insert here
-						if (rows[i]->cols[COL_STAMP] > stamp ||
-							zOrder > insertZOrder ||
-							rowGroup > insertRowGroup)
-						{
-							insertBefore = i;
-							break;
-						}
-
-						// we have a matching row, we will replace this
-						if (rowGroup == insertRowGroup)
-						{
-							row = rows[i];
-							insertBefore = i;
-							break;
-						}
-					}				
-					break;
-				}
-
-				if (zOrder > insertZOrder)
-				{
-					row = rows[i];
-					insertBefore = i;
-					break;
-				}
-
-			}
-			else if (rows[i]->cols[COL_STAMP] > stamp)
-			{
-				insertBefore = i;
-				break;
-			}
-		}
-	}
-
-
-	if (row) // delete the rows that matched, we will be replacing them
-	{
-		for (auto iter = rows.begin() + insertBefore; iter != rows.end();)
-		{
-			const auto rowGroup =HashPair((*iter)->cols[COL_STAMP], (*iter)->cols[COL_ACTION]);
-
-			// if stamp changes we are done scanning this row group
-			if ((*iter)->cols[0] != stamp)
-				break;
-
-			if ((*iter)->cols[COL_STAMP] == stamp &&
-				rowGroup == insertRowGroup)
-				iter = rows.erase(iter);
-			else
-				++iter;
-		}
-	}
+	// time bucketed index layer this row lands in
+	const auto bucket = table->indexBucket ? stamp / table->indexBucket : NONE;
 
 	auto expandedSet = iterate_expand(attrNode);
 
 	for (auto& r: expandedSet) // rows in set
 	{
 		auto fillCount = 0;
-		row = newRow();
+		const auto row = newRow();
 
 		for (auto& c: r) // columns in row
 		{			
@@ -1115,7 +1282,7 @@ void Grid::insert(cjson* rowData)
 				fillCount++;
 
 				auto attrInfo = attributes->getMake(schemaCol, NONE);
-				attributes->setDirty(this->rawData->linId, schemaCol, NONE);
+				dirty.push_back({ schemaCol, NONE, NONE });
 				
 				auto val = NONE;
 
@@ -1146,7 +1313,7 @@ void Grid::insert(cjson* rowData)
 						default:
 							break;
 					}					
-					attributes->setDirty(this->rawData->linId, schemaCol, val);
+					dirty.push_back({ schemaCol, val, NONE });
 					break;
 				case cjsonType::DBL:
 					switch (colInfo->type)
@@ -1173,7 +1340,7 @@ void Grid::insert(cjson* rowData)
 						default:
 							break;
 					}					
-					attributes->setDirty(this->rawData->linId, schemaCol, val);
+					dirty.push_back({ schemaCol, val, NONE });
 					break;
 				case cjsonType::STR:
 					switch (colInfo->type)
@@ -1195,7 +1362,7 @@ void Grid::insert(cjson* rowData)
 					default:
 						break;
 					}
-					attributes->setDirty(this->rawData->linId, schemaCol, val);
+					dirty.push_back({ schemaCol, val, NONE });
 					break;
 				case cjsonType::BOOL:
 					switch (colInfo->type)
@@ -1224,7 +1391,7 @@ void Grid::insert(cjson* rowData)
 					}
 
 					// attrInfo = attributes->getMake(schemaCol, val);
-					attributes->setDirty(this->rawData->linId, schemaCol, val);
+					dirty.push_back({ schemaCol, val, NONE });
 					break;
 
 				default:
@@ -1232,6 +1399,9 @@ void Grid::insert(cjson* rowData)
 					break;
 				}
 
+				if (bucket != NONE && val != NONE && (schemaCol == COL_ACTION || colInfo->bucketed))
+					dirty.push_back({ schemaCol, val, bucket });
+
 				row->cols[col] = val;
 			}
 			else
@@ -1244,16 +1414,181 @@ void Grid::insert(cjson* rowData)
 		if (fillCount)
 		{
 			row->cols[0] = stamp;
+			added.push_back(row);
+		}
+	}
+}
 
-			// action is injected into the attrs section so it will be indexed
+void Grid::insertBatch(const vector<cjson*>& rowData)
+{
+	struct event_s
+	{
+		int64_t stamp;
+		int zOrder;
+		int64_t rowGroup;
+		int first; // rows in `added`
+		int count;
+	};
 
-			if (insertBefore == -1) // no insertion found so append
-				rows.push_back(row);
-			else // insert before 
+	const auto zOrderInts = table->getZOrderInts();
+
+	auto getZOrder = [zOrderInts](int64_t value) -> int {
+		auto iter = zOrderInts->find(value);
+
+		if (iter != zOrderInts->end())
+			return (*iter).second;
+
+		return 99;
+	};
+
+	vector<event_s> events;
+	events.reserve(rowData.size());
+
+	Rows added;
+	vector<attr_bucket_key_s> dirty;
+
+	for (const auto json : rowData)
+	{
+		// ensure we have ms on the time stamp
+		const auto stampNode = json->xPath("/stamp");
+
+		if (!stampNode)
+			continue;
+
+		auto stamp = (stampNode->type() == cjsonType::STR) ?
+			Epoch::ISO8601ToEpoch(stampNode->getString()) :
+			stampNode->getInt();
+
+		stamp = Epoch::fixMilli(stamp);
+
+		if (stamp < 0)
+			continue;
+
+		const auto action = json->xPathString("/action", "");
+		const auto attrNode = json->xPath("/attr");
+
+		if (!attrNode || !action.length())
+			continue;
+
+		// move the action into the attrs so it will be integrated into the row set
+		attrNode->set("__action", action);
+
+		const auto hashedAction = MakeHash(action);
+		const auto first = static_cast<int>(added.size());
+
+		expandEvent(attrNode, stamp, added, dirty);
+
+		events.push_back({
+			stamp,
+			getZOrder(hashedAction),
+			HashPair(stamp, hashedAction),
+			first,
+			static_cast<int>(added.size()) - first
+		});
+	}
+
+	if (events.empty())
+		return;
+
+	rowsChanged = true;
+
+	/* Rows are ordered by stamp, then z-order, then row group (stamp + action).
+	 * An event replaces any rows already in its row group, so when the batch
+	 * has the same row group more than once the last one wins.
+	 */
+	std::stable_sort(events.begin(), events.end(), [](const event_s& a, const event_s& b) {
+		if (a.stamp != b.stamp)
+			return a.stamp < b.stamp;
+		if (a.zOrder != b.zOrder)
+			return a.zOrder < b.zOrder;
+		return a.rowGroup < b.rowGroup;
+	});
+
+	auto last = events.begin();
+	for (auto iter = events.begin() + 1; iter != events.end(); ++iter)
+	{
+		if (iter->stamp == last->stamp && iter->rowGroup == last->rowGroup)
+			*last = *iter;
+		else
+			*(++last) = *iter;
+	}
+	events.erase(last + 1, events.end());
+
+	// rows before the earliest event stay where they are, the rest are
+	// merged with the batch in one pass
+	const auto start = std::lower_bound(
+		rows.begin(),
+		rows.end(),
+		events.front().stamp,
+		[](const Col_s* row, const int64_t stamp) { return row->cols[COL_STAMP] < stamp; }) - rows.begin();
+
+	const Rows tail(rows.begin() + start, rows.end());
+	rows.resize(start);
+	rows.reserve(start + tail.size() + added.size());
+
+	auto changedAt = INT32_MAX;
+	size_t t = 0;
+
+	for (const auto& e : events)
+	{
+		// existing rows that sort before this event
+		for (; t < tail.size(); ++t)
+		{
+			const auto stamp = tail[t]->cols[COL_STAMP];
+
+			if (stamp > e.stamp)
+				break;
+
+			if (stamp == e.stamp)
 			{
-				rows.insert(rows.begin() + insertBefore, row);
+				const auto zOrder = getZOrder(tail[t]->cols[COL_ACTION]);
+
+				if (zOrder > e.zOrder ||
+					(zOrder == e.zOrder && HashPair(stamp, tail[t]->cols[COL_ACTION]) >= e.rowGroup))
+					break;
 			}
+
+			rows.push_back(tail[t]);
 		}
+
+		changedAt = std::min(changedAt, static_cast<int32_t>(rows.size()));
+
+		// drop the rows this event replaces
+		while (t < tail.size() &&
+			tail[t]->cols[COL_STAMP] == e.stamp &&
+			HashPair(e.stamp, tail[t]->cols[COL_ACTION]) == e.rowGroup)
+			++t;
+
+		rows.insert(rows.end(), added.begin() + e.first, added.begin() + e.first + e.count);
+	}
+
+	rows.insert(rows.end(), tail.begin() + t, tail.end());
+
+	// cull once for the whole batch
+	if (rows.size() > static_cast<size_t>(table->rowCull))
+	{
+		rows.erase(rows.begin(), rows.begin() + (rows.size() - table->rowCull));
+		changedAt = 0;
+	}
+
+	firstChangedRow = std::min(firstChangedRow, changedAt);
+
+	// each attribute is marked once per batch rather than once per value
+	std::sort(dirty.begin(), dirty.end(), [](const attr_bucket_key_s& a, const attr_bucket_key_s& b) {
+		if (a.column != b.column)
+			return a.column < b.column;
+		if (a.value != b.value)
+			return a.value < b.value;
+		return a.bucket < b.bucket;
+	});
+	dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+
+	for (const auto& d : dirty)
+	{
+		if (d.bucket == NONE)
+			attributes->setDirty(this->rawData->linId, d.column, d.value);
+		else
+			attributes->setDirty(this->rawData->linId, d.column, d.value, d.bucket);
 	}
 }
 
@@ -6,6 +6,7 @@
 #include <cstring>
 
 #include "common.h"
+#include "dbtypes.h"
 #include "cjson/cjson.h"
 
 namespace openset
@@ -46,6 +47,7 @@ namespace openset
 			feature_eof = 0, // end of list
 			feature_trigger = 1, // trigger
 			future_trigger = 2, // scheduled trigger
+			trigger_checkpoint = 3, // where an incremental trigger left off (see Trigger::checkpoint)
 		};
 
 		struct Flags_s // 26 bytes.
@@ -74,6 +76,22 @@ namespace openset
 			// to cast and check the buffer. 
 		};
 
+		/**
+		The action directory lists the rows holding each action, it lets
+		`match where action is ...` jump straight to candidate rows and lets
+		prepare skip expanding rows a query can never look at.
+
+		  int32_t actionCount
+		  ActionDir_s[actionCount] (sorted by action)
+		  int32_t rows[] (row numbers, ascending within each action)
+		*/
+		struct ActionDir_s // 16 bytes
+		{
+			int64_t action; // hashed action
+			int32_t first; // offset of the first row number for this action
+			int32_t count; // rows with this action
+		};
+
 		struct PersonData_s
 		{
 			/*
@@ -88,14 +106,23 @@ namespace openset
 			*  props
 			*  ------------
 			*  compressed event rows
+			*  ------------
+			*  action directory (see ActionDir_s)
 			*
 			*/
 
 			int64_t id;
+			// summary of the events, kept uncompressed so people can be ruled
+			// out of a query without expanding them (see Grid::commit)
+			int64_t firstStamp;
+			int64_t lastStamp;
+			uint64_t actionBloom; // two bits per action (see actionBloomBits)
+			int32_t eventCount; // rows
 			int32_t linId;
 			int32_t bytes; // bytes when uncompressed
 			int32_t comp; // bytes when compressed
 			int32_t propBytes;
+			int32_t dirBytes; // bytes in action directory
 			int16_t idBytes; // number of bytes in id string
 			int16_t flagRecords; // number of flag records
 			char events[1]; // char* (1st byte) of packed event struct
@@ -125,7 +152,7 @@ namespace openset
 
 			int64_t size() const
 			{
-				return sizeof(PersonData_s) + comp + propBytes + idBytes + flagBytes();
+				return sizeof(PersonData_s) + comp + dirBytes + propBytes + idBytes + flagBytes();
 			}
 
 			Flags_s* getFlags() 
@@ -151,6 +178,26 @@ namespace openset
 			{
 				return events + idBytes + flagBytes() + propBytes;
 			}
+
+			char* getDirectory()
+			{
+				if (!dirBytes)
+					return nullptr;
+				return events + idBytes + flagBytes() + propBytes + comp;
+			}
+
+			static uint64_t actionBloomBits(const int64_t action)
+			{
+				return (1ULL << (action & 63)) | (1ULL << ((action >> 6) & 63));
+			}
+
+			/**
+			* \brief could any row hold one of `actions` (any action if empty)
+			* with a stamp from `from` to `to` (inclusive)
+			*
+			* False means no row can, true means one might.
+			*/
+			bool mayHold(const vector<int64_t>& actions, const int64_t from, const int64_t to);
 		};
 
 		struct Col_s
@@ -191,6 +238,16 @@ namespace openset
 			Rows rows;
 			PersonData_s* rawData{ nullptr };
 
+			// action directory for rows expanded by a filtered prepare (row
+			// numbers in the directory stored with the person are for all rows)
+			const vector<int64_t>* actionFilter{ nullptr };
+			vector<pair<int32_t, int64_t>> candidates;
+			vector<ActionDir_s> filteredDir;
+			vector<int32_t> filteredRows;
+			bool filtered{ false };
+			bool rowsChanged{ false }; // inserted since prepare, the directory no longer matches
+			int32_t firstChangedRow{ INT32_MAX }; // lowest row inserted, replaced or culled since mount
+
 			int32_t columnCount{ 0 };
 			int32_t uuidColumn{ -1 }; // auto mapped in prepare
 			int32_t sessionColumn{ -1 };
@@ -230,10 +287,51 @@ namespace openset
 			void mount(PersonData_s* personData);
 			void prepare();
 			void insert(cjson* rowData);
+			/**
+			* \brief insert a person's events in one pass
+			*
+			* The events are sorted and merged with the rows after the earliest
+			* of them, rows are culled once and each attribute is marked dirty
+			* once, rather than per event.
+			*/
+			void insertBatch(const vector<cjson*>& rowData);
+
+			/**
+			* \brief only expand rows holding one of these actions in prepare
+			*
+			* Used for queries that can never look at any other row (see
+			* Macro_s::prepareActions). People without an action directory, or
+			* without any of these actions, are expanded in full. Pass nullptr
+			* to expand everything again.
+			*/
+			void setActionFilter(const vector<int64_t>* actions)
+			{
+				actionFilter = (actions && actions->size()) ? actions : nullptr;
+			}
+
+			/**
+			* \brief rows (positions in getRows) holding `action`
+			*
+			* \return false if there is no usable action directory, in which
+			*         case every row must be scanned.
+			*/
+			bool getActionRows(const int64_t action, const int32_t*& actionRows, int32_t& count) const;
 
 			PersonData_s* addFlag(const flagType_e flagType, const int64_t reference, const int64_t context, const int64_t value);
 			PersonData_s* clearFlag(const flagType_e flagType, const  int64_t reference, const int64_t context);
 
+			// false if there is no such flag
+			bool getFlag(const flagType_e flagType, const int64_t reference, const int64_t context, int64_t& value) const;
+			// updates the flag in place if it exists, otherwise adds it
+			PersonData_s* setFlag(const flagType_e flagType, const int64_t reference, const int64_t context, const int64_t value);
+			// removes every flag of this type for reference
+			PersonData_s* clearFlags(const flagType_e flagType, const int64_t reference);
+
+			int32_t getFirstChangedRow() const
+			{
+				return firstChangedRow;
+			}
+
 			/**
 			* \brief re-encodes and compresses the row data after inserts
 			*/
@@ -266,6 +364,12 @@ namespace openset
 				return rawData->linId;
 			}
 
+			// the record being worked on, adding or clearing flags moves it
+			inline PersonData_s* getMeta() const
+			{
+				return rawData;
+			}
+
 			inline bool isFullSchema() const
 			{
 				return fullSchemaMap;
@@ -304,6 +408,13 @@ namespace openset
 			*/
 			ExpandedRows iterate_expand(cjson* json) const;
 
+			// expands one event's attr node into rows (appended to `added`), the
+			// attributes it sets go in `dirty` with bucket NONE for the unbucketed layer
+			void expandEvent(cjson* attrNode, const int64_t stamp, Rows& added, vector<attr_bucket_key_s>& dirty);
+
+			// builds the action directory for the current rows into a PoolMem block
+			char* buildDirectory(int32_t& dirBytes) const;
+
 			// ready object for re-use while maintaining mountings
 			void reset();
 		};
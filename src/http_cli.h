@@ -17,6 +17,7 @@ namespace openset
 namespace openset::web
 {
 	using RestCbJson = std::function<void(const http::StatusCode, const bool, const cjson)>;
+	// the callback owns `data` (a PoolMem buffer, may be nullptr) and must free it
 	using RestCbBin = std::function<void(const http::StatusCode, const bool, char*, const size_t)>;
 	using HttpClient = SimpleWeb::Client<http::HTTP>;
 	using QueryParams = http::CaseInsensitiveMultimap;
@@ -3,6 +3,7 @@
 #include <iostream>
 #include <mutex>
 #include <queue>
+#include <future>
 
 #include "threads/locks.h"
 #include "server_http.hpp"
@@ -10,6 +11,7 @@
 #include "logger.h"
 #include "http_serve.h"
 #include "http_cli.h"
+#include "internodeframe.h"
 #include "rpc.h"
 
 using namespace std::string_literals;
@@ -55,7 +57,43 @@ namespace openset::web
 				response->write(data, length);
 		};
 
-		return make_shared<Message>(request->header, queryParts, request->method, request->path, request->query_string, data, length, reply);
+		// chunked replies hold the response open and write one chunk at a time. Each
+		// chunk waits for the socket write to complete so only one chunk is ever
+		// buffered, this keeps memory bounded when streaming large results.
+		auto headerSent = make_shared<bool>(false);
+
+		auto replyChunk = [request, response, headerSent](http::StatusCode status, const char* data, size_t length)
+		{
+			if (!*headerSent)
+			{
+				http::CaseInsensitiveMultimap header;
+				header.emplace("Transfer-Encoding", "chunked");
+				header.emplace("Content-Type", "application/json");
+				response->write(status, header);
+				*headerSent = true;
+			}
+
+			char sizeLine[32];
+			snprintf(sizeLine, sizeof(sizeLine), "%zx\r\n", length);
+			response->write(sizeLine, strlen(sizeLine));
+
+			if (data && length)
+				response->write(data, length);
+
+			response->write("\r\n", 2);
+
+			std::promise<void> sent;
+			auto sentFuture = sent.get_future();
+
+			response->send([&sent](const SimpleWeb::error_code&)
+			{
+				sent.set_value();
+			});
+
+			sentFuture.wait();
+		};
+
+		return make_shared<Message>(request->header, queryParts, request->method, request->path, request->query_string, data, length, reply, replyChunk);
 	}
 	
 	void webWorker::runner()
@@ -140,7 +178,7 @@ namespace openset::web
 		};
 
 		server.resource["^/ping$"]["GET"] = [&](SharedResponseT response, SharedRequestT request) {
-			response->write("{\"pong\":true}");
+			response->write(openset::comms::RpcInternode::pong());
 		};
 
 		// default
@@ -194,9 +232,22 @@ namespace openset::web
 			server.start(); // blocks
 		});
 
-		// make a client object for our Rest class (http_cli.h)		
-		openset::globals::global_io_service = std::make_shared<asio::io_service>();
-		
+		// io_service for internode sockets (internodeframe.h), framed requests
+		// share the REST workers
+		getInternodeIO();
+
+		std::unique_ptr<FrameServe> frameServer;
+		try
+		{
+			frameServer = std::make_unique<FrameServe>(this, ip, port + InternodePortOffset);
+			Logger::get().info("internode frames listening on "s + ip + ":"s + to_string(port + InternodePortOffset) + "."s);
+		}
+		catch (const std::exception& ex)
+		{
+			// nodes fall back to HTTP when they can't connect here
+			Logger::get().error("internode frames could not listen on port "s + to_string(port + InternodePortOffset) + " ("s + ex.what() + ")."s);
+		}
+
 		Logger::get().info("REST server listening on "s + ip + ":"s + to_string(port) + "."s);
 
 		server_thread.join();
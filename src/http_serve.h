@@ -23,6 +23,8 @@ namespace openset
 namespace openset::web
 {
 	using ReplyCB = std::function<void(const http::StatusCode status, const char*, const size_t)>;
+	// chunked replies - each call sends one chunk, a zero length chunk ends the reply
+	using ReplyChunkCB = std::function<void(const http::StatusCode status, const char*, const size_t)>;
 
 	class Message
 	{
@@ -34,6 +36,7 @@ namespace openset::web
 		char* payload;
 		size_t payloadLength;
 		ReplyCB cb;
+		ReplyChunkCB chunkCb;
 	public:
 		Message(
 			http::CaseInsensitiveMultimap header,
@@ -43,7 +46,8 @@ namespace openset::web
 			const std::string queryString,
 			char* payload,
 			const size_t payloadLength,
-			const ReplyCB cb) :
+			const ReplyCB cb,
+			const ReplyChunkCB chunkCb = nullptr) :
 			header(std::move(header)),
 			query(std::move(query)),
 			method(std::move(method)),
@@ -51,7 +55,8 @@ namespace openset::web
 			queryString(std::move(queryString)),
 			payload(payload),
 			payloadLength(payloadLength),
-			cb(cb)
+			cb(cb),
+			chunkCb(chunkCb)
 		{};
 
 		~Message()
@@ -128,7 +133,7 @@ namespace openset::web
 
 		cjson getJSON() const
 		{
-			cjson json(string{ payload, payloadLength }, payloadLength);
+			cjson json(payload, payloadLength);
 			return std::move(json);
 		}
 
@@ -154,6 +159,23 @@ namespace openset::web
 				cjson::releaseStringifyPtr(buffer);
 			}
 		}
+
+		bool canReplyChunked() const
+		{
+			return chunkCb != nullptr;
+		}
+
+		/* replyChunk - send part of a reply using chunked transfer encoding.
+		 *
+		 * The first call sends the headers, each call blocks until its chunk
+		 * has been written to the socket, so the caller can reuse its buffer.
+		 * Call with a zero length to end the reply.
+		 */
+		void replyChunk(const http::StatusCode status, const char* replyData, const size_t replyLength) const
+		{
+			if (chunkCb)
+				chunkCb(status, replyData, replyLength);
+		}
 	};
 
 	using MessagePtr = const shared_ptr<openset::web::Message>;
@@ -0,0 +1,590 @@
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include "internodeframe.h"
+#include "logger.h"
+#include "sba/sba.h"
+
+using namespace std::string_literals;
+
+namespace
+{
+	void appendString(std::string& out, const std::string& value)
+	{
+		const auto length = static_cast<uint32_t>(value.length());
+		out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+		out.append(value);
+	}
+
+	bool readString(const std::string& in, size_t& offset, std::string& value)
+	{
+		uint32_t length;
+		if (offset + sizeof(length) > in.length())
+			return false;
+
+		memcpy(&length, in.data() + offset, sizeof(length));
+		offset += sizeof(length);
+
+		if (offset + length > in.length())
+			return false;
+
+		value.assign(in.data() + offset, length);
+		offset += length;
+		return true;
+	}
+}
+
+std::string openset::web::encodeRoute(const std::string& method, const std::string& path, const QueryParams& params)
+{
+	std::string route;
+	route.reserve(method.length() + path.length() + 64);
+
+	appendString(route, method);
+	appendString(route, path);
+	appendString(route, std::to_string(params.size()));
+
+	for (const auto& param : params)
+	{
+		appendString(route, param.first);
+		appendString(route, param.second);
+	}
+
+	return route;
+}
+
+bool openset::web::decodeRoute(const std::string& route, std::string& method, std::string& path, QueryParams& params)
+{
+	size_t offset = 0;
+	std::string countText;
+
+	if (!readString(route, offset, method) ||
+		!readString(route, offset, path) ||
+		!readString(route, offset, countText))
+		return false;
+
+	auto count = strtoll(countText.c_str(), nullptr, 10);
+
+	while (count--)
+	{
+		std::string key, value;
+		if (!readString(route, offset, key) || !readString(route, offset, value))
+			return false;
+		params.emplace(std::move(key), std::move(value));
+	}
+
+	return true;
+}
+
+asio::io_service& openset::web::getInternodeIO()
+{
+	static std::once_flag started;
+
+	std::call_once(started, []()
+	{
+		if (!openset::globals::global_io_service)
+			openset::globals::global_io_service = std::make_shared<asio::io_service>();
+
+		auto io = openset::globals::global_io_service;
+
+		std::thread([io]()
+		{
+			// keeps run from returning when there is nothing to do
+			asio::io_service::work work(*io);
+			io->run();
+		}).detach();
+	});
+
+	return *openset::globals::global_io_service;
+}
+
+/*
+ *  SERVER
+ */
+
+namespace openset::web
+{
+	class FrameSession : public std::enable_shared_from_this<FrameSession>
+	{
+		HttpServe* server;
+		asio::ip::tcp::socket socket;
+
+		std::mutex writeLock;
+
+		frameHeader_s header;
+		std::string route;
+		char* payload{ nullptr };
+
+	public:
+
+		FrameSession(HttpServe* server, asio::ip::tcp::socket socket) :
+			server(server),
+			socket(std::move(socket))
+		{}
+
+		~FrameSession()
+		{
+			if (payload)
+				PoolMem::getPool().freePtr(payload);
+		}
+
+		void readHeader()
+		{
+			auto self = shared_from_this();
+
+			asio::async_read(socket, asio::buffer(&header, sizeof(header)),
+				[self](const SimpleWeb::error_code& ec, size_t)
+				{
+					if (ec)
+						return; // closed
+
+					if (self->header.magic != FrameMagic ||
+						self->header.type != frameType_e::request ||
+						self->header.routeLength > FrameMaxRouteLength ||
+						self->header.payloadLength > FrameMaxPayloadLength)
+					{
+						Logger::get().error("internode frame: bad header, closing connection.");
+						SimpleWeb::error_code ignored;
+						self->socket.close(ignored);
+						return;
+					}
+
+					self->readBody();
+				});
+		}
+
+		void readBody()
+		{
+			auto self = shared_from_this();
+
+			route.resize(header.routeLength);
+			payload = header.payloadLength ?
+				static_cast<char*>(PoolMem::getPool().getPtr(header.payloadLength)) :
+				nullptr;
+
+			const std::vector<asio::mutable_buffer> buffers = {
+				asio::buffer(&route[0], route.length()),
+				asio::buffer(payload, header.payloadLength)
+			};
+
+			asio::async_read(socket, buffers,
+				[self](const SimpleWeb::error_code& ec, size_t)
+				{
+					if (ec)
+						return;
+
+					if (self->dispatch())
+						self->readHeader();
+				});
+		}
+
+		bool dispatch()
+		{
+			std::string method;
+			std::string path;
+			QueryParams params;
+
+			const auto requestId = header.requestId;
+			auto self = shared_from_this();
+
+			// a bad route means the stream is out of step, the sender reconnects
+			if (!decodeRoute(route, method, path, params))
+			{
+				Logger::get().error("internode frame: bad route, closing connection.");
+				SimpleWeb::error_code ignored;
+				socket.close(ignored);
+				return false;
+			}
+
+			const auto reply = [self, requestId](const http::StatusCode status, const char* data, const size_t length)
+			{
+				self->writeResponse(requestId, status, data, length);
+			};
+
+			// the payload buffer now belongs to the message
+			server->queueMessage(std::make_shared<Message>(
+				http::CaseInsensitiveMultimap{},
+				params,
+				method,
+				path,
+				""s,
+				payload,
+				static_cast<size_t>(header.payloadLength),
+				reply));
+
+			payload = nullptr;
+			return true;
+		}
+
+		// called from worker threads, returns once the frame is on the wire so the
+		// caller can release `data`
+		void writeResponse(const uint64_t requestId, const http::StatusCode status, const char* data, const size_t length)
+		{
+			frameHeader_s response;
+			response.type = frameType_e::response;
+			response.requestId = requestId;
+			response.status = static_cast<int32_t>(status);
+			response.payloadLength = length;
+
+			std::lock_guard<std::mutex> guard(writeLock);
+
+			std::promise<void> sent;
+			auto sentFuture = sent.get_future();
+			auto self = shared_from_this();
+
+			getInternodeIO().post([self, &response, data, length, &sent]()
+			{
+				const std::vector<asio::const_buffer> buffers = {
+					asio::buffer(&response, sizeof(response)),
+					asio::buffer(data, length)
+				};
+
+				asio::async_write(self->socket, buffers,
+					[&sent](const SimpleWeb::error_code&, size_t)
+					{
+						sent.set_value();
+					});
+			});
+
+			sentFuture.wait();
+		}
+	};
+}
+
+openset::web::FrameServe::FrameServe(HttpServe* server, const std::string& ip, const int port) :
+	server(server),
+	acceptor(getInternodeIO())
+{
+	const asio::ip::tcp::endpoint endpoint(asio::ip::address::from_string(ip), static_cast<unsigned short>(port));
+
+	acceptor.open(endpoint.protocol());
+#ifndef _MSC_VER
+	// lets a restarted node bind past connections in TIME_WAIT, a port that
+	// is still listening fails the bind either way (not so on Windows)
+	acceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+#endif
+	acceptor.bind(endpoint);
+	acceptor.listen();
+
+	accept();
+}
+
+void openset::web::FrameServe::accept()
+{
+	acceptor.async_accept([this](const SimpleWeb::error_code& ec, asio::ip::tcp::socket socket)
+	{
+		if (!ec)
+		{
+			socket.set_option(asio::ip::tcp::no_delay(true));
+			std::make_shared<FrameSession>(server, std::move(socket))->readHeader();
+		}
+
+		accept();
+	});
+}
+
+/*
+ *  CLIENT
+ */
+
+openset::web::FrameClient::FrameClient(std::string host, const int port) :
+	host(std::move(host)),
+	port(port),
+	socket(getInternodeIO())
+{}
+
+bool openset::web::FrameClient::connect()
+{
+	// `lock` is not held while connecting, the handlers (and fail) run on the
+	// io thread and take it
+	std::lock_guard<std::mutex> connecting(connectLock);
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		if (connected)
+			return true;
+
+		if (Now() < retryAfter)
+			return false;
+	}
+
+	SimpleWeb::error_code ec;
+
+	asio::ip::tcp::resolver resolver(getInternodeIO());
+	const auto endpoints = resolver.resolve(host, std::to_string(port), ec);
+
+	const auto retryLater = [this]()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		retryAfter = Now() + FrameRetryDelay;
+	};
+
+	if (ec || endpoints == asio::ip::tcp::resolver::iterator())
+	{
+		retryLater();
+		return false;
+	}
+
+	std::promise<SimpleWeb::error_code> done;
+	auto doneFuture = done.get_future();
+
+	socket.async_connect(*endpoints, [&done](const SimpleWeb::error_code& connectError)
+	{
+		done.set_value(connectError);
+	});
+
+	if (doneFuture.wait_for(std::chrono::milliseconds(FrameConnectTimeout)) != std::future_status::ready)
+	{
+		getInternodeIO().post([self = shared_from_this()]()
+		{
+			SimpleWeb::error_code ignored;
+			self->socket.close(ignored);
+		});
+		doneFuture.wait(); // the handler runs with operation_aborted
+		retryLater();
+		return false;
+	}
+
+	if (doneFuture.get())
+	{
+		SimpleWeb::error_code ignored;
+		socket.close(ignored);
+		retryLater();
+		return false;
+	}
+
+	socket.set_option(asio::ip::tcp::no_delay(true), ec);
+
+	uint64_t connection;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		connection = ++generation;
+		connected = true;
+	}
+
+	getInternodeIO().post([self = shared_from_this(), connection]()
+	{
+		self->readHeader(connection);
+	});
+
+	return true;
+}
+
+void openset::web::FrameClient::readHeader(const uint64_t connection)
+{
+	auto self = shared_from_this();
+
+	asio::async_read(socket, asio::buffer(&header, sizeof(header)),
+		[self, connection](const SimpleWeb::error_code& ec, size_t)
+		{
+			if (ec ||
+				self->header.magic != FrameMagic ||
+				self->header.type != frameType_e::response ||
+				self->header.payloadLength > FrameMaxPayloadLength)
+			{
+				self->fail(connection);
+				return;
+			}
+
+			self->readPayload(connection);
+		});
+}
+
+void openset::web::FrameClient::readPayload(const uint64_t connection)
+{
+	auto self = shared_from_this();
+
+	payload = header.payloadLength ?
+		static_cast<char*>(PoolMem::getPool().getPtr(header.payloadLength)) :
+		nullptr;
+
+	asio::async_read(socket, asio::buffer(payload, header.payloadLength),
+		[self, connection](const SimpleWeb::error_code& ec, size_t)
+		{
+			if (ec)
+			{
+				if (self->payload)
+					PoolMem::getPool().freePtr(self->payload);
+				self->payload = nullptr;
+				self->fail(connection);
+				return;
+			}
+
+			Pending waiting;
+
+			{
+				std::lock_guard<std::mutex> guard(self->lock);
+				if (const auto iter = self->pending.find(self->header.requestId); iter != self->pending.end())
+				{
+					waiting = iter->second;
+					self->pending.erase(iter);
+				}
+			}
+
+			const auto status = static_cast<http::StatusCode>(self->header.status);
+
+			if (waiting)
+				waiting->set_value({
+					status,
+					status != http::StatusCode::success_ok,
+					self->payload,
+					static_cast<size_t>(self->header.payloadLength) });
+			else if (self->payload)
+				PoolMem::getPool().freePtr(self->payload); // nobody waiting (should not happen)
+
+			self->payload = nullptr;
+			self->readHeader(connection);
+		});
+}
+
+void openset::web::FrameClient::fail(const uint64_t connection)
+{
+	std::unordered_map<uint64_t, Pending> failed;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		// a read and a write can both fail on the same connection, and a
+		// late one must not close the connection that replaced it
+		if (connection != generation || !connected)
+			return;
+
+		connected = false;
+		failed.swap(pending);
+
+		SimpleWeb::error_code ignored;
+		socket.close(ignored);
+	}
+
+	for (auto& waiting : failed)
+		waiting.second->set_value({ http::StatusCode::client_error_bad_request, true, nullptr, 0 });
+}
+
+bool openset::web::FrameClient::request(
+	const std::string& method,
+	const std::string& path,
+	const QueryParams& params,
+	const char* payload,
+	const size_t length,
+	const RestCbBin& cb,
+	const int64_t timeout,
+	const std::atomic<bool>* cancelled)
+{
+	if (!connect())
+		return false;
+
+	const auto route = encodeRoute(method, path, params);
+
+	frameHeader_s request;
+	request.type = frameType_e::request;
+	request.routeLength = static_cast<uint32_t>(route.length());
+	request.payloadLength = payload ? length : 0;
+
+	auto waiting = std::make_shared<std::promise<response_s>>();
+	auto responseFuture = waiting->get_future();
+	uint64_t connection;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (!connected)
+			return false;
+		connection = generation;
+		request.requestId = ++nextId;
+		pending.emplace(request.requestId, waiting);
+	}
+
+	SimpleWeb::error_code writeError;
+
+	{
+		std::lock_guard<std::mutex> guard(writeLock);
+
+		std::promise<void> sent;
+		auto sentFuture = sent.get_future();
+		auto self = shared_from_this();
+
+		// written straight from the caller's buffers, we wait for the write so they stay valid
+		getInternodeIO().post([self, &request, &route, payload, &sent, &writeError]()
+		{
+			const std::vector<asio::const_buffer> buffers = {
+				asio::buffer(&request, sizeof(request)),
+				asio::buffer(route),
+				asio::buffer(payload, request.payloadLength)
+			};
+
+			asio::async_write(self->socket, buffers,
+				[&sent, &writeError](const SimpleWeb::error_code& ec, size_t)
+				{
+					writeError = ec;
+					sent.set_value();
+				});
+		});
+
+		sentFuture.wait();
+	}
+
+	if (writeError)
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			pending.erase(request.requestId);
+		}
+		getInternodeIO().post([self = shared_from_this(), connection]() { self->fail(connection); });
+		return false;
+	}
+
+	// wait for the response, the deadline or the caller to cancel, whichever comes first
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+	auto answered = false;
+
+	while (!answered)
+	{
+		const auto now = std::chrono::steady_clock::now();
+		if (now >= deadline || (cancelled && *cancelled))
+			break;
+
+		const auto wake = cancelled ? std::min(deadline, now + std::chrono::milliseconds(FrameCancelPoll)) : deadline;
+		answered = responseFuture.wait_until(wake) == std::future_status::ready;
+	}
+
+	if (!answered)
+	{
+		size_t erased;
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			erased = pending.erase(request.requestId);
+		}
+
+		// no longer pending, a late response is freed by readPayload
+		if (erased)
+		{
+			cb(http::StatusCode::client_error_bad_request, true, nullptr, 0);
+			return true;
+		}
+
+		// the response (or a failure) claimed it as we gave up, it is on its way
+	}
+
+	// the callback owns the response payload
+	const auto response = responseFuture.get();
+	cb(response.status, response.error, response.data, response.length);
+
+	return true;
+}
+
+void openset::web::FrameClient::close()
+{
+	uint64_t connection;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		connection = generation;
+	}
+
+	getInternodeIO().post([self = shared_from_this(), connection]()
+	{
+		self->fail(connection);
+	});
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "common.h"
+#include "asio.hpp"
+#include "http_serve.h"
+#include "http_cli.h"
+
+/*
+	Internode framing - a binary request/response protocol between nodes.
+
+	Each node listens on its HTTP port + InternodePortOffset. A connection
+	carries any number of requests at once, every frame has a request id
+	and responses come back in whatever order they finish.
+
+	frame:  frameHeader_s | route (requests only) | payload
+
+	route:  method, path and query params as length prefixed strings
+	        (see encodeRoute), so nothing is percent encoded
+
+	Payloads are read straight into a PoolMem buffer which is handed to
+	the Message (server) or the response callback (client) without copying,
+	replies are written straight from the caller's buffer.
+*/
+
+namespace openset::web
+{
+	const uint32_t FrameMagic = 0x3142534F; // "OSB1"
+	const int InternodePortOffset = 1000;
+	const int64_t FrameConnectTimeout = 2000; // milliseconds
+	const int64_t FrameRetryDelay = 5000; // milliseconds before retrying a node that refused
+	const int64_t FrameRequestTimeout = 300000; // milliseconds to wait for a response
+	const int64_t FrameCancelPoll = 25; // milliseconds between checks of a request's cancel flag
+
+	// a frame claiming more than this is treated as a broken stream and the connection is closed
+	const uint32_t FrameMaxRouteLength = 1024 * 1024;
+	const uint64_t FrameMaxPayloadLength = 256ULL * 1024ULL * 1024ULL;
+
+	enum class frameType_e : uint32_t
+	{
+		request = 1,
+		response = 2
+	};
+
+#pragma pack(push,1)
+	struct frameHeader_s
+	{
+		uint32_t magic{ FrameMagic };
+		frameType_e type{ frameType_e::request };
+		uint64_t requestId{ 0 };
+		uint32_t routeLength{ 0 }; // requests only
+		int32_t status{ 0 }; // responses only, an HTTP status code
+		uint64_t payloadLength{ 0 };
+	};
+#pragma pack(pop)
+
+	std::string encodeRoute(const std::string& method, const std::string& path, const QueryParams& params);
+	bool decodeRoute(const std::string& route, std::string& method, std::string& path, QueryParams& params);
+
+	// the io_service internode sockets run on (started on first use)
+	asio::io_service& getInternodeIO();
+
+	class FrameSession;
+
+	// accepts framed connections and queues their requests to the HttpServe workers
+	class FrameServe
+	{
+		HttpServe* server;
+		asio::ip::tcp::acceptor acceptor;
+
+		void accept();
+
+	public:
+		// port 0 binds any free port (see getPort)
+		FrameServe(HttpServe* server, const std::string& ip, int port);
+
+		int getPort() const
+		{
+			return acceptor.local_endpoint().port();
+		}
+	};
+
+	/* FrameClient - one persistent, multiplexed connection to a node
+	 *
+	 * request blocks the calling thread until the response arrives (like
+	 * Rest::request), any number of threads can have requests in flight on
+	 * the same connection. A request the node doesn't answer within its
+	 * timeout, or that is cancelled, fails, a response arriving after that
+	 * is dropped.
+	 */
+	class FrameClient : public std::enable_shared_from_this<FrameClient>
+	{
+		struct response_s
+		{
+			http::StatusCode status;
+			bool error;
+			char* data;
+			size_t length;
+		};
+
+		using Pending = std::shared_ptr<std::promise<response_s>>;
+
+		const std::string host;
+		const int port;
+
+		asio::ip::tcp::socket socket;
+
+		std::mutex lock; // connection state and pending requests
+		std::mutex connectLock; // one connect at a time (never held by the io thread)
+		std::mutex writeLock; // one frame is written at a time
+		bool connected{ false };
+		uint64_t generation{ 0 }; // bumped on every connect, see fail
+		int64_t retryAfter{ 0 };
+		uint64_t nextId{ 0 };
+		std::unordered_map<uint64_t, Pending> pending;
+
+		// response being read (only touched on the io thread)
+		frameHeader_s header;
+		char* payload{ nullptr };
+
+		void readHeader(uint64_t connection);
+		void readPayload(uint64_t connection);
+
+		// drops the connection and fails every pending request, does nothing if
+		// `connection` (the generation it was called for) was already dropped
+		void fail(uint64_t connection);
+
+	public:
+		FrameClient(std::string host, int port);
+
+		// connects if needed, false if the node can't be reached
+		bool connect();
+
+		// false if the request could not be sent, in which case the callback is not called
+		bool request(
+			const std::string& method,
+			const std::string& path,
+			const QueryParams& params,
+			const char* payload,
+			size_t length,
+			const RestCbBin& cb,
+			int64_t timeout = FrameRequestTimeout, // milliseconds
+			const std::atomic<bool>* cancelled = nullptr); // set by the caller to stop waiting
+
+		void close();
+	};
+
+	using FrameClientPtr = std::shared_ptr<FrameClient>;
+}
@@ -37,6 +37,31 @@ std::vector<int> openset::mapping::PartitionMap::getPartitionsByNodeIdAndStates(
 	return result;
 }
 
+std::vector<openset::mapping::PartitionMap::readHolders_s> openset::mapping::PartitionMap::getReadHolders()
+{
+	csLock lock(cs);
+
+	std::vector<readHolders_s> result;
+	result.reserve(part2node.size());
+
+	for (auto& p : part2node)
+	{
+		csLock nodeLock(p.second.cs);
+
+		readHolders_s holders{ p.first, -1, {} };
+
+		for (auto &n : p.second.nodes)
+			if (n.state == NodeState_e::active_owner)
+				holders.owner = n.nodeId;
+			else if (n.state == NodeState_e::active_clone)
+				holders.clones.push_back(n.nodeId);
+
+		if (holders.owner != -1 || holders.clones.size())
+			result.push_back(std::move(holders));
+	}
+
+	return result;
+}
 
 std::vector<int> openset::mapping::PartitionMap::getNodeIdsByState(NodeState_e state)
 {
@@ -222,6 +222,14 @@ namespace openset
 				}
 			};
 
+			// nodes a partition can be read from
+			struct readHolders_s
+			{
+				int partition;
+				int64_t owner; // -1 if the partition has no active_owner
+				std::vector<int64_t> clones; // active_clone nodes
+			};
+
 			mutable CriticalSection cs;
 
 			// locStat is a map of location and status
@@ -236,6 +244,9 @@ namespace openset
 			std::vector<int> getPartitionsByNodeId(int64_t nodeId);
 			std::vector<int> getPartitionsByNodeIdAndStates(int64_t nodeId, std::unordered_set<NodeState_e> states);
 
+			// owner and clones of every mapped partition, used to plan queries
+			std::vector<readHolders_s> getReadHolders();
+
 			// return list of nodeIds by state
 			std::vector<int> getNodeIdsByState(NodeState_e state);
 
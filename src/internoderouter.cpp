@@ -1,10 +1,13 @@
 #include <thread>
 #include <string>
+#include <algorithm>
 #include <memory>
+#include <chrono>
 #include "file/file.h"
 #include "config.h"
 
 #include "sba/sba.h"
+#include "asyncpool.h"
 #include "internoderouter.h"
 
 namespace openset
@@ -15,6 +18,163 @@ namespace openset
 	};
 };
 
+/*
+ *  ROUTE POOL
+ */
+
+openset::web::RestPtr openset::mapping::RoutePool::acquire()
+{
+	unique_lock<std::mutex> guard(lock);
+
+	available.wait(guard, [this]()
+	{
+		return inFlight < MaxRouteConnections;
+	});
+
+	++inFlight;
+	++requests;
+	if (inFlight > peakInFlight)
+		peakInFlight = inFlight;
+
+	if (!idle.empty())
+	{
+		auto rest = idle.back();
+		idle.pop_back();
+		return rest;
+	}
+
+	++connections;
+	guard.unlock();
+
+	return std::make_shared<openset::web::Rest>(host);
+}
+
+void openset::mapping::RoutePool::release(openset::web::RestPtr rest, const bool failed, const int64_t micros)
+{
+	{
+		lock_guard<std::mutex> guard(lock);
+
+		--inFlight;
+		latencyMicros += micros;
+		if (micros > maxLatencyMicros)
+			maxLatencyMicros = micros;
+
+		if (failed)
+			++errors;
+		else
+			idle.push_back(std::move(rest));
+	}
+
+	available.notify_one();
+}
+
+openset::mapping::RoutePool::~RoutePool()
+{
+	frameClient->close();
+}
+
+void openset::mapping::RoutePool::framedDone(const bool failed, const int64_t micros)
+{
+	lock_guard<std::mutex> guard(lock);
+
+	++requests;
+	++framed;
+	latencyMicros += micros;
+	if (micros > maxLatencyMicros)
+		maxLatencyMicros = micros;
+
+	if (failed)
+		++errors;
+}
+
+openset::mapping::RoutePool::Stats_s openset::mapping::RoutePool::getStats() const
+{
+	lock_guard<std::mutex> guard(lock);
+	return {
+		routeId,
+		host,
+		requests,
+		framed,
+		errors,
+		inFlight,
+		peakInFlight,
+		connections,
+		static_cast<int64_t>(idle.size()),
+		latencyMicros,
+		maxLatencyMicros
+	};
+}
+
+/*
+ *  DISPATCH POOL
+ */
+
+openset::mapping::DispatchPool::~DispatchPool()
+{
+	{
+		lock_guard<std::mutex> guard(lock);
+		stopping = true;
+		tasks.clear();
+	}
+
+	queued.notify_all();
+
+	for (auto& worker : workers)
+		worker.join();
+}
+
+void openset::mapping::DispatchPool::post(std::function<void()> task)
+{
+	{
+		lock_guard<std::mutex> guard(lock);
+
+		tasks.push_back(std::move(task));
+		++busy;
+
+		// a worker for every task up to the cap, idle workers are reused
+		if (idle < static_cast<int64_t>(tasks.size()) && static_cast<int>(workers.size()) < MaxDispatchWorkers)
+		{
+			++idle;
+			workers.emplace_back(&DispatchPool::work, this);
+		}
+	}
+
+	queued.notify_one();
+}
+
+int64_t openset::mapping::DispatchPool::getBusy()
+{
+	lock_guard<std::mutex> guard(lock);
+	return busy;
+}
+
+void openset::mapping::DispatchPool::work()
+{
+	unique_lock<std::mutex> guard(lock);
+
+	while (true)
+	{
+		queued.wait(guard, [this]()
+		{
+			return stopping || !tasks.empty();
+		});
+
+		if (stopping)
+			return;
+
+		auto task = std::move(tasks.front());
+		tasks.pop_front();
+		--idle;
+
+		guard.unlock();
+		task();
+		guard.lock();
+
+		++idle;
+		--busy;
+	}
+}
+
 /*
  *  MAILBOX
  */
@@ -71,6 +231,9 @@ void openset::mapping::Mapper::removeRoute(const int64_t routeId)
 		routes.erase(rt);
 		// clear the name out - will be in dictionary
 		names.erase(names.find(routeId));
+		// requests in flight hold the pool until they finish
+		pools.erase(routeId);
+		loads.erase(routeId);
 	}
 }
 
@@ -89,14 +252,53 @@ int64_t openset::mapping::Mapper::getRouteId(const std::string routeName)
 	return -1;
 }
 
-openset::web::RestPtr openset::mapping::Mapper::getRoute(const int64_t routeId)
+openset::mapping::RoutePoolPtr openset::mapping::Mapper::getRoute(const int64_t routeId)
 {
 	csLock lock(cs); // lock 
 	
-	if (const auto rt = routes.find(routeId); rt == routes.end())
+	const auto rt = routes.find(routeId);
+	if (rt == routes.end())
 		return nullptr;
-	else
-		return std::make_shared<openset::web::Rest>(rt->second.first + ":" + to_string(rt->second.second));
+
+	auto& pool = pools[routeId];
+	if (!pool)
+		pool = std::make_shared<RoutePool>(routeId, rt->second.first, rt->second.second);
+
+	return pool;
+}
+
+std::vector<openset::mapping::RoutePool::Stats_s> openset::mapping::Mapper::getRouteStats()
+{
+	std::vector<RoutePoolPtr> current;
+
+	{
+		csLock lock(cs);
+		for (auto& pool : pools)
+			current.push_back(pool.second);
+	}
+
+	std::vector<RoutePool::Stats_s> result;
+	for (auto& pool : current)
+		result.push_back(pool->getStats());
+
+	return result;
+}
+
+void openset::mapping::Mapper::setNodeLoad(const int64_t routeId, const int64_t load)
+{
+	csLock lock(cs);
+	loads[routeId] = load;
+}
+
+int64_t openset::mapping::Mapper::getNodeLoad(const int64_t routeId)
+{
+	// our own load is always current
+	if (routeId == globals::running->nodeId && globals::async)
+		return globals::async->getRealtimeTotal();
+
+	csLock lock(cs);
+	const auto iter = loads.find(routeId);
+	return iter == loads.end() ? 0 : iter->second;
 }
 
 bool openset::mapping::Mapper::isRoute(const int64_t routeId)
@@ -118,15 +320,47 @@ bool openset::mapping::Mapper::dispatchAsync(
 	const openset::web::QueryParams params,
 	const char* payload,
 	const size_t length,
-	const openset::web::RestCbBin callback)
+	const openset::web::RestCbBin callback,
+	const std::atomic<bool>* cancelled)
 {
 	// check if there is a route here
-	if (auto rest = getRoute(route); rest)
+	const auto pool = getRoute(route);
+	if (!pool)
+		return false;
+
+	auto started = std::chrono::steady_clock::now();
+	auto failed = false;
+
+	// both clients call back before returning, the callback owns `data`
+	const auto done = [&failed, &callback](const http::StatusCode status, const bool error, char* data, const size_t size)
 	{
-		rest->request(method, path, params, payload, length, callback);
+		failed = error;
+		callback(status, error, data, size);
+	};
+
+	// framed first, false means the request never left (node not listening
+	// for frames, or the connection dropped) so it is safe to send over HTTP
+	if (pool->getFrameClient()->request(method, path, params, payload, length, done, openset::web::FrameRequestTimeout, cancelled))
+	{
+		pool->framedDone(
+			failed,
+			std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count());
 		return true;
 	}
-	return false;
+
+	auto rest = pool->acquire();
+	started = std::chrono::steady_clock::now();
+
+	// Rest::request runs the client until the response arrives, so the
+	// callback has fired by the time it returns
+	rest->request(method, path, params, payload, length, done);
+
+	pool->release(
+		std::move(rest), 
+		failed, 
+		std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count());
+
+	return true;
 }
 
 bool openset::mapping::Mapper::dispatchAsync(
@@ -137,13 +371,7 @@ bool openset::mapping::Mapper::dispatchAsync(
 	const std::string& payload,
 	const openset::web::RestCbBin callback)
 {
-	// check if there is a route here
-	if (auto rest = getRoute(route); rest)
-	{
-		rest->request(method, path, params, &payload[0], payload.length(), callback);
-		return true;
-	}
-	return false;
+	return dispatchAsync(route, method, path, params, &payload[0], payload.length(), callback);
 }
 
 bool openset::mapping::Mapper::dispatchAsync(
@@ -154,15 +382,8 @@ bool openset::mapping::Mapper::dispatchAsync(
 	cjson& payload,
 	const openset::web::RestCbBin callback)
 {
-	// check if there is a route here
 	auto json = cjson::Stringify(&payload);
-
-	if (auto rest = getRoute(route); rest)
-	{
-		rest->request(method, path, params, &json[0], json.length(), callback);
-		return true;
-	}
-	return false;
+	return dispatchAsync(route, method, path, params, &json[0], json.length(), callback);
 }
 
 openset::mapping::Mapper::DataBlockPtr openset::mapping::Mapper::dispatchSync(
@@ -217,33 +438,22 @@ openset::mapping::Mapper::DataBlockPtr openset::mapping::Mapper::dispatchSync(
 	return std::move(dispatchSync(route, method, path, std::move(params), &json[0], json.length()));
 }
 
-class dispatchState
+namespace
 {
-	int requestCount{ 0 };
-	atomic<int> responseCount{ 0 };
-	bool active{ true };
-public:
-	bool isActive() const
-	{
-		return active;
-	}
-	void deactivate()
-	{
-		active = false;
-	}
-	bool isComplete() const
+	// shared by dispatchCluster and its requests. If dispatchCluster gives up
+	// (a route dropped) requests still running finish against this, not the
+	// caller's stack.
+	struct clusterDispatch_s
 	{
-		return responseCount >= requestCount;
-	}
-	void incrRequest()
-	{
-		++requestCount;
-	}
-	void incrResponse()
-	{
-		++responseCount;
-	}
-};
+		std::mutex lock;
+		std::condition_variable ready;
+		openset::mapping::Mapper::Responses result;
+		std::string payload;
+		int64_t expected{ 0 };
+		int64_t received{ 0 };
+		std::atomic<bool> abandoned{ false }; // set under `lock`, also read by requests in flight
+	};
+}
 
 openset::mapping::Mapper::Responses openset::mapping::Mapper::dispatchCluster(
 	const std::string method,
@@ -253,94 +463,115 @@ openset::mapping::Mapper::Responses openset::mapping::Mapper::dispatchCluster(
 	const size_t length,
 	const bool internalDispatch)
 {
-	mutex continueLock;
-	condition_variable continueReady;
+	auto state = std::make_shared<clusterDispatch_s>();
+	state->payload.assign(data ? data : "", data ? length : 0);
 
-	CriticalSection responseCs;
-
-	Responses result;
-	auto callbackState = new dispatchState();
+	std::vector<int64_t> cachedRoutes;
 
-	auto doneCb = [callbackState, &responseCs, &result, &continueReady](const http::StatusCode status, const bool error, char* data, const size_t size)
+	// we copy the routes so that another thread won't corrupt them
 	{
-		if (!callbackState->isActive())
+		csLock lock(cs);
+		for (const auto& r : routes)
 		{
-			// Trapped dead callback - if it aborted by error.
-			// callbackstate will still be on the heap
-			callbackState->incrResponse();
-			if (callbackState->isComplete())
-				delete callbackState;
+			// don't call this node unless we want to
+			if (!internalDispatch && r.first == globals::running->nodeId)
+				continue;
+			cachedRoutes.push_back(r.first);
 		}
+	}
+
+	state->expected = static_cast<int64_t>(cachedRoutes.size());
+	// DataBlocks free their data when destroyed, so the vector must never reallocate (copy)
+	state->result.responses.reserve(cachedRoutes.size());
+
+	const auto send = [this, state, method, path, params](const int64_t route)
+	{
+		// dispatchCluster gave up while this waited for a worker
+		if (state->abandoned)
+			return;
+
+		auto doneCb = [state](const http::StatusCode status, const bool error, char* data, const size_t size)
+		{
+			{
+				lock_guard<std::mutex> guard(state->lock);
+
+				if (!state->abandoned)
+				{
+					// the response takes ownership of data
+					state->result.responses.emplace_back(data, size, status);
+
+					if (error)
+						state->result.routeError = true;
+				}
+				else if (data)
+				{
+					PoolMem::getPool().freePtr(data);
+				}
+
+				++state->received;
+			}
+			state->ready.notify_one();
+		};
 
+		if (!dispatchAsync(route, method, path, params, state->payload.data(), state->payload.length(), doneCb, &state->abandoned))
 		{
-			csLock lock(responseCs);
-			// store this response in the response object, but first
-            // copy data, as data will be destoryed when this callback goes out of scope
-            auto dataCopy = static_cast<char*>(PoolMem::getPool().getPtr(size));
-            memcpy(dataCopy, data, size);
-			result.responses.emplace_back(openset::mapping::Mapper::DataBlock{ dataCopy, size, status });
-
-			if (error)
-				result.routeError = true;
+			{
+				lock_guard<std::mutex> guard(state->lock);
+				state->result.routeError = true;
+				++state->received;
+			}
+			state->ready.notify_one();
 		}
+	};
 
-		callbackState->incrResponse();
+	// requests run concurrently on the DispatchPool, the last one on this thread
+	for (auto i = 0; i < static_cast<int>(cachedRoutes.size()) - 1; ++i)
+		dispatcher.post([send, route = cachedRoutes[i]]() { send(route); });
 
-		if (callbackState->isComplete())
-			continueReady.notify_one();
-	};
+	if (cachedRoutes.size())
+		send(cachedRoutes.back());
 
-	std::vector<int64_t> cachedRoutes;
+	// we are going to loop and wait until we get all our responses back
+	Responses result;
 
-    // we copy the routes so that another thread won't corrupt them
-	decltype(routes) tRoutes;
-    	{
-		csLock lock(cs);
-		tRoutes = routes;
-	}
-	
-	// dispatchAsync to all our nodes
 	{
-		for (const auto r : tRoutes)
+		unique_lock<std::mutex> lock(state->lock);
+
+		while (state->received < state->expected)
 		{
-			// don't call this node unless we want to
-			if (!internalDispatch && r.first == globals::running->nodeId)
-				continue;
+			if (state->ready.wait_for(lock, 500ms, [&state]()
+			{
+				return state->received >= state->expected;
+			}))
+				break;
 
-			dispatchAsync(r.first, method, path, params, data, length, doneCb);
-			callbackState->incrRequest();
+			lock.unlock();
 
-			cachedRoutes.push_back(r.first);
-		}
-	}
+			auto dropped = false;
+			for (auto r : cachedRoutes)
+				if (!isRoute(r))
+				{
+					// route is missing, meaning it got dumped
+					// during this request
+					dropped = true;
+					break;
+				}
 
-	// we are going to loop and wait until we get all our responses back
-	while (!callbackState->isComplete())
-	{
-		unique_lock<std::mutex> lock(continueLock);
-		continueReady.wait_for(lock, 500ms, [callbackState]()
-		{
-			return callbackState->isComplete();
-		});
+			lock.lock();
 
-		for (auto r : cachedRoutes)
-			if (!isRoute(r))
+			if (dropped)
 			{
-                // route is missing, meaning it got dumped
-                // during this request
-				result.routeError = true;
+				state->result.routeError = true;
 				break;
 			}
+		}
 
-		if (result.routeError)
-			break;
+		// late responses are dropped, requests still running are cancelled
+		state->abandoned = true;
+		std::swap(result.responses, state->result.responses);
+		result.routeError = state->result.routeError;
 	}
 
-	// this callback is done
-	callbackState->deactivate();
-	if (callbackState->isComplete())
-		delete callbackState;
-
 	return result;
 }
 
@@ -360,6 +591,427 @@ openset::mapping::Mapper::Responses openset::mapping::Mapper::dispatchCluster(
 	return result;
 }
 
+namespace
+{
+	struct scatterArrival_s
+	{
+		int request;
+		char* data;
+		size_t length;
+		openset::http::StatusCode status;
+		bool error;
+	};
+
+	// shared by dispatchScatter and its requests, requests still running when
+	// dispatchScatter returns (timed out, or lost to a hedge) finish against this
+	struct scatterDispatch_s
+	{
+		std::mutex lock;
+		std::condition_variable ready;
+		std::vector<scatterArrival_s> arrivals;
+		std::string payload;
+		std::atomic<bool> abandoned{ false }; // set under `lock`, also read by requests in flight
+
+		~scatterDispatch_s()
+		{
+			for (auto& arrival : arrivals)
+				if (arrival.data)
+					PoolMem::getPool().freePtr(arrival.data);
+		}
+	};
+
+	std::string partitionList(const std::vector<int>& partitions)
+	{
+		std::string result;
+
+		for (const auto partition : partitions)
+		{
+			if (result.length())
+				result += ',';
+			result += std::to_string(partition);
+		}
+
+		return result;
+	}
+}
+
+std::vector<openset::mapping::Mapper::ScatterTask_s> openset::mapping::Mapper::planScatter(
+	const std::vector<PartitionMap::readHolders_s>& holders,
+	const bool replicas,
+	std::vector<int>& unplanned)
+{
+	std::vector<ScatterTask_s> tasks;
+	std::unordered_map<int64_t, int> taskOfRoute;
+	std::unordered_map<int64_t, int64_t> load; // reported load + partitions planned so far
+
+	const auto loadOf = [&](const int64_t route) -> int64_t&
+	{
+		auto iter = load.find(route);
+		if (iter == load.end())
+			iter = load.emplace(route, getNodeLoad(route)).first;
+		return iter->second;
+	};
+
+	for (const auto& h : holders)
+	{
+		int64_t route = -1;
+
+		// a node has to be better by more than one partition to take it, so
+		// balanced loads keep partitions with their owners
+		const auto consider = [&](const int64_t node)
+		{
+			if (node == -1 || !isRoute(node))
+				return;
+			if (route == -1 || loadOf(node) + 1 < loadOf(route))
+				route = node;
+		};
+
+		// the owner is considered first
+		consider(h.owner);
+
+		// without replicas clones are only read if the owner can't be
+		if (replicas || route == -1)
+			for (const auto clone : h.clones)
+				consider(clone);
+
+		if (route == -1)
+		{
+			unplanned.push_back(h.partition);
+			continue;
+		}
+
+		++loadOf(route);
+
+		auto iter = taskOfRoute.find(route);
+		if (iter == taskOfRoute.end())
+		{
+			iter = taskOfRoute.emplace(route, static_cast<int>(tasks.size())).first;
+			tasks.push_back({ route, {} });
+		}
+
+		tasks[iter->second].partitions.push_back(h.partition);
+	}
+
+	return tasks;
+}
+
+openset::mapping::Mapper::ScatterResult_s openset::mapping::Mapper::dispatchScatter(
+	const std::string method,
+	const std::string path,
+	const openset::web::QueryParams params,
+	const char* data,
+	const size_t length,
+	const ScatterOptions_s options,
+	const ScatterCB& onResponse)
+{
+	// one task per node in the plan, a hedged task also has requests to clones
+	struct task_s
+	{
+		int64_t route;
+		std::vector<int> partitions;
+		bool done{ false };
+		bool hedged{ false };
+		bool unhedgeable{ false }; // a partition has no other copy
+		bool originalFailed{ false };
+		bool hedgeFailed{ false };
+		int64_t hedgeWaiting{ 0 };
+		std::vector<scatterArrival_s> hedgeResponses; // held until every hedge request is in
+	};
+
+	struct request_s
+	{
+		int task;
+		bool hedge;
+	};
+
+	ScatterResult_s result;
+
+	auto state = std::make_shared<scatterDispatch_s>();
+	state->payload.assign(data ? data : "", data ? length : 0);
+
+	const auto holders = partitionMap.getReadHolders();
+
+	std::unordered_map<int, const PartitionMap::readHolders_s*> holdersOf;
+	for (const auto& h : holders)
+		holdersOf[h.partition] = &h;
+
+	std::vector<task_s> tasks;
+	for (auto& planned : planScatter(holders, options.replicas, result.missing))
+	{
+		tasks.emplace_back();
+		tasks.back().route = planned.route;
+		tasks.back().partitions = std::move(planned.partitions);
+	}
+
+	std::vector<request_s> requests;
+
+	const auto send = [&](const int taskIndex, const int64_t route, const std::vector<int>& partitions, const bool hedge)
+	{
+		const auto requestIndex = static_cast<int>(requests.size());
+		requests.push_back({ taskIndex, hedge });
+		++result.requests;
+
+		auto requestParams = params;
+		requestParams.erase("partitions");
+		requestParams.emplace("partitions", partitionList(partitions));
+
+		dispatcher.post([this, state, method, path, requestParams, route, requestIndex]()
+		{
+			// dispatchScatter returned while this waited for a worker
+			if (state->abandoned)
+				return;
+
+			const auto arrived = [&state, requestIndex](const http::StatusCode status, const bool error, char* data, const size_t size)
+			{
+				{
+					lock_guard<std::mutex> guard(state->lock);
+					if (!state->abandoned)
+					{
+						state->arrivals.push_back({ requestIndex, data, size, status, error });
+						data = nullptr;
+					}
+				}
+
+				if (data)
+					PoolMem::getPool().freePtr(data);
+
+				state->ready.notify_one();
+			};
+
+			if (!dispatchAsync(route, method, path, requestParams, state->payload.data(), state->payload.length(), arrived, &state->abandoned))
+				arrived(http::StatusCode::client_error_bad_request, true, nullptr, 0);
+		});
+	};
+
+	// re-send a task's partitions to the other nodes holding them, spread over as many as possible
+	const auto hedge = [&](const int taskIndex) -> bool
+	{
+		auto& task = tasks[taskIndex];
+
+		if (task.hedged || task.unhedgeable)
+			return false;
+
+		std::unordered_map<int64_t, std::vector<int>> byClone;
+
+		for (const auto partition : task.partitions)
+		{
+			const auto holder = holdersOf[partition];
+
+			int64_t target = -1;
+			size_t least = 0;
+
+			const auto consider = [&](const int64_t node)
+			{
+				if (node == -1 || node == task.route || !isRoute(node))
+					return;
+
+				const auto assigned = byClone.count(node) ? byClone[node].size() : 0;
+				if (target == -1 || assigned < least)
+				{
+					target = node;
+					least = assigned;
+				}
+			};
+
+			// the task may have been planned on a clone, so the owner is a candidate too
+			consider(holder->owner);
+			for (const auto clone : holder->clones)
+				consider(clone);
+
+			if (target == -1)
+			{
+				task.unhedgeable = true;
+				return false;
+			}
+
+			byClone[target].push_back(partition);
+		}
+
+		task.hedged = true;
+		task.hedgeWaiting = static_cast<int64_t>(byClone.size());
+		++result.hedged;
+
+		for (const auto& clone : byClone)
+			send(taskIndex, clone.first, clone.second, true);
+
+		return true;
+	};
+
+	std::vector<int64_t> responseTimes; // of un-hedged responses, for the straggler median
+	size_t tasksDone = 0;
+
+	const auto deliver = [&](scatterArrival_s& arrival)
+	{
+		DataBlock block(arrival.data, arrival.length, arrival.status);
+		arrival.data = nullptr;
+
+		if (arrival.error)
+			result.routeError = true;
+
+		onResponse(block);
+	};
+
+	const auto finish = [&](task_s& task)
+	{
+		task.done = true;
+		++tasksDone;
+
+		for (auto& held : task.hedgeResponses)
+			if (held.data)
+				PoolMem::getPool().freePtr(held.data);
+		task.hedgeResponses.clear();
+	};
+
+	// the original failed and the hedge can't (or didn't) finish the task
+	const auto originalFailed = [&](const int taskIndex)
+	{
+		auto& task = tasks[taskIndex];
+		task.originalFailed = true;
+
+		if (!task.hedged && !hedge(taskIndex))
+		{
+			result.routeError = true;
+			result.missing.insert(result.missing.end(), task.partitions.begin(), task.partitions.end());
+			finish(task);
+		}
+		else if (task.hedgeFailed)
+		{
+			result.routeError = true;
+			result.missing.insert(result.missing.end(), task.partitions.begin(), task.partitions.end());
+			finish(task);
+		}
+	};
+
+	const auto started = Now();
+
+	for (auto i = 0; i < static_cast<int>(tasks.size()); ++i)
+		send(i, tasks[i].route, tasks[i].partitions, false);
+
+	auto lastRouteCheck = started;
+
+	while (tasksDone < tasks.size())
+	{
+		std::vector<scatterArrival_s> arrived;
+
+		{
+			unique_lock<std::mutex> lock(state->lock);
+			state->ready.wait_for(lock, std::chrono::milliseconds(ScatterPoll), [&state]()
+			{
+				return state->arrivals.size() != 0;
+			});
+			arrived.swap(state->arrivals);
+		}
+
+		for (auto& arrival : arrived)
+		{
+			const auto& request = requests[arrival.request];
+			auto& task = tasks[request.task];
+
+			// never reached the node, or the connection dropped
+			const auto failed = arrival.error && !arrival.data;
+
+			if (task.done || failed)
+			{
+				if (arrival.data)
+					PoolMem::getPool().freePtr(arrival.data);
+
+				if (task.done)
+					continue;
+
+				if (request.hedge)
+				{
+					task.hedgeFailed = true;
+					if (task.originalFailed)
+						originalFailed(request.task);
+				}
+				else
+				{
+					originalFailed(request.task);
+				}
+
+				continue;
+			}
+
+			if (!request.hedge)
+			{
+				responseTimes.push_back(Now() - started);
+				deliver(arrival);
+				finish(task);
+				continue;
+			}
+
+			if (task.hedgeFailed)
+			{
+				// the original is still the only way to finish this task
+				PoolMem::getPool().freePtr(arrival.data);
+				continue;
+			}
+
+			task.hedgeResponses.push_back(arrival);
+
+			if (--task.hedgeWaiting == 0)
+			{
+				for (auto& held : task.hedgeResponses)
+					deliver(held);
+				finish(task);
+			}
+		}
+
+		const auto now = Now();
+
+		if (options.timeout > 0 && now - started >= options.timeout)
+			break;
+
+		// stragglers
+		auto hedgeAfter = options.hedgeAfter;
+
+		if (hedgeAfter < 0)
+		{
+			hedgeAfter = 0;
+
+			if (responseTimes.size() && responseTimes.size() * 2 >= tasks.size())
+			{
+				auto times = responseTimes;
+				const auto middle = times.begin() + times.size() / 2;
+				std::nth_element(times.begin(), middle, times.end());
+				hedgeAfter = std::max(ScatterHedgeMin, *middle * ScatterHedgeFactor);
+			}
+		}
+
+		if (hedgeAfter > 0 && now - started >= hedgeAfter)
+			for (auto i = 0; i < static_cast<int>(tasks.size()); ++i)
+				if (!tasks[i].done)
+					hedge(i);
+
+		// a route was dumped during this request
+		if (now - lastRouteCheck >= 500)
+		{
+			lastRouteCheck = now;
+
+			for (auto i = 0; i < static_cast<int>(tasks.size()); ++i)
+				if (!tasks[i].done && !tasks[i].originalFailed && !isRoute(tasks[i].route))
+					originalFailed(i);
+		}
+	}
+
+	{
+		// late responses are dropped, requests still running are cancelled
+		lock_guard<std::mutex> guard(state->lock);
+		state->abandoned = true;
+	}
+
+	for (auto& task : tasks)
+		if (!task.done)
+		{
+			result.missing.insert(result.missing.end(), task.partitions.begin(), task.partitions.end());
+			finish(task);
+		}
+
+	result.partial = result.missing.size() != 0;
+
+	return result;
+}
+
 void openset::mapping::Mapper::releaseResponses(Responses& responseSet)
 {
 	responseSet.responses.clear();
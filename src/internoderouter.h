@@ -1,10 +1,16 @@
 #pragma once
 
 #include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include "common.h"
 #include "internodemapping.h"
 #include "http_serve.h"
 #include "http_cli.h"
+#include "internodeframe.h"
 #include "threads/spinlock.h"
 
 namespace openset
@@ -22,6 +28,124 @@ namespace openset
 
 	namespace mapping
 	{
+		const int MaxRouteConnections = 16; // concurrent requests to one node
+
+		/* RoutePool - reusable connections to one node
+		 *
+		 * Requests go over the node's framed connection (internodeframe.h)
+		 * when it can be reached, one connection carries every request.
+		 *
+		 * Otherwise they fall back to HTTP. Each Rest object owns an
+		 * HttpClient, the client keeps its connection open between requests
+		 * (keep-alive), so a Rest returned to the pool carries a warm
+		 * connection to the next request. At most MaxRouteConnections HTTP
+		 * requests are in flight to a node, further requests wait for one to
+		 * finish.
+		 */
+		class RoutePool
+		{
+		public:
+
+			struct Stats_s
+			{
+				int64_t routeId;
+				std::string host;
+				int64_t requests;
+				int64_t framed; // requests sent over the framed connection
+				int64_t errors;
+				int64_t inFlight;
+				int64_t peakInFlight;
+				int64_t connections; // Rest objects created (new connections)
+				int64_t idle; // connections waiting for a request
+				int64_t latencyMicros; // total over all requests
+				int64_t maxLatencyMicros;
+			};
+
+		private:
+
+			const int64_t routeId;
+			const std::string host;
+			const openset::web::FrameClientPtr frameClient;
+
+			mutable std::mutex lock;
+			std::condition_variable available;
+			std::vector<openset::web::RestPtr> idle;
+
+			int64_t requests{ 0 };
+			int64_t framed{ 0 };
+			int64_t errors{ 0 };
+			int64_t inFlight{ 0 };
+			int64_t peakInFlight{ 0 };
+			int64_t connections{ 0 };
+			int64_t latencyMicros{ 0 };
+			int64_t maxLatencyMicros{ 0 };
+
+		public:
+
+			RoutePool(const int64_t routeId, const std::string& ip, const int port) :
+				routeId(routeId),
+				host(ip + ":" + to_string(port)),
+				frameClient(std::make_shared<openset::web::FrameClient>(ip, port + openset::web::InternodePortOffset))
+			{}
+
+			~RoutePool();
+
+			openset::web::FrameClientPtr getFrameClient() const
+			{
+				return frameClient;
+			}
+
+			// records a request that went over the framed connection
+			void framedDone(bool failed, int64_t micros);
+
+			// waits if the route is at MaxRouteConnections
+			openset::web::RestPtr acquire();
+
+			// a failed connection is dropped rather than reused
+			void release(openset::web::RestPtr rest, bool failed, int64_t micros);
+
+			Stats_s getStats() const;
+		};
+
+		using RoutePoolPtr = shared_ptr<RoutePool>;
+
+		const int MaxDispatchWorkers = 32; // requests dispatchCluster and dispatchScatter run at once
+
+		/* DispatchPool - the threads dispatchCluster and dispatchScatter send on
+		 *
+		 * A request blocks its thread until the node answers, so each runs on
+		 * a worker. Workers are started as they are needed, up to
+		 * MaxDispatchWorkers, requests beyond that wait in a queue for the
+		 * next free worker.
+		 */
+		class DispatchPool
+		{
+			std::mutex lock;
+			std::condition_variable queued;
+			std::deque<std::function<void()>> tasks;
+			std::vector<std::thread> workers;
+			int64_t idle{ 0 };
+			int64_t busy{ 0 };
+			bool stopping{ false };
+
+			void work();
+
+		public:
+			DispatchPool() = default;
+
+			// queued tasks are dropped, running tasks are finished
+			~DispatchPool();
+
+			void post(std::function<void()> task);
+
+			// tasks running or waiting for a worker
+			int64_t getBusy();
+		};
+
+		const int64_t ScatterHedgeMin = 100; // milliseconds, adaptive hedging never fires sooner
+		const int64_t ScatterHedgeFactor = 2; // a straggler has run this many times the median response
+		const int64_t ScatterPoll = 25; // milliseconds between straggler/timeout checks
+
 		class Mapper
 		{
 		public:
@@ -66,11 +190,41 @@ namespace openset
 
 			using Responses = Responses_s;
 
+			struct ScatterOptions_s
+			{
+				int64_t timeout{ 0 }; // milliseconds, 0 waits for every partition
+				int64_t hedgeAfter{ -1 }; // milliseconds, -1 is adaptive, 0 never hedges
+				bool replicas{ true }; // read from the least loaded of owner and clones, false reads owners
+			};
+
+			// the partitions one node is asked for
+			struct ScatterTask_s
+			{
+				int64_t route;
+				std::vector<int> partitions;
+			};
+
+			struct ScatterResult_s
+			{
+				bool partial{ false }; // some partitions have no result (timed out, or failed without a clone)
+				bool routeError{ false };
+				int64_t requests{ 0 };
+				int64_t hedged{ 0 }; // node requests re-sent to clones
+				std::vector<int> missing; // partitions without a result
+			};
+
+			// called on the dispatching thread as each response arrives, may take `data`
+			using ScatterCB = std::function<void(DataBlock& response)>;
+
 			mutable CriticalSection cs;
 
 			PartitionMap partitionMap;
 			Routes routes;
 			RouteNames names;
+			unordered_map<int64_t, RoutePoolPtr> pools;
+			unordered_map<int64_t, int64_t> loads; // last load each node reported (in its ping)
+
+			DispatchPool dispatcher;
 
 			// we increment every time we make a mailbox - use atomics as they are thread safe
 			atomic<int64_t> slotCounter;
@@ -87,13 +241,22 @@ namespace openset
 			std::string getRouteName(const int64_t routeId);
 			int64_t getRouteId(const std::string routeName);
 
-			// factories a Rest object
-			openset::web::RestPtr getRoute(const int64_t routeId);
+			// connection pool for a route (made on first use)
+			RoutePoolPtr getRoute(const int64_t routeId);
+
+			std::vector<RoutePool::Stats_s> getRouteStats();
+
+			// load is the number of query cells a node has queued or running
+			void setNodeLoad(const int64_t routeId, const int64_t load);
+			int64_t getNodeLoad(const int64_t routeId);
 
 			bool isRoute(const int64_t routeId);
 			bool isRouteNoLock(const int64_t routeId);
 
 			// dispatchAsync - send a payload down a route.
+			//
+			// a framed request fails as soon as `cancelled` is set (the
+			// caller stopped waiting for it), an HTTP request runs to the end
 			bool dispatchAsync(
 				const int64_t route, 
 				const std::string method,
@@ -101,7 +264,8 @@ namespace openset
 				const openset::web::QueryParams params,
 				const char* payload, 
 				const size_t length, 
-				const openset::web::RestCbBin callback);
+				const openset::web::RestCbBin callback,
+				const std::atomic<bool>* cancelled = nullptr);
 
 			bool dispatchAsync(
 				const int64_t route,
@@ -140,7 +304,8 @@ namespace openset
 				return &partitionMap;
 			}
 
-			// send a message to all known routes
+			// send a message to all known routes, requests run on the DispatchPool
+			// (see dispatchScatter for what happens to them if we give up)
 			Responses dispatchCluster(
 				const std::string method,
 				const std::string path,
@@ -156,6 +321,47 @@ namespace openset
 				cjson& json,
 				const bool internalDispatch = false);
 
+			/* dispatchScatter - send a request for every partition, one request per node
+			 *
+			 * Each node is sent the list of partitions it should answer for in the
+			 * `partitions` param. `onResponse` is called as responses arrive so
+			 * callers can merge incrementally.
+			 *
+			 * A node that fails, or is a straggler (slower than `hedgeAfter`, or
+			 * by default ScatterHedgeFactor x the median response once half the
+			 * nodes have answered), has its partitions re-sent to the other nodes
+			 * holding them. Whichever answer is complete first is used,
+			 * the other is dropped, so no partition is counted twice.
+			 *
+			 * With a `timeout` we stop waiting and return what arrived, with
+			 * `partial` set.
+			 *
+			 * Requests run on the DispatchPool. Once we return, requests still
+			 * waiting for a worker are skipped and framed requests in flight are
+			 * cancelled.
+			 */
+			/* planScatter - pick a node to read each partition from
+			 *
+			 * With `replicas` each partition goes to whichever of its owner and
+			 * clones has the lowest reported load plus partitions already planned
+			 * for it in this query. The owner keeps the partition unless a clone
+			 * is lower by more than one. Without `replicas` the owner is used.
+			 * Partitions that can't be read from any node go in `unplanned`.
+			 */
+			std::vector<ScatterTask_s> planScatter(
+				const std::vector<PartitionMap::readHolders_s>& holders,
+				const bool replicas,
+				std::vector<int>& unplanned);
+
+			ScatterResult_s dispatchScatter(
+				const std::string method,
+				const std::string path,
+				const openset::web::QueryParams params,
+				const char* data,
+				const size_t length,
+				const ScatterOptions_s options,
+				const ScatterCB& onResponse);
+
 			// helper to clean up responses from dispatchCluster
 			static void releaseResponses(Responses &responseSet);
 
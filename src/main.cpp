@@ -6,7 +6,9 @@
 #include "config.h"
 #include "logger.h"
 #include "var/var.h"
+#include "heapstack/heapstack.h"
 #include "../test/unittests.h"
+#include "../test/benchmarks.h"
 #include <string>
 
 #ifdef _MSC_VER
@@ -67,6 +69,8 @@ void StartOpenSet(openset::config::CommandlineArgs args)
 	// initialize our global config object
 	openset::globals::running = new openset::config::Config(args);
 
+	HeapStackBlockPool::getPool().setMaxRetained(args.retainMB * 1024LL * 1024LL / MemConstants::HeapStackBlockSize);
+
 	auto service = new openset::Service();
 	// run checks and create objects
 	service->initialize();
@@ -82,6 +86,7 @@ int main(const int argc, char* argv[])
 
 	auto help = false;
 	auto test = false;
+	auto bench = false;
 	
 	if (argc)
 	{
@@ -100,8 +105,12 @@ int main(const int argc, char* argv[])
 				args.portExternal = std::stoi(nextArg);
 			else if (arg == "--data"s)
 				args.path = argv[i + 1];
+			else if (arg == "--retain"s)
+				args.retainMB = std::stoll(nextArg);
 			else if (arg == "--test"s)
 				test = true;
+			else if (arg == "--bench"s)
+				bench = true;
 			else if (arg == "--help"s)
 				help = true;
 		}
@@ -113,6 +122,12 @@ int main(const int argc, char* argv[])
 		exit(testRes ? 0 : 1); // exit with 1 on test fail
 	}
 
+	if (bench)
+	{
+		const auto benchRes = runBenchmarks();
+		exit(benchRes ? 0 : 1);
+	}
+
 	if (help)
 	{
 		cout << "Command line options:" << endl << endl;
@@ -121,7 +136,9 @@ int main(const int argc, char* argv[])
 		cout << "    --hostext <host/ip, defaults to hostname>   ; optional external host/ip" << endl;
 		cout << "    --portext <port, defaults to --port value> ; optional external port" << endl;
 		cout << "    --data <relative or absolute path>         ; where commits will be stored" << endl;
+		cout << "    --retain <MB, defaults to 64>              ; free memory blocks kept for reuse" << endl;
 		cout << "    --test                                     ; will run unit tests" << endl;
+		cout << "    --bench                                    ; will run benchmarks" << endl;
 		cout << endl;
 		exit(0);
 	}
@@ -1,5 +1,6 @@
 #include "oloop.h"
 #include "asyncpool.h"
+#include "time/cycleclock.h"
 
 using namespace openset::async;
 
@@ -10,14 +11,20 @@ OpenLoop::OpenLoop(oloopPriority_e priority) :
 	state(oloopState_e::running),
 	runAt(0),
 	runStart(0),
+	sliceEnd(0),
+	lastRun(0),
+	queuedAt(0),
+	deadline(0),
 	prepared(false),
-	loop(nullptr)
+	loop(nullptr),
+	workerId(0),
+	realtimeCounted(false)
 {}
 
 OpenLoop::~OpenLoop()
 {
-	// calling suicide will set priority to background
-	if (priority == oloopPriority_e::realtime)
+	// calling suicide will have already released the count
+	if (realtimeCounted)
 		globals::async->realtimeDec(this->loop->worker);
 }
 
@@ -25,7 +32,10 @@ void OpenLoop::assignLoop(AsyncLoop* loop)
 {
 	this->loop = loop;
 	if (priority == oloopPriority_e::realtime)
+	{
 		globals::async->realtimeInc(this->loop->worker);
+		realtimeCounted = true;
+	}
 
 }
 
@@ -52,20 +62,47 @@ void OpenLoop::spawn(OpenLoop* newCell) const
 	loop->queueCell(newCell);
 }
 
+void OpenLoop::spawnShared(OpenLoop* newCell) const
+{
+	loop->queueSharedCell(newCell);
+}
+
 void OpenLoop::suicide()
 {
-	if (priority == oloopPriority_e::realtime)
+	if (realtimeCounted)
 	{
 		globals::async->realtimeDec(this->loop->worker);
-		priority = oloopPriority_e::background;
+		realtimeCounted = false;
 	}
 	state = oloopState_e::done;
 }
 
+void OpenLoop::beginSlice(const int64_t now)
+{
+	runStart = now;
+	lastRun = now;
+
+	auto budget = loop->runTime;
+
+	// realtime cells are waiting, ingest gets half a slice, background a third
+	if (priority != oloopPriority_e::realtime && inBypass())
+		budget /= (priority == oloopPriority_e::ingest) ? 2 : 3;
+
+	// don't run past the deadline
+	if (deadline && deadline - now < budget)
+		budget = std::max<int64_t>(1, deadline - now);
+
+	sliceEnd = CycleClock::ticks() + budget * CycleClock::ticksPerMilli();
+}
+
+bool OpenLoop::deadlinePassed(const int64_t now) const
+{
+	return deadline && now >= deadline;
+}
+
 bool OpenLoop::sliceComplete() const
 {
-	const auto sliceDivisor = inBypass() ? 3 : 1;
-	return (Now() > runStart + (loop->runTime / sliceDivisor));
+	return CycleClock::ticks() > sliceEnd;
 }
 
 bool OpenLoop::checkCondition()
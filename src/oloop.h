@@ -17,12 +17,17 @@ namespace openset
 			clear
 		};
 
+		// cells run in priority order on each pass of an AsyncLoop
 		enum class oloopPriority_e
 		{
-			background,
-			realtime
+			background, // segment refresh, triggers, yield to realtime cells
+			ingest, // inserts, slowed (never stopped) by realtime cells
+			realtime // interactive queries
 		};
 
+		// a background cell waiting this long runs even if realtime cells are present
+		const int64_t BACKGROUND_MAX_WAIT = 1000;
+
 		class OpenLoop
 		{
 		public:
@@ -31,8 +36,14 @@ namespace openset
 			oloopState_e state;
 			int64_t runAt;
 			int64_t runStart; // time or call to run
+			int64_t sliceEnd; // CycleClock ticks when the current slice is over
+			int64_t lastRun; // when the cell last got a slice
+			int64_t queuedAt; // when the cell was queued, for latency stats
+			int64_t deadline; // cell must complete by this time (0 is none)
 			bool prepared;
 			AsyncLoop* loop;
+			int workerId; // async worker running the current slice
+			bool realtimeCounted; // included in the partition's realtime cell count
 
 			explicit OpenLoop(oloopPriority_e priority = oloopPriority_e::background);
 			virtual ~OpenLoop();
@@ -46,8 +57,21 @@ namespace openset
 			void scheduleAt(uint64_t milliRunAt);
 
 			void spawn(OpenLoop* newCell) const;
+			// spawn a read-only cell, these can run on other workers alongside
+			// each other (but never alongside regular cells in this partition)
+			void spawnShared(OpenLoop* newCell) const;
 			void suicide();
 
+			int getWorkerId() const
+			{
+				return workerId;
+			}
+
+			// start a time slice, the budget depends on priority, realtime
+			// cells in the partition, and the deadline
+			void beginSlice(int64_t now);
+			bool deadlinePassed(int64_t now) const;
+
 			bool sliceComplete() const;
 			virtual bool checkCondition();
 			virtual bool checkTimer(const int64_t milliNow);
@@ -56,6 +80,9 @@ namespace openset
 			virtual void prepare() = 0;
 			virtual void run() = 0;			
 			virtual void partitionRemoved() = 0; // allow for error handling if a partition is removed
+			// called (before suicide) if a cell passes its deadline, cells with
+			// a shuttle should reply with an error here
+			virtual void deadlineExceeded() {}
 		};
 	};
 };
@@ -15,13 +15,14 @@ OpenLoopColumn::OpenLoopColumn(
     ShuttleLambda<CellQueryResult_s>* shuttle,
     openset::db::Table* table,
     ColumnQueryConfig_s config,
-    openset::result::ResultSet* result,
+    std::vector<openset::result::ResultSet*> resultSets,
     const int64_t instance):
         OpenLoop(oloopPriority_e::realtime),
         shuttle(shuttle),
         config(std::move(config)),
         table(table),
-        result(result),
+        resultSets(std::move(resultSets)),
+        result(nullptr),
         instance(instance)
 {}
 
@@ -31,8 +32,15 @@ OpenLoopColumn::~OpenLoopColumn()
         delete s;
 }
 
+void OpenLoopColumn::bindResult()
+{
+    result = resultSets[getWorkerId()];
+}
+
 void OpenLoopColumn::prepare()
 {  
+    bindResult();
+
     parts = table->getPartitionObjects(loop->partition);
     stopBit = parts->people.peopleCount();
 
@@ -206,6 +214,7 @@ void OpenLoopColumn::prepare()
 
 void OpenLoopColumn::run()
 {
+    bindResult();
 
     while (true)
     {
@@ -309,3 +318,19 @@ void OpenLoopColumn::partitionRemoved()
         }
     );
 }
+
+void OpenLoopColumn::deadlineExceeded()
+{
+    shuttle->reply(
+        0,
+        result::CellQueryResult_s{
+            instance,
+            {},
+            openset::errors::Error{
+                openset::errors::errorClass_e::query,
+                openset::errors::errorCode_e::deadline_exceeded,
+                "query deadline exceeded"
+            }
+        }
+    );
+}
@@ -70,6 +70,7 @@ namespace openset
 
             db::Table* table;
             db::TablePartitioned* parts;
+            std::vector<result::ResultSet*> resultSets; // one per async worker
             result::ResultSet* result;
 
             int64_t stopBit{ 0 };
@@ -89,7 +90,7 @@ namespace openset
                 ShuttleLambda<result::CellQueryResult_s>* shuttle,
                 openset::db::Table* table,
                 ColumnQueryConfig_s config,
-                openset::result::ResultSet* result,
+                std::vector<openset::result::ResultSet*> resultSets,
                 const int64_t instance);
 
             ~OpenLoopColumn() final;
@@ -97,6 +98,11 @@ namespace openset
             void prepare() final;
             void run() final;
             void partitionRemoved() final;
+            void deadlineExceeded() final;
+
+        private:
+            // point `result` at the ResultSet for the worker running this slice
+            void bindResult();
         };
 
     }
@@ -14,10 +14,10 @@ OpenLoopCount::OpenLoopCount(
 	ShuttleLambda<CellQueryResult_s>* shuttle,
 	Table* table,
     const QueryPairs macros,
-	openset::result::ResultSet* result,
+	std::vector<openset::result::ResultSet*> resultSets,
     const int instance) :
 
-	OpenLoop(),
+	OpenLoop(oloopPriority_e::realtime), // counts are interactive queries
 	macrosList(macros),
 	shuttle(shuttle),
 	table(table),
@@ -31,7 +31,8 @@ OpenLoopCount::OpenLoopCount(
 	population(0),
 	popEvaluated(0),
 	index(nullptr),
-	result(result),
+	resultSets(std::move(resultSets)),
+	result(nullptr),
 	macroIter(macrosList.begin())
 {}
 
@@ -243,8 +244,21 @@ bool OpenLoopCount::nextMacro()
 	}
 }
 
+void OpenLoopCount::bindResult()
+{
+	const auto current = resultSets[getWorkerId()];
+
+	if (current == result)
+		return;
+
+	result = current;
+	result->setAccTypesFromMacros(macros);
+}
+
 void OpenLoopCount::prepare()
 {
+	bindResult();
+
 	auto prepStart = Now();
 
 	parts = table->getPartitionObjects(loop->partition);
@@ -284,6 +298,8 @@ void OpenLoopCount::prepare()
 
 void OpenLoopCount::run()
 {
+	bindResult();
+
 	openset::db::PersonData_s* personData;
 	while (true)
 	{
@@ -380,3 +396,18 @@ void OpenLoopCount::partitionRemoved()
 	    }
 	});
 }
+
+void OpenLoopCount::deadlineExceeded()
+{
+	shuttle->reply(
+		0,
+		CellQueryResult_s{
+			instance,
+			{},
+			openset::errors::Error{
+				openset::errors::errorClass_e::query,
+				openset::errors::errorCode_e::deadline_exceeded,
+				"query deadline exceeded"
+			}
+		});
+}
@@ -35,6 +35,7 @@ namespace openset
 			int popEvaluated;
 			openset::query::Indexing indexing;
 			openset::db::IndexBits* index;
+			std::vector<openset::result::ResultSet*> resultSets; // one per async worker
 			openset::result::ResultSet* result;
 
 			std::unordered_set<std::string> segmentWasCached;
@@ -50,7 +51,7 @@ namespace openset
 				ShuttleLambda<openset::result::CellQueryResult_s>* shuttle,
 				openset::db::Table* table,
 				const query::QueryPairs macros,
-				openset::result::ResultSet* result,
+				std::vector<openset::result::ResultSet*> resultSets,
 				const int instance);
 
 			~OpenLoopCount() final;
@@ -62,9 +63,13 @@ namespace openset
 
 			bool nextMacro();
 
+			// point `result` at the ResultSet for the worker running this slice
+			void bindResult();
+
 			void prepare() final;
 			void run() final;
 			void partitionRemoved() final;
+			void deadlineExceeded() final;
 		};
 	}
 }
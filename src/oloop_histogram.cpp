@@ -3,6 +3,7 @@
 #include "asyncpool.h"
 #include "tablepartitioned.h"
 #include "internoderouter.h"
+#include "attributes.h"
 
 using namespace openset::async;
 using namespace openset::query;
@@ -15,8 +16,9 @@ OpenLoopHistogram::OpenLoopHistogram(
 	Macro_s macros, 
     std::string groupName,
     const int64_t bucket,
-	openset::result::ResultSet* result,
-    const int instance) :
+	std::vector<openset::result::ResultSet*> resultSets,
+    const int instance,
+    const int columnIndex) :
 
 	OpenLoop(oloopPriority_e::realtime), // queries are high priority and will preempt other running cells
 	macros(std::move(macros)),
@@ -33,11 +35,17 @@ OpenLoopHistogram::OpenLoopHistogram(
 	startTime(0),
 	population(0),
 	index(nullptr),
-	result(result)
+	resultSets(std::move(resultSets)),
+	result(nullptr),
+	columnIndex(columnIndex)
 {}
 
 OpenLoopHistogram::~OpenLoopHistogram()
 {
+	// segment bits we made in column mode ("*" and missing segments)
+	for (auto bits : segments)
+		delete bits;
+
 	if (interpreter)
 	{
 		// free up any segment bits we may have made
@@ -48,11 +56,32 @@ OpenLoopHistogram::~OpenLoopHistogram()
 	}
 }
 
+void OpenLoopHistogram::bindResult()
+{
+	const auto current = resultSets[getWorkerId()];
+
+	if (current == result)
+		return;
+
+	result = current;
+
+	if (interpreter)
+		interpreter->setResultObject(result);
+}
+
 void OpenLoopHistogram::prepare()
 {
+	bindResult();
+
 	parts = table->getPartitionObjects(loop->partition);
 	maxLinearId = parts->people.peopleCount();
 
+	if (columnIndex != -1)
+	{
+		prepareColumn();
+		return;
+	}
+
 	// generate the index for this query	
 	indexing.mount(table, macros, loop->partition, maxLinearId);
 	bool countable;
@@ -107,6 +136,14 @@ void OpenLoopHistogram::prepare()
 
 void OpenLoopHistogram::run()
 {
+	bindResult();
+
+	if (columnIndex != -1)
+	{
+		runColumn();
+		return;
+	}
+
 	auto count = 0;
 	openset::db::PersonData_s* personData;
 	while (true)
@@ -189,6 +226,163 @@ void OpenLoopHistogram::run()
 	}
 }
 
+int64_t OpenLoopHistogram::toKey(const int64_t value) const
+{
+	// histogram keys are scaled doubles (value * 10000), double
+	// columns are already stored that way in the attributes
+	auto key = columnType == openset::db::columnTypes_e::doubleColumn ? value : value * 10000;
+
+	if (bucket)
+		key = (key / bucket) * bucket;
+
+	return key;
+}
+
+void OpenLoopHistogram::prepareColumn()
+{
+	/* Column mode
+	 *
+	 * The histogram counts people who have a value in each bucket. This
+	 * comes straight from the attribute index, each value has a bitmap of
+	 * the people that have it, so we OR the bitmaps for the values in a 
+	 * bucket, AND with the segment and take the population. No person is
+	 * mounted and no script is run.
+	 */
+	const auto columnInfo = table->getColumns()->getColumn(columnIndex);
+	columnType = columnInfo ? columnInfo->type : openset::db::columnTypes_e::freeColumn;
+
+	// a segment of "everyone" unless segments were specified
+	if (!macros.segments.size())
+		macros.segments.push_back("*");
+
+	for (const auto& segmentName : macros.segments)
+	{
+		auto bits = new IndexBits();
+
+		if (segmentName == "*")
+		{
+			bits->makeBits(maxLinearId, 1);
+		}
+		else if (const auto attr = parts->attributes.get(COL_SEGMENT, MakeHash(segmentName)); attr)
+		{
+			delete bits;
+			bits = attr->getBits();
+		}
+		else
+		{
+			// no such segment, nobody is in it (opAnd skips empty bits)
+			bits->makeBits(maxLinearId, 0);
+		}
+
+		segments.push_back(bits);
+	}
+
+	rowKey.clear();
+	rowKey.key[0] = MakeHash(groupName);
+	result->addLocalText(rowKey.key[0], groupName);
+
+	rowKey.types[0] = ResultTypes_e::Text;
+	rowKey.types[1] = ResultTypes_e::Double;
+
+	// the root row counts everyone with a value for this column
+	if (const auto all = parts->attributes.get(columnIndex, NONE); all)
+	{
+		const auto bits = all->getBits();
+		rowKey.key[1] = NONE;
+		tallyColumn(*bits);
+		delete bits;
+	}
+
+	// group the values by bucket, the bits are ORed in run
+	for (auto& v : parts->attributes.getColumnValues(columnIndex))
+		buckets[toKey(v.first)].push_back(v.first);
+
+	bucketsIter = buckets.begin();
+
+	startTime = Now();
+}
+
+void OpenLoopHistogram::runColumn()
+{
+	while (bucketsIter != buckets.end())
+	{
+		if (sliceComplete())
+			return;
+
+		auto sumBits = new IndexBits();
+
+		for (auto value : bucketsIter->second)
+		{
+			const auto attr = parts->attributes.get(columnIndex, value);
+
+			if (!attr)
+				continue;
+
+			const auto bits = attr->getBits();
+			sumBits->opOr(*bits);
+			delete bits;
+		}
+
+		rowKey.key[1] = bucketsIter->first;
+		tallyColumn(*sumBits);
+
+		delete sumBits;
+		++bucketsIter;
+	}
+
+	shuttle->reply(
+		0,
+		CellQueryResult_s{
+			instance,
+			{},
+			openset::errors::Error{}
+		});
+
+	suicide();
+}
+
+void OpenLoopHistogram::tallyColumn(const IndexBits& valueBits)
+{
+	std::vector<int64_t> populations;
+	auto any = false;
+
+	for (auto segmentBits : segments)
+	{
+		IndexBits bits;
+		bits.opCopy(valueBits);
+		bits.opAnd(*segmentBits);
+
+		populations.push_back(bits.population(maxLinearId));
+		any = any || populations.back();
+	}
+
+	// like the script version, a row is only added when someone in a
+	// segment lands in it
+	if (!any)
+		return;
+
+	auto tPair = result->results.get(rowKey);
+	if (!tPair)
+	{
+		const auto t = new (result->mem.newPtr(sizeof(openset::result::Accumulator))) openset::result::Accumulator();
+		tPair = result->results.set(rowKey, t);
+	}
+
+	auto idx = 0;
+	for (const auto population : populations)
+	{
+		if (population)
+		{
+			if (tPair->second->columns[idx].value == NONE)
+				tPair->second->columns[idx].value = population;
+			else
+				tPair->second->columns[idx].value += population;
+		}
+
+		++idx;
+	}
+}
+
 void OpenLoopHistogram::partitionRemoved()
 {
 	shuttle->reply(
@@ -203,3 +397,18 @@ void OpenLoopHistogram::partitionRemoved()
 		}
 	});
 }
+
+void OpenLoopHistogram::deadlineExceeded()
+{
+	shuttle->reply(
+		0,
+		CellQueryResult_s{
+			instance,
+			{},
+			openset::errors::Error{
+				openset::errors::errorClass_e::query,
+				openset::errors::errorCode_e::deadline_exceeded,
+				"query deadline exceeded"
+			}
+		});
+}
@@ -36,24 +36,47 @@ namespace openset
 			int population;
 			openset::query::Indexing indexing;
 			openset::db::IndexBits* index;
+			std::vector<openset::result::ResultSet*> resultSets; // one per async worker
 			openset::result::ResultSet* result;
             // loop locals
             result::RowKey rowKey;
 
+            // column mode - histogram of a single numeric column built from
+            // the attribute index bits, no script is run
+            using Ids = vector<int64_t>;
+            using BucketMap = unordered_map<int64_t, Ids>; // bucket -> values in bucket
+
+            int columnIndex{ -1 };
+            openset::db::columnTypes_e columnType{ openset::db::columnTypes_e::freeColumn };
+            std::vector<openset::db::IndexBits*> segments;
+            BucketMap buckets;
+            BucketMap::iterator bucketsIter;
+
 			explicit OpenLoopHistogram(
 				ShuttleLambda<openset::result::CellQueryResult_s>* shuttle,
 				openset::db::Table* table,
 				openset::query::Macro_s macros, 
                 std::string groupName,
                 const int64_t bucket,
-				openset::result::ResultSet* result,
-				const int instance);
+				std::vector<openset::result::ResultSet*> resultSets,
+				const int instance,
+				const int columnIndex = -1);
 
 			~OpenLoopHistogram() final;
 
 			void prepare() final;
 			void run() final;
 			void partitionRemoved() final;
+			void deadlineExceeded() final;
+
+		private:
+			// point `result` at the ResultSet for the worker running this slice
+			void bindResult();
+			void prepareColumn();
+			void runColumn();
+			// adds the people in valueBits to the row at rowKey, per segment
+			void tallyColumn(const openset::db::IndexBits& valueBits);
+			int64_t toKey(const int64_t value) const;
 		};
 	}
 }
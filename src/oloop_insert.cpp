@@ -15,7 +15,7 @@ using namespace openset::async;
 using namespace openset::db;
 
 OpenLoopInsert::OpenLoopInsert(TablePartitioned* tablePartitioned) :
-	OpenLoop(),
+	OpenLoop(oloopPriority_e::ingest),
 	tablePartitioned(tablePartitioned),
 	runCount(0)
 {
@@ -93,53 +93,79 @@ void OpenLoopInsert::run()
 	// pass. This can greatly reduce redundant calls to Mount and Commit
 	// which can be expensive as they both call LZ4 (which is fast, but still
 	// has it's overhead)
-	std::unordered_map < std::string, std::vector<cjson>> evtByPerson;
+	std::unordered_map < std::string, std::vector<cjson*>> evtByPerson;
+
+	// the documents from the last run go away here
+	parseArena.reset();
 
 	// now insert without locks
 	for (auto count = 0; queueIter != localQueue.end() && count < (inBypass() ? 15 : 50); ++queueIter, ++count, --tablePartitioned->insertBacklog)
 	{
-		cjson row(*queueIter, strlen(*queueIter));		
+		const auto row = cjson::Parse(*queueIter, strlen(*queueIter), cjson::MakeDocument(&parseArena));
 		cjson::releaseStringifyPtr(*queueIter);
 
 		// we will take profile or table to specify the table name
-		auto uuidString = row.xPathString("/person", "");
+		auto uuidString = row->xPathString("/person", "");
 		toLower(uuidString);
 
-	    const auto attr = row.xPath("/attr");
+	    const auto attr = row->xPath("/attr");
 
 		// do we have what we need to insert?
 		if (attr && uuidString.length())
 		{
 			//if (!evtByPerson.count(uuidString))
-				//evtByPerson.emplace(uuidString, std::vector<cjson>{});
+				//evtByPerson.emplace(uuidString, std::vector<cjson*>{});
 
-			evtByPerson[uuidString].emplace_back(std::move(row));
+			evtByPerson[uuidString].push_back(row);
 		}
 	}
 
+	std::vector<int64_t> insertedActions;
+	std::vector<openset::trigger::Trigger*> triggers;
+	std::vector<openset::trigger::Trigger*> skipped;
+
 	for (auto& uuid : evtByPerson)
 	{
 	    const auto personData = tablePartitioned->people.getmakePerson(uuid.first);
 		person.mount(personData);
 		person.prepare();
 
-		auto triggers = tablePartitioned->triggers->getTriggerMap();
+		insertedActions.clear();
+		for (auto json : uuid.second)
+			insertedActions.push_back(MakeHash(json->xPathString("/action", "")));
+
+		// only triggers that look at these actions can change state
+		triggers.clear();
+		skipped.clear();
+		for (auto trigger : tablePartitioned->triggers->getTriggerMap())
+			if (trigger.second->dependsOn(insertedActions))
+				triggers.push_back(trigger.second);
+			else
+				skipped.push_back(trigger.second);
+
 		for (auto trigger : triggers)
 		{
-			trigger.second->mount(&person);
-			trigger.second->preInsertTest();
+			trigger->mount(&person);
+			trigger->preInsertTest();
 		}
 
+		const auto rowsBefore = static_cast<int32_t>(person.getGrid()->getRows()->size());
+
 		// insert events for this uuid
-		for (auto &json : uuid.second)
-			person.insert(&json);
+		person.insertBatch(uuid.second);
 
 		// check status after insert
 		for (auto trigger : triggers)
-			trigger.second->postInsertTest();
+			trigger->postInsertTest();
+
+		for (auto trigger : skipped)
+			trigger->insertSkipped(&person, rowsBefore);
 
 		person.commit();
 	}
 
 	tablePartitioned->attributes.clearDirty();
+
+	if (const auto table = tablePartitioned->table; table->indexBucket)
+		tablePartitioned->attributes.cullBuckets((Now() - table->stampCull) / table->indexBucket);
 }
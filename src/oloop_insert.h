@@ -2,6 +2,7 @@
 
 #include "common.h"
 #include "oloop.h"
+#include "heapstack/heapstack.h"
 #include <unordered_set>
 
 namespace openset
@@ -37,6 +38,10 @@ namespace openset
 			std::vector<char*> localQueue;
 			decltype(localQueue)::iterator queueIter;
 
+			// the rows of a run are parsed into this, it is reset (not freed)
+			// each run so it stays warm and grows to fit a run in one block
+			HeapStack parseArena{ MemConstants::HeapStackSmallBlockSize };
+
 
 		public:
 
@@ -8,12 +8,28 @@ using namespace openset::async;
 using namespace openset::query;
 using namespace openset::result;
 
+namespace
+{
+	// false if the person's event summary rules out every top level match
+	bool personMayMatch(const RowFilters& filters, openset::db::PersonData_s* personData)
+	{
+		if (filters.empty())
+			return true;
+
+		for (const auto& filter : filters)
+			if (personData->mayHold(filter.actions, filter.from, filter.to))
+				return true;
+
+		return false;
+	}
+}
+
 // yes, we are passing queryMacros by value to get a copy
 OpenLoopQuery::OpenLoopQuery(
 	ShuttleLambda<CellQueryResult_s>* shuttle,
 	Table* table, 
 	Macro_s macros, 
-	openset::result::ResultSet* result,
+	std::vector<openset::result::ResultSet*> resultSets,
 	int instance) :
 
 	OpenLoop(oloopPriority_e::realtime), // queries are high priority and will preempt other running cells
@@ -29,7 +45,8 @@ OpenLoopQuery::OpenLoopQuery(
 	startTime(0),
 	population(0),
 	index(nullptr),
-	result(result)
+	resultSets(std::move(resultSets)),
+	result(nullptr)
 {}
 
 OpenLoopQuery::~OpenLoopQuery()
@@ -44,15 +61,95 @@ OpenLoopQuery::~OpenLoopQuery()
 	}
 }
 
+void OpenLoopQuery::bindResult()
+{
+	// a partition may be run by any async worker (work stealing), results
+	// always go to the ResultSet of the worker running this slice
+	const auto current = resultSets[getWorkerId()];
+
+	if (current == result)
+		return;
+
+	result = current;
+	result->setAccTypesFromMacros(macros);
+
+	if (interpreter)
+		interpreter->setResultObject(result);
+}
+
+bool OpenLoopQuery::splitIntoMorsels()
+{
+	// fewer partitions than workers, spread a big partition over the spare workers
+	const auto workers = globals::async->getWorkerCount();
+	const auto partitions = std::max(1, static_cast<int>(globals::async->count()));
+
+	const auto morsels = std::min<int64_t>(workers / partitions, maxLinearId / QUERY_MORSEL_MIN);
+
+	if (morsels < 2)
+		return false;
+
+	const auto group = std::make_shared<QueryMorselGroup_s>(static_cast<int32_t>(morsels));
+	const auto step = (maxLinearId + morsels - 1) / morsels;
+
+	// morsels are split at the current people count, people inserted after
+	// this point are not part of the query
+	for (auto i = 0; i < morsels; ++i)
+	{
+		const auto morsel = new OpenLoopQuery(shuttle, table, macros, resultSets, instance);
+		morsel->morselStart = i * step;
+		morsel->morselEnd = std::min(maxLinearId, (i + 1) * step);
+		morsel->morselGroup = group;
+		morsel->deadline = deadline;
+		spawnShared(morsel);
+	}
+
+	// the morsels will reply for this partition
+	suicide();
+	return true;
+}
+
+void OpenLoopQuery::reply(const openset::errors::Error& error)
+{
+	if (morselGroup)
+	{
+		// only the last morsel replies, with the first error if any
+		if (!morselGroup->complete(error))
+			return;
+
+		csLock lock(morselGroup->lock);
+		shuttle->reply(0, CellQueryResult_s{ instance, {}, morselGroup->error });
+		return;
+	}
+
+	shuttle->reply(0, CellQueryResult_s{ instance, {}, error });
+}
+
 void OpenLoopQuery::prepare()
 {
+	bindResult();
+
 	parts = table->getPartitionObjects(loop->partition);
 	maxLinearId = parts->people.peopleCount();
 
+	if (morselEnd == -1)
+	{
+		if (splitIntoMorsels())
+			return;
+	}
+	else
+	{
+		currentLinId = static_cast<int32_t>(morselStart - 1);
+	}
+
 	// generate the index for this query	
-	indexing.mount(table, macros, loop->partition, maxLinearId);
+	indexing.mount(table, macros, loop->partition, maxLinearId, true);
 	bool countable;
 	index = indexing.getIndex("_", countable);
+
+	// a morsel stops at the end of its range
+	if (morselEnd != -1)
+		maxLinearId = morselEnd;
+
 	population = index->population(maxLinearId);
 
 	interpreter = new Interpreter(macros);
@@ -90,12 +187,16 @@ void OpenLoopQuery::prepare()
 	// map table, partition and select schema columns to the Person object
 	person.mapTable(table, loop->partition, mappedColumns);
 	person.setSessionTime(macros.sessionTime);
+	// only expand rows the script can match (empty if it needs every row)
+	person.getGrid()->setActionFilter(&macros.prepareActions);
 	
 	startTime = Now();
 }
 
 void OpenLoopQuery::run()
 {
+	bindResult();
+
 	auto count = 0;
 	openset::db::PersonData_s* personData;
 	while (true)
@@ -105,23 +206,23 @@ void OpenLoopQuery::run()
 
     	// are we done? This will return the index of the 
 		// next set bit until there are no more, or maxLinId is met
-		if (interpreter->error.inError() || !index->linearIter(currentLinId, maxLinearId))
+		// note: linearIter can return an id past maxLinearId within the last word
+		if (interpreter->error.inError() || 
+			!index->linearIter(currentLinId, maxLinearId) ||
+			currentLinId >= maxLinearId)
 		{
-			shuttle->reply(
-				0, 
-				CellQueryResult_s{				
-					instance,
-                    {},
-					interpreter->error,
-				});
-
             result->setAccTypesFromMacros(macros);
+
+			// the last reply can hand the result sets off to be merged, so
+			// nothing touches `result` after this
+			reply(interpreter->error);
 			
 			suicide();
 			return;
 		}
 
-		if ((personData = parts->people.getPersonByLIN(currentLinId)) != nullptr)
+		if ((personData = parts->people.getPersonByLIN(currentLinId)) != nullptr &&
+			personMayMatch(macros.personFilters, personData))
 		{
 			++runCount;
 			person.mount(personData);
@@ -136,15 +237,20 @@ void OpenLoopQuery::run()
 
 void OpenLoopQuery::partitionRemoved()
 {
-	shuttle->reply(
-		0,
-		CellQueryResult_s{
-		instance,
-        {},
+	reply(
 		openset::errors::Error{
 			openset::errors::errorClass_e::run_time,
 			openset::errors::errorCode_e::partition_migrated,
 			"please retry query"
-		}
-	});
+		});
+}
+
+void OpenLoopQuery::deadlineExceeded()
+{
+	reply(
+		openset::errors::Error{
+			openset::errors::errorClass_e::query,
+			openset::errors::errorCode_e::deadline_exceeded,
+			"query deadline exceeded"
+		});
 }
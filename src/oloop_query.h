@@ -6,6 +6,7 @@
 #include "queryindexing.h"
 #include "queryinterpreter.h"
 #include "result.h"
+#include <memory>
 
 namespace openset
 {
@@ -17,6 +18,36 @@ namespace openset
 
 	namespace async
 	{
+		// smallest number of people worth handing to a worker of its own
+		const int64_t QUERY_MORSEL_MIN = 25000;
+
+		/* A partition query split into linear ID ranges (morsels). The
+		 * morsels run in parallel on any worker, the last one to finish
+		 * replies for the partition.
+		 */
+		struct QueryMorselGroup_s
+		{
+			atomic<int32_t> pending;
+			CriticalSection lock;
+			openset::errors::Error error;
+
+			explicit QueryMorselGroup_s(const int32_t morsels) :
+				pending(morsels)
+			{}
+
+			// returns true for the last morsel
+			bool complete(const openset::errors::Error& morselError)
+			{
+				if (morselError.inError())
+				{
+					csLock guard(lock);
+					error = morselError;
+				}
+
+				return --pending == 0;
+			}
+		};
+
 		class OpenLoopQuery : public OpenLoop
 		{
 		public:
@@ -34,13 +65,19 @@ namespace openset
 			int population;
 			openset::query::Indexing indexing;
 			openset::db::IndexBits* index;
+			std::vector<openset::result::ResultSet*> resultSets; // one per async worker
 			openset::result::ResultSet* result;
 
+			// morsel mode, iterate linear IDs from morselStart to morselEnd
+			int64_t morselStart{ 0 };
+			int64_t morselEnd{ -1 };
+			std::shared_ptr<QueryMorselGroup_s> morselGroup;
+
 			explicit OpenLoopQuery(
 				ShuttleLambda<openset::result::CellQueryResult_s>* shuttle,
 				openset::db::Table* table,
 				openset::query::Macro_s macros, 
-				openset::result::ResultSet* result,
+				std::vector<openset::result::ResultSet*> resultSets,
 				int instance);
 
 			~OpenLoopQuery() final;
@@ -48,6 +85,13 @@ namespace openset
 			void prepare() final;
 			void run() final;
 			void partitionRemoved() final;
+			void deadlineExceeded() final;
+
+		private:
+			void bindResult();
+			// split a large partition into shared morsel cells, returns true if it did
+			bool splitIntoMorsels();
+			void reply(const openset::errors::Error& error);
 		};
 	}
 }
@@ -66,9 +66,14 @@ PersonData_s* People::getmakePerson(string userIdString)
 			//strcpy(newUser->idstr, idCstr);
 
 			newUser->id = hashId;
+			newUser->firstStamp = 0;
+			newUser->lastStamp = 0;
+			newUser->actionBloom = 0;
+			newUser->eventCount = 0;
 			newUser->linId = static_cast<int32_t>(peopleLinear.size());
 			newUser->idBytes = 0;
 			newUser->propBytes = 0;
+			newUser->dirBytes = 0;
 			newUser->flagRecords = 0;
 			newUser->bytes = 0;
 			newUser->comp = 0;
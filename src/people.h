@@ -3,7 +3,7 @@
 #include "common.h"
 #include "logger.h"
 #include "person.h"
-#include "mem/bigring.h"
+#include "mem/flatmap.h"
 #include "grid.h"
 
 #include <vector>
@@ -19,7 +19,7 @@ namespace openset
 		class People
 		{
 		public:
-			bigRing<int64_t, int32_t> peopleMap; // probably delete this!
+			flatMap<int64_t, int32_t> peopleMap; // probably delete this!
 			vector<PersonData_s*> peopleLinear;
 			int partition;
 		public:
@@ -96,6 +96,11 @@ void Person::insert(cjson* rowData)
 	grid.insert(rowData);
 }
 
+void Person::insertBatch(const std::vector<cjson*>& rowData)
+{
+	grid.insertBatch(rowData);
+}
+
 PersonData_s* Person::commit()
 {
 	data = grid.commit();
@@ -102,7 +102,7 @@ namespace openset
 
 			inline PersonData_s* getMeta() const
 			{
-				return data;
+				return grid.getMeta(); // flags can move the record after mount
 			}
 
 			/**
@@ -111,6 +111,12 @@ namespace openset
 			 */
 			void insert(cjson* rowData);
 
+			/**
+			 * \brief insert all of a person's new rows at once (see Grid::insertBatch)
+			 * \param rowData JSON document objects, in any order.
+			 */
+			void insertBatch(const std::vector<cjson*>& rowData);
+
 			/**
 			 * \brief commit (re-compress) the data in Person.grid
 			 * 
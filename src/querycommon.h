@@ -4,6 +4,7 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
+#include <limits>
 
 #include "errors.h"
 #include "dbtypes.h"
@@ -11,6 +12,8 @@
 #include "var/var.h"
 #include "../lib/str/strtools.h"
 
+class TimeZone;
+
 namespace openset
 {
 	namespace query
@@ -31,6 +34,8 @@ namespace openset
 			avg,
 			count,
 			dist_count_person,
+			approx_count_distinct,
+			percentile,
 			value,
 			var,
 			second_number,
@@ -320,6 +325,9 @@ namespace openset
 					{"avg", Modifiers_e::avg},
 					{"count", Modifiers_e::count},
 					{"dist_count_person", Modifiers_e::dist_count_person },
+					{"approx_count_distinct", Modifiers_e::approx_count_distinct },
+					{"percentile", Modifiers_e::percentile },
+					{"median", Modifiers_e::percentile },
 					{"value", Modifiers_e::value},
 					{"val", Modifiers_e::value },
 					{"variable", Modifiers_e::var },
@@ -334,6 +342,8 @@ namespace openset
 					{Modifiers_e::avg, "AVG"},
 					{Modifiers_e::count, "COUNT"},
 					{Modifiers_e::dist_count_person, "DCNTPP" },
+					{Modifiers_e::approx_count_distinct, "APPROX_DCNT" },
+					{Modifiers_e::percentile, "PERCENTILE" },
 					{Modifiers_e::value, "VALUE"},
 					{Modifiers_e::var, "VAR"},
 					{Modifiers_e::second_number, "SECOND"},
@@ -723,6 +733,7 @@ namespace openset
 			int sortOrder{-1}; // used for sorting in column order
 			int lambdaIndex{-1}; // used for variable assignment by lambada
 			bool nonDistinct{ false };
+			double percentile{ 50.0 }; // used by the `percentile` modifier
 
 			cvar value{NONE};
 			cvar startingValue{NONE};
@@ -770,6 +781,7 @@ namespace openset
 				lambdaIndex = source.lambdaIndex;
 
 				nonDistinct = source.nonDistinct;
+				percentile = source.percentile;
 
 				value = source.value;
 				startingValue = source.startingValue;
@@ -888,6 +900,29 @@ namespace openset
 			CountList countList;
 		};
 
+		// `match where` lambdas (by code offset) that can only pass on rows holding one of these actions
+		using ActionLambdas = unordered_map<int64_t, vector<int64_t>>;
+
+		using ColumnValues = vector<pair<int32_t, vector<int64_t>>>; // schema column, sorted values
+
+		// what rows passing a `match where` must look like, as far as actions and stamps go
+		struct RowFilter_s
+		{
+			vector<int64_t> actions; // sorted, empty means any action
+			ColumnValues values; // other columns, a passing row holds one of the values in each
+			int64_t from{ std::numeric_limits<int64_t>::min() };
+			int64_t to{ std::numeric_limits<int64_t>::max() };
+		};
+
+		using RowFilters = vector<RowFilter_s>;
+
+		// how a trigger function can carry on from where its last run ended (see QueryParser::incrementalPlan)
+		struct IncrementalPlan_s
+		{
+			int64_t match{ -1 }; // offset of the function's only top level `match`, -1 if it can't
+			vector<int> stateVars; // user variables carried from one run to the next
+		};
+
 		using HintPair = pair<string, HintOpList>;
 		using HintPairs = vector<HintPair>;
 		using ParamVars = unordered_map<string, cvar>;
@@ -902,11 +937,15 @@ namespace openset
 			string segmentName;
 			SegmentList segments;
 			MarshalSet marshalsReferenced;
+			ActionLambdas actionLambdas;
+			vector<int64_t> prepareActions; // rows without these actions are never looked at (empty means all rows are)
+			RowFilters personFilters; // people can only produce results if one of these can pass (empty means run everyone)
 
 			int64_t segmentTTL{ -1 };
 			int64_t segmentRefresh{ -1 };
 			int sessionColumn{ -1 };
 			int64_t sessionTime{ 60'000LL * 30LL }; // 30 minutes
+			const TimeZone* timeZone{ nullptr }; // date functions work in this zone (`tz` param), nullptr is UTC
 
 			std::string rawScript;
 
@@ -5,17 +5,21 @@
 using namespace openset::query;
 using namespace openset::db;
 
+// most buckets a value's layers will be ORed over before the range is considered too wide
+const int64_t BucketScanMax = 1000;
+
 openset::query::Indexing::Indexing() :
 	table(nullptr),
 	parts(nullptr),
 	partition(-1), 
-	stopBit(0)
+	stopBit(0),
+	useBuckets(false)
 {}
 
 Indexing::~Indexing()
 {}
 
-void Indexing::mount(Table* tablePtr, Macro_s& queryMacros, int partitionNumber, int stopAtBit)
+void Indexing::mount(Table* tablePtr, Macro_s& queryMacros, int partitionNumber, int stopAtBit, bool narrowByBuckets)
 {
 	indexes.clear();
 	table = tablePtr;
@@ -23,6 +27,7 @@ void Indexing::mount(Table* tablePtr, Macro_s& queryMacros, int partitionNumber,
 	partition = partitionNumber;
 	parts = table->getPartitionObjects(partition);
 	stopBit = stopAtBit;
+	useBuckets = narrowByBuckets;
 
 	// this will build all the indexes and store them 
 	// in a vector of indexes using an std::pair of name and index
@@ -243,6 +248,7 @@ IndexBits Indexing::buildIndex(HintOpList &index, bool &countable)
 		IndexBits bits;
 		bits.makeBits(maxLinId, 1);
 		countable = true;
+		narrowToBuckets(bits);
 		return bits;
 	}
 
@@ -263,6 +269,86 @@ IndexBits Indexing::buildIndex(HintOpList &index, bool &countable)
 		cout << ss.str() << endl;
 
 	*/
+	narrowToBuckets(res);
 	res.grow((stopBit / 64) + 1);
 	return res;
 }
+
+/*
+	narrowToBuckets - when every top level match is date bounded (see
+	Macro_s::personFilters) only people with a matching action or value
+	in one of the buckets covering that range can produce results. 
+
+	The attribute bits above say who *ever* had a value, this ANDs in
+	the bucketed layers for the range. Left alone if any filter can't
+	be answered by the layers (open start, culled buckets, no bucketed
+	column pinned to values).
+*/
+void Indexing::narrowToBuckets(IndexBits& bits)
+{
+	const auto width = table->indexBucket;
+
+	if (!useBuckets || !width || macros.personFilters.empty() || macros.segments.size())
+		return;
+
+	auto& attributes = parts->attributes;
+
+	IndexBits active;
+	active.makeBits(64, 0);
+
+	for (const auto& filter : macros.personFilters)
+	{
+		// never passes
+		if (filter.from > filter.to)
+			continue;
+
+		if (filter.from == std::numeric_limits<int64_t>::min())
+			return;
+
+		const auto fromBucket = filter.from / width;
+		const auto toBucket = std::min(filter.to / width, attributes.newestBucket);
+
+		if (fromBucket < attributes.cullBucket ||
+			toBucket - std::max(fromBucket, attributes.oldestBucket) > BucketScanMax)
+			return;
+
+		// the columns this filter pins to values, that have layers
+		ColumnValues pinned;
+
+		if (filter.actions.size())
+			pinned.emplace_back(COL_ACTION, filter.actions);
+
+		for (const auto& column : filter.values)
+			if (table->getColumns()->getColumn(column.first)->bucketed)
+				pinned.push_back(column);
+
+		if (pinned.empty())
+			return;
+
+		IndexBits filterBits;
+		auto initialized = false;
+
+		for (const auto& column : pinned)
+		{
+			IndexBits columnBits;
+			columnBits.makeBits(64, 0);
+
+			for (const auto value : column.second)
+				attributes.getBucketBits(column.first, value, fromBucket, toBucket, columnBits);
+
+			if (initialized)
+			{
+				filterBits.opAnd(columnBits);
+			}
+			else
+			{
+				filterBits.opCopy(columnBits);
+				initialized = true;
+			}
+		}
+
+		active.opOr(filterBits);
+	}
+
+	bits.opAnd(active);
+}
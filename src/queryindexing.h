@@ -21,6 +21,7 @@ namespace openset
 			openset::db::TablePartitioned* parts;
 			int partition;
 			int stopBit;
+			bool useBuckets;
 			IndexList indexes;
 
 			Indexing();
@@ -30,12 +31,14 @@ namespace openset
 				openset::db::Table* tablePtr, 
 				Macro_s& queryMacros, 
 				int partitionNumber, 
-				int stopAtBit);
+				int stopAtBit,
+				bool narrowByBuckets = false);
 
 			openset::db::IndexBits* getIndex(std::string name, bool &countable);
 
 		private:
 			openset::db::IndexBits buildIndex(HintOpList &index, bool &countable);
+			void narrowToBuckets(openset::db::IndexBits& bits);
 		};
 	};
 };
@@ -29,6 +29,7 @@ openset::query::Interpreter::~Interpreter()
 void openset::query::Interpreter::setResultObject(result::ResultSet* resultSet)
 {
 	result = resultSet;
+	++tallyCacheGeneration; // cached accumulators belong to the old result
 }
 
 void openset::query::Interpreter::configure()
@@ -126,27 +127,58 @@ openset::query::SegmentList* openset::query::Interpreter::getSegmentList() const
 	return &macros.segments;
 }
 
-void openset::query::Interpreter::marshal_tally(const int paramCount, const Col_s* columns, const int currentRow)
+void openset::query::Interpreter::buildTallyPlan()
 {
+	tallyPlan.clear();
+	tallyPlan.reserve(macros.vars.columnVars.size());
+
+	for (auto& resCol : macros.vars.columnVars)
+		tallyPlan.push_back(TallyColumn_s{
+			&resCol,
+			resCol.modifier,
+			resCol.index,
+			resCol.column,
+			resCol.distinctColumn,
+			// 'all' was NOT used on the aggregator, sketches are distinct by nature
+			!resCol.nonDistinct && resCol.modifier != Modifiers_e::approx_count_distinct,
+			!(resCol.schemaColumn == COL_UUID || resCol.modifier == Modifiers_e::dist_count_person)
+		});
+
+	tallyPlanReady = true;
+}
 
-	if (paramCount <= 0)
-		return;
+openset::result::Accumulator* openset::query::Interpreter::getTallyAccumulator(const int depth)
+{
+	// rowKey is filled to depth, everything after depth is NONE, so
+	// the cache slot can be chosen from the populated keys only
+	auto hash = static_cast<uint64_t>(depth);
+	for (auto i = 0; i <= depth; ++i)
+		hash = (hash ^ static_cast<uint64_t>(rowKey.key[i])) * 0x9E3779B97F4A7C15ULL;
 
-	vector<cvar> params(paramCount);
+	auto& entry = tallyCache[(hash >> 32) & (TallyCacheSize - 1)];
 
-	for (auto i = paramCount - 1 ; i >= 0; --i)
-	{
-		--stackPtr;
+	if (entry.generation == tallyCacheGeneration && entry.key == rowKey)
+		return entry.accumulator;
 
-		// if any of these params are undefined, exit
-		if (stackPtr->typeof() != cvar::valueType::STR &&
-			*stackPtr == NONE)
-			params[i] = NONE;
-		else
-			params[i] = std::move(*stackPtr);
+	auto tPair = result->results.get(rowKey);
+
+	if (!tPair)
+	{
+		const auto t = new (result->mem.newPtr(sizeof(openset::result::Accumulator))) openset::result::Accumulator();
+		tPair = result->results.set(rowKey, t);
 	}
 
-	if (!params.size())
+	entry.key = rowKey;
+	entry.accumulator = tPair->second;
+	entry.generation = tallyCacheGeneration;
+
+	return tPair->second;
+}
+
+void openset::query::Interpreter::marshal_tally(const int paramCount, const Col_s* columns, const int currentRow)
+{
+
+	if (paramCount <= 0)
 		return;
 
 	// strings, doubles, and bools are all ints internally,
@@ -200,134 +232,166 @@ void openset::query::Interpreter::marshal_tally(const int paramCount, const Col_
         }
     };
 
-	const auto aggColumns = [&](result::Accumulator* resultColumns)
+	// pop the params and convert them to group keys right on the
+	// stack, this used to copy them into a vector<cvar> for every row.
+	// Grouping stops at the first undefined (NONE) param.
+	stackPtr -= paramCount;
+
+	int64_t keys[result::keyDepth];
+	result::ResultTypes_e types[result::keyDepth];
+	auto keyCount = 0;
+
+	for (auto i = 0; i < paramCount && keyCount < result::keyDepth; ++i)
 	{
-		for (auto& resCol: macros.vars.columnVars)
-		{
-			if (!resCol.nonDistinct) // if the 'all' flag was NOT used on an aggregater
-			{
-				/* Yikes - a big gnarly tuple (hash can colide, tuple won't)
-				 * 
-				 *  What this is saying is for this column, and this value for
-				 *  this branch in the result at this timestamp, have we ever ran
-				 *  an aggregation? If not, run it, otherwise move on
-				 */ 				
-
-				// emplaceTry will return false if the value exists
-				if (!eventDistinct.emplaceTry(
-                    ValuesSeenKey{
-                        resCol.index,
-                        resCol.modifier == Modifiers_e::var ? fixToInt(resCol.value) : columns->cols[resCol.distinctColumn],
-                        reinterpret_cast<int64_t>(resultColumns), // this pointer is unique to the ResultSet row
-                        resCol.schemaColumn == COL_UUID ? 0 : (resCol.modifier == Modifiers_e::dist_count_person ? 0 : columns->cols[COL_STAMP])
-                    }, 
-                    1))
-					continue; // we already tabulated this for this key
-			}
+		auto& item = stackPtr[i];
+
+		if (item.typeof() != cvar::valueType::STR &&
+			item == NONE)
+			break;
+
+		keys[keyCount] = fixToInt(item);
+		types[keyCount] = getType(item);
+		++keyCount;
+	}
+
+	// run column lambdas!
+	if (macros.vars.columnLambdas.size())
+		for (auto lambdaIndex : macros.vars.columnLambdas)
+			opRunner(// call the column lambda
+				&macros.code.front() + lambdaIndex,
+				currentRow);
+
+	if (!keyCount)
+		return;
 
-			auto resultIndex = resCol.index + segmentColumnShift;
+	if (!tallyPlanReady)
+		buildTallyPlan();
+
+	const auto stamp = columns->cols[COL_STAMP];
+
+	rowKey.clear();
+
+	for (auto depth = 0; depth < keyCount; ++depth)
+	{
+		rowKey.key[depth] = keys[depth];
+		rowKey.types[depth] = types[depth];
+
+		const auto resultColumns = getTallyAccumulator(depth);
+
+		for (auto& resCol : tallyPlan)
+		{
+			// 'var' aggregators use the value of the variable rather than a column
+			const auto isVar = resCol.modifier == Modifiers_e::var;
+			const auto varValue = isVar ? fixToInt(resCol.var->value) : 0;
+
+			/* for this column, and this value for this branch in the
+			 * result at this timestamp, have we ever ran an aggregation?
+			 * If not, run it, otherwise move on
+			 */
+			if (resCol.distinct &&
+				!eventDistinct.insert(
+					resCol.index,
+					isVar ? varValue : columns->cols[resCol.distinctColumn],
+					reinterpret_cast<int64_t>(resultColumns), // this pointer is unique to the ResultSet row
+					resCol.useStamp ? stamp : 0))
+				continue; // we already tabulated this for this key
+
+			const auto value = columns->cols[resCol.column];
+			auto& target = resultColumns->columns[resCol.index + segmentColumnShift];
 
 			switch (resCol.modifier)
 			{
 				case Modifiers_e::sum:
-					if (columns->cols[resCol.column] != NONE)
+					if (value != NONE)
 					{
-						if (resultColumns->columns[resultIndex].value == NONE)
-							resultColumns->columns[resultIndex].value = columns->cols[resCol.column];
+						if (target.value == NONE)
+							target.value = value;
 						else
-							resultColumns->columns[resultIndex].value += columns->cols[resCol.column];
+							target.value += value;
 					}
 					break;
 
 				case Modifiers_e::min:
-					if (columns->cols[resCol.column] != NONE &&
-							(resultColumns->columns[resultIndex].value == NONE ||
-							 resultColumns->columns[resultIndex].value > columns->cols[resCol.column]))
-						resultColumns->columns[resultIndex].value = columns->cols[resCol.column];
+					if (value != NONE &&
+							(target.value == NONE ||
+							 target.value > value))
+						target.value = value;
 					break;
 
 				case Modifiers_e::max:
-					if (columns->cols[resCol.column] != NONE &&
-							(resultColumns->columns[resultIndex].value == NONE ||
-							 resultColumns->columns[resultIndex].value < columns->cols[resCol.column]))
-						resultColumns->columns[resultIndex].value = columns->cols[resCol.column];
+					if (value != NONE &&
+							(target.value == NONE ||
+							 target.value < value))
+						target.value = value;
 					break;
 
 				case Modifiers_e::avg:
-					if (columns->cols[resCol.column] != NONE)
+					if (value != NONE)
 					{
-						if (resultColumns->columns[resultIndex].value == NONE)
+						if (target.value == NONE)
 						{
-							resultColumns->columns[resultIndex].value = columns->cols[resCol.column];
-							resultColumns->columns[resultIndex].count = 1;
+							target.value = value;
+							target.count = 1;
 						}
 						else
 						{
-							resultColumns->columns[resultIndex].value += columns->cols[resCol.column];
-							resultColumns->columns[resultIndex].count++;
+							target.value += value;
+							target.count++;
 						}
 					}
 					break;
 
 				case Modifiers_e::dist_count_person:
 				case Modifiers_e::count:
-					if (columns->cols[resCol.column] != NONE)
+					if (value != NONE)
 					{
-						if (resultColumns->columns[resultIndex].value == NONE)
-							resultColumns->columns[resultIndex].value = 1;
+						if (target.value == NONE)
+							target.value = 1;
 						else
-							resultColumns->columns[resultIndex].value++;
+							target.value++;
+					}
+					break;
+
+				case Modifiers_e::approx_count_distinct:
+					if (value != NONE)
+					{
+						// the accumulator holds a pointer to the sketch registers
+						if (target.value == NONE)
+						{
+							const auto registers = recast<uint8_t*>(result->mem.newPtr(sketch::HyperLogLog::Size));
+							sketch::HyperLogLog::init(registers);
+							target.value = reinterpret_cast<int64_t>(registers);
+						}
+						sketch::HyperLogLog::add(reinterpret_cast<uint8_t*>(target.value), value);
+					}
+					break;
+
+				case Modifiers_e::percentile:
+					if (value != NONE)
+					{
+						if (target.value == NONE)
+						{
+							const auto block = recast<uint8_t*>(result->mem.newPtr(sketch::TDigest::Size));
+							sketch::TDigest::init(block, resCol.var->percentile / 100.0);
+							target.value = reinterpret_cast<int64_t>(block);
+						}
+						sketch::TDigest::add(reinterpret_cast<uint8_t*>(target.value), static_cast<double>(value));
 					}
 					break;
 
 				case Modifiers_e::value:
-					resultColumns->columns[resultIndex].value = columns->cols[resCol.column];
+					target.value = value;
 					break;
 
 				case Modifiers_e::var:
-					if (resultColumns->columns[resultIndex].value == NONE)
-						resultColumns->columns[resultIndex].value = fixToInt(resCol.value);
+					if (target.value == NONE)
+						target.value = varValue;
 					else
-						resultColumns->columns[resultIndex].value += fixToInt(resCol.value);
+						target.value += varValue;
 					break;
 				default: break;
 			}
 		}
-	};
-
-	rowKey.clear();
-
-	// run column lambdas!
-	if (macros.vars.columnLambdas.size())
-		for (auto lambdaIndex : macros.vars.columnLambdas)
-			opRunner(// call the column lambda
-				&macros.code.front() + lambdaIndex,
-				currentRow);
-
-	auto depth = 0;
-
-	for (auto item : params)
-    {
-
-		if (item.typeof() != cvar::valueType::STR &&
-			item == NONE)
-			break;
-
-	    rowKey.key[depth] = fixToInt(item);
-        rowKey.types[depth] = getType(item);
-			
-		//result->setAtDepth(rowKey, set_cb);
-		auto tPair = result->results.get(rowKey);
-
-		if (!tPair)
-		{
-			const auto t = new (result->mem.newPtr(sizeof(openset::result::Accumulator))) openset::result::Accumulator();
-			tPair = result->results.set(rowKey, t);
-		}
-
-		aggColumns(tPair->second);
-
-	    ++depth;
 	}
 
 }
@@ -590,7 +654,7 @@ void openset::query::Interpreter::marshal_dt_between(const int paramCount, const
 
 	// make sure the stamp is in milliseconds
 	start_stamp = Epoch::fixMilli(start_stamp);
-	end_stamp = Epoch::fixMilli(start_stamp);
+	end_stamp = Epoch::fixMilli(end_stamp);
 	
 	*stackPtr = 
 		(rowStamp >= start_stamp.getInt64() && 
@@ -1320,6 +1384,33 @@ string openset::query::Interpreter::getLiteral(const int64_t id) const
 	return "";
 }
 
+int64_t openset::query::Interpreter::toLocal(int64_t stamp)
+{
+	stamp = Epoch::fixUnix(stamp);
+
+	if (!macros.timeZone)
+		return stamp;
+
+	if (!zoneSpan.contains(stamp))
+		zoneSpan = macros.timeZone->spanAt(stamp);
+
+	return stamp + zoneSpan.offset;
+}
+
+int64_t openset::query::Interpreter::fromLocal(const int64_t localStamp)
+{
+	if (!macros.timeZone)
+		return localStamp;
+
+	// the last offset is usually right, if not it puts us in the span to look in
+	const auto stamp = localStamp - zoneSpan.offset;
+
+	if (!zoneSpan.contains(stamp))
+		zoneSpan = macros.timeZone->spanAt(stamp);
+
+	return localStamp - zoneSpan.offset;
+}
+
 bool openset::query::Interpreter::marshal(Instruction_s* inst, int& currentRow)
 {
 	// index maps to function in the enumerator marshals_e
@@ -1404,43 +1495,43 @@ bool openset::query::Interpreter::marshal(Instruction_s* inst, int& currentRow)
 		*(stackPtr - 1) = Epoch::fixMilli(Epoch::epochMinuteDate(*(stackPtr - 1)));
 		break;
 	case Marshals_e::marshal_get_hour:
-		*(stackPtr - 1) = Epoch::epochHourNumber(*(stackPtr - 1));
+		*(stackPtr - 1) = Epoch::epochHourNumber(toLocal(*(stackPtr - 1)));
 		break;
 	case Marshals_e::marshal_round_hour:
-		*(stackPtr - 1) = Epoch::fixMilli(Epoch::epochHourDate(*(stackPtr - 1)));
+		*(stackPtr - 1) = Epoch::fixMilli(fromLocal(Epoch::epochHourDate(toLocal(*(stackPtr - 1)))));
 		break;
 	case Marshals_e::marshal_round_day:
-		*(stackPtr - 1) = Epoch::fixMilli(Epoch::epochDayDate(*(stackPtr - 1)));
+		*(stackPtr - 1) = Epoch::fixMilli(fromLocal(Epoch::epochDayDate(toLocal(*(stackPtr - 1)))));
 		break;
 	case Marshals_e::marshal_get_day_of_week:
-		*(stackPtr - 1) = Epoch::epochDayOfWeek(*(stackPtr - 1));
+		*(stackPtr - 1) = Epoch::epochDayOfWeek(toLocal(*(stackPtr - 1)));
 		break;
 	case Marshals_e::marshal_get_day_of_month:
-		*(stackPtr - 1) = Epoch::epochDayOfMonth(*(stackPtr - 1));
+		*(stackPtr - 1) = Epoch::epochDayOfMonth(toLocal(*(stackPtr - 1)));
 		break;
 	case Marshals_e::marshal_get_day_of_year:
-		*(stackPtr - 1) = Epoch::epochDayOfYear(*(stackPtr - 1));
+		*(stackPtr - 1) = Epoch::epochDayOfYear(toLocal(*(stackPtr - 1)));
 		break;
 	case Marshals_e::marshal_round_week:
-		*(stackPtr - 1) = Epoch::fixMilli(Epoch::epochWeekDate(*(stackPtr - 1)));
+		*(stackPtr - 1) = Epoch::fixMilli(fromLocal(Epoch::epochWeekDate(toLocal(*(stackPtr - 1)))));
 		break;
 	case Marshals_e::marshal_get_month:
-		*(stackPtr - 1) = Epoch::epochMonthNumber(*(stackPtr - 1));
+		*(stackPtr - 1) = Epoch::epochMonthNumber(toLocal(*(stackPtr - 1)));
 		break;
 	case Marshals_e::marshal_round_month:
-		*(stackPtr - 1) = Epoch::fixMilli(Epoch::epochMonthDate(*(stackPtr - 1)));
+		*(stackPtr - 1) = Epoch::fixMilli(fromLocal(Epoch::epochMonthDate(toLocal(*(stackPtr - 1)))));
 		break;
 	case Marshals_e::marshal_get_quarter:
-		*(stackPtr - 1) = Epoch::epochQuarterNumber(*(stackPtr - 1));
+		*(stackPtr - 1) = Epoch::epochQuarterNumber(toLocal(*(stackPtr - 1)));
 		break;
 	case Marshals_e::marshal_round_quarter:
-		*(stackPtr - 1) = Epoch::fixMilli(Epoch::epochQuarterDate(*(stackPtr - 1)));
+		*(stackPtr - 1) = Epoch::fixMilli(fromLocal(Epoch::epochQuarterDate(toLocal(*(stackPtr - 1)))));
 		break;
 	case Marshals_e::marshal_get_year:
-		*(stackPtr - 1) = Epoch::epochYearNumber(*(stackPtr - 1));
+		*(stackPtr - 1) = Epoch::epochYearNumber(toLocal(*(stackPtr - 1)));
 		break;
 	case Marshals_e::marshal_round_year:
-		*(stackPtr - 1) = Epoch::fixMilli(Epoch::epochYearDate(*(stackPtr - 1)));
+		*(stackPtr - 1) = Epoch::fixMilli(fromLocal(Epoch::epochYearDate(toLocal(*(stackPtr - 1)))));
 		break;
 	case Marshals_e::marshal_iter_get:
 		*stackPtr = currentRow;
@@ -2288,6 +2379,10 @@ void openset::query::Interpreter::opRunner(Instruction_s* inst, int currentRow)
 			case OpCode_e::ITNEXT:
 				// fancy and strange stuff happens here					
 				{
+					// an earlier match at this level used up the rows
+					if (currentRow >= static_cast<int>(rows->size()))
+						break;
+
 					auto iterCount = 0;
 					cvar lambda;
 					auto rowGrp = HashPair((*rows)[currentRow]->cols[COL_STAMP], (*rows)[currentRow]->cols[COL_ACTION]); // use left to hold lastRowId
@@ -2298,6 +2393,49 @@ void openset::query::Interpreter::opRunner(Instruction_s* inst, int currentRow)
 					// store the time stamp of the last match
 					matchStampPrev.push_back((*rows)[currentRow]->cols[0]);
 
+					// if the where clause can only pass on certain actions we
+					// visit just the rows holding them (see Grid::getActionRows)
+					auto skipping = false;
+					const int32_t* candidate = nullptr;
+					const int32_t* candidateEnd = nullptr;
+					std::vector<int32_t> merged; // where clauses with more than one action
+
+					if (inst->extra)
+						if (const auto found = macros.actionLambdas.find(inst->extra); found != macros.actionLambdas.end())
+						{
+							skipping = true;
+
+							for (const auto action : found->second)
+							{
+								const int32_t* actionRows;
+								int32_t count;
+
+								if (!grid->getActionRows(action, actionRows, count))
+								{
+									skipping = false;
+									break;
+								}
+
+								if (found->second.size() == 1)
+								{
+									candidate = actionRows;
+									candidateEnd = actionRows + count;
+								}
+								else
+									merged.insert(merged.end(), actionRows, actionRows + count);
+							}
+
+							if (skipping && found->second.size() != 1)
+							{
+								sort(merged.begin(), merged.end());
+								candidate = merged.data();
+								candidateEnd = candidate + merged.size();
+							}
+
+							if (skipping && candidate != candidateEnd)
+								candidate = std::lower_bound(candidate, candidateEnd, currentRow);
+						}
+
 					// user right for count
 					for (const auto rowCount = rows->size();
 					     iterCount < inst->value && currentRow < rowCount;
@@ -2305,6 +2443,23 @@ void openset::query::Interpreter::opRunner(Instruction_s* inst, int currentRow)
 					{
 						//++loopCount;
 
+						if (skipping)
+						{
+							while (candidate != candidateEnd && *candidate < currentRow)
+								++candidate;
+
+							// no candidates left, end as if we had scanned every row
+							if (candidate == candidateEnd)
+							{
+								if (nestDepth == 1)
+									matchStampTop = rows->back()->cols[0];
+								currentRow = static_cast<int>(rowCount);
+								break;
+							}
+
+							currentRow = *candidate;
+						}
+
 						if (loopState == LoopState_e::in_exit || error.inError())
 						{
 							*stackPtr = 0;
@@ -2869,6 +3024,47 @@ void openset::query::Interpreter::exec(const int64_t functionHash)
 		"function_id: " + to_string(functionHash));
 }
 
+void openset::query::Interpreter::execFrom(const int64_t offset, const int startRow)
+{
+	execReset();
+	returns.clear();
+
+	if (!rows || startRow >= static_cast<int>(rows->size()))
+		return;
+
+	try
+	{
+		segmentColumnShift = 0;
+		opRunner(&macros.code.front() + offset, startRow);
+	}
+	catch (const std::runtime_error& ex)
+	{
+		std::string additional = "";
+		if (lastDebug)
+			additional = lastDebug->toStrShort();
+
+		error.set(
+			openset::errors::errorClass_e::run_time,
+			openset::errors::errorCode_e::run_time_exception_triggered,
+			std::string{ ex.what() } +" (4)",
+			additional
+		);
+	}
+	catch (...)
+	{
+		std::string additional = "";
+		if (lastDebug)
+			additional = lastDebug->toStrShort();
+
+		error.set(
+			openset::errors::errorClass_e::run_time,
+			openset::errors::errorCode_e::run_time_exception_triggered,
+			"unknown run-time error (5)",
+			additional
+		);
+	}
+}
+
 openset::query::Interpreter::Returns& openset::query::Interpreter::getLastReturn()
 {
     return returns;
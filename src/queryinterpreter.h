@@ -4,6 +4,8 @@
 #include "grid.h"
 #include "result.h"
 #include "errors.h"
+#include "mem/distinctset.h"
+#include "time/timezone.h"
 
 using namespace openset::db;
 
@@ -114,6 +116,10 @@ namespace openset
 			int64_t matchStampTop{ 0 };
 			vector<int64_t> matchStampPrev{ 0 };
 
+			// last offset looked up in macros.timeZone, date functions only
+			// search again when a stamp falls outside it
+			TimeZone::span_s zoneSpan{ 0, 0, 0 };
+
 			// switches
 			InterpretMode_e interpretMode{ InterpretMode_e::query };
 			LoopState_e loopState{ LoopState_e::run }; // run, continue, break, exit
@@ -130,13 +136,40 @@ namespace openset
 			function<bool(string emitMessage)> emit_cb{ nullptr };
 			function<IndexBits*(string, bool&)> getSegment_cb{ nullptr };
 
-			// distinct counting structures
-			using ValuesSeenKey = tuple<int32_t, int64_t, int64_t, int64_t>;
-			using ValuesSeen = bigRing<ValuesSeenKey, int32_t>;
+			// distinct counting (column, value, result row, stamp)
+			DistinctSet eventDistinct;
 
-			// distinct counting (with column as key)
-			ValuesSeen eventDistinct{ ringHint_e::lt_compact }; // distinct to group id
-			ValuesSeenKey distinctKey;
+			// tally plan - columnVars flattened on first tally so the
+			// per row aggregation loop doesn't chase through Variable_s
+			struct TallyColumn_s
+			{
+				Variable_s* var;
+				Modifiers_e modifier;
+				int index;
+				int column;
+				int distinctColumn;
+				bool distinct;
+				bool useStamp;
+			};
+
+			std::vector<TallyColumn_s> tallyPlan;
+			bool tallyPlanReady{ false };
+
+			// direct mapped cache of recently used result rows, consecutive
+			// events (and people) usually land in the same groups. Entries are
+			// invalidated by bumping tallyCacheGeneration when the result
+			// object changes
+			static const int TallyCacheSize = 64;
+
+			struct TallyCache_s
+			{
+				result::RowKey key;
+				result::Accumulator* accumulator{ nullptr };
+				int32_t generation{ 0 };
+			};
+
+			TallyCache_s tallyCache[TallyCacheSize];
+			int32_t tallyCacheGeneration{ 1 };
 
 			// used to load global variables into user variable space
 			bool firstRun{ true };
@@ -174,6 +207,8 @@ namespace openset
 
 			SegmentList* getSegmentList() const;
 
+			void buildTallyPlan();
+			result::Accumulator* getTallyAccumulator(const int depth);
 			void marshal_tally(const int paramCount, const Col_s* columns, const int currentRow);
 
 			void marshal_schedule(const int paramCount);
@@ -206,6 +241,11 @@ namespace openset
 			// get a string from the literals script block by ID
 			string getLiteral(const int64_t id) const;
 
+			// UTC stamp (seconds or ms) to seconds in macros.timeZone
+			int64_t toLocal(int64_t stamp);
+			// seconds in macros.timeZone back to UTC seconds
+			int64_t fromLocal(const int64_t localStamp);
+
 			bool marshal(Instruction_s* inst, int& currentRow);
 			void opRunner(Instruction_s* inst, int currentRow = 0);
 
@@ -222,6 +262,9 @@ namespace openset
 			void exec();
 			void exec(const string functionName);
 			void exec(const int64_t functionHash);
+			// runs the code at `offset` starting on `startRow` without re-running
+			// whatever came before it (see QueryParser::incrementalPlan)
+			void execFrom(const int64_t offset, const int startRow);
 
             // if you need the result of exec+function this will get it or return value NONE
             Returns& getLastReturn();
@@ -2,11 +2,13 @@
 #include <unordered_set>
 #include "str/strtools.h"
 #include "errors.h"
+#include "time/epoch.h"
 
 #include <limits>
 #include <sstream>
 #include <iomanip>
 #include <iterator>
+#include <algorithm>
 
 using namespace openset::query;
 
@@ -417,6 +419,7 @@ int64_t QueryParser::extractBlocks(const int indent, FirstPass& lines, BlockList
 
 					auto nonDistinct = false;
 					auto forceDistinct = false;
+					auto percentile = 50.0;
 					auto lambdaIdx = -1;
 					auto lambdaId = -1;
 
@@ -455,6 +458,22 @@ int64_t QueryParser::extractBlocks(const int indent, FirstPass& lines, BlockList
 						}
 					}							
 					
+					// percentile takes the percent after the column name (i.e. `percentile price 95`)
+					if (modifier->second == Modifiers_e::percentile &&
+						c.parts.size() > 2 &&
+						isNumeric(c.parts[2]))
+					{
+						percentile = stod(c.parts[2]);
+
+						if (percentile < 0 || percentile > 100)
+							throw ParseFail_s{
+							errors::errorClass_e::parse,
+							errors::errorCode_e::syntax_error,
+							"percentile must be between 0 and 100",
+							c.debug
+						};
+					}
+
 					if (lambdaIdx != -1) // found a lambda? Then assign a lambda assignment
 					{
 						if (modifier->second != Modifiers_e::var)
@@ -535,6 +554,7 @@ int64_t QueryParser::extractBlocks(const int indent, FirstPass& lines, BlockList
 					vars.columnVars[alias].distinctColumnName = distinct;
 					vars.columnVars[alias].lambdaIndex = lambdaId;
 					vars.columnVars[alias].nonDistinct = nonDistinct;
+					vars.columnVars[alias].percentile = percentile;
 				}
 
 				blocks.pop_back();
@@ -3866,6 +3886,783 @@ void QueryParser::build(
 	}
 }
 
+namespace
+{
+	// what a where lambda has on its stack, as far as actions and stamps go
+	struct RowTerm_s
+	{
+		enum class kind_e
+		{
+			value, // anything else
+			actionColumn,
+			stampColumn,
+			column, // any other table column (literal is the schema column)
+			text, // string literal (hashed)
+			number, // integer literal
+			now,
+			condition // only true on rows matching `actions`, `from` and `to`
+		};
+
+		kind_e kind{ kind_e::value };
+		int64_t literal{ 0 };
+		string text;
+		columnTypes_e columnType{ columnTypes_e::freeColumn };
+
+		bool hasActions{ false };
+		vector<int64_t> actions; // sorted
+		ColumnValues values;
+		int64_t from{ std::numeric_limits<int64_t>::min() };
+		int64_t to{ std::numeric_limits<int64_t>::max() };
+
+		static RowTerm_s stampRange(const int64_t from, const int64_t to)
+		{
+			RowTerm_s term;
+			term.kind = kind_e::condition;
+			term.from = from;
+			term.to = to;
+			return term;
+		}
+	};
+
+	// both `left` and `right` hold
+	ColumnValues andValues(const ColumnValues& left, const ColumnValues& right)
+	{
+		auto result = left;
+
+		for (const auto& r : right)
+		{
+			auto iter = find_if(result.begin(), result.end(), [&](const auto& l) { return l.first == r.first; });
+
+			if (iter == result.end())
+			{
+				result.push_back(r);
+				continue;
+			}
+
+			vector<int64_t> both;
+			set_intersection(
+				iter->second.begin(), iter->second.end(),
+				r.second.begin(), r.second.end(),
+				back_inserter(both));
+			iter->second = move(both);
+		}
+
+		return result;
+	}
+
+	// `left` or `right` holds, only columns both sides name are still known
+	ColumnValues orValues(const ColumnValues& left, const ColumnValues& right)
+	{
+		ColumnValues result;
+
+		for (const auto& l : left)
+			for (const auto& r : right)
+				if (l.first == r.first)
+				{
+					vector<int64_t> either;
+					set_union(
+						l.second.begin(), l.second.end(),
+						r.second.begin(), r.second.end(),
+						back_inserter(either));
+					result.emplace_back(l.first, move(either));
+				}
+
+		return result;
+	}
+
+	// a stamp from a literal (ISO 8601 text or a number), -1 if it isn't one
+	int64_t literalStamp(const RowTerm_s& term)
+	{
+		if (term.kind == RowTerm_s::kind_e::number)
+			return Epoch::fixMilli(term.literal);
+		if (term.kind == RowTerm_s::kind_e::text)
+			return Epoch::fixMilli(Epoch::ISO8601ToEpoch(term.text));
+		return -1;
+	}
+
+	/* Runs a where lambda over what it pushes rather than values. Returns true
+	 * (with the condition) if the lambda can only be true on rows with
+	 * certain actions or stamps. Lambdas that call functions or marshals with
+	 * side effects are never matched, skipping rows must not skip side effects.
+	 */
+	bool lambdaCondition(const Macro_s& macros, const int64_t offset, RowTerm_s& condition)
+	{
+		using kind_e = RowTerm_s::kind_e;
+
+		vector<RowTerm_s> stack;
+
+		const auto pop = [&]() -> RowTerm_s
+		{
+			auto term = move(stack.back());
+			stack.pop_back();
+			return term;
+		};
+
+		for (auto i = offset; i < static_cast<int64_t>(macros.code.size()); ++i)
+		{
+			const auto& inst = macros.code[i];
+			RowTerm_s term;
+
+			switch (inst.op)
+			{
+			case OpCode_e::PSHTBLCOL:
+				if (macros.vars.tableVars[inst.index].actual == "__action")
+					term.kind = kind_e::actionColumn;
+				else if (macros.vars.tableVars[inst.index].actual == "__stamp")
+					term.kind = kind_e::stampColumn;
+				else
+				{
+					term.kind = kind_e::column;
+					term.literal = macros.vars.tableVars[inst.index].schemaColumn;
+					term.columnType = macros.vars.tableVars[inst.index].schemaType;
+				}
+				stack.push_back(term);
+				break;
+			case OpCode_e::PSHLITSTR:
+				term.kind = kind_e::text;
+				term.literal = macros.vars.literals[inst.index].hashValue;
+				term.text = macros.vars.literals[inst.index].value;
+				stack.push_back(term);
+				break;
+			case OpCode_e::PSHLITINT:
+				term.kind = kind_e::number;
+				term.literal = inst.value;
+				stack.push_back(term);
+				break;
+			case OpCode_e::PSHUSRVAR:
+			case OpCode_e::PSHLITTRUE:
+			case OpCode_e::PSHLITFALSE:
+			case OpCode_e::PSHLITFLT:
+			case OpCode_e::PSHLITNUL:
+				stack.push_back(term);
+				break;
+			case OpCode_e::OPEQ:
+			case OpCode_e::OPGT:
+			case OpCode_e::OPLT:
+			case OpCode_e::OPGTE:
+			case OpCode_e::OPLTE:
+				{
+					if (stack.size() < 2)
+						return false;
+
+					auto right = pop();
+					auto left = pop();
+					auto op = inst.op;
+
+					// put the column on the left
+					if (left.kind == kind_e::text || left.kind == kind_e::number)
+					{
+						swap(left, right);
+						switch (op)
+						{
+						case OpCode_e::OPGT: op = OpCode_e::OPLT; break;
+						case OpCode_e::OPLT: op = OpCode_e::OPGT; break;
+						case OpCode_e::OPGTE: op = OpCode_e::OPLTE; break;
+						case OpCode_e::OPLTE: op = OpCode_e::OPGTE; break;
+						default: break;
+						}
+					}
+
+					if (op == OpCode_e::OPEQ && left.kind == kind_e::actionColumn && right.kind == kind_e::text)
+					{
+						term.kind = kind_e::condition;
+						term.hasActions = true;
+						term.actions.push_back(right.literal);
+					}
+					else if (op == OpCode_e::OPEQ && left.kind == kind_e::column &&
+						((right.kind == kind_e::text && left.columnType == columnTypes_e::textColumn) ||
+						 (right.kind == kind_e::number && left.columnType == columnTypes_e::intColumn)))
+					{
+						term.kind = kind_e::condition;
+						term.values.push_back({ static_cast<int32_t>(left.literal), { right.literal } });
+					}
+					else if (left.kind == kind_e::stampColumn && right.kind == kind_e::number)
+					{
+						const auto value = right.literal;
+						switch (op)
+						{
+						case OpCode_e::OPEQ: term = RowTerm_s::stampRange(value, value); break;
+						case OpCode_e::OPGT: term = RowTerm_s::stampRange(value + 1, std::numeric_limits<int64_t>::max()); break;
+						case OpCode_e::OPGTE: term = RowTerm_s::stampRange(value, std::numeric_limits<int64_t>::max()); break;
+						case OpCode_e::OPLT: term = RowTerm_s::stampRange(std::numeric_limits<int64_t>::min(), value - 1); break;
+						case OpCode_e::OPLTE: term = RowTerm_s::stampRange(std::numeric_limits<int64_t>::min(), value); break;
+						default: break;
+						}
+					}
+
+					stack.push_back(term);
+				}
+				break;
+			case OpCode_e::OPNEQ:
+			case OpCode_e::MATHADD:
+			case OpCode_e::MATHSUB:
+			case OpCode_e::MATHMUL:
+			case OpCode_e::MATHDIV:
+				if (stack.size() < 2)
+					return false;
+				pop();
+				pop();
+				stack.push_back(term);
+				break;
+			case OpCode_e::OPNOT:
+				if (stack.empty())
+					return false;
+				pop();
+				stack.push_back(term);
+				break;
+			case OpCode_e::LGCAND:
+				{
+					if (stack.size() < 2)
+						return false;
+
+					const auto right = pop();
+					const auto left = pop();
+
+					if (left.kind == kind_e::condition && right.kind == kind_e::condition)
+					{
+						term.kind = kind_e::condition;
+						term.hasActions = left.hasActions || right.hasActions;
+
+						if (left.hasActions && right.hasActions)
+							set_intersection(
+								left.actions.begin(), left.actions.end(),
+								right.actions.begin(), right.actions.end(),
+								back_inserter(term.actions));
+						else
+							term.actions = left.hasActions ? left.actions : right.actions;
+
+						term.values = andValues(left.values, right.values);
+						term.from = std::max(left.from, right.from);
+						term.to = std::min(left.to, right.to);
+					}
+					else if (left.kind == kind_e::condition)
+						term = left;
+					else if (right.kind == kind_e::condition)
+						term = right;
+
+					stack.push_back(term);
+				}
+				break;
+			case OpCode_e::LGCOR:
+				{
+					if (stack.size() < 2)
+						return false;
+
+					const auto right = pop();
+					const auto left = pop();
+
+					if (left.kind == kind_e::condition && right.kind == kind_e::condition)
+					{
+						term.kind = kind_e::condition;
+						term.hasActions = left.hasActions && right.hasActions;
+
+						if (term.hasActions)
+							set_union(
+								left.actions.begin(), left.actions.end(),
+								right.actions.begin(), right.actions.end(),
+								back_inserter(term.actions));
+
+						term.values = orValues(left.values, right.values);
+						term.from = std::min(left.from, right.from);
+						term.to = std::max(left.to, right.to);
+					}
+
+					stack.push_back(term);
+				}
+				break;
+			case OpCode_e::MARSHAL:
+				switch (cast<Marshals_e>(inst.index))
+				{
+				case Marshals_e::marshal_now:
+					term.kind = kind_e::now;
+					stack.push_back(term);
+					break;
+				case Marshals_e::marshal_event_time:
+					term.kind = kind_e::stampColumn;
+					stack.push_back(term);
+					break;
+				case Marshals_e::marshal_iter_between:
+					{
+						if (inst.extra != 2 || stack.size() < 2)
+							return false;
+
+						const auto end = literalStamp(pop());
+						const auto start = literalStamp(pop());
+
+						// start <= stamp < end
+						if (start >= 0 && end >= 0)
+							term = RowTerm_s::stampRange(start, end - 1);
+
+						stack.push_back(term);
+					}
+					break;
+				case Marshals_e::marshal_iter_within:
+					{
+						if (inst.extra != 2 || stack.size() < 2)
+							return false;
+
+						const auto compare = pop();
+						const auto window = pop();
+
+						// `now` only moves forward, so the window can only start later
+						if (compare.kind == kind_e::now && window.kind == kind_e::number)
+							term = RowTerm_s::stampRange(Now() - window.literal, std::numeric_limits<int64_t>::max());
+
+						stack.push_back(term);
+					}
+					break;
+				default:
+					return false;
+				}
+				break;
+			case OpCode_e::RETURN:
+				if (stack.size() != 1 || stack.back().kind != kind_e::condition)
+					return false;
+				condition = move(stack.back());
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		return false;
+	}
+
+	// what the code outside of `match` blocks does
+	struct TopLevel_s
+	{
+		bool readsRows{ false }; // outside a match row 0 is used
+		bool sideEffects{ false }; // does something even if nothing matches
+		vector<const Instruction_s*> matches;
+	};
+
+	void scanTopLevel(const Macro_s& macros, const int64_t offset, TopLevel_s& scan)
+	{
+		for (auto i = offset; i < static_cast<int64_t>(macros.code.size()); ++i)
+		{
+			const auto& inst = macros.code[i];
+
+			switch (inst.op)
+			{
+			case OpCode_e::RETURN:
+				return;
+			case OpCode_e::PSHTBLCOL:
+			case OpCode_e::PSHRESCOL:
+				scan.readsRows = true;
+				break;
+			case OpCode_e::CALL:
+				scan.sideEffects = true;
+				break;
+			case OpCode_e::MARSHAL:
+				switch (cast<Marshals_e>(inst.index))
+				{
+				case Marshals_e::marshal_tally:
+					scan.readsRows = true;
+					scan.sideEffects = true;
+					break;
+				case Marshals_e::marshal_emit:
+				case Marshals_e::marshal_schedule:
+					scan.sideEffects = true;
+					break;
+				case Marshals_e::marshal_event_time:
+				case Marshals_e::marshal_prev_match:
+				case Marshals_e::marshal_first_match:
+				case Marshals_e::marshal_iter_within:
+				case Marshals_e::marshal_iter_between:
+					scan.readsRows = true;
+					break;
+				default:
+					break;
+				}
+				break;
+			case OpCode_e::ITNEXT:
+				scan.matches.push_back(&inst);
+				break;
+			case OpCode_e::CNDIF:
+			case OpCode_e::CNDELIF:
+				scanTopLevel(macros, inst.extra, scan);
+				scanTopLevel(macros, inst.index, scan);
+				break;
+			case OpCode_e::CNDELSE:
+			case OpCode_e::ITFOR:
+				scanTopLevel(macros, inst.index, scan);
+				break;
+			default:
+				break;
+			}
+		}
+	}
+}
+
+void QueryParser::planActionFilters(Macro_s& macros)
+{
+	macros.actionLambdas.clear();
+	macros.prepareActions.clear();
+	macros.personFilters.clear();
+
+	// sessions are counted over every row
+	auto rowsNeeded = macros.useSessions;
+	vector<int64_t> allActions;
+	unordered_map<int64_t, RowTerm_s> conditions; // by lambda offset
+
+	for (const auto& inst : macros.code)
+	{
+		switch (inst.op)
+		{
+		case OpCode_e::ITNEXT:
+			{
+				RowTerm_s condition;
+
+				if (inst.extra && lambdaCondition(macros, inst.extra, condition))
+				{
+					if (condition.hasActions)
+					{
+						allActions.insert(allActions.end(), condition.actions.begin(), condition.actions.end());
+						macros.actionLambdas.emplace(inst.extra, condition.actions);
+					}
+					else
+						rowsNeeded = true;
+
+					// counted matches count from the row they start on
+					if (inst.value != 9999999)
+						rowsNeeded = true;
+
+					conditions.emplace(inst.extra, move(condition));
+				}
+				else
+					rowsNeeded = true;
+			}
+			break;
+		case OpCode_e::ITPREV:
+		case OpCode_e::CALL:
+			rowsNeeded = true;
+			break;
+		case OpCode_e::MARSHAL:
+			// these look at rows other than the current one
+			switch (cast<Marshals_e>(inst.index))
+			{
+			case Marshals_e::marshal_last_event:
+			case Marshals_e::marshal_first_event:
+			case Marshals_e::marshal_iter_get:
+			case Marshals_e::marshal_iter_set:
+			case Marshals_e::marshal_iter_move_first:
+			case Marshals_e::marshal_iter_move_last:
+			case Marshals_e::marshal_iter_next:
+			case Marshals_e::marshal_iter_prev:
+			case Marshals_e::marshal_event_count:
+			case Marshals_e::marshal_session_count:
+				rowsNeeded = true;
+				break;
+			default:
+				break;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	TopLevel_s topLevel;
+	scanTopLevel(macros, 0, topLevel);
+
+	/* A person can only produce results if a top level match can pass on
+	 * one of their rows, nested matches only run inside those. Every top
+	 * level match needs a known condition for this to hold.
+	 */
+	if (!topLevel.sideEffects && topLevel.matches.size())
+	{
+		RowFilters filters;
+
+		for (const auto match : topLevel.matches)
+		{
+			const auto condition = match->extra ? conditions.find(match->extra) : conditions.end();
+
+			if (condition == conditions.end())
+			{
+				filters.clear();
+				break;
+			}
+
+			RowFilter_s filter;
+			filter.actions = condition->second.actions;
+			filter.values = condition->second.values;
+			filter.from = condition->second.from;
+			filter.to = condition->second.to;
+
+			// `and` of two different actions never passes
+			if (condition->second.hasActions && filter.actions.empty())
+			{
+				filter.from = std::numeric_limits<int64_t>::max();
+				filter.to = std::numeric_limits<int64_t>::min();
+			}
+			// no actions or stamps to go on (i.e. only column values), everyone passes
+			else if (filter.actions.empty() &&
+				filter.from == std::numeric_limits<int64_t>::min() &&
+				filter.to == std::numeric_limits<int64_t>::max())
+			{
+				filters.clear();
+				break;
+			}
+
+			filters.push_back(move(filter));
+		}
+
+		macros.personFilters = move(filters);
+	}
+
+	if (rowsNeeded || allActions.empty() || topLevel.readsRows)
+		return;
+
+	sort(allActions.begin(), allActions.end());
+	allActions.erase(unique(allActions.begin(), allActions.end()), allActions.end());
+	macros.prepareActions = move(allActions);
+}
+
+bool QueryParser::actionDependencies(const Macro_s& macros, const int64_t functionHash, vector<int64_t>& actions)
+{
+	actions.clear();
+
+	auto entry = -1LL;
+	for (const auto& f : macros.vars.functions)
+		if (f.nameHash == functionHash)
+			entry = f.execPtr;
+
+	if (entry == -1)
+		return false;
+
+	/* The function only sees rows through `match where action is ...` so
+	 * rows with other actions can't change what it does. Anything that
+	 * looks at other rows, calls other functions or depends on the clock
+	 * can change on any insert.
+	 */
+	for (const auto& inst : macros.code)
+	{
+		switch (inst.op)
+		{
+		case OpCode_e::ITNEXT:
+			{
+				const auto condition = inst.extra ? macros.actionLambdas.find(inst.extra) : macros.actionLambdas.end();
+
+				if (condition == macros.actionLambdas.end())
+					return false;
+
+				actions.insert(actions.end(), condition->second.begin(), condition->second.end());
+			}
+			break;
+		case OpCode_e::ITPREV:
+		case OpCode_e::CALL:
+			return false;
+		case OpCode_e::MARSHAL:
+			switch (cast<Marshals_e>(inst.index))
+			{
+			case Marshals_e::marshal_now:
+			case Marshals_e::marshal_last_event:
+			case Marshals_e::marshal_first_event:
+			case Marshals_e::marshal_iter_get:
+			case Marshals_e::marshal_iter_set:
+			case Marshals_e::marshal_iter_move_first:
+			case Marshals_e::marshal_iter_move_last:
+			case Marshals_e::marshal_iter_next:
+			case Marshals_e::marshal_iter_prev:
+			case Marshals_e::marshal_event_count:
+			case Marshals_e::marshal_session_count:
+				return false;
+			default:
+				break;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	// outside a match the function reads whatever row it is on
+	TopLevel_s topLevel;
+	scanTopLevel(macros, entry, topLevel);
+
+	if (topLevel.readsRows || actions.empty())
+		return false;
+
+	sort(actions.begin(), actions.end());
+	actions.erase(unique(actions.begin(), actions.end()), actions.end());
+	return true;
+}
+
+namespace
+{
+	/* true if a block only works on the current row and the variables in
+	 * `vars`, so running it over rows one at a time from a saved state is
+	 * the same as running it over all of them.
+	 */
+	bool rowLocalBlock(const Macro_s& macros, const int64_t offset, const unordered_set<int64_t>& vars)
+	{
+		for (auto i = offset; i < static_cast<int64_t>(macros.code.size()); ++i)
+		{
+			const auto& inst = macros.code[i];
+
+			switch (inst.op)
+			{
+			case OpCode_e::RETURN:
+				return true;
+			case OpCode_e::PSHTBLCOL:
+			case OpCode_e::PSHLITTRUE:
+			case OpCode_e::PSHLITFALSE:
+			case OpCode_e::PSHLITSTR:
+			case OpCode_e::PSHLITINT:
+			case OpCode_e::PSHLITFLT:
+			case OpCode_e::PSHLITNUL:
+			case OpCode_e::MATHADD:
+			case OpCode_e::MATHSUB:
+			case OpCode_e::MATHMUL:
+			case OpCode_e::MATHDIV:
+			case OpCode_e::OPGT:
+			case OpCode_e::OPLT:
+			case OpCode_e::OPGTE:
+			case OpCode_e::OPLTE:
+			case OpCode_e::OPEQ:
+			case OpCode_e::OPNEQ:
+			case OpCode_e::OPWTHN:
+			case OpCode_e::OPNOT:
+			case OpCode_e::LGCAND:
+			case OpCode_e::LGCOR:
+			case OpCode_e::LGCNSTAND:
+			case OpCode_e::LGCNSTOR:
+				break;
+			case OpCode_e::PSHUSRVAR:
+			case OpCode_e::POPUSRVAR:
+				if (!vars.count(inst.index))
+					return false;
+				break;
+			case OpCode_e::MATHADDEQ:
+			case OpCode_e::MATHSUBEQ:
+			case OpCode_e::MATHMULEQ:
+			case OpCode_e::MATHDIVEQ:
+				// extra is set for container members
+				if (inst.extra || !vars.count(inst.index))
+					return false;
+				break;
+			case OpCode_e::CNDIF:
+			case OpCode_e::CNDELIF:
+				if (!rowLocalBlock(macros, inst.extra, vars) || !rowLocalBlock(macros, inst.index, vars))
+					return false;
+				break;
+			case OpCode_e::CNDELSE:
+				if (!rowLocalBlock(macros, inst.index, vars))
+					return false;
+				break;
+			case OpCode_e::MARSHAL:
+				switch (cast<Marshals_e>(inst.index))
+				{
+				// emit ends the script and the trigger is done with the person
+				case Marshals_e::marshal_emit:
+				case Marshals_e::marshal_continue:
+				case Marshals_e::marshal_event_time:
+				case Marshals_e::marshal_iter_between:
+				case Marshals_e::marshal_bucket:
+				case Marshals_e::marshal_round:
+				case Marshals_e::marshal_trunc:
+				case Marshals_e::marshal_fix:
+				case Marshals_e::marshal_to_seconds:
+				case Marshals_e::marshal_to_minutes:
+				case Marshals_e::marshal_to_hours:
+				case Marshals_e::marshal_to_days:
+				case Marshals_e::marshal_get_second:
+				case Marshals_e::marshal_round_second:
+				case Marshals_e::marshal_get_minute:
+				case Marshals_e::marshal_round_minute:
+				case Marshals_e::marshal_get_hour:
+				case Marshals_e::marshal_round_hour:
+				case Marshals_e::marshal_round_day:
+				case Marshals_e::marshal_get_day_of_week:
+				case Marshals_e::marshal_get_day_of_month:
+				case Marshals_e::marshal_get_day_of_year:
+				case Marshals_e::marshal_round_week:
+				case Marshals_e::marshal_round_month:
+				case Marshals_e::marshal_get_month:
+				case Marshals_e::marshal_get_quarter:
+				case Marshals_e::marshal_round_quarter:
+				case Marshals_e::marshal_get_year:
+				case Marshals_e::marshal_round_year:
+				case Marshals_e::marshal_int:
+				case Marshals_e::marshal_float:
+				case Marshals_e::marshal_str:
+				case Marshals_e::marshal_len:
+					break;
+				default:
+					return false;
+				}
+				break;
+			default:
+				return false;
+			}
+		}
+
+		return false;
+	}
+}
+
+bool QueryParser::incrementalPlan(const Macro_s& macros, const int64_t functionHash, IncrementalPlan_s& plan)
+{
+	plan = IncrementalPlan_s{};
+
+	auto entry = -1LL;
+	for (const auto& f : macros.vars.functions)
+		if (f.nameHash == functionHash)
+			entry = f.execPtr;
+
+	if (entry == -1)
+		return false;
+
+	/* The function has to look like:
+	 *
+	 *     def on_insert():
+	 *         counter = 0              <- literals only
+	 *         match where ...:         <- one uncounted match, nothing after it
+	 *             counter += 1         <- current row and those variables only
+	 *             if counter > 99:
+	 *                 emit("...")
+	 *
+	 * the variables after the last row are all the state there is.
+	 */
+	unordered_set<int64_t> vars;
+	auto i = entry;
+
+	while (i + 1 < static_cast<int64_t>(macros.code.size()) &&
+		macros.code[i + 1].op == OpCode_e::POPUSRVAR)
+	{
+		switch (macros.code[i].op)
+		{
+		case OpCode_e::PSHLITTRUE:
+		case OpCode_e::PSHLITFALSE:
+		case OpCode_e::PSHLITSTR:
+		case OpCode_e::PSHLITINT:
+		case OpCode_e::PSHLITFLT:
+		case OpCode_e::PSHLITNUL:
+			break;
+		default:
+			return false;
+		}
+
+		vars.insert(macros.code[i + 1].index);
+		plan.stateVars.push_back(static_cast<int>(macros.code[i + 1].index));
+		i += 2;
+	}
+
+	if (i + 1 >= static_cast<int64_t>(macros.code.size()))
+		return false;
+
+	const auto& match = macros.code[i];
+
+	if (match.op != OpCode_e::ITNEXT || match.value != 9999999 || macros.code[i + 1].op != OpCode_e::RETURN)
+		return false;
+
+	if ((match.extra && !rowLocalBlock(macros, match.extra, vars)) || !rowLocalBlock(macros, match.index, vars))
+		return false;
+
+	plan.match = i;
+	return true;
+}
+
 bool QueryParser::compileQuery(const char* query, Columns* columnsPtr, Macro_s& macros, ParamVars* templateVars)
 {	
 
@@ -3963,6 +4760,8 @@ bool QueryParser::compileQuery(const char* query, Columns* columnsPtr, Macro_s&
 				}
 		}
 
+		planActionFilters(macros);
+
 		return true;
 	}
 	catch (ParseFail_s & caught)
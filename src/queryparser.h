@@ -363,12 +363,24 @@ namespace openset
 				InstructionList& finCode,
 				Variables_S& finVars);
 
+			// finds `match where` lambdas that can only pass on certain actions
+			// and whether the whole script can run on just those rows
+			static void planActionFilters(Macro_s& macros);
+
 		public:
 
 			// compile a query into a macro_s block
 			bool compileQuery(const char* query, Columns* columnsPtr, Macro_s& macros, ParamVars* templateVars = nullptr);
 
 			static std::vector<std::pair<std::string, std::string>> extractCountQueries(const char* query);
+
+			// the actions whose rows can change what the function `functionHash`
+			// returns, false if any inserted row could (or it can't be told)
+			static bool actionDependencies(const Macro_s& macros, const int64_t functionHash, vector<int64_t>& actions);
+
+			// whether the function `functionHash` can resume over just the rows
+			// appended since its last run, false if it has to see every row
+			static bool incrementalPlan(const Macro_s& macros, const int64_t functionHash, IncrementalPlan_s& plan);
 		};
 
 		string MacroDbg(Macro_s& macro);
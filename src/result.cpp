@@ -1,6 +1,7 @@
 ﻿#include "result.h"
 #include <algorithm>
 #include <sstream>
+#include <unordered_set>
 #include "cjson/cjson.h"
 #include "tablepartitioned.h"
 
@@ -32,7 +33,7 @@ void ResultSet::makeSortedList()
 
 	sortedResult.clear();
 
-	sortedResult.reserve(results.distinct);
+	sortedResult.reserve(results.size());
 
 	for (auto& kv: results)
 		sortedResult.emplace_back(kv);
@@ -100,6 +101,10 @@ void ResultSet::setAccTypesFromMacros(const openset::query::Macro_s macros)
                     accTypes[dataIndex] = ResultTypes_e::None;
             }
         }
+        else if (g.modifier == query::Modifiers_e::approx_count_distinct)
+        {
+            accTypes[dataIndex] = ResultTypes_e::Int; // the estimate, regardless of column type
+        }
         else if (g.modifier == query::Modifiers_e::value)
         {
             switch (g.schemaType)
@@ -330,6 +335,17 @@ ResultSet::RowVector mergeResultSets(
 										left->columns[valueIndex].value = right->columns[valueIndex].value;
 										left->columns[valueIndex].count = right->columns[valueIndex].count;
 										break;
+									case openset::query::Modifiers_e::approx_count_distinct:
+										// values are pointers to sketch registers
+										openset::sketch::HyperLogLog::merge(
+											reinterpret_cast<uint8_t*>(left->columns[valueIndex].value),
+											reinterpret_cast<uint8_t*>(right->columns[valueIndex].value));
+										break;
+									case openset::query::Modifiers_e::percentile:
+										openset::sketch::TDigest::merge(
+											reinterpret_cast<uint8_t*>(left->columns[valueIndex].value),
+											reinterpret_cast<uint8_t*>(right->columns[valueIndex].value));
+										break;
 									case openset::query::Modifiers_e::var:
 									case openset::query::Modifiers_e::avg: // average is determined later
 									case openset::query::Modifiers_e::sum:
@@ -415,6 +431,8 @@ char* ResultMuxDemux::multiSetToInternode(
     const auto modifiers = reinterpret_cast<char*>(mem.newPtr(sizeof(ResultSet::accModifiers)));
     memcpy(modifiers, resultSets[0]->accModifiers, sizeof(ResultSet::accModifiers));
 
+    const auto shiftIterations = resultSetCount ? resultSetCount : 1;
+
     // iterate the result set
     for (const auto r : rows)
     {
@@ -422,10 +440,34 @@ char* ResultMuxDemux::multiSetToInternode(
         const auto keyPtr = recast<openset::result::RowKey*>(mem.newPtr(sizeof(openset::result::RowKey)));
         // make space for the columns
         const auto accumulatorPtr = recast<openset::result::Accumulator*>(mem.newPtr(sizeof(openset::result::Accumulator)));
+        // flags for columns that have sketch blocks following the accumulator
+        const auto sketchFlags = recast<uint16_t*>(mem.newPtr(sizeof(uint16_t)));
+        *sketchFlags = 0;
 
         // copy the values
         memcpy(keyPtr, r.first.key, sizeof(openset::result::RowKey));
         memcpy(accumulatorPtr, r.second->columns, sizeof(openset::result::Accumulator));
+
+        // sketch columns hold pointers, so the blocks themselves are copied
+        // after the accumulator (the pointers are fixed up when deserializing)
+        for (auto shiftCount = 0, shiftOffset = 0; shiftCount < shiftIterations; ++shiftCount, shiftOffset += resultColumnCount)
+            for (auto columnIndex = 0; columnIndex < resultColumnCount; ++columnIndex)
+            {
+                const auto valueIndex = columnIndex + shiftOffset;
+                const auto bytes = sketchBytes(resultSets[0]->accModifiers[columnIndex]);
+
+                if (valueIndex >= ACCUMULATOR_DEPTH ||
+                    !bytes ||
+                    r.second->columns[valueIndex].value == NONE)
+                    continue;
+
+                *sketchFlags |= static_cast<uint16_t>(1 << valueIndex);
+                *recast<int32_t*>(mem.newPtr(sizeof(int32_t))) = static_cast<int32_t>(bytes);
+                memcpy(
+                    mem.newPtr(bytes),
+                    reinterpret_cast<uint8_t*>(r.second->columns[valueIndex].value),
+                    bytes);
+            }
     }
 
     // lets encode the text. 
@@ -510,6 +552,21 @@ openset::result::ResultSet* ResultMuxDemux::internodeToResultSet(
 		auto accumulatorPtr = recast<openset::result::Accumulator*>(read);
 		read += sizeof(openset::result::Accumulator);
 
+		const auto sketchFlags = *recast<uint16_t*>(read);
+		read += sizeof(uint16_t);
+
+		// point sketch columns at their blocks in this buffer, each
+		// block is prefixed with it's length
+		for (auto valueIndex = 0; valueIndex < ACCUMULATOR_DEPTH; ++valueIndex)
+		{
+			if (!(sketchFlags & (1 << valueIndex)))
+				continue;
+			const auto bytes = *recast<int32_t*>(read);
+			read += sizeof(int32_t);
+			accumulatorPtr->columns[valueIndex].value = reinterpret_cast<int64_t>(read);
+			read += bytes;
+		}
+
 		result->sortedResult.emplace_back(
 			openset::result::ResultSet::RowPair{ *keyPtr, accumulatorPtr });
 	}
@@ -680,6 +737,15 @@ void ResultMuxDemux::resultSetToJson(
 					case query::Modifiers_e::dist_count_person:
 						array->push(value);
 						break;
+					case query::Modifiers_e::approx_count_distinct:
+						array->push(openset::sketch::HyperLogLog::estimate(reinterpret_cast<const uint8_t*>(value)));
+						break;
+					case query::Modifiers_e::percentile:
+					{
+						const auto estimate = openset::sketch::TDigest::estimate(reinterpret_cast<uint8_t*>(value));
+						array->push(types[colIndex] == ResultTypes_e::Double ? estimate / 10000.0 : estimate);
+					}
+					break;
 					case query::Modifiers_e::value:
                         if (types[colIndex] == ResultTypes_e::Text)
 							array->push(getText(value));
@@ -750,6 +816,630 @@ void ResultMuxDemux::resultSetToJson(
     */
 }
 
+ResultJsonWriter::ResultJsonWriter(FlushCB flushCb, const int64_t chunkSize) :
+    buffer(static_cast<char*>(PoolMem::getPool().getPtr(chunkSize))),
+    bufferSize(chunkSize),
+    flushCb(std::move(flushCb))
+{}
+
+ResultJsonWriter::~ResultJsonWriter()
+{
+    PoolMem::getPool().freePtr(buffer);
+}
+
+void ResultJsonWriter::write(const char* data, const int64_t length)
+{
+    auto remaining = length;
+    auto read = data;
+
+    while (remaining)
+    {
+        if (used == bufferSize)
+            flush();
+
+        const auto copyLength = std::min(remaining, bufferSize - used);
+        memcpy(buffer + used, read, copyLength);
+
+        used += copyLength;
+        read += copyLength;
+        remaining -= copyLength;
+    }
+}
+
+void ResultJsonWriter::writeInt(const int64_t value)
+{
+    char number[32];
+    snprintf(number, sizeof(number), "%lld", static_cast<long long>(value));
+    write(number);
+}
+
+void ResultJsonWriter::writeDouble(const double value)
+{
+    // same formatting as cjson::Stringify
+    if (value == 0)
+    {
+        write("0.0", 3);
+        return;
+    }
+
+    char number[64];
+    snprintf(number, 32, "%0.7f", value);
+    write(number);
+}
+
+void ResultJsonWriter::writeBool(const bool value)
+{
+    if (value)
+        write("true", 4);
+    else
+        write("false", 5);
+}
+
+void ResultJsonWriter::writeString(const char* text)
+{
+    write('"');
+
+    // we are going to emit any UTF-8 or other bytes as such
+    for (auto ch = text; *ch; ++ch)
+    {
+        switch (*ch)
+        {
+        case '\r':
+            write("\\r", 2);
+            break;
+        case '\n':
+            write("\\n", 2);
+            break;
+        case '\t':
+            write("\\t", 2);
+            break;
+        case '\\':
+            write("\\\\", 2);
+            break;
+        case '\b':
+            write("\\b", 2);
+            break;
+        case '\f':
+            write("\\f", 2);
+            break;
+        case '"':
+            write("\\\"", 2);
+            break;
+        default:
+            write(*ch);
+        }
+    }
+
+    write('"');
+}
+
+void ResultJsonWriter::writeNull()
+{
+    write("null", 4);
+}
+
+void ResultJsonWriter::flush()
+{
+    if (!used)
+        return;
+
+    if (flushCb)
+        flushCb(buffer, used);
+
+    totalBytes += used;
+    used = 0;
+}
+
+/* RowValue_s
+*
+* A rendered group or column value. This is what resultSetToJson
+* would place into the cjson document for a given key or accumulator
+* column, it is used to sort the flat row vector and to stream JSON.
+*/
+struct RowValue_s
+{
+    cjsonType type{ cjsonType::NUL };
+    int64_t asInt{ 0 };
+    double asDouble{ 0 };
+    const char* asText{ nullptr };
+
+    static RowValue_s Int(const int64_t value)
+    {
+        RowValue_s result;
+        result.type = cjsonType::INT;
+        result.asInt = value;
+        return result;
+    }
+
+    static RowValue_s Double(const double value)
+    {
+        RowValue_s result;
+        result.type = cjsonType::DBL;
+        result.asDouble = value;
+        return result;
+    }
+
+    static RowValue_s Bool(const bool value)
+    {
+        RowValue_s result;
+        result.type = cjsonType::BOOL;
+        result.asInt = value ? 1 : 0;
+        return result;
+    }
+
+    static RowValue_s Text(const char* value)
+    {
+        RowValue_s result;
+        result.type = cjsonType::STR;
+        result.asText = value;
+        return result;
+    }
+
+    double getNumber() const
+    {
+        return type == cjsonType::DBL ? asDouble : static_cast<double>(asInt);
+    }
+
+    bool isNumber() const
+    {
+        return type == cjsonType::INT || type == cjsonType::DBL || type == cjsonType::BOOL;
+    }
+
+    void write(ResultJsonWriter& writer) const
+    {
+        switch (type)
+        {
+        case cjsonType::INT:
+            writer.writeInt(asInt);
+            break;
+        case cjsonType::DBL:
+            writer.writeDouble(asDouble);
+            break;
+        case cjsonType::BOOL:
+            writer.writeBool(asInt != 0);
+            break;
+        case cjsonType::STR:
+            writer.writeString(asText);
+            break;
+        default:
+            writer.writeNull();
+        }
+    }
+
+    // returns true if left sorts before right, nulls never sort first
+    static bool less(const RowValue_s& left, const RowValue_s& right, const ResultSortOrder_e sort)
+    {
+        if (left.type == cjsonType::STR && right.type == cjsonType::STR)
+        {
+            const auto compare = strcmp(left.asText, right.asText);
+            return sort == ResultSortOrder_e::Asc ? compare < 0 : compare > 0;
+        }
+
+        if (!left.isNumber() || !right.isNumber())
+            return false;
+
+        if (left.type == cjsonType::DBL || right.type == cjsonType::DBL)
+            return sort == ResultSortOrder_e::Asc ? 
+                left.getNumber() < right.getNumber() : 
+                left.getNumber() > right.getNumber();
+
+        return sort == ResultSortOrder_e::Asc ? left.asInt < right.asInt : left.asInt > right.asInt;
+    }
+};
+
+using MergedText = bigRing<int64_t, const char*>;
+
+RowValue_s getGroupValue(const RowKey& key, const int depth, MergedText& mergedText)
+{
+    switch (key.types[depth])
+    {
+    case ResultTypes_e::Int:
+        return RowValue_s::Int(key.key[depth]);
+    case ResultTypes_e::Double:
+        return RowValue_s::Double(key.key[depth] / 10000.0);
+    case ResultTypes_e::Bool:
+        return RowValue_s::Bool(key.key[depth] ? true : false);
+    case ResultTypes_e::Text:
+    {
+        const auto textPair = mergedText.get(key.key[depth]);
+        if (textPair)
+            return RowValue_s::Text(textPair->second);
+        return RowValue_s::Int(key.key[depth]);
+    }
+    case ResultTypes_e::None:
+    default:
+        return RowValue_s::Text(NA_TEXT);
+    }
+}
+
+RowValue_s getColumnValue(
+    const Accumulator* accumulator,
+    const int dataIndex,
+    const int colIndex,
+    const ResultTypes_e* types,
+    const openset::query::Modifiers_e* modifiers,
+    MergedText& mergedText)
+{
+    const auto& value = accumulator->columns[dataIndex].value;
+    const auto& count = accumulator->columns[dataIndex].count;
+
+    const auto getText = [&](const int64_t valueHash) -> const char*
+    {
+        const auto textPair = mergedText.get(valueHash);
+        return textPair ? textPair->second : NA_TEXT;
+    };
+
+    if (value == NONE)
+    {
+        if (types[colIndex] == ResultTypes_e::Double ||
+            types[colIndex] == ResultTypes_e::Int)
+            return RowValue_s::Int(0);
+        return RowValue_s{};
+    }
+
+    switch (modifiers[colIndex])
+    {
+    case openset::query::Modifiers_e::sum:
+    case openset::query::Modifiers_e::min:
+    case openset::query::Modifiers_e::max:
+        if (types[colIndex] == ResultTypes_e::Double)
+            return RowValue_s::Double(value / 10000.0);
+        return RowValue_s::Int(value);
+    case openset::query::Modifiers_e::avg:
+        if (!count)
+            return RowValue_s{};
+        if (types[colIndex] == ResultTypes_e::Double)
+            return RowValue_s::Double((value / 10000.0) / static_cast<double>(count));
+        return RowValue_s::Double(value / static_cast<double>(count));
+    case openset::query::Modifiers_e::count:
+    case openset::query::Modifiers_e::dist_count_person:
+        return RowValue_s::Int(value);
+    case openset::query::Modifiers_e::approx_count_distinct:
+        return RowValue_s::Int(openset::sketch::HyperLogLog::estimate(reinterpret_cast<const uint8_t*>(value)));
+    case openset::query::Modifiers_e::percentile:
+    {
+        const auto estimate = openset::sketch::TDigest::estimate(reinterpret_cast<uint8_t*>(value));
+        return RowValue_s::Double(types[colIndex] == ResultTypes_e::Double ? estimate / 10000.0 : estimate);
+    }
+    case openset::query::Modifiers_e::value:
+    case openset::query::Modifiers_e::var:
+        if (types[colIndex] == ResultTypes_e::Text)
+            return RowValue_s::Text(getText(value));
+        if (types[colIndex] == ResultTypes_e::Double)
+            return RowValue_s::Double(value / 10000.0);
+        if (types[colIndex] == ResultTypes_e::Bool)
+            return RowValue_s::Bool(value ? true : false);
+        return RowValue_s::Int(value);
+    default:
+        return RowValue_s::Int(value);
+    }
+}
+
+/* histogramFillRows
+*
+* flat row version of jsonResultHistogramFill. Missing buckets in the first
+* group are added as zero rows, values at or above `max` are rolled into 
+* a single overflow row. New accumulators are allocated in `mem`.
+*/
+void histogramFillRows(
+    ResultSet::RowVector& rows,
+    const int resultColumnCount,
+    const int setCount,
+    const int64_t bucket,
+    const int64_t forceMin,
+    const int64_t forceMax,
+    HeapStack& mem)
+{
+    if (!rows.size() || bucket <= 0)
+        return;
+
+    // the first group is rows[0], it's children run until the next top level row
+    auto childEnd = rows.begin() + 1;
+    while (childEnd != rows.end() && childEnd->first.getDepth() > 1)
+        ++childEnd;
+
+    // collect the direct children of the first group (with their subtrees)
+    ResultSet::RowVector children(rows.begin() + 1, childEnd);
+
+    if (!children.size())
+        return;
+
+    auto min = std::numeric_limits<int64_t>::max();
+    auto max = std::numeric_limits<int64_t>::min();
+
+    unordered_set<int64_t> knownValues;
+
+    auto isDouble = false;
+
+    const auto getBucketValue = [&](const RowKey& key) -> int64_t
+    {
+        switch (key.types[1])
+        {
+        case ResultTypes_e::Bool:
+        case ResultTypes_e::Int:
+            isDouble = false;
+            return key.key[1] * 10000;
+        case ResultTypes_e::Double:
+            isDouble = true;
+            return key.key[1];
+        default:
+            return 0;
+        }
+    };
+
+    for (auto& c : children)
+    {
+        if (c.first.getDepth() != 2)
+            continue;
+
+        const auto value = getBucketValue(c.first);
+
+        knownValues.insert(value);
+
+        if (value > max)
+            max = value;
+        if (value < min)
+            min = value;
+    }
+
+    if (forceMin != std::numeric_limits<int64_t>::min())
+        min = forceMin;
+
+    if (forceMax != std::numeric_limits<int64_t>::min())
+        max = forceMax;
+
+    std::vector<int64_t> overflow(setCount, 0);
+
+    ResultSet::RowVector filled;
+    filled.reserve(children.size());
+
+    // remove rows at or above max (and their subtrees), and total them in overflow
+    auto skipping = false;
+    for (auto& c : children)
+    {
+        if (c.first.getDepth() != 2)
+        {
+            if (!skipping)
+                filled.push_back(c);
+            continue;
+        }
+
+        const auto value = getBucketValue(c.first);
+
+        skipping = value >= max;
+
+        if (skipping)
+        {
+            for (auto set = 0; set < setCount; ++set)
+            {
+                const auto columnValue = c.second->columns[set * resultColumnCount].value;
+                if (columnValue != NONE)
+                    overflow[set] += columnValue;
+            }
+        }
+        else
+        {
+            knownValues.insert(value);
+            filled.push_back(c);
+        }
+    }
+
+    const auto makeRow = [&](const int64_t value) -> ResultSet::RowPair
+    {
+        auto key = rows.front().first;
+        key.clearFrom(1);
+        key.key[1] = isDouble ? value : value / 10000;
+        key.types[1] = isDouble ? ResultTypes_e::Double : ResultTypes_e::Int;
+
+        const auto accumulator = new (mem.newPtr(sizeof(Accumulator))) Accumulator();
+
+        for (auto set = 0; set < setCount; ++set)
+            accumulator->columns[set * resultColumnCount].value = 0;
+
+        return ResultSet::RowPair{ key, accumulator };
+    };
+
+    for (auto i = min; i < max; i += bucket)
+    {
+        if (!knownValues.count(i))
+            filled.push_back(makeRow(i));
+    }
+
+    // re-inject the max branch
+    auto maxRow = makeRow(max);
+    for (auto set = 0; set < setCount; ++set)
+        maxRow.second->columns[set * resultColumnCount].value = overflow[set];
+    filled.push_back(maxRow);
+
+    // put the first group back together with it's new children
+    ResultSet::RowVector result;
+    result.reserve(rows.size() + filled.size());
+    result.push_back(rows.front());
+    result.insert(result.end(), filled.begin(), filled.end());
+    result.insert(result.end(), childEnd, rows.end());
+
+    rows = std::move(result);
+}
+
+/* sortRows
+*
+* flat row version of recurseSort and recurseTrim. Rows are stored in key
+* order, so each row is followed by it's children. Each level is broken into
+* blocks (a row and it's children), the blocks are sorted, trimmed and
+* then appended to `sorted` recursively.
+*/
+void sortRows(
+    const ResultSet::RowVector& rows,
+    const std::vector<int>& depths,
+    const size_t begin,
+    const size_t end,
+    const std::function<RowValue_s(const ResultSet::RowPair&)>& getSortValue,
+    const ResultSortOrder_e sortOrder,
+    const int trim,
+    ResultSet::RowVector& sorted)
+{
+    struct Block_s
+    {
+        size_t begin;
+        size_t end;
+        RowValue_s sortValue;
+    };
+
+    std::vector<Block_s> blocks;
+
+    const auto depth = depths[begin];
+    for (auto idx = begin; idx < end; ++idx)
+    {
+        if (depths[idx] != depth)
+            continue;
+
+        if (blocks.size())
+            blocks.back().end = idx;
+
+        blocks.push_back(Block_s{ idx, end, getSortValue(rows[idx]) });
+    }
+
+    std::sort(
+        blocks.begin(),
+        blocks.end(),
+        [&](const Block_s& left, const Block_s& right) -> bool
+        {
+            return RowValue_s::less(left.sortValue, right.sortValue, sortOrder);
+        });
+
+    if (trim > 0 && static_cast<int>(blocks.size()) > trim)
+        blocks.resize(trim);
+
+    for (const auto& block : blocks)
+    {
+        sorted.push_back(rows[block.begin]);
+        if (block.begin + 1 < block.end)
+            sortRows(rows, depths, block.begin + 1, block.end, getSortValue, sortOrder, trim, sorted);
+    }
+}
+
+void ResultMuxDemux::resultSetToJsonStream(
+    const int resultColumnCount,
+    const int resultSetCount,
+    std::vector<openset::result::ResultSet*>& resultSets,
+    ResultJsonWriter& writer,
+    const ResultSortMode_e sortMode,
+    const ResultSortOrder_e sortOrder,
+    const int sortColumn,
+    const int trim,
+    const int64_t bucket,
+    const int64_t forceMin,
+    const int64_t forceMax,
+    const bool partial)
+{
+    auto mergedText = mergeResultText(resultSets);
+    auto rows = mergeResultSets(resultColumnCount, resultSetCount, resultSets);
+
+    const auto shiftIterations = resultSetCount ? resultSetCount : 1;
+    const auto shiftSize = resultColumnCount;
+
+    auto& modifiers = resultSets[0]->accModifiers;
+    auto& types = resultSets[0]->accTypes;
+
+    // accumulators for rows added by the histogram fill
+    HeapStack fillMem;
+
+    if (bucket)
+        histogramFillRows(rows, resultColumnCount, shiftIterations, bucket, forceMin, forceMax, fillMem);
+
+    // sort and trim the flat rows
+    if (rows.size())
+    {
+        std::vector<int> depths;
+        depths.reserve(rows.size());
+        for (auto& r : rows)
+            depths.push_back(r.first.getDepth());
+
+        const std::function<RowValue_s(const ResultSet::RowPair&)> getSortValue =
+            [&](const ResultSet::RowPair& row) -> RowValue_s
+            {
+                if (sortMode == ResultSortMode_e::key)
+                    return getGroupValue(row.first, row.first.getDepth() - 1, mergedText);
+
+                if (sortColumn < 0 || sortColumn >= resultColumnCount)
+                    return RowValue_s{};
+
+                return getColumnValue(row.second, sortColumn, sortColumn, types, modifiers, mergedText);
+            };
+
+        ResultSet::RowVector sorted;
+        sorted.reserve(rows.size());
+        sortRows(rows, depths, 0, rows.size(), getSortValue, sortOrder, trim, sorted);
+        rows = std::move(sorted);
+    }
+
+    // stream the rows. Rows are in tree order, an entry object is left open until the
+    // next row tells us if we are nesting deeper, staying level or closing branches
+    writer.write("{\"_\":[", 6);
+
+    auto lastDepth = 0;
+    for (auto& r : rows)
+    {
+        const auto depth = r.first.getDepth();
+
+        if (lastDepth)
+        {
+            if (depth > lastDepth)
+            {
+                writer.write(",\"_\":[", 6);
+            }
+            else
+            {
+                writer.write('}');
+                for (auto i = depth; i < lastDepth; ++i)
+                    writer.write("]}", 2);
+                writer.write(',');
+            }
+        }
+
+        writer.write("{\"g\":", 5);
+        getGroupValue(r.first, depth - 1, mergedText).write(writer);
+
+        for (auto shiftCount = 0, shiftOffset = 0; shiftCount < shiftIterations; ++shiftCount, shiftOffset += shiftSize)
+        {
+            // one result columns branch will be "c", if multiple it will be "c", "c2", "c3", "c4"
+            if (!shiftCount)
+                writer.write(",\"c\":[", 6);
+            else
+            {
+                writer.write(",\"c", 3);
+                writer.writeInt(shiftCount + 1);
+                writer.write("\":[", 3);
+            }
+
+            for (auto dataIndex = shiftOffset, colIndex = 0; dataIndex < shiftOffset + shiftSize; ++dataIndex, ++colIndex)
+            {
+                if (colIndex)
+                    writer.write(',');
+                getColumnValue(r.second, dataIndex, colIndex, types, modifiers, mergedText).write(writer);
+            }
+
+            writer.write(']');
+        }
+
+        lastDepth = depth;
+    }
+
+    // close any open entries and branches
+    if (lastDepth)
+    {
+        writer.write('}');
+        for (auto i = 1; i < lastDepth; ++i)
+            writer.write("]}", 2);
+    }
+
+    if (partial)
+        writer.write("],\"partial\":true}");
+    else
+        writer.write("]}", 2);
+    writer.flush();
+}
+
 void ResultMuxDemux::jsonResultHistogramFill(
     cjson* doc, 
     const int64_t bucket, 
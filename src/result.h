@@ -6,7 +6,10 @@
 #include "common.h"
 #include "cjson/cjson.h"
 #include "mem/bigring.h"
+#include "mem/flatmap.h"
 #include "heapstack/heapstack.h"
+#include "sketch/hyperloglog.h"
+#include "sketch/tdigest.h"
 #include "querycommon.h"
 #include "table.h"
 #include "errors.h"
@@ -86,7 +89,7 @@ namespace openset
 				rowKey.clearFrom(index);
 			}
 
-			int getDepth()
+			int getDepth() const
 			{
 				auto count = 0;
 				for (auto iter = key; iter < key + keyDepth; ++iter, ++count)
@@ -168,6 +171,21 @@ namespace openset
 
 		const int ACCUMULATOR_DEPTH = 16;
 
+		// sketch modifiers keep a pointer to an out-of-line block in the
+		// accumulator value, returns the block size (or 0 if not a sketch)
+		inline int64_t sketchBytes(const query::Modifiers_e modifier)
+		{
+			switch (modifier)
+			{
+			case query::Modifiers_e::approx_count_distinct:
+				return sketch::HyperLogLog::Size;
+			case query::Modifiers_e::percentile:
+				return sketch::TDigest::Size;
+			default:
+				return 0;
+			}
+		}
+
 		struct Accumulator
 		{
 			Accumulation_s columns[ACCUMULATOR_DEPTH];
@@ -192,7 +210,7 @@ namespace openset
 		class ResultSet
 		{
 		public:
-			bigRing<RowKey, Accumulator*> results{ ringHint_e::lt_compact };
+			flatMap<RowKey, Accumulator*> results{ ringHint_e::lt_compact };
 			using RowPair = pair<RowKey, Accumulator*>;
 			using RowVector = vector<RowPair>;
 			vector<RowPair> sortedResult;			
@@ -295,6 +313,59 @@ namespace openset
 			}
 		};
 
+		/*
+		 *  ResultJsonWriter - writes JSON text into a fixed size chunk buffer.
+		 *
+		 *  When the buffer fills it is handed to the flush callback and reused,
+		 *  so memory stays at one chunk regardless of how big the result is.
+		 *  Output is formatted the same as cjson::Stringify (non-pretty).
+		 */
+		class ResultJsonWriter
+		{
+		public:
+			using FlushCB = std::function<void(const char* data, const int64_t length)>;
+
+		private:
+			char* buffer;
+			int64_t bufferSize;
+			int64_t used{ 0 };
+			int64_t totalBytes{ 0 };
+			FlushCB flushCb;
+
+		public:
+			explicit ResultJsonWriter(FlushCB flushCb, const int64_t chunkSize = 65536);
+			~ResultJsonWriter();
+
+			ResultJsonWriter(const ResultJsonWriter&) = delete;
+
+			void write(const char* data, const int64_t length);
+			void write(const char* text)
+			{
+				write(text, strlen(text));
+			}
+
+			void write(const char ch)
+			{
+				if (used == bufferSize)
+					flush();
+				buffer[used++] = ch;
+			}
+
+			void writeInt(const int64_t value);
+			void writeDouble(const double value);
+			void writeBool(const bool value);
+			void writeString(const char* text); // quotes and escapes
+			void writeNull();
+
+			// send whatever is buffered to the flush callback
+			void flush();
+
+			int64_t getBytes() const
+			{
+				return totalBytes + used;
+			}
+		};
+
 		/*
 		 *  MUX/DEMUX - Merge and generate mutiple result types.
 		 *
@@ -334,6 +405,29 @@ namespace openset
                 const int64_t forceMin = std::numeric_limits<int64_t>::min(),
                 const int64_t forceMax = std::numeric_limits<int64_t>::min());
 
+            /* resultSetToJsonStream - the streaming version of resultSetToJson
+             *
+             * Merges the result sets into a flat row vector, applies histogram
+             * fill, sorting and trimming to that vector and then writes JSON
+             * directly to `writer` without building a cjson document.
+             *
+             * Output matches resultSetToJson followed by the jsonResult* functions,
+             * with `"partial":true` added when `partial` is set.
+             */
+            static void resultSetToJsonStream(
+                const int resultColumnCount,
+                const int resultSetCount,
+                std::vector<openset::result::ResultSet*>& resultSets,
+                ResultJsonWriter& writer,
+                const ResultSortMode_e sortMode = ResultSortMode_e::column,
+                const ResultSortOrder_e sortOrder = ResultSortOrder_e::Desc,
+                const int sortColumn = 0,
+                const int trim = -1,
+                const int64_t bucket = 0,
+                const int64_t forceMin = std::numeric_limits<int64_t>::min(),
+                const int64_t forceMax = std::numeric_limits<int64_t>::min(),
+                const bool partial = false);
+
             static void jsonResultSortByColumn(cjson* doc, const ResultSortOrder_e sort, const int column);
             static void jsonResultSortByGroup(cjson* doc, const ResultSortOrder_e sort);
             static void jsonResultTrim(cjson* doc, const int trim);
@@ -27,6 +27,7 @@
 #include "internoderouter.h"
 #include "names.h"
 #include "http_serve.h"
+#include "time/timezone.h"
 
 //#include "trigger.h"
 
@@ -60,6 +61,153 @@ void RpcInternode::is_member(const openset::web::MessagePtr message, const RpcMa
 	message->reply(openset::http::StatusCode::success_ok, response);
 }
 
+std::string RpcInternode::pong()
+{
+	const auto load = globals::async ? globals::async->getRealtimeTotal() : 0;
+	return "{\"pong\":true,\"load\":" + to_string(load) + "}";
+}
+
+void RpcInternode::ping(const openset::web::MessagePtr message, const RpcMapping&)
+{
+	message->reply(openset::http::StatusCode::success_ok, pong());
+}
+
+void RpcInternode::workers(const openset::web::MessagePtr message, const RpcMapping&)
+{
+	cjson response;
+	auto list = response.setArray("workers");
+
+	for (const auto& stats : globals::async->getWorkerStats())
+	{
+		const auto total = stats.busyMicros + stats.idleMicros;
+
+		auto item = list->pushObject();
+		item->set("worker", stats.worker);
+		item->set("partitions", stats.partitions);
+		item->set("busy_us", stats.busyMicros);
+		item->set("idle_us", stats.idleMicros);
+		item->set("utilization", total ? static_cast<double>(stats.busyMicros) / static_cast<double>(total) : 0.0);
+		item->set("runs", stats.runs);
+		item->set("steals", stats.steals);
+	}
+
+	// queued to completed cell latency by priority class, log2 millisecond buckets
+	auto latency = response.setObject("latency");
+
+	const std::vector<std::pair<std::string, openset::async::oloopPriority_e>> classes = {
+		{ "realtime", openset::async::oloopPriority_e::realtime },
+		{ "ingest", openset::async::oloopPriority_e::ingest },
+		{ "background", openset::async::oloopPriority_e::background }
+	};
+
+	for (const auto& priorityClass : classes)
+	{
+		auto buckets = latency->setArray(priorityClass.first);
+		for (const auto count : globals::async->getLatencyHistogram(priorityClass.second))
+			buckets->push(count);
+	}
+
+	message->reply(openset::http::StatusCode::success_ok, response);
+}
+
+void RpcInternode::memory(const openset::web::MessagePtr message, const RpcMapping&)
+{
+	cjson response;
+
+	// reclaim before reporting if asked (this also happens every 10 seconds)
+	if (message->getParamBool("trim"))
+	{
+		response.set("trimmed_pool", PoolMem::getPool().trim());
+		response.set("trimmed_blocks", HeapStackBlockPool::getPool().trim());
+	}
+
+	// PoolMem - small allocations by size bucket
+	auto pool = response.setObject("pool");
+	auto buckets = pool->setArray("buckets");
+
+	int64_t poolInUse = 0;
+	int64_t poolFree = 0;
+	int64_t poolRetained = 0;
+	int64_t poolReclaimed = 0;
+	int64_t poolBlocks = 0;
+
+	for (const auto& stats : PoolMem::getPool().getStats())
+	{
+		if (!stats.heapAllocated)
+			continue;
+
+		const auto entrySize = stats.maxSize + MemConstants::PoolMemHeaderSize;
+		const auto inUse = stats.allocated * entrySize;
+		const auto free = stats.heapBytes - inUse; // free list plus thread caches
+		const auto retained = stats.heapAllocated - stats.reclaimedBytes;
+
+		poolInUse += inUse;
+		poolFree += free;
+		poolRetained += retained;
+		poolReclaimed += stats.reclaimedBytes;
+		poolBlocks += stats.blocks;
+
+		auto item = buckets->pushObject();
+		item->set("size", stats.maxSize);
+		item->set("allocated", stats.allocated);
+		item->set("in_use", inUse);
+		item->set("free", free);
+		item->set("retained", retained);
+		item->set("reclaimed", stats.reclaimedBytes);
+		item->set("blocks", stats.blocks);
+		item->set("free_blocks", stats.freeBlocks);
+		item->set("refills", stats.refills);
+		item->set("flushes", stats.flushes);
+	}
+
+	pool->set("in_use", poolInUse);
+	pool->set("free", poolFree);
+	pool->set("retained", poolRetained);
+	pool->set("reclaimed", poolReclaimed);
+
+	// HeapStack blocks - PoolMem buckets plus everything else built on HeapStack
+	// (people, attributes, indexes, results)
+	const auto blockStats = HeapStackBlockPool::getPool().getStats();
+
+	auto heapStacks = response.setObject("heap_stacks");
+	heapStacks->set("in_use", (blockStats.inUse - poolBlocks) * blockStats.blockSize);
+
+	auto blockPool = response.setObject("block_pool");
+	blockPool->set("block_size", blockStats.blockSize);
+	blockPool->set("in_use", blockStats.inUse * blockStats.blockSize);
+	blockPool->set("retained", blockStats.retained * blockStats.blockSize);
+	blockPool->set("max_retained", blockStats.maxRetained * blockStats.blockSize);
+	blockPool->set("released", blockStats.released * blockStats.blockSize);
+
+	message->reply(openset::http::StatusCode::success_ok, response);
+}
+
+void RpcInternode::routes(const openset::web::MessagePtr message, const RpcMapping&)
+{
+	cjson response;
+	auto list = response.setArray("routes");
+
+	for (const auto& stats : globals::mapper->getRouteStats())
+	{
+		auto item = list->pushObject();
+		item->set("node_id", stats.routeId);
+		item->set("node_name", globals::mapper->getRouteName(stats.routeId));
+		item->set("host", stats.host);
+		item->set("requests", stats.requests);
+		item->set("framed", stats.framed);
+		item->set("load", globals::mapper->getNodeLoad(stats.routeId));
+		item->set("errors", stats.errors);
+		item->set("in_flight", stats.inFlight);
+		item->set("peak_in_flight", stats.peakInFlight);
+		item->set("connections", stats.connections);
+		item->set("idle", stats.idle);
+		item->set("avg_latency_us", stats.requests ? stats.latencyMicros / stats.requests : 0);
+		item->set("max_latency_us", stats.maxLatencyMicros);
+	}
+
+	message->reply(openset::http::StatusCode::success_ok, response);
+}
+
 void RpcInternode::join_to_cluster(const openset::web::MessagePtr message, const RpcMapping& matches)
 {
 	globals::mapper->removeRoute(globals::running->nodeId);
@@ -379,10 +527,8 @@ ForwardStatus_e ForwardRequest(const openset::web::MessagePtr message)
 	{
 		cjson response;
 		cjson::Parse(
-			string{
-				result.responses[0].data,
-				result.responses[0].length
-			},
+			result.responses[0].data,
+			result.responses[0].length,
 			&response
 		);
 
@@ -398,7 +544,7 @@ ForwardStatus_e ForwardRequest(const openset::web::MessagePtr message)
             result.responses[0].length &&
             result.responses[0].data[0] == '{')
         {
-            cjson error(std::string(result.responses[0].data, result.responses[0].length), result.responses[0].length);
+            cjson error(result.responses[0].data, result.responses[0].length);
 
             if (error.xPath("/error"))
                 message->reply(openset::http::StatusCode::client_error_bad_request, error);
@@ -754,6 +900,30 @@ void RpcTable::table_create(const openset::web::MessagePtr message, const RpcMap
 
 	const auto sourceZOrder = request.xPath("/z_order");
 
+	// optional time bucketed index layers for `action` and columns marked `bucketed`
+	int64_t indexBucket = 0;
+
+	if (const auto bucketNode = request.xPath("/index_bucket"); bucketNode)
+	{
+		if (bucketNode->type() == cjsonType::INT)
+			indexBucket = bucketNode->getInt();
+		else if (bucketNode->getString() == "day")
+			indexBucket = 86'400'000LL;
+		else if (bucketNode->getString() == "week")
+			indexBucket = 86'400'000LL * 7LL;
+
+		if (indexBucket <= 0)
+		{
+			RpcError(
+				openset::errors::Error{
+				openset::errors::errorClass_e::config,
+				openset::errors::errorCode_e::general_config_error,
+				"bad index_bucket: must be day|week or milliseconds" },
+				message);
+			return;
+		}
+	}
+
 	auto sourceColumnsList = sourceColumns->getNodes();
 
     // validate column names and types
@@ -818,6 +988,7 @@ void RpcTable::table_create(const openset::web::MessagePtr message, const RpcMap
 	{
 	    const auto name = n->xPathString("/name", "");
 	    const auto type = n->xPathString("/type", "");
+	    const auto bucketed = n->xPathBool("/bucketed", false);
 
 		columnTypes_e colType;
 
@@ -846,11 +1017,14 @@ void RpcTable::table_create(const openset::web::MessagePtr message, const RpcMap
 			name, 
 			colType, 
 			false, 
-			false);	
+			false,
+			bucketed);	
 
 		++columnEnum;
 	}
 
+	table->indexBucket = indexBucket;
+
 	if (sourceZOrder)
 	{
 		auto zOrderStrings = table->getZOrderStrings();
@@ -913,6 +1087,9 @@ void RpcTable::table_describe(const openset::web::MessagePtr message, const RpcM
 
 	response.set("table", tableName);
 
+	if (table->indexBucket)
+		response.set("index_bucket", table->indexBucket);
+
 	auto columnNodes = response.setArray("columns");
 	auto columns = table->getColumns();
 
@@ -943,6 +1120,8 @@ void RpcTable::table_describe(const openset::web::MessagePtr message, const RpcM
 
 			columnRecord->set("name", c.name);
 			columnRecord->set("type", type);
+			if (c.bucketed)
+				columnRecord->set("bucketed", true);
             //columnRecord->set("index", cast<int64_t>(c.idx)); not required for describe, possibly confusing
 		}
 
@@ -1430,10 +1609,11 @@ void RpcInsert::insert(const openset::web::MessagePtr message, const RpcMapping&
 
 	auto remoteCount = 0;
 
-	const auto thankyouCB = [](http::StatusCode, bool, char*, size_t)
+	const auto thankyouCB = [](http::StatusCode, bool, char* data, size_t)
 	{		
         // TODO - we should probably handle this horrible possibility somehow.
-		// delete message;
+		if (data)
+			PoolMem::getPool().freePtr(data);
 	};
 
 	if (!isFork)
@@ -1585,6 +1765,64 @@ enum class queryFunction_e : int32_t
 };
 
 
+const size_t ForkFoldEvery = 4; // node results held before they are folded into the merged result
+
+/*
+ * forkPartitions - the partitions a fork runs its cells on.
+ *
+ * The originating node lists them in the `partitions` param (see
+ * Mapper::dispatchScatter), these can be partitions we own or clone. A
+ * request without the list runs on every partition we own.
+ *
+ * Replies with an error and returns false if a listed partition is no
+ * longer on this node.
+ */
+bool forkPartitions(const openset::web::MessagePtr message, std::vector<int>& activeList)
+{
+	const auto nodeId = openset::globals::running->nodeId;
+
+	if (!message->isParam("partitions"))
+	{
+		activeList = openset::globals::mapper->partitionMap.getPartitionsByNodeIdAndStates(
+			nodeId,
+			{
+				openset::mapping::NodeState_e::active_owner
+			}
+		);
+		return true;
+	}
+
+	const auto list = message->getParamString("partitions");
+	activeList.clear();
+
+	for (size_t start = 0; start < list.length();)
+	{
+		auto end = list.find(',', start);
+		if (end == std::string::npos)
+			end = list.length();
+
+		const auto partition = static_cast<int>(strtol(list.c_str() + start, nullptr, 10));
+		const auto state = openset::globals::mapper->partitionMap.getState(partition, nodeId);
+
+		if (state != openset::mapping::NodeState_e::active_owner &&
+			state != openset::mapping::NodeState_e::active_clone)
+		{
+			RpcError(
+				openset::errors::Error{
+					openset::errors::errorClass_e::internode,
+					openset::errors::errorCode_e::partition_migrated,
+					"partition " + to_string(partition) + " is not on this node" },
+				message);
+			return false;
+		}
+
+		activeList.push_back(partition);
+		start = end + 1;
+	}
+
+	return true;
+}
+
 /*  
  * The magic FORK function. 
  *
@@ -1600,7 +1838,7 @@ enum class queryFunction_e : int32_t
  * result set. This greatly reduces the number of data sets that need to be held
  * in memory and marged by the originator.
  */
-shared_ptr<cjson> forkQuery(
+void forkQuery(
 	Table* table,
 	const openset::web::MessagePtr message,
     const int resultColumnCount,
@@ -1617,161 +1855,158 @@ shared_ptr<cjson> forkQuery(
 	newParams.emplace("fork", "true");
 
     const auto setCount = resultSetCount ? resultSetCount : 1;
-	
-	// call all nodes and gather results - JSON is what's coming back
-	// NOTE - it would be fully possible to flatten results to binary
-	auto result = openset::globals::mapper->dispatchCluster(
-		message->getMethod(),
-		message->getPath(),
-		newParams,
-		message->getPayload(),
-		message->getPayloadLength(),
-		true);
 
-	std::vector<openset::result::ResultSet*> resultSets;
+	openset::mapping::Mapper::ScatterOptions_s options;
+	options.timeout = message->getParamInt("timeout", 0);
+	options.hedgeAfter = message->getParamInt("hedge", -1);
+	options.replicas = message->getParamBool("replicas", true);
+
+	// node results are merged as they arrive. Every ForkFoldEvery results are folded
+	// into one merged set, so we never hold every node's result at once
+	std::vector<std::pair<openset::result::ResultSet*, char*>> pending; // result set and the buffer it points into
+	openset::result::ResultSet* merged = nullptr;
+	char* mergedBuffer = nullptr;
 
-	for (auto &r : result.responses)
+	std::string errorReply;
+	auto emptyReply = false;
+
+	const auto fold = [&]()
 	{
-		if (ResultMuxDemux::isInternode(r.data, r.length))
-			resultSets.push_back(ResultMuxDemux::internodeToResultSet(r.data, r.length));
-		else
-		{
-			// there is an error message from one of the participing nodes
-			// TODO - handle error
-			if (!r.data || !r.length)
-				RpcError(
-					openset::errors::Error{
-						openset::errors::errorClass_e::internode,
-						openset::errors::errorCode_e::internode_error,
-						"Cluster error. Node had empty reply."},
-					message);
-			else
-				message->reply(openset::http::StatusCode::success_ok, r.data, r.length);
-			return nullptr;
-		}
-	}
-	
-    auto resultJson = make_shared<cjson>();
-    ResultMuxDemux::resultSetToJson(
-        resultColumnCount,
-        setCount,
-        resultSets,
-        resultJson.get());
+		std::vector<openset::result::ResultSet*> sets;
+		if (merged)
+			sets.push_back(merged);
+		for (auto& p : pending)
+			sets.push_back(p.first);
 
-    if (bucket)
-        ResultMuxDemux::jsonResultHistogramFill(resultJson.get(), bucket, forceMin, forceMax);
+		if (sets.size() < 2)
+			return;
 
-    switch (sortMode)
-    {
-        case ResultSortMode_e::key: 
-            ResultMuxDemux::jsonResultSortByGroup(resultJson.get(), sortOrder);
-        break;
-        case ResultSortMode_e::column: 
-            ResultMuxDemux::jsonResultSortByColumn(resultJson.get(), sortOrder, sortColumn);
-        break;
-        default: ;
-    }
+		int64_t bufferLength = 0;
+		const auto buffer = ResultMuxDemux::multiSetToInternode(resultColumnCount, setCount, sets, bufferLength);
 
-    ResultMuxDemux::jsonResultTrim(resultJson.get(), trim);
+		for (auto set : sets)
+			delete set;
+		if (mergedBuffer)
+			PoolMem::getPool().freePtr(mergedBuffer);
+		for (auto& p : pending)
+			PoolMem::getPool().freePtr(p.second);
+		pending.clear();
 
-	// local function to fill Meta data in result JSON
-	const auto fillMeta = [](const openset::query::VarList& mapping, cjson* jsonArray) {
+		merged = ResultMuxDemux::internodeToResultSet(buffer, bufferLength);
+		mergedBuffer = buffer;
+	};
 
-		for (auto c : mapping)
+	// call all nodes (each with the partitions it should run), results come back binary
+	const auto scatter = openset::globals::mapper->dispatchScatter(
+		message->getMethod(),
+		message->getPath(),
+		newParams,
+		message->getPayload(),
+		message->getPayloadLength(),
+		options,
+		[&](openset::mapping::Mapper::DataBlock& response)
 		{
-			auto tNode = jsonArray->pushObject();
+			// once a node has errored the rest of the results are thrown away
+			if (errorReply.length() || emptyReply)
+				return;
 
-			if (c.modifier == openset::query::Modifiers_e::var)
+			if (ResultMuxDemux::isInternode(response.data, response.length))
 			{
-				tNode->set("mode", "var");
-				tNode->set("name", c.alias);
+				pending.emplace_back(ResultMuxDemux::internodeToResultSet(response.data, response.length), response.data);
+				response.data = nullptr; // the result set points into it
 
-				switch (c.value.typeof())
-				{
-				case cvar::valueType::INT32:
-				case cvar::valueType::INT64:
-					tNode->set("type", "int");
-					break;
-				case cvar::valueType::FLT:
-				case cvar::valueType::DBL:
-					tNode->set("type", "double");
-					break;
-				case cvar::valueType::STR:
-					tNode->set("type", "text");
-					break;
-				case cvar::valueType::BOOL:
-					tNode->set("type", "bool");
-					break;
-				default:
-					tNode->set("type", "na");
-					break;
-				}
+				if (pending.size() >= ForkFoldEvery)
+					fold();
 			}
-			else if (openset::query::isTimeModifiers.count(c.modifier))
-			{
-				auto mode = openset::query::ModifierDebugStrings.at(c.modifier);
-				toLower(mode);
-				tNode->set("mode", mode);
-				tNode->set("name", c.alias);
-				tNode->set("type", "int");
-			}
-			else
-			{
-				auto mode = openset::query::ModifierDebugStrings.at(c.modifier);
-				toLower(mode);
-				tNode->set("mode", mode);
-				tNode->set("name", c.alias);
-				tNode->set("column", c.actual);
-
-				switch (c.schemaType)
-				{
-				case columnTypes_e::freeColumn:
-					tNode->set("type", "na");
-					break;
-				case columnTypes_e::intColumn:
-					tNode->set("type", "int");
-					break;
-				case columnTypes_e::doubleColumn:
-					tNode->set("type", "double");
-					break;
-				case columnTypes_e::boolColumn:
-					tNode->set("type", "bool");
-					break;
-				case columnTypes_e::textColumn:
-					tNode->set("type", "text");
-					break;
-				default:;
-				}
-			}
-		}
-
+			else if (!response.data || !response.length)
+				emptyReply = true;
+			else // there is an error message from one of the participating nodes
+				errorReply.assign(response.data, response.length);
+		});
 
+	std::vector<openset::result::ResultSet*> resultSets;
+	if (merged)
+		resultSets.push_back(merged);
+	for (auto& p : pending)
+		resultSets.push_back(p.first);
+
+	const auto cleanup = [&]()
+	{
+		for (auto r : resultSets)
+			delete r;
+		if (mergedBuffer)
+			PoolMem::getPool().freePtr(mergedBuffer);
+		for (auto& p : pending)
+			PoolMem::getPool().freePtr(p.second);
 	};
 
-	// add status nodes to JSON document
-	//auto metaJson = resultJson->setObject("info");
-	//auto dataJson = metaJson->setObject("data");
-	//fillMeta(queryMacros.vars.columnVars, dataJson->setArray("columns"));
-	//fillMeta(queryMacros.vars.groupVars, dataJson->setArray("groups"));
+	if (emptyReply || errorReply.length())
+	{
+		if (emptyReply)
+			RpcError(
+				openset::errors::Error{
+					openset::errors::errorClass_e::internode,
+					openset::errors::errorCode_e::internode_error,
+					"Cluster error. Node had empty reply."},
+				message);
+		else
+			message->reply(openset::http::StatusCode::success_ok, errorReply);
 
+		cleanup();
+		return;
+	}
 
-	//metaJson->set("query_time", queryTime);
-	//metaJson->set("pop_evaluated", population);
-	//metaJson->set("pop_total", totalPopulation);
-	//metaJson->set("compile_time", compileTime);
-	//metaJson->set("serialize_time", serialTime);
-	//metaJson->set("total_time", elapsed);
+	if (scatter.hedged || scatter.partial)
+		Logger::get().info(
+			"fork query: " + to_string(scatter.requests) + " requests, " + 
+			to_string(scatter.hedged) + " hedged, " + 
+			to_string(scatter.missing.size()) + " partitions missing");
 
-	Logger::get().info("RpcQuery on " + table->getName());
+	// no partitions mapped yet, an empty result
+	if (resultSets.empty())
+		resultSets.push_back(new openset::result::ResultSet());
+	
+    // merge and serialize straight to the response. Sorting and trimming are done
+    // on the flat merged rows and JSON is sent in chunks as it is written, so
+    // we never build a cjson document or hold the whole JSON string in memory
+    const auto replyChunked = message->canReplyChunked();
+    std::string replyBuffer; // used if chunked replies are not available
 
-	// free up the responses
-	openset::globals::mapper->releaseResponses(result);
+    ResultJsonWriter writer([&](const char* data, const int64_t length)
+    {
+        if (replyChunked)
+            message->replyChunk(openset::http::StatusCode::success_ok, data, length);
+        else
+            replyBuffer.append(data, length);
+    });
+
+    ResultMuxDemux::resultSetToJsonStream(
+        resultColumnCount,
+        setCount,
+        resultSets,
+        writer,
+        sortMode,
+        sortOrder,
+        sortColumn,
+        trim,
+        bucket,
+        forceMin,
+        forceMax,
+        scatter.partial);
+
+    if (replyChunked)
+    {
+        message->replyChunk(openset::http::StatusCode::success_ok, nullptr, 0); // end of reply
+    }
+    else
+    {
+        message->reply(openset::http::StatusCode::success_ok, replyBuffer);
+    }
 
-	// clean up all those resultSet*
-	for (auto r : resultSets)
-		delete r;
+	Logger::get().info("RpcQuery on " + table->getName());
 
-	return std::move(resultJson);
+	// clean up all those resultSet* and the buffers they point into
+	cleanup();
 }
 
 
@@ -1787,6 +2022,7 @@ void RpcQuery::events(const openset::web::MessagePtr message, const RpcMapping&
 
 	const auto debug = message->getParamBool("debug");
 	const auto isFork = message->getParamBool("fork");
+    const auto deadline = message->getParamInt("deadline", 0); // milliseconds, 0 is none
 
     const auto trimSize = message->getParamInt("trim", -1);
     const auto sortOrder = message->getParamString("order", "desc") == "asc" ? ResultSortOrder_e::Asc : ResultSortOrder_e::Desc;
@@ -1945,6 +2181,23 @@ void RpcQuery::events(const openset::web::MessagePtr message, const RpcMapping&
 	// through the to oloop_query, the person object and finally the grid
 	queryMacros.sessionTime = sessionTime;
 
+	// date functions bucket in the caller's time zone when one is given
+	if (message->isParam("tz"))
+	{
+		queryMacros.timeZone = TimeZone::get(message->getParamString("tz"));
+
+		if (!queryMacros.timeZone)
+		{
+			RpcError(
+				openset::errors::Error{
+					openset::errors::errorClass_e::query,
+					openset::errors::errorCode_e::general_query_error,
+					"unknown time zone: " + message->getParamString("tz") },
+				message);
+			return;
+		}
+	}
+
 	const auto compileTime = Now() - startTime;
 	const auto queryStart = Now();
 	
@@ -2013,32 +2266,24 @@ void RpcQuery::events(const openset::web::MessagePtr message, const RpcMapping&
 	if (!isFork)
 	{               
 
-		const auto json = std::move(
-            forkQuery(
-                table, 
-                message, 
-                queryMacros.vars.columnVars.size(), 
-                queryMacros.segments.size(),
-                sortMode,
-                sortOrder,
-                sortColumn,
-                trimSize)
-        );
-
-		if (json) // if null/empty we had an error
-			message->reply(http::StatusCode::success_ok, *json);
+		forkQuery(
+            table, 
+            message, 
+            queryMacros.vars.columnVars.size(), 
+            queryMacros.segments.size(),
+            sortMode,
+            sortOrder,
+            sortColumn,
+            trimSize);
 		return;
 	}
 
 	// We are a Fork!
 
-	// create list of active_owner parititions for factory function
-	auto activeList = openset::globals::mapper->partitionMap.getPartitionsByNodeIdAndStates(
-		openset::globals::running->nodeId,
-		{
-			openset::mapping::NodeState_e::active_owner
-		}
-	);
+	// create list of parititions for factory function
+	std::vector<int> activeList;
+	if (!forkPartitions(message, activeList))
+		return;
 
 	// Shared Results - Partitions spread across working threads (AsyncLoop's made by AsyncPool)
 	//      we don't have to worry about locking anything shared between partitions in the same
@@ -2142,11 +2387,15 @@ void RpcQuery::events(const openset::web::MessagePtr message, const RpcMapping&
 		});
 
 	auto instance = 0;
+	// each node times the deadline from when it receives the fork
+	const auto deadlineAt = deadline > 0 ? Now() + deadline : 0;
 	// pass factory function (as lambda) to create new cell objects
-	partitions->cellFactory(activeList, [shuttle, table, queryMacros, resultSets, &instance](AsyncLoop* loop) -> OpenLoop*
+	partitions->cellFactory(activeList, [shuttle, table, queryMacros, resultSets, deadlineAt, &instance](AsyncLoop*) -> OpenLoop*
 		{
 			instance++;
-			return new OpenLoopQuery(shuttle, table, queryMacros, resultSets[loop->getWorkerId()], instance);
+			const auto cell = new OpenLoopQuery(shuttle, table, queryMacros, resultSets, instance);
+			cell->deadline = deadlineAt;
+			return cell;
 		});
 
 }
@@ -2163,6 +2412,7 @@ void RpcQuery::counts(const openset::web::MessagePtr message, const RpcMapping&
 
 	const auto debug = message->getParamBool("debug");
 	const auto isFork = message->getParamBool("fork");
+	const auto deadline = message->getParamInt("deadline", 0); // milliseconds, 0 is none
 
 	const auto startTime = Now();
 
@@ -2327,26 +2577,19 @@ void RpcQuery::counts(const openset::web::MessagePtr message, const RpcMapping&
 	*/
 	if (!isFork)
 	{
-		const auto json = std::move(
-            forkQuery(
-                table, 
-                message, 
-                queries.front().second.vars.columnVars.size(), 
-                queries.front().second.segments.size())
-        );
-		if (json) // if null/empty we had an error
-			message->reply(http::StatusCode::success_ok, *json);
+		forkQuery(
+            table, 
+            message, 
+            queries.front().second.vars.columnVars.size(), 
+            queries.front().second.segments.size());
 		return;
 	}
 
 	// We are a Fork!
 
-	auto activeList = openset::globals::mapper->partitionMap.getPartitionsByNodeIdAndStates(
-		openset::globals::running->nodeId,
-		{ 
-			openset::mapping::NodeState_e::active_owner 
-		}
-	);
+	std::vector<int> activeList;
+	if (!forkPartitions(message, activeList))
+		return;
 
 	for (auto i = 0; i < partitions->getWorkerCount(); ++i)
 		resultSets.push_back(new openset::result::ResultSet());
@@ -2425,12 +2668,16 @@ void RpcQuery::counts(const openset::web::MessagePtr message, const RpcMapping&
 
 	auto instance = 0;
 	auto workers = 0;
+	// each node times the deadline from when it receives the fork
+	const auto deadlineAt = deadline > 0 ? Now() + deadline : 0;
 	// pass factory function (as lambda) to create new cell objects
-	partitions->cellFactory(activeList, [shuttle, table, queries, resultSets, &workers, &instance](AsyncLoop* loop) -> OpenLoop*
+	partitions->cellFactory(activeList, [shuttle, table, queries, resultSets, deadlineAt, &workers, &instance](AsyncLoop*) -> OpenLoop*
 	{
 		++instance;
 		++workers;
-		return new OpenLoopCount(shuttle, table, queries, resultSets[loop->getWorkerId()], instance);
+		const auto cell = new OpenLoopCount(shuttle, table, queries, resultSets, instance);
+		cell->deadline = deadlineAt;
+		return cell;
 	});
 
 	Logger::get().info("Started " + to_string(workers) + " count worker async cells.");
@@ -2444,6 +2691,7 @@ void RpcQuery::column(openset::web::MessagePtr message, const RpcMapping& matche
     const auto tableName = matches.find("table"s)->second;
     const auto columnName = matches.find("name"s)->second;
     const auto isFork = message->getParamBool("fork");
+    const auto deadline = message->getParamInt("deadline", 0); // milliseconds, 0 is none
 
     const auto trimSize = message->getParamInt("trim", -1);
     const auto sortOrder = message->getParamString("order", "desc") == "asc" ? ResultSortOrder_e::Asc : ResultSortOrder_e::Desc;
@@ -2715,31 +2963,23 @@ void RpcQuery::column(openset::web::MessagePtr message, const RpcMapping& matche
     */
     if (!isFork)
     {
-        const auto json = std::move(
-            forkQuery(
-                table, 
-                message, 
-                1, 
-                queryInfo.segments.size(),
-                ResultSortMode_e::column,
-                sortOrder,
-                0,
-                trimSize
-            )
-        );
-        if (json) // if null/empty we had an error
-            message->reply(http::StatusCode::success_ok, *json);
+        forkQuery(
+            table, 
+            message, 
+            1, 
+            queryInfo.segments.size(),
+            ResultSortMode_e::column,
+            sortOrder,
+            0,
+            trimSize);
         return;
     }
 
 
-    // create list of active_owner parititions for factory function
-    auto activeList = openset::globals::mapper->partitionMap.getPartitionsByNodeIdAndStates(
-        openset::globals::running->nodeId,
-        {
-            openset::mapping::NodeState_e::active_owner
-        }
-    );
+    // create list of parititions for factory function
+    std::vector<int> activeList;
+    if (!forkPartitions(message, activeList))
+        return;
     
     // Shared Results - Partitions spread across working threads (AsyncLoop's made by AsyncPool)
     //      we don't have to worry about locking anything shared between partitions in the same
@@ -2829,11 +3069,15 @@ void RpcQuery::column(openset::web::MessagePtr message, const RpcMapping& matche
     });
 
     auto instance = 0;
+    // each node times the deadline from when it receives the fork
+    const auto deadlineAt = deadline > 0 ? Now() + deadline : 0;
     // pass factory function (as lambda) to create new cell objects
-    partitions->cellFactory(activeList, [shuttle, table, queryInfo, resultSets, &instance](AsyncLoop* loop) -> OpenLoop*
+    partitions->cellFactory(activeList, [shuttle, table, queryInfo, resultSets, deadlineAt, &instance](AsyncLoop*) -> OpenLoop*
     {
         instance++;
-        return new OpenLoopColumn(shuttle, table, queryInfo, resultSets[loop->getWorkerId()], instance);
+        const auto cell = new OpenLoopColumn(shuttle, table, queryInfo, resultSets, instance);
+        cell->deadline = deadlineAt;
+        return cell;
     });
 
 }
@@ -2961,8 +3205,14 @@ void RpcQuery::histogram(openset::web::MessagePtr message, const RpcMapping& mat
     const auto groupName = matches.find("name"s)->second;
     const auto queryCode = std::string{ message->getPayload(), message->getPayloadLength() };
 
+    // column mode - `column=` without a script builds the histogram for a numeric
+    // column directly from the index bits (no people are mounted, no script is run)
+    const auto columnName = message->getParamString("column");
+    const auto columnMode = columnName.length() && !trim(queryCode).length();
+
     const auto debug = message->getParamBool("debug");
     const auto isFork = message->getParamBool("fork");
+    const auto deadline = message->getParamInt("deadline", 0); // milliseconds, 0 is none
 
     const auto trimSize = message->getParamInt("trim", -1);
     const auto sortOrder = message->getParamString("order", "desc") == "asc" ? ResultSortOrder_e::Asc : ResultSortOrder_e::Desc;
@@ -2985,7 +3235,7 @@ void RpcQuery::histogram(openset::web::MessagePtr message, const RpcMapping& mat
         return;
     }
 
-    if (!queryCode.length())
+    if (!queryCode.length() && !columnMode)
     {
         RpcError(
             openset::errors::Error{
@@ -3061,40 +3311,64 @@ void RpcQuery::histogram(openset::web::MessagePtr message, const RpcMapping& mat
     openset::query::Macro_s queryMacros; // this is our compiled code block
     openset::query::QueryParser p;
 
-    try
+    auto columnIndex = -1;
+
+    if (columnMode)
     {
-        p.compileQuery(queryCode.c_str(), table->getColumns(), queryMacros, &paramVars);
+        const auto columnInfo = table->getColumns()->getColumn(columnName);
+
+        if (!columnInfo ||
+            (columnInfo->type != columnTypes_e::intColumn &&
+             columnInfo->type != columnTypes_e::doubleColumn))
+        {
+            RpcError(
+                openset::errors::Error{
+                    openset::errors::errorClass_e::query,
+                    openset::errors::errorCode_e::column_not_in_table,
+                    "histogram column '" + columnName + "' must be an int or double column in the table" },
+                    message);
+            return;
+        }
+
+        columnIndex = columnInfo->idx;
     }
-    catch (const std::runtime_error &ex)
+    else
     {
-        RpcError(
-            openset::errors::Error{
-                openset::errors::errorClass_e::parse,
-                openset::errors::errorCode_e::syntax_error,
-                std::string{ ex.what() }
-            },
-            message);
-        return;
-    }
+        try
+        {
+            p.compileQuery(queryCode.c_str(), table->getColumns(), queryMacros, &paramVars);
+        }
+        catch (const std::runtime_error &ex)
+        {
+            RpcError(
+                openset::errors::Error{
+                    openset::errors::errorClass_e::parse,
+                    openset::errors::errorCode_e::syntax_error,
+                    std::string{ ex.what() }
+                },
+                message);
+            return;
+        }
 
-    if (p.error.inError())
-    {
-        Logger::get().error(p.error.getErrorJSON());
-        message->reply(http::StatusCode::client_error_bad_request, p.error.getErrorJSON());
-        return;
-    }
+        if (p.error.inError())
+        {
+            Logger::get().error(p.error.getErrorJSON());
+            message->reply(http::StatusCode::client_error_bad_request, p.error.getErrorJSON());
+            return;
+        }
 
-    // Histogram querys must call tally
-    if (queryMacros.marshalsReferenced.count(query::Marshals_e::marshal_tally))
-    {
-        RpcError(
-            openset::errors::Error{
-                openset::errors::errorClass_e::parse,
-                openset::errors::errorCode_e::syntax_error,
-                "histogram queries should not call 'tally'. They should 'return' the value to store."
-            },
-            message);
-        return;
+        // Histogram querys must call tally
+        if (queryMacros.marshalsReferenced.count(query::Marshals_e::marshal_tally))
+        {
+            RpcError(
+                openset::errors::Error{
+                    openset::errors::errorClass_e::parse,
+                    openset::errors::errorCode_e::syntax_error,
+                    "histogram queries should not call 'tally'. They should 'return' the value to store."
+                },
+                message);
+            return;
+        }
     }
 
     if (message->isParam("segments"))
@@ -3124,6 +3398,23 @@ void RpcQuery::histogram(openset::web::MessagePtr message, const RpcMapping& mat
     // through the to oloop_query, the person object and finally the grid
     queryMacros.sessionTime = sessionTime;
 
+    // date functions bucket in the caller's time zone when one is given
+    if (message->isParam("tz"))
+    {
+        queryMacros.timeZone = TimeZone::get(message->getParamString("tz"));
+
+        if (!queryMacros.timeZone)
+        {
+            RpcError(
+                openset::errors::Error{
+                    openset::errors::errorClass_e::query,
+                    openset::errors::errorCode_e::general_query_error,
+                    "unknown time zone: " + message->getParamString("tz") },
+                message);
+            return;
+        }
+    }
+
     const auto compileTime = Now() - startTime;
     const auto queryStart = Now();
 
@@ -3166,36 +3457,27 @@ void RpcQuery::histogram(openset::web::MessagePtr message, const RpcMapping& mat
     */
     if (!isFork)
     {
-        const auto json = std::move(
-            forkQuery(
-                table,
-                message,
-                1,
-                queryMacros.segments.size(),
-                sortMode,
-                sortOrder,
-                0,
-                trimSize,
-                bucket,
-                forceMin,
-                forceMax
-            )
-        );
-
-        if (json) // if null/empty we had an error
-            message->reply(http::StatusCode::success_ok, *json);
+        forkQuery(
+            table,
+            message,
+            1,
+            queryMacros.segments.size(),
+            sortMode,
+            sortOrder,
+            0,
+            trimSize,
+            bucket,
+            forceMin,
+            forceMax);
         return;
     }
 
     // We are a Fork!
 
-    // create list of active_owner parititions for factory function
-    auto activeList = openset::globals::mapper->partitionMap.getPartitionsByNodeIdAndStates(
-        openset::globals::running->nodeId,
-        {
-            openset::mapping::NodeState_e::active_owner
-        }
-    );
+    // create list of parititions for factory function
+    std::vector<int> activeList;
+    if (!forkPartitions(message, activeList))
+        return;
 
     // Shared Results - Partitions spread across working threads (AsyncLoop's made by AsyncPool)
     //      we don't have to worry about locking anything shared between partitions in the same
@@ -3293,11 +3575,15 @@ void RpcQuery::histogram(openset::web::MessagePtr message, const RpcMapping& mat
     });
 
     auto instance = 0;
+    // each node times the deadline from when it receives the fork
+    const auto deadlineAt = deadline > 0 ? Now() + deadline : 0;
     // pass factory function (as lambda) to create new cell objects
     partitions->cellFactory(activeList, [=, &instance](AsyncLoop* loop) -> OpenLoop*
     {
         instance++;
-        return new OpenLoopHistogram(shuttle, table, queryMacros, groupName, bucket, resultSets[loop->getWorkerId()], instance);
+        const auto cell = new OpenLoopHistogram(shuttle, table, queryMacros, groupName, bucket, resultSets, instance, columnIndex);
+        cell->deadline = deadlineAt;
+        return cell;
     });
 }
 
@@ -60,6 +60,17 @@ namespace openset::comms
 		static void transfer_init(const openset::web::MessagePtr message, const RpcMapping& matches);
 		// POST /v1/internode/transfer?partition={partition_id}&table={table_name}
 		static void transfer_receive(const openset::web::MessagePtr message, const RpcMapping& matches);
+		// GET /v1/internode/workers
+		static void workers(const openset::web::MessagePtr message, const RpcMapping& matches);
+		// GET /v1/internode/memory?trim={true|false}
+		static void memory(const openset::web::MessagePtr message, const RpcMapping& matches);
+		// GET /v1/internode/routes
+		static void routes(const openset::web::MessagePtr message, const RpcMapping& matches);
+		// GET /ping (framed requests, HTTP pings are answered by the server thread)
+		static void ping(const openset::web::MessagePtr message, const RpcMapping& matches);
+
+		// {"pong":true,"load":#} - load is read by the pinging node to plan queries
+		static std::string pong();
 	};
 
 	class RpcCluster
@@ -154,6 +165,10 @@ namespace openset::comms
 
 		// RpcInternode
 		{ "GET", std::regex(R"(^/v1/internode/is_member$)"), RpcInternode::is_member, {} },
+		{ "GET", std::regex(R"(^/v1/internode/workers$)"), RpcInternode::workers, {} },
+		{ "GET", std::regex(R"(^/v1/internode/memory$)"), RpcInternode::memory, {} },
+		{ "GET", std::regex(R"(^/v1/internode/routes$)"), RpcInternode::routes, {} },
+		{ "GET", std::regex(R"(^/ping$)"), RpcInternode::ping, {} },
 		{ "POST", std::regex(R"(^/v1/internode/join_to_cluster$)"), RpcInternode::join_to_cluster, {} },
 		{ "POST", std::regex(R"(^/v1/internode/add_node$)"), RpcInternode::add_node, {} },
 		{ "PUT", std::regex(R"(^/v1/internode/transfer)"), RpcInternode::transfer_init, {} },
@@ -64,7 +64,10 @@ bool openset::mapping::Sentinel::failCheck()
 			cjson json(resultJson, resultJson.length());
 
 			if (json.xPathBool("/pong", false))
+			{
 				isValid = true;
+				mapper->setNodeLoad(r, json.xPathInt("/load", 0));
+			}
 		}
 
 		if (!isValid)
@@ -11,6 +11,7 @@
 #include "sentinel.h"
 
 #include "http_serve.h"
+#include "sba/sba.h"
 
 
 #include <thread>
@@ -56,6 +57,18 @@ namespace openset
 	
 		openset::mapping::Sentinel teamster(&mapper, &db);
 
+		// return memory freed by spikes (large transfers, ingest bursts) to the OS
+		std::thread memoryTrim([]()
+		{
+			while (true)
+			{
+				ThreadSleep(10000);
+				PoolMem::getPool().trim();
+				HeapStackBlockPool::getPool().trim();
+			}
+		});
+		memoryTrim.detach();
+
 		web::HttpServe httpd;	
 		httpd.serve(ip, port); // this function will never return
 
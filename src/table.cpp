@@ -125,8 +125,13 @@ void Table::serializeTable(cjson* doc)
 			columnRecord->set("type", type);
 			columnRecord->set("deleted", c.deleted);
 			columnRecord->set("prop", c.isProp);
+			if (c.bucketed)
+				columnRecord->set("bucketed", true);
 		}
 
+	if (indexBucket)
+		doc->set("index_bucket", indexBucket);
+
 }
 
 void Table::serializeTriggers(cjson* doc)
@@ -141,6 +146,13 @@ void Table::serializeTriggers(cjson* doc)
 		trigNode->set("name", t.second->name);
 		trigNode->set("entry", t.second->entryFunction);
 		trigNode->set("script", t.second->script);
+
+		if (t.second->dependsOn.size())
+		{
+			auto dependsNode = trigNode->setArray("depends_on");
+			for (const auto& action : t.second->dependsOn)
+				dependsNode->push(action);
+		}
 	}	
 }
 
@@ -155,6 +167,7 @@ void Table::deserializeTable(cjson* doc)
 		auto type = item->xPathString("/type", "");
 		auto index = item->xPathInt("/index", -1);
 		auto isProp = item->xPathBool("/prop", false);
+		auto bucketed = item->xPathBool("/bucketed", false);
 		// was it deleted? > 0 = deleted, value is epoch time of deletion
 		auto deleted = item->xPathInt("/deleted", 0);
 		
@@ -174,10 +187,12 @@ void Table::deserializeTable(cjson* doc)
 		else
 			return; // TODO hmmm...
 
-		columns.setColumn(index, colName, colType, isProp, deleted);
+		columns.setColumn(index, colName, colType, isProp, deleted, bucketed);
 		count++;
 	};
 
+	indexBucket = doc->xPathInt("/index_bucket", 0);
+
 	// load the PK
 	zOrderStrings.clear();
 	zOrderInts.clear();
@@ -235,12 +250,18 @@ void Table::deserializeTriggers(cjson* doc)
 		trigInfo->entryFunctionHash = MakeHash(trigInfo->entryFunction);
 		trigInfo->configVersion = 0;
 
+		if (const auto dependsNode = t->xPath("/depends_on"); dependsNode)
+			for (const auto n : dependsNode->getNodes())
+				trigInfo->dependsOn.push_back(n->getString());
+
 		auto error = openset::trigger::Trigger::compileTrigger(
 			this,
 			trigInfo->name,
 			trigInfo->script,
 			trigInfo->macros);
 
+		openset::trigger::Trigger::resolveDependencies(trigInfo);
+
 		triggerConf[trigInfo->name] = trigInfo;
 
 		Logger::get().info("initialized trigger '" + trigInfo->name + "' on table '" + this->name + ".");
@@ -96,6 +96,7 @@ namespace openset
 			int rowCull{ 5000 }; // remove oldest rows if more than rowCull
 			int64_t stampCull{ 86'400'000LL * 365LL }; // auto cull older than stampCull
 			int64_t sessionTime{ 60'000LL * 30LL }; // 30 minutes
+			int64_t indexBucket{ 0 }; // width of time bucketed index layers, 0 for none
 
 			explicit Table(string name, openset::db::Database* database);
 
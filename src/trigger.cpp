@@ -1,4 +1,7 @@
 #include "trigger.h"
+
+#include <algorithm>
+
 #include "tablepartitioned.h"
 #include "queryinterpreter.h"
 #include "table.h"
@@ -72,6 +75,26 @@ openset::errors::Error Trigger::compileTrigger(
 	return p.error;
 }
 
+void Trigger::resolveDependencies(triggerSettings_s* settings)
+{
+	settings->actionDeps.clear();
+
+	if (settings->dependsOn.size())
+	{
+		for (const auto& action : settings->dependsOn)
+			settings->actionDeps.push_back(MakeHash(action));
+
+		sort(settings->actionDeps.begin(), settings->actionDeps.end());
+		return;
+	}
+
+	// leaves actionDeps empty if the script can't be narrowed
+	openset::query::QueryParser::actionDependencies(
+		settings->macros, 
+		settings->entryFunctionHash, 
+		settings->actionDeps);
+}
+
 void Trigger::init()
 {
 	// local copy of macros
@@ -86,6 +109,8 @@ void Trigger::init()
 
 	interpreter = new openset::query::Interpreter(macros, openset::query::InterpretMode_e::job);
 
+	incremental = openset::query::QueryParser::incrementalPlan(macros, settings->entryFunctionHash, plan);
+
 	// This is the text value for this triggers on_insert event
 	const auto valueName = settings->name + "::on_insert";
 
@@ -199,6 +224,18 @@ void Trigger::mount(openset::db::Person* personPtr)
 	interpreter->mount(person);
 }
 
+bool Trigger::dependsOn(const std::vector<int64_t>& insertedActions) const
+{
+	if (settings->actionDeps.empty())
+		return true;
+
+	for (const auto action : insertedActions)
+		if (binary_search(settings->actionDeps.begin(), settings->actionDeps.end(), action))
+			return true;
+
+	return false;
+}
+
 void Trigger::preInsertTest()
 {
 	checkReload();
@@ -221,10 +258,118 @@ void Trigger::postInsertTest()
 		return; // already done it
 
 	currentFunctionHash = settings->entryFunctionHash;
-	interpreter->exec(settings->entryFunctionHash); // call the script 'trigger' function
+
+	if (!incremental || !resume())
+		interpreter->exec(settings->entryFunctionHash); // call the script 'trigger' function
 
 	if (!beforeState && interpreter->jobState)
 		bits->bitSet(person->getMeta()->linId);
+
+	if (incremental)
+		checkpoint();
+}
+
+void Trigger::insertSkipped(openset::db::Person* personPtr, const int32_t rowsBefore)
+{
+	const auto grid = personPtr->getGrid();
+
+	// appended rows leave the checkpoint lined up
+	if (grid->getFirstChangedRow() >= rowsBefore)
+		return;
+
+	parts->people.replacePersonRecord(
+		grid->clearFlags(openset::db::flagType_e::trigger_checkpoint, settings->id));
+}
+
+namespace
+{
+	// trigger_checkpoint contexts, the state variables use their own index
+	const int64_t CheckpointRows = -2; // rows already run
+	const int64_t CheckpointStamp = -1; // stamp of the last of those rows
+}
+
+bool Trigger::resume()
+{
+	const auto grid = person->getGrid();
+	const auto rows = grid->getRows();
+
+	int64_t processed;
+	int64_t lastStamp;
+
+	if (!grid->getFlag(openset::db::flagType_e::trigger_checkpoint, settings->id, CheckpointRows, processed) ||
+		!grid->getFlag(openset::db::flagType_e::trigger_checkpoint, settings->id, CheckpointStamp, lastStamp))
+		return false;
+
+	// rows before the checkpoint have to be exactly the ones it saw, anything
+	// inserted out of order or culled since means starting over
+	if (processed <= 0 ||
+		processed >= static_cast<int64_t>(rows->size()) ||
+		grid->getFirstChangedRow() < processed ||
+		(*rows)[processed - 1]->cols[openset::db::COL_STAMP] != lastStamp)
+		return false;
+
+	auto& userVars = macros.vars.userVars;
+
+	for (const auto index : plan.stateVars)
+	{
+		int64_t value;
+		if (!grid->getFlag(openset::db::flagType_e::trigger_checkpoint, settings->id, index, value))
+			return false;
+		userVars[index].value = value;
+	}
+
+	interpreter->execFrom(plan.match, static_cast<int>(processed));
+
+	return true;
+}
+
+void Trigger::checkpoint()
+{
+	const auto grid = person->getGrid();
+
+	// fired (or failed), nothing left to carry on from
+	if (interpreter->jobState || interpreter->error.inError())
+	{
+		parts->people.replacePersonRecord(
+			grid->clearFlags(openset::db::flagType_e::trigger_checkpoint, settings->id));
+		return;
+	}
+
+	const auto rows = grid->getRows();
+	auto processed = static_cast<int64_t>(rows->size());
+
+	// only integers are kept, anything else runs in full next time
+	for (const auto index : plan.stateVars)
+	{
+		const auto& value = macros.vars.userVars[index].value;
+		const auto type = value.typeof();
+
+		if (type != cvar::valueType::INT32 && type != cvar::valueType::INT64)
+			processed = 0;
+	}
+
+	if (!processed)
+	{
+		parts->people.replacePersonRecord(
+			grid->setFlag(openset::db::flagType_e::trigger_checkpoint, settings->id, CheckpointRows, 0));
+		return;
+	}
+
+	grid->setFlag(openset::db::flagType_e::trigger_checkpoint, settings->id, CheckpointRows, processed);
+	grid->setFlag(
+		openset::db::flagType_e::trigger_checkpoint,
+		settings->id,
+		CheckpointStamp,
+		(*rows)[processed - 1]->cols[openset::db::COL_STAMP]);
+
+	for (const auto index : plan.stateVars)
+		grid->setFlag(
+			openset::db::flagType_e::trigger_checkpoint,
+			settings->id,
+			index,
+			macros.vars.userVars[index].value.getInt64());
+
+	parts->people.replacePersonRecord(grid->getMeta());
 }
 
 bool Trigger::runFunction(const int64_t functionHash)
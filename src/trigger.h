@@ -131,6 +131,8 @@ namespace openset
 			std::string script;
 			int configVersion;
 			openset::query::Macro_s macros;
+			std::vector<std::string> dependsOn; // declared actions (`depends_on`), empty to infer them
+			std::vector<int64_t> actionDeps; // hashed and sorted, empty means any insert can fire it
 		};
 
 		class Trigger
@@ -158,6 +160,16 @@ namespace openset
 			bool beforeState;
 			bool inError;
 
+			// set when the entry function can carry on from its last run, the
+			// person keeps where it got to in trigger_checkpoint flags
+			openset::query::IncrementalPlan_s plan;
+			bool incremental{ false };
+
+			// runs just the rows after the checkpoint, false if it has to start over
+			bool resume();
+			// saves where this run got to (or clears it once the trigger has fired)
+			void checkpoint();
+
 		public:
 
 			std::vector<triggerMessage_s> triggerQueue;
@@ -171,6 +183,9 @@ namespace openset
 				std::string script,
 				openset::query::Macro_s &targetMacros);
 
+			// fills settings->actionDeps from `depends_on` or the compiled script
+			static void resolveDependencies(triggerSettings_s* settings);
+
 			void init();
 
 			void flushDirty();
@@ -183,9 +198,16 @@ namespace openset
 					init();
 			}
 			
+			// false if none of the inserted actions can change the outcome
+			bool dependsOn(const std::vector<int64_t>& insertedActions) const;
+
 			void preInsertTest();
 			void postInsertTest();
 
+			// an insert this trigger was skipped for (see dependsOn) moved rows it
+			// has already run over, so its checkpoint can't be resumed from
+			void insertSkipped(openset::db::Person* personPtr, int32_t rowsBefore);
+
 			bool runFunction(const int64_t functionHash);
 
 			std::string getName() const
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "benchmarking.h"
+
+#include "../lib/time/epoch.h"
+
+/* bench_calendar - date functions/sec, Epoch against gmtime/timegm
+ *
+ * the `gmtime` and `timegm` runs are how Epoch did it before the calendar
+ * table (a gmtime_r per call, stoi per ISO8601 field), they give the
+ * numbers something to be compared with.
+ */
+namespace bench_calendar_legacy
+{
+	inline int64_t monthDate(int64_t stamp)
+	{
+		stamp = Epoch::fixUnix(stamp);
+		struct tm time;
+		Epoch::stampToTimeStruct(&time, stamp);
+		return (stamp / 86400) * 86400 - (time.tm_mday - 1) * 86400;
+	}
+
+	inline int64_t dayOfWeek(int64_t stamp)
+	{
+		struct tm time;
+		Epoch::stampToTimeStruct(&time, Epoch::fixUnix(stamp));
+		return time.tm_wday + 1;
+	}
+
+	inline int64_t quarterNumber(int64_t stamp)
+	{
+		struct tm time;
+		Epoch::stampToTimeStruct(&time, Epoch::fixUnix(stamp));
+		return (time.tm_mon / 3) * 3 + 1;
+	}
+
+	inline int64_t iso8601ToEpoch(const std::string& time)
+	{
+		struct tm t = { 0 };
+		t.tm_sec = stoi(time.substr(17, 2));
+		t.tm_min = stoi(time.substr(14, 2));
+		t.tm_hour = stoi(time.substr(11, 2));
+		t.tm_mday = stoi(time.substr(8, 2));
+		t.tm_mon = stoi(time.substr(5, 2)) - 1;
+		t.tm_year = stoi(time.substr(0, 4)) - 1900;
+
+		auto milli = 0;
+		if (time[19] == '.')
+			milli = stoi(time.substr(20));
+
+		return static_cast<int64_t>(timegm(&t)) * 1000 + milli;
+	}
+}
+
+inline Benchmarks bench_calendar()
+{
+	const int64_t calls = 5'000'000;
+
+	// a spread of stamps (milliseconds) across 2010 to 2030
+	auto stamps = std::make_shared<std::vector<int64_t>>();
+	for (int64_t i = 0; i < 4096; ++i)
+		stamps->push_back((1262304000LL + (i * 154747LL)) * 1000LL + i % 1000);
+
+	auto isoStrings = std::make_shared<std::vector<std::string>>();
+	for (const auto stamp : *stamps)
+		isoStrings->push_back(Epoch::EpochToISO8601(stamp - stamp % 1000 + 250));
+
+	const auto run = [stamps](const std::string& name, int64_t(*fn)(int64_t)) -> int64_t
+	{
+		int64_t sum = 0;
+
+		BenchTimer timer;
+		for (int64_t i = 0; i < calls; ++i)
+			sum += fn((*stamps)[i & 4095]);
+		reportBench(name, "calls", calls, timer.elapsed());
+
+		return sum;
+	};
+
+	return {
+		{
+			"bench_calendar: round_month", [run]
+			{
+				const auto before = run("round_month gmtime", bench_calendar_legacy::monthDate);
+				const auto after = run("round_month calendar", Epoch::epochMonthDate);
+				ASSERT(before == after);
+			}
+		},
+		{
+			"bench_calendar: get_day_of_week", [run]
+			{
+				const auto before = run("get_day_of_week gmtime", bench_calendar_legacy::dayOfWeek);
+				const auto after = run("get_day_of_week calendar", Epoch::epochDayOfWeek);
+				ASSERT(before == after);
+			}
+		},
+		{
+			"bench_calendar: get_quarter", [run]
+			{
+				const auto before = run("get_quarter gmtime", bench_calendar_legacy::quarterNumber);
+				const auto after = run("get_quarter calendar", Epoch::epochQuarterNumber);
+				ASSERT(before == after);
+			}
+		},
+		{
+			"bench_calendar: ISO8601 parse", [isoStrings]
+			{
+				const int64_t parses = 2'000'000;
+				int64_t before = 0;
+				int64_t after = 0;
+
+				BenchTimer timer;
+				for (int64_t i = 0; i < parses; ++i)
+					before += bench_calendar_legacy::iso8601ToEpoch((*isoStrings)[i & 4095]);
+				reportBench("ISO8601 timegm", "parses", parses, timer.elapsed());
+
+				timer.reset();
+				for (int64_t i = 0; i < parses; ++i)
+					after += Epoch::ISO8601ToEpoch((*isoStrings)[i & 4095]);
+				reportBench("ISO8601 calendar", "parses", parses, timer.elapsed());
+
+				ASSERT(before == after);
+			}
+		}
+	};
+}
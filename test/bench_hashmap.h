@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "benchmarking.h"
+
+#include "../lib/mem/bigring.h"
+#include "../lib/mem/flatmap.h"
+
+/* bench_hashmap - set/get/miss ops/sec for flatMap and bigRing
+ *
+ * int64 keys to int32 values (the shape of People::peopleMap) at 1M and
+ * 10M entries. Set OPENSET_BENCH_LARGE=1 to add 100M entries (needs
+ * several GB of memory).
+ */
+template <typename Map>
+void bench_hashmap_run(const std::string& name, const int64_t entries)
+{
+	// spread the keys out like hashed person ids, misses use keys never inserted
+	const auto keyOf = [](const int64_t i) { return i * 0x9E3779B97F4A7C15LL; };
+
+	Map map(ringHint_e::gt_25_million);
+
+	BenchTimer timer;
+	for (int64_t i = 0; i < entries; ++i)
+		map.set(keyOf(i), static_cast<int32_t>(i));
+	reportBench(name + " set", "ops", entries, timer.elapsed());
+
+	ASSERT(static_cast<int64_t>(map.size()) == entries);
+
+	int32_t value;
+	int64_t found = 0;
+
+	timer.reset();
+	for (int64_t i = 0; i < entries; ++i)
+		if (map.get(keyOf(i), value) && value == static_cast<int32_t>(i))
+			++found;
+	reportBench(name + " get", "ops", entries, timer.elapsed());
+
+	ASSERT(found == entries);
+
+	found = 0;
+
+	timer.reset();
+	for (int64_t i = entries; i < entries * 2; ++i)
+		if (map.get(keyOf(i), value))
+			++found;
+	reportBench(name + " miss", "ops", entries, timer.elapsed());
+
+	ASSERT(found == 0);
+}
+
+inline Benchmarks bench_hashmap()
+{
+	std::vector<int64_t> sizes = { 1'000'000, 10'000'000 };
+
+	if (const auto large = getenv("OPENSET_BENCH_LARGE"); large && large[0] == '1')
+		sizes.push_back(100'000'000);
+
+	Benchmarks benchmarks;
+
+	for (const auto entries : sizes)
+	{
+		const auto label = std::to_string(entries / 1'000'000) + "M";
+
+		benchmarks.push_back({
+			"bench_hashmap: flatMap " + label, [entries, label]
+			{
+				bench_hashmap_run<flatMap<int64_t, int32_t>>("flatMap " + label, entries);
+			}
+		});
+
+		benchmarks.push_back({
+			"bench_hashmap: bigRing " + label, [entries, label]
+			{
+				bench_hashmap_run<bigRing<int64_t, int32_t>>("bigRing " + label, entries);
+			}
+		});
+	}
+
+	return benchmarks;
+}
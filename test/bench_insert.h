@@ -0,0 +1,149 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "benchmarking.h"
+
+#include "../lib/cjson/cjson.h"
+#include "../src/database.h"
+#include "../src/table.h"
+#include "../src/columns.h"
+#include "../src/tablepartitioned.h"
+#include "../src/asyncloop.h"
+#include "../src/oloop_insert.h"
+#include "../src/internodemapping.h"
+
+/* bench_insert - events/sec through OpenLoopInsert
+ *
+ * events are queued on a partition the way RpcInsert queues them (one
+ * stringified row each) and OpenLoopInsert::run is called until the
+ * queue is empty. `row parse` compares parsing each queued row into its
+ * own document against parsing into one reused arena.
+ */
+inline Benchmarks bench_insert()
+{
+	const auto eventCount = 20000;
+	const auto people = 500;
+
+	const std::vector<std::string> products = {
+		"apple", "orange", "pear", "banana", "kiwi", "grape", "plum", "lime" };
+
+	const auto makeEvents = [products](const int count, const int64_t start) -> std::vector<std::string>
+	{
+		std::vector<std::string> events;
+
+		for (auto i = 0; i < count; ++i)
+		{
+			cjson event;
+			event.set("person", "user" + std::to_string(i % people) + "@test.com");
+			event.set("stamp", static_cast<int64_t>(start + i * 1000LL));
+			event.set("action", i % 3 ? "page_view" : "purchase");
+			auto attr = event.setObject("attr");
+			attr->set("product", products[i % products.size()]);
+			attr->set("price", 1.25 + (i % 17));
+			attr->set("qty", static_cast<int64_t>(i % 5));
+			events.push_back(cjson::Stringify(&event));
+		}
+
+		return events;
+	};
+
+	return {
+		{
+			"bench_insert: OpenLoopInsert", [makeEvents]
+			{
+				auto database = openset::globals::database;
+
+				auto table = database->newTable("__bench_insert__");
+				auto columns = table->getColumns();
+
+				int col = 1000;
+				columns->setColumn(++col, "product", columnTypes_e::textColumn, false, 0);
+				columns->setColumn(++col, "price", columnTypes_e::doubleColumn, false, 0);
+				columns->setColumn(++col, "qty", columnTypes_e::intColumn, false, 0);
+
+				auto parts = table->getPartitionObjects(0);
+
+				openset::globals::mapper->partitionMap.setState(
+					0, openset::globals::running->nodeId, openset::mapping::NodeState_e::active_owner);
+
+				openset::async::AsyncLoop loop(openset::globals::async, 0, 0);
+				openset::async::OpenLoopInsert insertCell(parts);
+				insertCell.assignLoop(&loop);
+				insertCell.prepare();
+
+				// queued the way RpcInsert queues them
+				const auto events = makeEvents(eventCount, 1458820830000LL);
+
+				for (const auto& event : events)
+				{
+					const auto row = static_cast<char*>(PoolMem::getPool().getPtr(event.length() + 1));
+					memcpy(row, event.c_str(), event.length() + 1);
+					parts->insertQueue.push_back(row);
+				}
+
+				parts->insertBacklog += eventCount;
+
+				BenchTimer timer;
+
+				while (parts->insertBacklog)
+					insertCell.run();
+
+				reportBench("OpenLoopInsert", "events", eventCount, timer.elapsed());
+
+				// every person got their events
+				auto count = 0;
+				Person person;
+				person.mapTable(table, 0);
+
+				for (auto i = 0; i < people; ++i)
+				{
+					person.mount(parts->people.getmakePerson("user" + std::to_string(i) + "@test.com"));
+					person.prepare();
+					count += static_cast<int>(person.getGrid()->getRows()->size());
+				}
+
+				ASSERT(count == eventCount);
+			}
+		},
+		{
+			"bench_insert: row parse", [makeEvents]
+			{
+				const auto iterations = 20;
+				const auto events = makeEvents(2000, 1458820830000LL);
+				int64_t before = 0;
+
+				int64_t after = 0;
+
+				BenchTimer timer;
+				for (auto i = 0; i < iterations; ++i)
+					for (const auto& event : events)
+					{
+						cjson row(event.c_str(), event.length());
+						before += row.xPathInt("/stamp", 0);
+					}
+				reportBench("row parse document", "events", iterations * events.size(), timer.elapsed());
+
+				// the way OpenLoopInsert::run parses, reset once per 50 rows
+				HeapStack arena(MemConstants::HeapStackSmallBlockSize);
+
+				timer.reset();
+				for (auto i = 0; i < iterations; ++i)
+					for (auto e = 0; e < static_cast<int>(events.size()); ++e)
+					{
+						if (e % 50 == 0)
+							arena.reset();
+
+						const auto& event = events[e];
+						const auto row = cjson::Parse(event.c_str(), event.length(), cjson::MakeDocument(&arena));
+						after += row->xPathInt("/stamp", 0);
+					}
+				reportBench("row parse arena", "events", iterations * events.size(), timer.elapsed());
+
+				ASSERT(before != 0);
+				ASSERT(before == after);
+			}
+		}
+	};
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "benchmarking.h"
+
+#include "../lib/cjson/cjson.h"
+
+/* bench_json - bytes/sec through cjson::Parse
+ *
+ * `serial` is cjson::ParseSerial, the character at a time parser Parse
+ * used before the structural index, `indexed` is cjson::Parse. Payloads
+ * are events like the ones the insert endpoint takes, as one batch and
+ * one event at a time (how OpenLoopInsert reparses its queue).
+ */
+inline Benchmarks bench_json()
+{
+	const auto eventCount = 1000;
+
+	const std::vector<std::string> products = {
+		"apple", "orange", "pear", "banana", "kiwi", "grape", "plum", "lime" };
+
+	auto events = std::make_shared<std::vector<std::string>>();
+
+	for (auto i = 0; i < eventCount; ++i)
+	{
+		cjson event;
+		event.set("person", "user" + std::to_string(i % 50) + "@test.com");
+		event.set("stamp", static_cast<int64_t>(1458820830000LL + i * 1000LL));
+		event.set("action", i % 3 ? "page view" : "purchase");
+		auto attr = event.setObject("attr");
+		attr->set("product", products[i % products.size()]);
+		attr->set("price", 1.25 + (i % 17));
+		attr->set("qty", static_cast<int64_t>(i % 5));
+		attr->set("url", "https://www.test.com/shop/" + products[i % products.size()] + "?ref=\"campaign\"&page=" + std::to_string(i));
+		attr->set("referrer", "https://www.search.com/results?q=" + products[(i + 3) % products.size()]);
+		auto tags = attr->setArray("tags");
+		tags->push("fruit");
+		tags->push(i % 2 ? "sale" : "new");
+		events->push_back(cjson::Stringify(&event));
+	}
+
+	auto batch = std::make_shared<std::string>("[");
+	for (const auto& event : *events)
+	{
+		if (batch->length() > 1)
+			*batch += ",";
+		*batch += event;
+	}
+	*batch += "]";
+
+	return {
+		{
+			"bench_json: insert batch", [batch]
+			{
+				const auto iterations = 200;
+				const auto bytes = static_cast<int64_t>(batch->length()) * iterations;
+
+				std::string before;
+				std::string after;
+
+				BenchTimer timer;
+				for (auto i = 0; i < iterations; ++i)
+				{
+					const auto doc = cjson::ParseSerial(batch->c_str());
+					if (!i)
+						before = cjson::Stringify(doc);
+					cjson::DisposeDocument(doc);
+				}
+				reportBench("insert batch serial", "bytes", bytes, timer.elapsed());
+
+				timer.reset();
+				for (auto i = 0; i < iterations; ++i)
+				{
+					const auto doc = cjson::Parse(batch->c_str(), batch->length());
+					if (!i)
+						after = cjson::Stringify(doc);
+					cjson::DisposeDocument(doc);
+				}
+				reportBench("insert batch indexed", "bytes", bytes, timer.elapsed());
+
+				ASSERT(before == after);
+			}
+		},
+		{
+			"bench_json: single events", [events]
+			{
+				const auto iterations = 200;
+				int64_t bytes = 0;
+				int64_t before = 0;
+				int64_t after = 0;
+
+				for (const auto& event : *events)
+					bytes += event.length() * iterations;
+
+				BenchTimer timer;
+				for (auto i = 0; i < iterations; ++i)
+					for (const auto& event : *events)
+					{
+						const auto doc = cjson::ParseSerial(event.c_str());
+						before += doc->xPathInt("/stamp", 0);
+						cjson::DisposeDocument(doc);
+					}
+				reportBench("single events serial", "bytes", bytes, timer.elapsed());
+
+				timer.reset();
+				for (auto i = 0; i < iterations; ++i)
+					for (const auto& event : *events)
+					{
+						cjson row(event.c_str(), event.length());
+						after += row.xPathInt("/stamp", 0);
+					}
+				reportBench("single events indexed", "bytes", bytes, timer.elapsed());
+
+				ASSERT(before == after);
+			}
+		}
+	};
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+
+#include "benchmarking.h"
+
+#include "../lib/sba/sba.h"
+
+/* bench_poolmem - PoolMem getPtr/freePtr pairs/sec under N thread contention
+ *
+ * each thread allocates a batch of mixed sizes (the sizes grid rows,
+ * attribute blobs and result rows tend to use), frees the batch, then
+ * frees a batch allocated by its neighbour (cross-thread frees).
+ *
+ * runs with thread caching off (every call locks the shared bucket) and
+ * on, at 1, 4 and 8 threads.
+ */
+inline Benchmarks bench_poolmem()
+{
+	const auto batchSize = 256;
+	const auto rounds = 2000;
+
+	const auto runPool = [batchSize, rounds](const int threadCount, const bool caching) -> int64_t
+	{
+		auto& pool = PoolMem::getPool();
+		pool.setThreadCaching(caching);
+
+		const int64_t sizes[] = { 16, 24, 40, 64, 100, 250, 500, 1000 };
+
+		// one batch per thread is handed to the neighbouring thread to free
+		std::vector<std::vector<void*>> handoff(threadCount);
+		for (auto& batch : handoff)
+			batch.resize(batchSize, nullptr);
+
+		std::vector<std::thread> threads;
+		for (auto t = 0; t < threadCount; ++t)
+			threads.emplace_back([&, t]()
+			{
+				std::vector<void*> local(batchSize);
+
+				for (auto r = 0; r < rounds; ++r)
+				{
+					for (auto i = 0; i < batchSize; ++i)
+						local[i] = pool.getPtr(sizes[(i + r) % 8]);
+					for (auto i = 0; i < batchSize; ++i)
+						pool.freePtr(local[i]);
+				}
+
+				// cross-thread: allocate here, free on the neighbour
+				for (auto i = 0; i < batchSize; ++i)
+					handoff[t][i] = pool.getPtr(sizes[i % 8]);
+			});
+
+		for (auto& thread : threads)
+			thread.join();
+		threads.clear();
+
+		for (auto t = 0; t < threadCount; ++t)
+			threads.emplace_back([&, t]()
+			{
+				for (auto ptr : handoff[(t + 1) % threadCount])
+					pool.freePtr(ptr);
+			});
+
+		for (auto& thread : threads)
+			thread.join();
+
+		pool.flushThreadCache();
+		pool.setThreadCaching(true);
+
+		return static_cast<int64_t>(threadCount) * (rounds + 1) * batchSize;
+	};
+
+	Benchmarks benchmarks;
+
+	for (auto threadCount : { 1, 4, 8 })
+		for (auto caching : { false, true })
+		{
+			const auto name = "bench_poolmem: " + std::to_string(threadCount) + " thread" +
+				(caching ? ", thread cache" : ", shared buckets");
+
+			benchmarks.push_back({
+				name, [runPool, name, threadCount, caching]
+				{
+					const auto liveCount = []()
+					{
+						PoolMem::getPool().flushThreadCache();
+						int64_t live = 0;
+						for (auto& bucket : PoolMem::getPool().getStats())
+							live += bucket.allocated;
+						return live;
+					};
+
+					const auto liveBefore = liveCount();
+
+					BenchTimer timer;
+					const auto pairs = runPool(threadCount, caching);
+					reportBench(name.substr(15), "alloc/free", pairs, timer.elapsed());
+
+					// every thread has exited (flushing its cache), nothing should be left live
+					ASSERT(liveCount() == liveBefore);
+				}
+			});
+		}
+
+	return benchmarks;
+}
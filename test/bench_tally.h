@@ -0,0 +1,125 @@
+#pragma once
+
+#include "benchmarking.h"
+
+#include "../lib/cjson/cjson.h"
+#include "../lib/var/var.h"
+#include "../src/database.h"
+#include "../src/table.h"
+#include "../src/columns.h"
+#include "../src/tablepartitioned.h"
+#include "../src/queryinterpreter.h"
+#include "../src/queryparser.h"
+#include "../src/result.h"
+
+/* bench_tally - rows/sec through Interpreter::marshal_tally
+ *
+ * one person with `eventCount` events is tallied `iterations` times 
+ * into a mix of distinct and non-distinct aggregators grouped by text
+ * and numeric keys.
+ */
+inline Benchmarks bench_tally()
+{
+	const auto eventCount = 2000;
+	const auto iterations = 250;
+
+	auto tally_pyql = fixIndent(R"pyql(
+	agg:
+		count person
+		count product
+		sum price as price_total all
+		avg price as price_avg
+		max price as price_max
+
+	match:
+		tally('all', product, qty)
+	)pyql");
+
+	return {
+		{
+			"bench_tally: insert test data", [eventCount]
+			{
+				auto database = openset::globals::database;
+
+				auto table = database->newTable("__bench_tally__");
+				auto columns = table->getColumns();
+
+				int col = 1000;
+				columns->setColumn(++col, "product", columnTypes_e::textColumn, false, 0);
+				columns->setColumn(++col, "price", columnTypes_e::doubleColumn, false, 0);
+				columns->setColumn(++col, "qty", columnTypes_e::intColumn, false, 0);
+
+				auto parts = table->getPartitionObjects(0);
+				auto personRaw = parts->people.getmakePerson("bench@test.com");
+
+				Person person;
+				person.mapTable(table, 0);
+				person.mount(personRaw);
+
+				const std::vector<std::string> products = {
+					"apple", "orange", "pear", "banana", "kiwi", "grape", "plum", "lime" };
+
+				for (auto i = 0; i < eventCount; ++i)
+				{
+					cjson event;
+					event.set("person", "bench@test.com");
+					event.set("stamp", static_cast<int64_t>(1458820830000LL + i * 1000LL));
+					event.set("action", "purchase");
+					auto attr = event.setObject("attr");
+					attr->set("product", products[i % products.size()]);
+					attr->set("price", 1.25 + (i % 17));
+					attr->set("qty", static_cast<int64_t>(i % 5));
+					person.insert(&event);
+				}
+
+				person.commit();
+			}
+		},
+		{
+			"bench_tally: tally rows", [tally_pyql, eventCount, iterations]
+			{
+				auto database = openset::globals::database;
+				auto table = database->getTable("__bench_tally__");
+				auto parts = table->getPartitionObjects(0);
+
+				openset::query::Macro_s queryMacros;
+				openset::query::QueryParser p;
+				p.compileQuery(tally_pyql.c_str(), table->getColumns(), queryMacros);
+				ASSERT(!p.error.inError());
+
+				auto interpreter = new openset::query::Interpreter(queryMacros);
+				openset::result::ResultSet resultSet;
+				interpreter->setResultObject(&resultSet);
+
+				auto personRaw = parts->people.getmakePerson("bench@test.com");
+
+				auto mappedColumns = interpreter->getReferencedColumns();
+
+				Person person;
+				person.mapTable(table, 0, mappedColumns);
+				person.mount(personRaw);
+				person.prepare();
+
+				const auto rowCount = person.getGrid()->getRows()->size();
+				ASSERT(rowCount == eventCount);
+
+				BenchTimer timer;
+
+				for (auto i = 0; i < iterations; ++i)
+				{
+					interpreter->mount(&person);
+					interpreter->exec();
+				}
+
+				reportBench("tally", "rows", rowCount * iterations, timer.elapsed());
+
+				ASSERT(!interpreter->error.inError());
+
+				// 'all' + 8 products + 8*5 product/qty pairs
+				ASSERT(resultSet.results.size() == 1 + 8 + 40);
+
+				delete interpreter;
+			}
+		}
+	};
+}
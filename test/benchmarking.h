@@ -0,0 +1,47 @@
+#pragma once
+
+#include <chrono>
+#include <iomanip>
+
+#include "testing.h"
+
+/*
+ * Benchmarks use the same runner as the unit tests (they are Tests), 
+ * they can ASSERT to validate their results and report throughput
+ * with `reportBench`.
+ *
+ * Run with `openset --bench`
+ */
+
+using Benchmarks = Tests;
+
+class BenchTimer
+{
+	std::chrono::high_resolution_clock::time_point start;
+public:
+	BenchTimer() :
+		start(std::chrono::high_resolution_clock::now())
+	{}
+
+	void reset()
+	{
+		start = std::chrono::high_resolution_clock::now();
+	}
+
+	// elapsed time in seconds
+	double elapsed() const
+	{
+		return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+};
+
+// prints `count` items over `seconds` as items/second
+inline void reportBench(const std::string name, const std::string units, const int64_t count, const double seconds)
+{
+	const auto perSecond = seconds > 0 ? static_cast<double>(count) / seconds : 0.0;
+
+	cout << "BENCH  - " << name << ": " 
+		<< std::fixed << std::setprecision(0) << perSecond << " " << units << "/sec"
+		<< " (" << count << " " << units << " in " << std::setprecision(3) << seconds << "s)" 
+		<< std::defaultfloat << endl;
+}
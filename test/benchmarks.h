@@ -0,0 +1,46 @@
+#pragma once
+
+#include "benchmarking.h"
+#include "bench_tally.h"
+#include "bench_poolmem.h"
+#include "bench_hashmap.h"
+#include "bench_calendar.h"
+#include "bench_json.h"
+#include "bench_insert.h"
+#include "../src/config.h"
+#include "../src/asyncpool.h"
+#include "../src/internoderouter.h"
+#include "../src/database.h"
+#include "../src/logger.h"
+
+bool runBenchmarks()
+{
+	Benchmarks allBenchmarks;
+
+	Logger::get().suspendLogging(true);
+
+	// same engine objects the unit tests create (see test_db.h)
+	openset::config::CommandlineArgs args;
+	openset::globals::running = new openset::config::Config(args);
+	openset::globals::running->testMode = true;
+
+	auto async = new openset::async::AsyncPool(1, 1);
+	auto mapper = new openset::mapping::Mapper();
+	mapper->startRouter();
+	async->suspendAsync();
+
+	new Database();
+
+	const auto add = [&allBenchmarks](Benchmarks newBenchmarks) {
+		allBenchmarks.insert(allBenchmarks.end(), newBenchmarks.begin(), newBenchmarks.end());
+	};
+
+	add(bench_tally());
+	add(bench_poolmem());
+	add(bench_hashmap());
+	add(bench_calendar());
+	add(bench_json());
+	add(bench_insert());
+
+	return runTests(allBenchmarks).size() == 0;
+}
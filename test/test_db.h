@@ -12,9 +12,15 @@
 #include "../src/tablepartitioned.h"
 #include "../src/queryinterpreter.h"
 #include "../src/queryparser.h"
+#include "../src/queryindexing.h"
+#include "../src/trigger.h"
+#include "../src/oloop_query.h"
+#include "../src/oloop_histogram.h"
 #include "../src/internoderouter.h"
 #include "../src/result.h"
+#include "../lib/sba/sba.h"
 
+#include <set>
 #include <unordered_set>
 
 // Our tests
@@ -110,6 +116,15 @@ inline Tests test_db()
 
 	)pyql");
 
+	auto test_approx_distinct_pyql = fixIndent(R"pyql(
+	agg:
+		approx_count_distinct page
+		approx_count_distinct referral_search
+
+	match:
+		tally('all')
+	)pyql");
+
 
 	/* In order to make the engine start there are a few required objects as 
 	 * they will get called in the background during testing:
@@ -555,8 +570,1089 @@ inline Tests test_db()
 				totalsNode = dataNodes[1]->xPath("/c");
 				values = cjson::Stringify(totalsNode);
 				ASSERT(values == "[1,1]");
+
+				// the streaming serializer should produce the same JSON as the 
+				// cjson document after it was sorted. A tiny chunk size is used
+				// so the result is sent in many pieces
+				std::string streamed;
+				int chunks = 0;
+
+				openset::result::ResultJsonWriter writer([&](const char* data, const int64_t length)
+				{
+					streamed.append(data, length);
+					++chunks;
+				}, 16);
+
+				merger.resultSetToJsonStream(
+					queryMacros.vars.columnVars.size(), 
+					1, 
+					resultSets, 
+					writer,
+					openset::result::ResultSortMode_e::column,
+					openset::result::ResultSortOrder_e::Desc, 
+					1);
+
+				ASSERT(chunks > 1);
+				ASSERT(streamed == cjson::Stringify(&resultJSON));
+
+				// trim to one row
+				streamed.clear();
+				merger.resultSetToJsonStream(
+					queryMacros.vars.columnVars.size(), 
+					1, 
+					resultSets, 
+					writer,
+					openset::result::ResultSortMode_e::column,
+					openset::result::ResultSortOrder_e::Desc, 
+					1,
+					1);
+
+				cjson trimmedJSON(streamed, streamed.length());
+				dataNodes = trimmedJSON.xPath("/_")->getNodes();
+				ASSERT(dataNodes.size() == 1);
+				values = cjson::Stringify(dataNodes[0]->xPath("/c"));
+				ASSERT(values == "[1,2]");
 				
 			}
+		},
+		{
+			"db: action directory row skipping", [database]() {
+
+				auto table = database->newTable("__test_actiondir__");
+				table->getColumns()->setColumn(2000, "page", openset::db::columnTypes_e::textColumn, false);
+
+				auto parts = table->getPartitionObjects(0);
+				auto personRaw = parts->people.getmakePerson("skip@test.com");
+				ASSERT(personRaw->dirBytes == 0);
+
+				Person person;
+				person.mapTable(table, 0);
+				person.mount(personRaw);
+
+				// one purchase in every ten events
+				for (auto i = 0; i < 200; ++i)
+				{
+					cjson event;
+					event.set("person", "skip@test.com");
+					event.set("stamp", static_cast<int64_t>(1458820830000LL + i * 1000LL));
+					event.set("action", i % 10 == 5 ? "purchase" : "page_view");
+					event.setObject("attr")->set("page", "page_" + to_string(i % 4));
+					person.insert(&event);
+				}
+
+				personRaw = person.commit();
+				ASSERT(personRaw->dirBytes > 0);
+
+				auto runQuery = [&](const string& script, const bool filterRows, openset::query::Macro_s& queryMacros, size_t& rowCount) -> string
+				{
+					openset::query::QueryParser p;
+					p.compileQuery(script.c_str(), table->getColumns(), queryMacros);
+
+					auto interpreter = new openset::query::Interpreter(queryMacros);
+					openset::result::ResultSet resultSet;
+					interpreter->setResultObject(&resultSet);
+
+					auto mappedColumns = interpreter->getReferencedColumns();
+
+					Person queryPerson;
+					queryPerson.mapTable(table, 0, mappedColumns);
+					if (filterRows)
+						queryPerson.getGrid()->setActionFilter(&queryMacros.prepareActions);
+					queryPerson.mount(personRaw);
+					queryPerson.prepare();
+					rowCount = queryPerson.getGrid()->getRows()->size();
+
+					interpreter->mount(&queryPerson);
+					interpreter->exec();
+
+					std::vector<openset::result::ResultSet*> resultSets{ interpreter->result };
+					openset::result::ResultMuxDemux merger;
+					cjson resultJSON;
+					merger.resultSetToJson(queryMacros.vars.columnVars.size(), 1, resultSets, &resultJSON);
+
+					delete interpreter;
+					return cjson::Stringify(&resultJSON);
+				};
+
+				// `or page == ...` can pass on any action, so every row is scanned
+				openset::query::Macro_s scanMacros;
+				size_t scanRows;
+				const auto scanned = runQuery(fixIndent(R"pyql(
+				agg:
+					count person
+
+				match where action is 'purchase' or page == 'nope':
+					tally(page)
+				)pyql"), true, scanMacros, scanRows);
+
+				ASSERT(scanMacros.actionLambdas.empty());
+				ASSERT(scanMacros.prepareActions.empty());
+				ASSERT(scanRows == 200);
+
+				const auto skipPyql = fixIndent(R"pyql(
+				agg:
+					count person
+
+				match where action is 'purchase' and page != 'nope':
+					tally(page)
+				)pyql");
+
+				openset::query::Macro_s skipMacros;
+				size_t skipRows;
+				const auto skipped = runQuery(skipPyql, false, skipMacros, skipRows);
+
+				ASSERT(skipMacros.actionLambdas.size() == 1);
+				ASSERT(skipMacros.prepareActions.size() == 1 && skipMacros.prepareActions[0] == MakeHash("purchase"));
+				ASSERT(skipRows == 200);
+				ASSERT(skipped == scanned);
+
+				// prepare only expands the purchases
+				openset::query::Macro_s filterMacros;
+				size_t filterRows;
+				const auto filtered = runQuery(skipPyql, true, filterMacros, filterRows);
+
+				ASSERT(filterRows == 20);
+				ASSERT(filtered == scanned);
+				ASSERT(scanned.find("page_1") != string::npos);
+				ASSERT(scanned.find("page_0") == string::npos);
+
+				// rows from the directory are the purchases
+				Person directPerson;
+				directPerson.mapTable(table, 0);
+				directPerson.mount(personRaw);
+				directPerson.prepare();
+
+				const int32_t* actionRows;
+				int32_t count;
+				ASSERT(directPerson.getGrid()->getActionRows(MakeHash("purchase"), actionRows, count));
+				ASSERT(count == 20);
+
+				auto wrongAction = 0;
+				for (auto i = 0; i < count; ++i)
+					if ((*directPerson.getGrid()->getRows())[actionRows[i]]->cols[COL_ACTION] != MakeHash("purchase"))
+						++wrongAction;
+				ASSERT(wrongAction == 0);
+
+				// a script that reads rows outside of a match can't be filtered
+				openset::query::Macro_s topMacros;
+				openset::query::QueryParser p;
+				p.compileQuery(fixIndent(R"pyql(
+				agg:
+					count person
+
+				tally(page)
+				match where action is 'purchase':
+					tally(page)
+				)pyql").c_str(), table->getColumns(), topMacros);
+				ASSERT(topMacros.actionLambdas.size() == 1);
+				ASSERT(topMacros.prepareActions.empty());
+			}
+		},
+		{
+			"db: person summaries rule people out", [database, async]() {
+
+				// person from "db: action directory row skipping", 200 events a second apart
+				auto table = database->getTable("__test_actiondir__");
+				auto parts = table->getPartitionObjects(0);
+				auto personRaw = parts->people.getmakePerson("skip@test.com");
+
+				// index the inserts so the query index finds the person
+				parts->attributes.clearDirty();
+
+				ASSERT(personRaw->eventCount == 200);
+				ASSERT(personRaw->firstStamp == 1458820830000LL);
+				ASSERT(personRaw->lastStamp == 1458820830000LL + 199'000LL);
+
+				const auto purchaseBits = PersonData_s::actionBloomBits(MakeHash("purchase"));
+				ASSERT((personRaw->actionBloom & purchaseBits) == purchaseBits);
+
+				auto compile = [&](const string& script) -> openset::query::RowFilters
+				{
+					openset::query::Macro_s queryMacros;
+					openset::query::QueryParser p;
+					p.compileQuery(fixIndent(script).c_str(), table->getColumns(), queryMacros);
+					return queryMacros.personFilters;
+				};
+
+				// runs the script through the query cell, with or without the person
+				// summaries, and returns the merged result
+				auto runQuery = [&](const string& script, const bool useSummaries, int& ran) -> string
+				{
+					openset::query::Macro_s queryMacros;
+					openset::query::QueryParser p;
+					p.compileQuery(fixIndent(script).c_str(), table->getColumns(), queryMacros);
+					if (!useSummaries)
+						queryMacros.personFilters.clear();
+
+					std::vector<openset::result::ResultSet*> resultSets;
+					for (auto i = 0; i < async->getWorkerCount(); ++i)
+						resultSets.push_back(new openset::result::ResultSet());
+
+					openset::async::ShuttleLambda<openset::result::CellQueryResult_s> shuttle(
+						nullptr,
+						1,
+						[](vector<openset::async::response_s<openset::result::CellQueryResult_s>>&, openset::web::MessagePtr, voidfunc) {});
+
+					openset::async::AsyncLoop loop(async, 0, 0);
+
+					{
+						openset::async::OpenLoopQuery query(&shuttle, table, queryMacros, resultSets, 0);
+						query.assignLoop(&loop);
+						query.prepare();
+
+						while (query.state == openset::async::oloopState_e::running)
+						{
+							query.beginSlice(Now());
+							query.run();
+						}
+
+						ran = query.runCount;
+					}
+
+					openset::result::ResultMuxDemux merger;
+					cjson resultJSON;
+					merger.resultSetToJson(queryMacros.vars.columnVars.size(), 1, resultSets, &resultJSON);
+
+					for (auto resultSet : resultSets)
+						delete resultSet;
+
+					return cjson::Stringify(&resultJSON);
+				};
+
+				// same result with and without the summaries, true if the summaries
+				// skipped a person the query would otherwise have run
+				auto skips = [&](const string& script) -> bool
+				{
+					int withRan, withoutRan;
+					const auto with = runQuery(script, true, withRan);
+					const auto without = runQuery(script, false, withoutRan);
+
+					ASSERTMSG(with == without, with + " != " + without);
+					ASSERT(withRan <= withoutRan);
+					return withRan < withoutRan;
+				};
+
+				const auto purchasePyql = R"pyql(
+				agg:
+					count person
+
+				match where action is 'purchase' and event_time > 1458820899999:
+					tally(page)
+				)pyql";
+
+				const auto purchase = compile(purchasePyql);
+				ASSERT(purchase.size() == 1 && purchase[0].actions.size() == 1 && purchase[0].from == 1458820900000LL);
+				ASSERT(!skips(purchasePyql));
+
+				int ran;
+				const auto purchased = runQuery(purchasePyql, true, ran);
+				ASSERT(purchased.find("page_1") != string::npos);
+
+				// the query index can't rule these out, the summaries do
+				ASSERT(skips(R"pyql(
+				agg:
+					count person
+
+				match where event_time > 1558820830000:
+					tally(page)
+				)pyql"));
+
+				ASSERT(skips(R"pyql(
+				agg:
+					count person
+
+				match where page == 'page_1' and event_time > 1558820830000:
+					tally(page)
+				)pyql"));
+
+				// never run, whether the index or the summaries rule the person out
+				for (const auto script : {
+					R"pyql(
+					match where action is 'refund':
+						tally(page)
+					)pyql",
+					R"pyql(
+					match where action is 'refund' and action is 'purchase':
+						tally(page)
+					)pyql" })
+				{
+					ASSERT(compile(script).size() == 1);
+					skips(script);
+					runQuery(script, true, ran);
+					ASSERT(ran == 0);
+				}
+
+				// one possible top level match is enough
+				ASSERT(!skips(R"pyql(
+				agg:
+					count person
+
+				match where action is 'purchase' or action is 'refund':
+					tally(page)
+				match where event_time > 1558820830000:
+					tally(page)
+				)pyql"));
+
+				// [start, end)
+				const auto betweenPyql = R"pyql(
+				agg:
+					count person
+
+				match where iter_between(1458820830, 1458820840):
+					tally(page)
+				)pyql";
+
+				const auto between = compile(betweenPyql);
+				ASSERT(between.size() == 1 && between[0].from == 1458820830000LL && between[0].to == 1458820839999LL);
+				ASSERT(!skips(betweenPyql));
+
+				// can't rule anyone out
+				ASSERT(compile(R"pyql(
+				tally(page)
+				match where action is 'refund':
+					tally(page)
+				)pyql").empty());
+
+				ASSERT(compile(R"pyql(
+				match where action is 'refund' or page == 'page_1':
+					tally(page)
+				)pyql").empty());
+			}
+		},
+		{
+			"db: column histograms match script histograms", [database, async]() {
+
+				auto table = database->newTable("__test_histogram__");
+				table->getColumns()->setColumn(2000, "visits", openset::db::columnTypes_e::intColumn, false);
+				table->getColumns()->setColumn(2001, "price", openset::db::columnTypes_e::doubleColumn, false);
+
+				auto parts = table->getPartitionObjects(0);
+
+				// one event each, the last few people have no visits
+				for (auto i = 0; i < 24; ++i)
+				{
+					const auto uuid = "hist_" + to_string(i) + "@test.com";
+
+					Person person;
+					person.mapTable(table, 0);
+					person.mount(parts->people.getmakePerson(uuid));
+
+					cjson event;
+					event.set("person", uuid);
+					event.set("stamp", static_cast<int64_t>(1458820830000LL + i * 1000LL));
+					event.set("action", "visit");
+					const auto attr = event.setObject("attr");
+					if (i < 20)
+						attr->set("visits", static_cast<int64_t>((i * 7) % 17));
+					attr->set("price", 1.0 + (i % 9) * 0.25);
+					person.insert(&event);
+					person.commit();
+				}
+
+				parts->attributes.clearDirty();
+
+				// a segment with every third person
+				IndexBits segmentBits;
+				segmentBits.makeBits(parts->people.peopleCount(), 0);
+				for (auto i = 0; i < 24; i += 3)
+					segmentBits.bitSet(parts->people.getmakePerson("hist_" + to_string(i) + "@test.com")->linId);
+
+				parts->attributes.getMake(COL_SEGMENT, "thirds");
+				parts->attributes.swap(COL_SEGMENT, MakeHash("thirds"), &segmentBits);
+
+				// runs a histogram cell the way RpcQuery::histogram does (column mode when
+				// the script is empty) and merges the reply the way the originating node does
+				auto histogram = [&](
+					const string& column,
+					const string& script,
+					const vector<string>& segments,
+					const int64_t bucket,
+					const int64_t forceMin,
+					const int64_t forceMax) -> string
+				{
+					openset::query::Macro_s queryMacros;
+					auto columnIndex = -1;
+
+					if (script.length())
+					{
+						openset::query::QueryParser p;
+						p.compileQuery(fixIndent(script).c_str(), table->getColumns(), queryMacros);
+						ASSERT(!p.error.inError());
+					}
+					else
+					{
+						columnIndex = table->getColumns()->getColumn(column)->idx;
+					}
+
+					queryMacros.segments = segments;
+
+					std::vector<openset::result::ResultSet*> resultSets;
+					for (auto i = 0; i < async->getWorkerCount(); ++i)
+						resultSets.push_back(new openset::result::ResultSet());
+
+					openset::async::ShuttleLambda<openset::result::CellQueryResult_s> shuttle(
+						nullptr,
+						1,
+						[](vector<openset::async::response_s<openset::result::CellQueryResult_s>>&, openset::web::MessagePtr, voidfunc) {});
+
+					openset::async::AsyncLoop loop(async, 0, 0);
+
+					{
+						openset::async::OpenLoopHistogram cell(
+							&shuttle, table, queryMacros, column, bucket, resultSets, 0, columnIndex);
+						cell.assignLoop(&loop);
+						cell.prepare();
+
+						while (cell.state == openset::async::oloopState_e::running)
+						{
+							cell.beginSlice(Now());
+							cell.run();
+						}
+					}
+
+					int64_t bufferLength = 0;
+					const auto buffer = openset::result::ResultMuxDemux::multiSetToInternode(
+						1, queryMacros.indexes.size(), resultSets, bufferLength);
+
+					for (auto resultSet : resultSets)
+						delete resultSet;
+
+					std::vector<openset::result::ResultSet*> internodeSets{
+						openset::result::ResultMuxDemux::internodeToResultSet(buffer, bufferLength) };
+
+					string json;
+					openset::result::ResultJsonWriter writer([&](const char* data, const int64_t length)
+					{
+						json.append(data, length);
+					});
+
+					openset::result::ResultMuxDemux::resultSetToJsonStream(
+						1,
+						segments.size() ? static_cast<int>(segments.size()) : 1,
+						internodeSets,
+						writer,
+						openset::result::ResultSortMode_e::key,
+						openset::result::ResultSortOrder_e::Desc,
+						0,
+						-1,
+						bucket,
+						forceMin,
+						forceMax);
+
+					delete internodeSets[0];
+					PoolMem::getPool().freePtr(buffer);
+
+					return json;
+				};
+
+				const auto noFill = std::numeric_limits<int64_t>::min();
+
+				// same output from the index bits as from running the script on everyone
+				auto matches = [&](
+					const string& column,
+					const vector<string>& segments,
+					const int64_t bucket,
+					const int64_t forceMin,
+					const int64_t forceMax) -> string
+				{
+					const auto fromColumn = histogram(column, "", segments, bucket, forceMin, forceMax);
+					const auto fromScript = histogram(column, "return " + column, segments, bucket, forceMin, forceMax);
+
+					ASSERTMSG(fromColumn == fromScript, fromColumn + " != " + fromScript);
+					return fromColumn;
+				};
+
+				const auto visits = matches("visits", {}, 0, noFill, noFill);
+
+				// 20 people have visits, the root row counts each of them once
+				cjson visitsJSON(visits, visits.length());
+				const auto groups = visitsJSON.xPath("/_")->getNodes();
+				ASSERT(groups.size() == 1);
+				ASSERT(cjson::Stringify(groups[0]->xPath("/c")) == "[20]");
+				ASSERT(groups[0]->xPath("/_")->getNodes().size() == 17);
+
+				matches("visits", { "*", "thirds" }, 0, noFill, noFill);
+				matches("visits", { "thirds" }, 30000, noFill, noFill);
+				matches("visits", { "*", "thirds", "missing" }, 40000, noFill, noFill);
+
+				// zero filled between min= and max=, anything over max is totaled into it
+				const auto filled = matches("visits", { "*", "thirds" }, 20000, -40000, 100000);
+				ASSERT(filled != matches("visits", { "*", "thirds" }, 20000, noFill, noFill));
+
+				matches("price", {}, 0, noFill, noFill);
+				matches("price", { "thirds" }, 5000, noFill, noFill);
+				matches("price", { "*", "thirds" }, 2500, 5000, 20000);
+			}
+		},
+		{
+			"db: time bucketed attribute layers", [database]() {
+
+				const auto day = 86'400'000LL;
+				const auto start = 1458820830000LL;
+
+				auto table = database->newTable("__test_buckets__");
+				table->indexBucket = day;
+				table->getColumns()->setColumn(2000, "page", openset::db::columnTypes_e::textColumn, false, false, true);
+
+				auto parts = table->getPartitionObjects(0);
+
+				// old buyer buys on day 0, recent buyer on day 5, browser only visits 'home' on day 5
+				const vector<tuple<string, int64_t, string, string>> events = {
+					{ "old@test.com", start, "purchase", "cart" },
+					{ "old@test.com", start + 5 * day, "page_view", "cart" },
+					{ "recent@test.com", start + 5 * day, "purchase", "cart" },
+					{ "browser@test.com", start + 5 * day, "page_view", "home" },
+				};
+
+				for (const auto& e : events)
+				{
+					Person person;
+					person.mapTable(table, 0);
+					person.mount(parts->people.getmakePerson(get<0>(e)));
+
+					cjson event;
+					event.set("person", get<0>(e));
+					event.set("stamp", get<1>(e));
+					event.set("action", get<2>(e));
+					event.setObject("attr")->set("page", get<3>(e));
+					person.insert(&event);
+					person.commit();
+				}
+
+				parts->attributes.clearDirty();
+
+				const auto oldId = parts->people.getmakePerson("old@test.com")->linId;
+				const auto recentId = parts->people.getmakePerson("recent@test.com")->linId;
+				const auto browserId = parts->people.getmakePerson("browser@test.com")->linId;
+
+				ASSERT(parts->attributes.oldestBucket == start / day);
+				ASSERT(parts->attributes.newestBucket == start / day + 5);
+
+				// who can pass, according to the query index
+				auto candidates = [&](const string& script) -> vector<int32_t>
+				{
+					openset::query::Macro_s queryMacros;
+					openset::query::QueryParser p;
+					p.compileQuery(fixIndent(script).c_str(), table->getColumns(), queryMacros);
+
+					openset::query::Indexing indexing;
+					indexing.mount(table, queryMacros, 0, parts->people.peopleCount(), true);
+
+					bool countable;
+					const auto index = indexing.getIndex("_", countable);
+
+					vector<int32_t> result;
+					for (auto linId = 0; linId < parts->people.peopleCount(); ++linId)
+						if (index->bitState(linId))
+							result.push_back(linId);
+					return result;
+				};
+
+				const auto recentPurchase = R"pyql(
+				match where action is 'purchase' and event_time > 1459166430000:
+					tally(page)
+				)pyql"; // after day 4
+
+				ASSERT(candidates(recentPurchase) == vector<int32_t>{ recentId });
+
+				ASSERT(candidates(R"pyql(
+				match where page == 'home' and event_time > 1459166430000:
+					tally(page)
+				)pyql") == vector<int32_t>{ browserId });
+
+				// undated queries get everyone who ever purchased
+				ASSERT(candidates(R"pyql(
+				match where action is 'purchase':
+					tally(page)
+				)pyql").size() == 2);
+
+				// layers travel with the partition
+				HeapStack mem;
+				parts->attributes.serialize(&mem);
+				const auto block = mem.flatten();
+
+				Attributes copy(0, table->getAttributeBlob(), table->getColumns());
+				copy.deserialize(block);
+				HeapStack::releaseFlatPtr(block);
+
+				IndexBits copied;
+				copied.makeBits(64, 0);
+				copy.getBucketBits(COL_ACTION, MakeHash("purchase"), 0, std::numeric_limits<int64_t>::max(), copied);
+				ASSERT(copy.bucketIndex.size() == parts->attributes.bucketIndex.size());
+				ASSERT(copied.bitState(oldId) && copied.bitState(recentId) && !copied.bitState(browserId));
+
+				// once day 0 is culled a query reaching back to it can't be narrowed
+				parts->attributes.cullBuckets(start / day + 1);
+				ASSERT(parts->attributes.bucketIndex.size() < copy.bucketIndex.size());
+				ASSERT(candidates(R"pyql(
+				match where action is 'purchase' and event_time > 1458820829999:
+					tally(page)
+				)pyql").size() == 2);
+				ASSERT(candidates(recentPurchase) == vector<int32_t>{ recentId });
+			}
+		},
+		{
+			"db: trigger action dependencies", [database]() {
+
+				auto table = database->getTable("__test_actiondir__");
+				auto parts = table->getPartitionObjects(0);
+
+				const auto onInsert = MakeHash("on_insert");
+
+				auto depends = [&](const string& script, vector<int64_t>& actions) -> bool
+				{
+					openset::query::Macro_s queryMacros;
+					openset::query::QueryParser p;
+					p.compileQuery(fixIndent(script).c_str(), table->getColumns(), queryMacros);
+					return openset::query::QueryParser::actionDependencies(queryMacros, onInsert, actions);
+				};
+
+				vector<int64_t> actions;
+
+				ASSERT(depends(R"pyql(
+				def on_insert():
+					counter = 0
+					match where action is 'purchase' and page is not None:
+						counter += 1
+						if counter > 99:
+							emit("one hundred purchases")
+					match where action is 'refund' or action is 'return':
+						counter -= 1
+				)pyql", actions));
+				vector<int64_t> expected = { MakeHash("purchase"), MakeHash("refund"), MakeHash("return") };
+				sort(expected.begin(), expected.end());
+				ASSERT(actions == expected);
+
+				// reads whatever row it's on
+				ASSERT(!depends(R"pyql(
+				def on_insert():
+					if page == 'page_1':
+						emit("page one")
+				)pyql", actions));
+
+				// any row can pass
+				ASSERT(!depends(R"pyql(
+				def on_insert():
+					match where page == 'page_1':
+						emit("page one")
+				)pyql", actions));
+
+				// changes with the clock
+				ASSERT(!depends(R"pyql(
+				def on_insert():
+					match where action is 'purchase' and iter_within(1 days, now):
+						emit("bought today")
+				)pyql", actions));
+
+				// no such function
+				ASSERT(!depends(R"pyql(
+				def on_purchase():
+					match where action is 'purchase':
+						emit("bought")
+				)pyql", actions));
+
+				// a declared list wins over the script
+				openset::trigger::triggerSettings_s settings;
+				settings.name = "__test_deps__";
+				settings.entryFunction = "on_insert";
+				settings.entryFunctionHash = onInsert;
+				settings.configVersion = 0;
+				settings.script = fixIndent(R"pyql(
+				def on_insert():
+					match where action is 'purchase':
+						emit("bought")
+				)pyql");
+				openset::trigger::Trigger::compileTrigger(table, settings.name, settings.script, settings.macros);
+
+				openset::trigger::Trigger::resolveDependencies(&settings);
+				ASSERT(settings.actionDeps == vector<int64_t>{ MakeHash("purchase") });
+
+				openset::trigger::Trigger trigger(&settings, parts);
+				ASSERT(trigger.dependsOn({ MakeHash("page_view"), MakeHash("purchase") }));
+				ASSERT(!trigger.dependsOn({ MakeHash("page_view") }));
+
+				settings.dependsOn = { "refund" };
+				openset::trigger::Trigger::resolveDependencies(&settings);
+				ASSERT(!trigger.dependsOn({ MakeHash("purchase") }));
+				ASSERT(trigger.dependsOn({ MakeHash("refund") }));
+			}
+		},
+		{
+			"db: incremental triggers", [database]() {
+
+				auto table = database->getTable("__test_actiondir__");
+				auto parts = table->getPartitionObjects(0);
+
+				const auto onInsert = MakeHash("on_insert");
+
+				auto planOf = [&](const string& script, openset::query::IncrementalPlan_s& plan) -> bool
+				{
+					openset::query::Macro_s queryMacros;
+					openset::query::QueryParser p;
+					p.compileQuery(fixIndent(script).c_str(), table->getColumns(), queryMacros);
+					return openset::query::QueryParser::incrementalPlan(queryMacros, onInsert, plan);
+				};
+
+				openset::query::IncrementalPlan_s plan;
+
+				// a single match over the rows, state in `counter`
+				const auto counterPyql = R"pyql(
+				def on_insert():
+					counter = 0
+					match where action is 'purchase' and page != 'nope':
+						counter += 1
+						if counter > 4:
+							emit("five purchases")
+				)pyql";
+
+				ASSERT(planOf(counterPyql, plan));
+				ASSERT(plan.match > 0);
+				ASSERT(plan.stateVars.size() == 1);
+
+				// a second pass over the rows
+				ASSERT(!planOf(R"pyql(
+				def on_insert():
+					counter = 0
+					match where action is 'purchase':
+						counter += 1
+					match where action is 'refund':
+						counter -= 1
+					if counter > 4:
+						emit("net purchases")
+				)pyql", plan));
+
+				// looks back at earlier matches
+				ASSERT(!planOf(R"pyql(
+				def on_insert():
+					match where action is 'purchase':
+						if iter_within(1 days, prev_match):
+							emit("two in a day")
+				)pyql", plan));
+
+				// keeps state that isn't set up front
+				ASSERT(!planOf(R"pyql(
+				def on_insert():
+					match where action is 'purchase':
+						last = page
+						if last == 'page_1':
+							emit("bought on page one")
+				)pyql", plan));
+
+				// side effects other than emit
+				ASSERT(!planOf(R"pyql(
+				def on_insert():
+					match where action is 'purchase':
+						schedule(on_insert, 1 days)
+				)pyql", plan));
+
+				openset::trigger::triggerSettings_s settings;
+				settings.name = "__test_incremental__";
+				settings.entryFunction = "on_insert";
+				settings.entryFunctionHash = onInsert;
+				settings.configVersion = 0;
+				settings.script = fixIndent(counterPyql);
+				openset::trigger::Trigger::compileTrigger(table, settings.name, settings.script, settings.macros);
+
+				openset::trigger::Trigger trigger(&settings, parts);
+				ASSERT(planOf(counterPyql, plan));
+				const auto counterVar = plan.stateVars[0];
+
+				Person person;
+				person.mapTable(table, 0);
+
+				// inserts one batch the way OpenLoopInsert does
+				auto insertBatch = [&](const vector<pair<int64_t, string>>& events)
+				{
+					person.mount(parts->people.getmakePerson("incremental@test.com"));
+					person.prepare();
+
+					trigger.mount(&person);
+					trigger.preInsertTest();
+
+					for (const auto& e : events)
+					{
+						cjson event;
+						event.set("person", "incremental@test.com");
+						event.set("stamp", e.first);
+						event.set("action", e.second);
+						event.setObject("attr")->set("page", "page_1");
+						person.insert(&event);
+					}
+
+					trigger.postInsertTest();
+					person.commit();
+				};
+
+				auto checkpoint = [&](const int64_t context, int64_t& value) -> bool
+				{
+					person.mount(parts->people.getmakePerson("incremental@test.com"));
+					return person.getGrid()->getFlag(
+						openset::db::flagType_e::trigger_checkpoint, settings.id, context, value);
+				};
+
+				const auto start = 1458820830000LL;
+				int64_t value;
+
+				insertBatch({ { start, "purchase" }, { start + 1000, "page_view" }, { start + 2000, "purchase" } });
+				ASSERT(trigger.triggerQueue.empty());
+				ASSERT(checkpoint(-2, value) && value == 3); // rows run
+				ASSERT(checkpoint(counterVar, value) && value == 2);
+
+				// appended, carries on from row 3
+				insertBatch({ { start + 3000, "purchase" }, { start + 4000, "page_view" } });
+				ASSERT(trigger.triggerQueue.empty());
+				ASSERT(checkpoint(-2, value) && value == 5);
+				ASSERT(checkpoint(counterVar, value) && value == 3);
+
+				insertBatch({ { start + 5000, "purchase" } });
+				ASSERT(trigger.triggerQueue.empty());
+				ASSERT(checkpoint(counterVar, value) && value == 4);
+
+				// lands before the checkpoint, so the whole history is run again
+				insertBatch({ { start - 1000, "purchase" } });
+				ASSERT(trigger.triggerQueue.size() == 1);
+				ASSERT(!checkpoint(-2, value));
+
+				// fired, later inserts don't run it
+				insertBatch({ { start + 6000, "purchase" } });
+				ASSERT(trigger.triggerQueue.size() == 1);
+
+				// a trigger skipped for an insert (it only depends on purchases) still
+				// loses its checkpoint when the insert lands before the end
+				openset::trigger::triggerSettings_s skipSettings;
+				skipSettings.name = "__test_incremental_skip__";
+				skipSettings.entryFunction = "on_insert";
+				skipSettings.entryFunctionHash = onInsert;
+				skipSettings.configVersion = 0;
+				skipSettings.script = fixIndent(counterPyql);
+				openset::trigger::Trigger::compileTrigger(table, skipSettings.name, skipSettings.script, skipSettings.macros);
+				openset::trigger::Trigger::resolveDependencies(&skipSettings);
+				ASSERT(skipSettings.actionDeps == vector<int64_t>{ MakeHash("purchase") });
+
+				openset::trigger::Trigger skipTrigger(&skipSettings, parts);
+
+				// inserts one batch the way OpenLoopInsert does, skipping the trigger
+				// when none of the actions matter to it
+				auto insertSkipping = [&](const vector<pair<int64_t, string>>& events)
+				{
+					person.mount(parts->people.getmakePerson("skipped@test.com"));
+					person.prepare();
+
+					vector<int64_t> insertedActions;
+					for (const auto& e : events)
+						insertedActions.push_back(MakeHash(e.second));
+
+					const auto runs = skipTrigger.dependsOn(insertedActions);
+					if (runs)
+					{
+						skipTrigger.mount(&person);
+						skipTrigger.preInsertTest();
+					}
+
+					const auto rowsBefore = static_cast<int32_t>(person.getGrid()->getRows()->size());
+
+					for (const auto& e : events)
+					{
+						cjson event;
+						event.set("person", "skipped@test.com");
+						event.set("stamp", e.first);
+						event.set("action", e.second);
+						event.setObject("attr")->set("page", "page_1");
+						person.insert(&event);
+					}
+
+					if (runs)
+						skipTrigger.postInsertTest();
+					else
+						skipTrigger.insertSkipped(&person, rowsBefore);
+
+					person.commit();
+				};
+
+				auto skipCheckpoint = [&](const int64_t context, int64_t& value) -> bool
+				{
+					person.mount(parts->people.getmakePerson("skipped@test.com"));
+					return person.getGrid()->getFlag(
+						openset::db::flagType_e::trigger_checkpoint, skipSettings.id, context, value);
+				};
+
+				insertSkipping({ { start, "purchase" }, { start + 1000, "purchase" } });
+				ASSERT(skipCheckpoint(-2, value) && value == 2);
+				ASSERT(skipCheckpoint(counterVar, value) && value == 2);
+
+				// an action that sorts ahead of the purchase it shares a stamp with,
+				// so the last row the checkpoint saw still has the stamp it expects
+				string early;
+				for (const auto candidate : { "page_view", "signup", "refund", "search", "login" })
+					if (HashPair(start + 1000, MakeHash(candidate)) < HashPair(start + 1000, MakeHash("purchase")))
+					{
+						early = candidate;
+						break;
+					}
+				ASSERT(early.length());
+
+				insertSkipping({ { start + 1000, early } });
+				ASSERT(!skipCheckpoint(-2, value));
+
+				// runs in full, the purchase after the inserted row is counted once
+				insertSkipping({ { start + 2000, "purchase" } });
+				ASSERT(skipTrigger.triggerQueue.empty());
+				ASSERT(skipCheckpoint(-2, value) && value == 4);
+				ASSERT(skipCheckpoint(counterVar, value) && value == 3);
+			}
+		},
+		{
+			"db: batched inserts", [database]() {
+
+				auto table = database->getTable("__test_actiondir__");
+				auto parts = table->getPartitionObjects(0);
+
+				const vector<string> actions = { "page_view", "purchase", "signup" };
+				const auto start = 1458820830000LL;
+
+				// out of order, with repeated stamps and repeated stamp + action pairs
+				vector<cjson> events(60);
+				set<pair<int64_t, string>> rowGroups;
+
+				for (auto i = 0; i < static_cast<int>(events.size()); ++i)
+				{
+					const int64_t stamp = start + ((i * 7) % 20) * 1000LL;
+					const auto& action = actions[(i * 5) % 3];
+					events[i].set("person", "batch@test.com");
+					events[i].set("stamp", stamp);
+					events[i].set("action", action);
+					events[i].setObject("attr")->set("page", "page_" + to_string(i));
+					rowGroups.insert({ stamp, action });
+				}
+
+				auto rowsOf = [&](const string& uuid, const std::function<void(Person&)>& insert) -> vector<vector<int64_t>>
+				{
+					Person person;
+					person.mapTable(table, 0);
+					person.mount(parts->people.getmakePerson(uuid));
+					person.prepare();
+					insert(person);
+					person.commit();
+
+					person.mount(parts->people.getmakePerson(uuid));
+					person.prepare();
+
+					const auto pageColumn = person.getGrid()->getGridColumn(2000);
+
+					vector<vector<int64_t>> result;
+					for (const auto row : *person.getGrid()->getRows())
+						result.push_back({ row->cols[COL_STAMP], row->cols[COL_ACTION], row->cols[pageColumn] });
+					return result;
+				};
+
+				const auto oneByOne = rowsOf("one_by_one@test.com", [&](Person& person) {
+					for (auto& e : events)
+						person.insert(&e);
+				});
+
+				const auto batched = rowsOf("batched@test.com", [&](Person& person) {
+					vector<cjson*> batch;
+					for (auto& e : events)
+						batch.push_back(&e);
+					person.insertBatch(batch);
+				});
+
+				// the last event in each stamp + action group replaces the others
+				ASSERT(batched.size() == rowGroups.size());
+				ASSERT(batched == oneByOne);
+
+				auto sorted = true;
+				for (auto i = 1; i < static_cast<int>(batched.size()); ++i)
+					if (batched[i][0] < batched[i - 1][0])
+						sorted = false;
+				ASSERT(sorted);
+
+				const auto lastPage = MakeHash("page_" + to_string(events.size() - 1));
+				auto foundLast = false;
+				for (const auto& row : batched)
+					if (row[2] == lastPage)
+						foundLast = true;
+				ASSERT(foundLast);
+			}
+		},
+		{
+			"db: approx_count_distinct", [database, test_approx_distinct_pyql]() {
+
+				auto table = database->getTable("__test001__");
+				auto parts = table->getPartitionObjects(0); // partition zero for test				
+
+				openset::query::Macro_s queryMacros; // this is our compiled code block
+				openset::query::QueryParser p;
+				p.compileQuery(test_approx_distinct_pyql.c_str(), table->getColumns(), queryMacros);
+				ASSERT(!p.error.inError());
+
+				auto personRaw = parts->people.getmakePerson("user1@test.com"); // get a user			
+				ASSERT(personRaw != nullptr);
+
+				// run the same person into two result sets, as if they were two
+				// partitions. Sketches are unions, so merging them must not double count
+				openset::result::ResultSet resultSetA;
+				openset::result::ResultSet resultSetB;
+
+				for (auto resultSet : { &resultSetA, &resultSetB })
+				{
+					auto interpreter = new openset::query::Interpreter(queryMacros);
+					interpreter->setResultObject(resultSet);
+					resultSet->setAccTypesFromMacros(queryMacros);
+
+					auto mappedColumns = interpreter->getReferencedColumns();
+
+					Person person; // Person overlay for personRaw;
+					person.mapTable(table, 0, mappedColumns);
+					person.mount(personRaw);
+					person.prepare();
+
+					interpreter->mount(&person);
+					interpreter->exec();
+					ASSERT(!interpreter->error.inError());
+				}
+
+				std::vector<openset::result::ResultSet*> resultSets{ &resultSetA, &resultSetB };
+
+				// binary internode format, the sketch registers travel with the rows
+				int64_t bufferLength = 0;
+				const auto buffer = openset::result::ResultMuxDemux::multiSetToInternode(
+					queryMacros.vars.columnVars.size(), 1, resultSets, bufferLength);
+
+				auto internode = openset::result::ResultMuxDemux::internodeToResultSet(buffer, bufferLength);
+
+				std::vector<openset::result::ResultSet*> internodeSets{ internode };
+
+				cjson resultJSON;
+				openset::result::ResultMuxDemux::resultSetToJson(
+					queryMacros.vars.columnVars.size(), 1, internodeSets, &resultJSON);
+
+				// 3 distinct pages, 5 distinct search terms (see user1_raw_inserts)
+				auto dataNodes = resultJSON.xPath("/_")->getNodes();
+				ASSERT(dataNodes.size() == 1);
+				auto values = cjson::Stringify(dataNodes[0]->xPath("/c"));
+				ASSERT(values == "[3,5]");
+
+				delete internode;
+				PoolMem::getPool().freePtr(buffer);
+
+				// accuracy at a larger cardinality, and merge order shouldn't matter
+				uint8_t left[openset::sketch::HyperLogLog::Size];
+				uint8_t right[openset::sketch::HyperLogLog::Size];
+				openset::sketch::HyperLogLog::init(left);
+				openset::sketch::HyperLogLog::init(right);
+
+				for (auto i = 0; i < 60000; ++i)
+					openset::sketch::HyperLogLog::add(i < 40000 ? left : right, i);
+
+				// overlap 20000..39999 in both
+				for (auto i = 20000; i < 40000; ++i)
+					openset::sketch::HyperLogLog::add(right, i);
+
+				openset::sketch::HyperLogLog::merge(left, right);
+				const auto estimate = openset::sketch::HyperLogLog::estimate(left);
+				ASSERT(estimate > 57000 && estimate < 63000); // within 5%
+			}
 		}
 	};
 
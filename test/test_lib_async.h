@@ -0,0 +1,135 @@
+#pragma once
+
+#include <vector>
+
+#include "testing.h"
+#include "../src/config.h"
+#include "../src/asyncpool.h"
+#include "../src/asyncloop.h"
+#include "../src/oloop.h"
+
+inline Tests test_lib_async()
+{
+	// need config objects to run this
+	openset::config::CommandlineArgs args;
+	openset::globals::running = new openset::config::Config(args);
+
+	// stop load/save objects from doing anything
+	openset::globals::running->testMode = true;
+
+	// one worker, suspended so the tests can claim and run loops themselves
+	openset::async::AsyncPool* async = new openset::async::AsyncPool(1, 1);
+	async->suspendAsync();
+
+	return {
+		{
+			"async: partition claim", [async]() {
+
+				// a partition loop can be run by any worker, but never two at once
+				openset::async::AsyncLoop loop(async, 0, 0);
+
+				ASSERT(loop.getWorkerId() == 0);
+				ASSERT(!loop.hasWork());
+
+				ASSERT(loop.tryClaim(1)); // stolen by worker 1
+				ASSERT(loop.getWorkerId() == 1);
+				ASSERT(!loop.tryClaim(0)); // home worker has to wait
+
+				loop.unclaim();
+				ASSERT(loop.tryClaim(0));
+				ASSERT(loop.getWorkerId() == 0);
+				ASSERT(!loop.trySharedClaim()); // no readers while claimed
+				loop.unclaim();
+
+				// read-only (shared) claims stack, but hold off an exclusive claim
+				ASSERT(loop.trySharedClaim());
+				ASSERT(loop.trySharedClaim());
+				ASSERT(!loop.tryClaim(0));
+				ASSERT(!loop.trySharedClaim()); // exclusive is waiting, no new readers
+				loop.unclaimShared();
+				loop.unclaimShared();
+				ASSERT(loop.tryClaim(0));
+				loop.unclaim();
+				ASSERT(loop.trySharedClaim());
+				loop.unclaimShared();
+
+				const auto stats = async->getWorkerStats();
+				ASSERT(stats.size() == 1);
+				ASSERT(stats[0].steals == 0);
+			}
+		},
+		{
+			"async: priorities and deadlines", [async]() {
+
+				using namespace openset::async;
+
+				// records the order cells run in
+				class TestCell : public OpenLoop
+				{
+				public:
+					std::vector<int>* order;
+					int id;
+					bool expired{ false };
+
+					TestCell(const oloopPriority_e priority, std::vector<int>* order, const int id) :
+						OpenLoop(priority),
+						order(order),
+						id(id)
+					{}
+
+					void prepare() final {}
+					void run() final { order->push_back(id); suicide(); }
+					void partitionRemoved() final {}
+					void deadlineExceeded() final { expired = true; }
+				};
+
+				const auto countLatency = [async](const oloopPriority_e priority) -> int64_t
+				{
+					int64_t total = 0;
+					for (const auto count : async->getLatencyHistogram(priority))
+						total += count;
+					return total;
+				};
+
+				const auto realtimeBefore = countLatency(oloopPriority_e::realtime);
+
+				std::vector<int> order;
+				AsyncLoop loop(async, 0, 0);
+				loop.tryClaim(0);
+
+				const auto late = new TestCell(oloopPriority_e::realtime, &order, 4);
+				late->deadline = Now() - 1;
+
+				loop.queueCell(new TestCell(oloopPriority_e::background, &order, 1));
+				loop.queueCell(new TestCell(oloopPriority_e::realtime, &order, 2));
+				loop.queueCell(new TestCell(oloopPriority_e::ingest, &order, 3));
+				loop.queueCell(late);
+
+				int64_t nextRun = -1;
+				loop.Run(nextRun);
+
+				// realtime, then ingest, then background (never ran, so it isn't
+				// deferred), the late cell is expired without running
+				ASSERT(order.size() == 3);
+				ASSERT(order[0] == 2 && order[1] == 3 && order[2] == 1);
+				ASSERT(late->expired);
+				loop.unclaim();
+
+				// both realtime cells completed (one by expiring)
+				ASSERT(async->getLatencyHistogram(oloopPriority_e::realtime).size() == LATENCY_BUCKETS);
+				ASSERT(countLatency(oloopPriority_e::realtime) - realtimeBefore == 2);
+
+				// log2 millisecond buckets, the background cell above has already
+				// recorded its own latency, so only count what is added here
+				const auto backgroundBefore = async->getLatencyHistogram(oloopPriority_e::background);
+				async->recordLatency(oloopPriority_e::background, 0);
+				async->recordLatency(oloopPriority_e::background, 3);
+				async->recordLatency(oloopPriority_e::background, 1000000);
+				const auto background = async->getLatencyHistogram(oloopPriority_e::background);
+				ASSERT(background[0] - backgroundBefore[0] == 1);
+				ASSERT(background[2] - backgroundBefore[2] == 1);
+				ASSERT(background[LATENCY_BUCKETS - 1] - backgroundBefore[LATENCY_BUCKETS - 1] == 1);
+			}
+		}
+	};
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "testing.h"
+#include "../lib/cjson/cjson.h"
+#include "../lib/cjson/jsonindex.h"
+
+inline Tests test_lib_cjson()
+{
+	return {
+		{
+			"cjson: structural index", [] {
+				const std::string text = R"({"a": [1, true], "b\"}": "x,y"})";
+				std::vector<uint32_t> index;
+
+				ASSERT(jsonIndex::build(text.c_str(), text.length(), index));
+
+				std::string found;
+				for (auto i = 0; i < static_cast<int>(index.size()) - 1; ++i)
+					found += text[index[i]];
+
+				// brackets inside strings and escaped quotes are not structural
+				ASSERTMSG(found == R"({"":[1,t],"":""})", found);
+				ASSERT(index.back() == text.length());
+
+				// unterminated
+				ASSERT(!jsonIndex::build("{\"a", 3, index));
+
+				// a run of backslashes across a 64 byte boundary, the quote after an even run closes the string
+				for (auto run = 1; run < 6; ++run)
+				{
+					const std::string value = std::string(61, 'x') + std::string(run * 2, '\\');
+					const auto doc = "{\"" + value + "\":1}";
+
+					cjson json(doc.c_str(), doc.length());
+					ASSERT(json.memberCount == 1);
+					ASSERT(strlen(json.membersHead->nameCstr()) == 61 + static_cast<size_t>(run));
+					ASSERT(json.xPathInt("/" + json.membersHead->name(), 0) == 1);
+				}
+			}
+		},
+		{
+			"cjson: parse values", [] {
+				const std::string text = R"(
+				{
+					"int": -1234567890123,
+					"big": 123456789012345678901,
+					"double": 2.5,
+					"exp": 1e3,
+					"text": "line\none \"quoted\" \\ \/ é 😀",
+					"unicode": "\u00e9 \ud83d\ude00",
+					"yes": true,
+					"no": false,
+					"nothing": null,
+					"list": [1, "two", 3.5, true, null, {"a": 1}, [], {}],
+					"nested": {"deeper": {"deepest": [[1, 2], [3]]}},
+					"int": 42
+				})";
+
+				cjson json(text.c_str(), text.length());
+
+				// a repeated name replaces the value
+				ASSERT(json.memberCount == 11);
+				ASSERT(json.xPathInt("/int", 0) == 42);
+				ASSERT(json.xPathInt("/big", 0) == INT64_MAX);
+				ASSERT(json.xPathDouble("/double", 0) == 2.5);
+				ASSERT(json.xPathDouble("/exp", 0) == 1000.0);
+				ASSERT(json.xPathString("/text", "") == "line\none \"quoted\" \\ / \xC3\xA9 \xF0\x9F\x98\x80");
+				ASSERT(json.xPathString("/unicode", "") == "\xC3\xA9 \xF0\x9F\x98\x80");
+				ASSERT(json.xPathBool("/yes", false) == true);
+				ASSERT(json.xPathBool("/no", true) == false);
+				ASSERT(json.xPath("/nothing")->isNull());
+
+				auto list = json.xPath("/list");
+				ASSERT(list->type() == cjsonType::ARRAY);
+				ASSERT(list->memberCount == 8);
+				ASSERT(list->at(1)->getString() == "two");
+				ASSERT(list->at(3)->getBool() == true);
+				ASSERT(list->at(4)->isNull());
+				ASSERT(list->at(5)->xPathInt("/a", 0) == 1);
+				ASSERT(list->at(6)->type() == cjsonType::ARRAY && list->at(6)->memberCount == 0);
+				ASSERT(list->at(7)->type() == cjsonType::OBJECT && list->at(7)->memberCount == 0);
+
+				ASSERT(json.xPath("/nested/deeper/deepest")->at(0)->at(1)->getInt() == 2);
+
+				// the string the parser reads doesn't need to be terminated
+				const std::string padded = "[1,2,3]999";
+				cjson array(padded.c_str(), 7);
+				ASSERT(array.type() == cjsonType::ARRAY);
+				ASSERT(cjson::Stringify(&array) == "[1,2,3]");
+			}
+		},
+		{
+			"cjson: matches the serial parser", [] {
+				// events like the ones inserted, with strings long enough to cross blocks
+				std::string events = "[";
+
+				for (auto i = 0; i < 200; ++i)
+				{
+					if (i)
+						events += ",";
+
+					events +=
+						"{\"id\":\"user" + std::to_string(i) + "@test.com\",\"stamp\":" + std::to_string(1458820830 + i) +
+						",\"_\":{\"action\":\"page \\\"view\\\"\",\"price\":" + std::to_string(i) + ".25" +
+						",\"path\":\"" + std::string(i % 97, 'p') + "\",\"tags\":[\"a\\\\\",\"b\\n\"]}}";
+				}
+
+				events += "]";
+
+				cjson indexed(events.c_str(), events.length());
+				const auto serial = cjson::ParseSerial(events.c_str());
+
+				ASSERT(indexed.memberCount == 200);
+				ASSERT(cjson::Stringify(&indexed) == cjson::Stringify(serial));
+
+				cjson::DisposeDocument(serial);
+
+				// embedded parse into an existing node
+				cjson json;
+				auto events_node = json.setArray("events");
+				cjson::Parse(R"({"a": 1, "b": [2]})", events_node->pushObject(), true);
+				ASSERT(cjson::Stringify(&json) == R"({"events":[{"a":1,"b":[2]}]})");
+			}
+		},
+		{
+			"cjson: documents that aren't well formed", [] {
+				// unquoted junk falls back to the serial parser, which skips it
+				cjson junk(std::string(R"({"a": 1, "b": undefinedx, "c": 3})"), 0);
+				ASSERT(junk.xPathInt("/a", 0) == 1);
+
+				// an unterminated string
+				cjson open(std::string(R"({"a": 1, "b": "open)"), 0);
+				ASSERT(open.xPathInt("/a", 0) == 1);
+
+				// missing commas
+				cjson missing(std::string(R"({"a": 1 "b": 2})"), 0);
+				ASSERT(missing.xPathInt("/a", 0) == 1);
+
+				// not a document, whatever the serial parser makes of it
+				cjson notDocument(std::string("  12 "), 0);
+				cjson notDocumentSerial;
+				cjson::ParseSerial("  12 ", &notDocumentSerial);
+				ASSERT(cjson::Stringify(&notDocument) == cjson::Stringify(&notDocumentSerial));
+
+				// leading bytes the serial parser skips, like a UTF-8 BOM
+				const std::string bom = "\xEF\xBB\xBF{\"a\":1}";
+				cjson withBom(bom, bom.length());
+				ASSERT(cjson::Stringify(&withBom) == R"({"a":1})");
+
+				// `undefined` members and elements are left out, as the serial parser does
+				const std::string undefinedValues = R"({"a":undefined,"b":2,"c":[1,undefined,3]})";
+				cjson indexed(undefinedValues, undefinedValues.length());
+				const auto serial = cjson::ParseSerial(undefinedValues.c_str());
+				ASSERT(cjson::Stringify(&indexed) == R"({"b":2,"c":[1,3]})");
+				ASSERT(cjson::Stringify(&indexed) == cjson::Stringify(serial));
+				cjson::DisposeDocument(serial);
+
+				// a fallback into an existing node drops what the structural parser added
+				cjson list(cjsonType::ARRAY);
+				list.push(static_cast<int64_t>(0));
+				cjson::Parse("[1, 2 3]", &list);
+				ASSERT(cjson::Stringify(&list) == "[0,1,2,3]");
+			}
+		}
+	};
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <ctime>
+#include <string>
+
+#include "testing.h"
+#include "../lib/time/epoch.h"
+#include "../lib/time/timezone.h"
+
+inline Tests test_lib_epoch()
+{
+	return {
+		{
+			"epoch: calendar math matches gmtime", [] {
+				// every 7h 13m 17s from 1970 up to 2100, hits every hour and weekday
+				auto mismatches = 0;
+
+				for (int64_t stamp = 0; stamp < 4102444800LL; stamp += 25997)
+				{
+					struct tm time;
+					Epoch::stampToTimeStruct(&time, stamp);
+
+					const auto dayStart = (stamp / 86400) * 86400;
+					// fixUnix takes anything this small to be seconds already
+					const auto milli = stamp < 4102445 ? stamp : stamp * 1000LL + 123;
+
+					if (Epoch::epochSecondNumber(milli) != time.tm_sec ||
+						Epoch::epochMinuteNumber(milli) != time.tm_min ||
+						Epoch::epochHourNumber(milli) != time.tm_hour ||
+						Epoch::epochDayOfWeek(milli) != time.tm_wday + 1 ||
+						Epoch::epochDayOfMonth(milli) != time.tm_mday ||
+						Epoch::epochDayOfYear(milli) != time.tm_yday + 1 ||
+						Epoch::epochMonthNumber(milli) != time.tm_mon + 1 ||
+						Epoch::epochQuarterNumber(milli) != (time.tm_mon / 3) * 3 + 1 ||
+						Epoch::epochYearNumber(milli) != time.tm_year + 1900 ||
+						Epoch::epochWeekDate(milli) != dayStart - time.tm_wday * 86400 ||
+						Epoch::epochMonthDate(milli) != dayStart - (time.tm_mday - 1) * 86400 ||
+						Epoch::epochYearDate(milli) != dayStart - time.tm_yday * 86400)
+						++mismatches;
+
+					struct tm quarter = { 0 };
+					quarter.tm_mday = 1;
+					quarter.tm_mon = (time.tm_mon / 3) * 3;
+					quarter.tm_year = time.tm_year;
+
+					if (Epoch::epochQuarterDate(milli) != static_cast<int64_t>(timegm(&quarter)))
+						++mismatches;
+				}
+
+				ASSERT(mismatches == 0);
+
+				// either side of the lookup table
+				ASSERT(Epoch::civilDay(-1).year == 1969 && Epoch::civilDay(-1).month == 12 && Epoch::civilDay(-1).day == 31);
+				ASSERT(Epoch::civilDay(-1).weekDay == 3);
+				ASSERT(Epoch::civilDay(Epoch::CalendarDays).year == 2100 && Epoch::civilDay(Epoch::CalendarDays).yearDay == 0);
+				ASSERT(Epoch::daysFromCivil(2100, 1, 1) == Epoch::CalendarDays);
+				ASSERT(Epoch::daysFromCivil(2000, 2, 29) + 1 == Epoch::daysFromCivil(2000, 3, 1));
+			}
+		},
+		{
+			"epoch: ISO8601 parsing", [] {
+				ASSERT(Epoch::ISO8601ToEpoch("1970-01-01T00:00:00Z") == 0);
+				ASSERT(Epoch::ISO8601ToEpoch("2016-03-24T12:00:30Z") == 1458820830000LL);
+				ASSERT(Epoch::ISO8601ToEpoch("2016-03-24T12:00:30.250Z") == 1458820830250LL);
+				ASSERT(Epoch::ISO8601ToEpoch("2016-03-24T14:30:30+02:30") == 1458820830000LL);
+				ASSERT(Epoch::ISO8601ToEpoch("2016-03-24T07:00:30.5-05:00") == 1458820830005LL);
+				ASSERT(Epoch::ISO8601ToEpoch("2000-02-29T23:59:59Z") == 951868799000LL);
+
+				ASSERT(Epoch::ISO8601ToEpoch("2016-03-24") == -1);
+				ASSERT(Epoch::ISO8601ToEpoch("2016/03/24T12:00:30Z") == -1);
+				ASSERT(Epoch::ISO8601ToEpoch("2016-0x-24T12:00:30Z") == -1);
+
+				// round trips
+				ASSERT(Epoch::EpochToISO8601(1458820830000LL) == "2016-03-24T12:00:30Z");
+				ASSERT(Epoch::EpochToISO8601(1458820830250LL) == "2016-03-24T12:00:30.250Z");
+				ASSERT(Epoch::ISO8601ToEpoch(Epoch::EpochToISO8601(951868799123LL)) == 951868799123LL);
+			}
+		},
+		{
+			"epoch: time zones", [] {
+				const auto utc = TimeZone::get("UTC");
+				ASSERT(utc && utc->offsetAt(1458820830) == 0);
+
+				const auto india = TimeZone::get("+05:30");
+				ASSERT(india && india->offsetAt(1458820830) == 19800);
+				ASSERT(TimeZone::get("+05:30") == india); // loaded once
+
+				const auto west = TimeZone::get("-08:00");
+				ASSERT(west && west->offsetAt(0) == -28800);
+
+				ASSERT(TimeZone::get("Not/A_Zone") == nullptr);
+				ASSERT(TimeZone::get("../../etc/passwd") == nullptr);
+				ASSERT(TimeZone::get("+25:00") == nullptr);
+
+				// from the tz database, where the host has one
+				if (const auto newYork = TimeZone::get("America/New_York"); newYork)
+				{
+					ASSERT(newYork->offsetAt(1452816000) == -18000); // 2016-01-15, EST
+					ASSERT(newYork->offsetAt(1468540800) == -14400); // 2016-07-15, EDT
+
+					// 2016-03-13 02:00 EST, clocks went forward
+					ASSERT(newYork->offsetAt(1457852399) == -18000);
+					ASSERT(newYork->offsetAt(1457852400) == -14400);
+
+					const auto span = newYork->spanAt(1458820830);
+					ASSERT(span.from == 1457852400 && span.to == 1478412000); // until 2016-11-06 02:00 EDT
+
+					// past the last transition in the file, from the rule at the end of it
+					ASSERT(newYork->offsetAt(3803587200) == -14400); // 2090-07-13
+					ASSERT(newYork->offsetAt(3818102400) == -18000); // 2090-12-28
+				}
+
+				if (const auto sydney = TimeZone::get("Australia/Sydney"); sydney)
+				{
+					ASSERT(sydney->offsetAt(1452816000) == 39600); // January is summer
+					ASSERT(sydney->offsetAt(1468540800) == 36000);
+					ASSERT(sydney->offsetAt(3818102400) == 39600);
+				}
+			}
+		}
+	};
+}
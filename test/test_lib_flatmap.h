@@ -0,0 +1,119 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+#include "common.h"
+#include "testing.h"
+#include "../lib/mem/flatmap.h"
+
+inline Tests test_lib_flatmap()
+{
+	return {
+		{
+			"flatMap: set, get and overwrite", [] {
+				flatMap<int64_t, int32_t> map(ringHint_e::lt_compact);
+
+				ASSERT(map.empty());
+
+				map.set(10, 1);
+				map.set(20, 2);
+				map.set(10, 3); // overwrite
+
+				ASSERT(map.size() == 2);
+
+				int32_t value = 0;
+				ASSERT(map.get(10, value) && value == 3);
+				ASSERT(map.get(20, value) && value == 2);
+				ASSERT(!map.get(30, value));
+				ASSERT(map.get(30) == nullptr);
+				ASSERT(map.count(20) == 1);
+
+				map[30] = 4;
+				++map[30];
+				ASSERT(map.get(30, value) && value == 5);
+
+				ASSERT(!map.emplaceTry(30, 9));
+				ASSERT(map.emplaceTry(40, 9));
+				ASSERT(map.size() == 4);
+			}
+		},
+		{
+			"flatMap: incremental resize", [] {
+				// starts at 16 slots, grows many times while older tables are still migrating
+				flatMap<int64_t, int64_t> map(ringHint_e::lt_compact);
+				std::unordered_map<int64_t, int64_t> reference;
+
+				auto missing = 0;
+
+				for (int64_t i = 0; i < 50000; ++i)
+				{
+					const auto key = i * 7919;
+					map.set(key, i);
+					reference[key] = i;
+
+					// every key inserted so far is still reachable mid-resize
+					if (i % 997 == 0)
+						for (const auto& kv : reference)
+						{
+							int64_t value;
+							if (!map.get(kv.first, value) || value != kv.second)
+								++missing;
+						}
+				}
+
+				ASSERT(missing == 0);
+				ASSERT(map.size() == reference.size());
+
+				// iteration visits each item once
+				auto visited = 0;
+				for (auto& kv : map)
+					if (reference.count(kv.first) && reference[kv.first] == kv.second)
+						++visited;
+				ASSERT(visited == static_cast<int>(reference.size()));
+
+				ASSERT(map.get(-1) == nullptr);
+				ASSERT(map.getBytes() > 0);
+			}
+		},
+		{
+			"flatMap: erase and reuse", [] {
+				flatMap<std::string, int> map(ringHint_e::lt_compact);
+
+				for (auto i = 0; i < 1000; ++i)
+					map.set("key_" + std::to_string(i), i);
+
+				// erase the even keys while iterating
+				for (auto it = map.begin(); it != map.end();)
+				{
+					if (it->second % 2 == 0)
+						it = map.erase(it);
+					else
+						++it;
+				}
+
+				ASSERT(map.size() == 500);
+				ASSERT(map.erase("key_1") == 1);
+				ASSERT(map.erase("key_1") == 0);
+				ASSERT(map.find("key_1") == map.end());
+				ASSERT(map.find("key_3") != map.end());
+				ASSERT(map.find("key_3")->second == 3);
+
+				// deleted slots are reused without losing anything
+				for (auto i = 0; i < 1000; i += 2)
+					map.set("key_" + std::to_string(i), i);
+
+				auto found = 0;
+				for (auto i = 0; i < 1000; ++i)
+					if (map.get("key_" + std::to_string(i)))
+						++found;
+				ASSERT(found == 999);
+				ASSERT(map.get("key_1") == nullptr);
+
+				map.clear();
+				ASSERT(map.empty());
+				ASSERT(map.begin() == map.end());
+			}
+		}
+	};
+}
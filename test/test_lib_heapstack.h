@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+
+#include "testing.h"
+#include "../lib/heapstack/heapstack.h"
+#include "../lib/cjson/cjson.h"
+
+inline Tests test_lib_heapstack()
+{
+	return {
+		{
+			"heapstack: parse arena", []() {
+
+				auto& blockPool = HeapStackBlockPool::getPool();
+				const auto inUse = blockPool.getStats().inUse;
+
+				// small blocks come from the heap and double
+				HeapStack arena(MemConstants::HeapStackSmallBlockSize);
+				const std::string row = R"({"person":"user1@test.com","stamp":1458820830000,"action":"purchase","attr":{"product":"pear","qty":2}})";
+
+				for (auto i = 0; i < 50; ++i)
+				{
+					const auto doc = cjson::Parse(row.c_str(), row.length(), cjson::MakeDocument(&arena));
+					ASSERT(doc->xPathString("/attr/product", "") == "pear");
+				}
+
+				const auto used = arena.getBytes();
+				ASSERT(arena.getBlocks() > 1);
+				ASSERT(blockPool.getStats().inUse == inUse);
+
+				// after a reset the next round of the same size fits in one block
+				arena.reset();
+				ASSERT(arena.getBytes() == 0);
+
+				for (auto i = 0; i < 50; ++i)
+					cjson::Parse(row.c_str(), row.length(), cjson::MakeDocument(&arena));
+
+				ASSERT(arena.getBytes() == used);
+				ASSERT(arena.getBlocks() == 1);
+				ASSERT(arena.getAllocated() < MemConstants::HeapStackBlockSize);
+
+				// a round too large for small blocks moves on to pooled blocks
+				arena.reset();
+				arena.newPtr(MemConstants::HeapStackBlockSize / 2);
+				arena.newPtr(MemConstants::HeapStackBlockSize / 2);
+				ASSERT(blockPool.getStats().inUse > inUse);
+
+				arena.reset();
+				arena.newPtr(16);
+				ASSERT(arena.getBlocks() == 1);
+			}
+		}
+	};
+}
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "testing.h"
+#include "../src/internodeframe.h"
+#include "../src/internoderouter.h"
+#include "../lib/sba/sba.h"
+
+inline Tests test_lib_internodeframe()
+{
+	return {
+		{
+			"internode frames: routes and loopback requests", []() {
+
+				using namespace openset::web;
+				namespace http = openset::http;
+
+				QueryParams params;
+				params.emplace("table", "high street");
+				params.emplace("fork", "true");
+
+				std::string method, path;
+				QueryParams decoded;
+				ASSERT(decodeRoute(encodeRoute("POST", "/v1/query/t/event", params), method, path, decoded));
+				ASSERT(method == "POST" && path == "/v1/query/t/event");
+				ASSERT(decoded == params);
+				ASSERT(!decodeRoute("\x05\x00", method, path, decoded));
+
+				// loopback, the test plays the worker threads. Both live for the
+				// life of the process like the real server.
+				static auto server = new HttpServe();
+				static auto frames = new FrameServe(server, "127.0.0.1", 0);
+				const auto port = frames->getPort();
+
+				// a node with nothing listening is refused, callers fall back to HTTP
+				auto refused = std::make_shared<FrameClient>("127.0.0.1", 1);
+				ASSERT(!refused->request("GET", "/", {}, nullptr, 0, [](http::StatusCode, bool, char*, size_t) {}));
+
+				std::atomic<bool> running{ true };
+				std::thread worker([&running]()
+				{
+					while (running)
+					{
+						const auto message = server->getQueuedMessage();
+						if (!message)
+						{
+							ThreadSleep(1);
+							continue;
+						}
+
+						// echo the path, table and payload back
+						const auto body =
+							message->getPath() + "|" +
+							message->getParamString("table") + "|" +
+							std::string(message->getPayload(), message->getPayloadLength());
+						message->reply(http::StatusCode::success_ok, body);
+					}
+				});
+
+				auto client = std::make_shared<FrameClient>("127.0.0.1", port);
+
+				// several threads share the one connection
+				std::atomic<int> matched{ 0 };
+				std::vector<std::thread> callers;
+
+				for (auto i = 0; i < 4; ++i)
+					callers.emplace_back([&client, &params, &matched, i]()
+					{
+						for (auto r = 0; r < 25; ++r)
+						{
+							const auto payload = "payload_" + std::to_string(i) + "_" + std::to_string(r);
+							const auto expected = "/v1/echo|high street|" + payload;
+
+							client->request("POST", "/v1/echo", params, payload.c_str(), payload.length(),
+								[&matched, &expected](const http::StatusCode status, const bool error, char* data, const size_t size)
+								{
+									if (status == http::StatusCode::success_ok && !error && std::string(data, size) == expected)
+										++matched;
+									PoolMem::getPool().freePtr(data);
+								});
+						}
+					});
+
+				for (auto& caller : callers)
+					caller.join();
+
+				ASSERT(matched == 100);
+
+				const auto echo = [&client, &params]() -> bool
+				{
+					auto ok = false;
+					client->request("POST", "/v1/echo", params, "x", 1,
+						[&ok](const http::StatusCode status, const bool error, char* data, const size_t size)
+						{
+							ok = status == http::StatusCode::success_ok && !error && std::string(data, size) == "/v1/echo|high street|x";
+							PoolMem::getPool().freePtr(data);
+						});
+					return ok;
+				};
+
+				// a frame claiming more than the cap closes that connection, the server carries on
+				{
+					asio::io_service io;
+					asio::ip::tcp::socket raw(io);
+					raw.connect({ asio::ip::address::from_string("127.0.0.1"), static_cast<unsigned short>(port) });
+
+					frameHeader_s huge;
+					huge.payloadLength = FrameMaxPayloadLength + 1;
+					asio::write(raw, asio::buffer(&huge, sizeof(huge)));
+
+					char byte;
+					SimpleWeb::error_code ec;
+					raw.read_some(asio::buffer(&byte, 1), ec);
+					ASSERT(ec == asio::error::eof || ec == asio::error::connection_reset);
+				}
+
+				ASSERT(echo());
+
+				// dropping the same connection twice (a read and a write error) leaves
+				// the next connection alone
+				client->close();
+				client->close();
+				ThreadSleep(100);
+				ASSERT(echo());
+				ASSERT(echo());
+
+				running = false;
+				worker.join();
+				client->close();
+			}
+		},
+		{
+			"internode frames: requests a node never answers time out", []() {
+
+				using namespace openset::web;
+				namespace http = openset::http;
+
+				// listens but never accepts, the connection completes in the backlog
+				// and nothing is ever read or replied
+				asio::io_service io;
+				asio::ip::tcp::acceptor silent(io, { asio::ip::address::from_string("127.0.0.1"), 0 });
+
+				auto client = std::make_shared<FrameClient>("127.0.0.1", silent.local_endpoint().port());
+
+				const auto timedOut = [&client]() -> bool
+				{
+					auto called = false;
+					auto failed = false;
+
+					const auto started = Now();
+					const auto sent = client->request("GET", "/v1/silent", {}, nullptr, 0,
+						[&called, &failed](const http::StatusCode, const bool error, char* data, const size_t)
+						{
+							called = true;
+							failed = error && !data;
+						}, 200);
+
+					const auto waited = Now() - started;
+					return sent && called && failed && waited >= 150 && waited < 5000;
+				};
+
+				ASSERT(timedOut());
+
+				// the connection is still good, the next request times out the same way
+				ASSERT(timedOut());
+
+				client->close();
+			}
+		},
+		{
+			"internode frames: route connection pool", []() {
+
+				using namespace openset::mapping;
+
+				// nothing connects until a request is made
+				RoutePool pool(1, "127.0.0.1", 1);
+
+				auto rest = pool.acquire();
+				ASSERT(pool.getStats().inFlight == 1);
+				pool.release(rest, false, 100);
+
+				// the connection is reused
+				rest = pool.acquire();
+				pool.release(rest, false, 300);
+
+				auto stats = pool.getStats();
+				ASSERT(stats.requests == 2);
+				ASSERT(stats.connections == 1);
+				ASSERT(stats.idle == 1);
+				ASSERT(stats.inFlight == 0);
+				ASSERT(stats.latencyMicros == 400);
+				ASSERT(stats.maxLatencyMicros == 300);
+
+				// a failed connection is not reused
+				rest = pool.acquire();
+				pool.release(rest, true, 100);
+				stats = pool.getStats();
+				ASSERT(stats.errors == 1);
+				ASSERT(stats.idle == 0);
+
+				// requests beyond MaxRouteConnections wait for one to finish
+				std::vector<openset::web::RestPtr> held;
+				for (auto i = 0; i < MaxRouteConnections; ++i)
+					held.push_back(pool.acquire());
+
+				std::atomic<bool> acquired{ false };
+				std::thread waiter([&pool, &acquired]()
+				{
+					auto extra = pool.acquire();
+					acquired = true;
+					pool.release(extra, false, 0);
+				});
+
+				ThreadSleep(50);
+				ASSERT(!acquired);
+				ASSERT(pool.getStats().peakInFlight == MaxRouteConnections);
+
+				pool.release(held.back(), false, 0);
+				held.pop_back();
+				waiter.join();
+				ASSERT(acquired);
+
+				for (auto& r : held)
+					pool.release(r, false, 0);
+
+				ASSERT(pool.getStats().inFlight == 0);
+
+				// the dispatch pool runs at most MaxDispatchWorkers requests at once, the rest wait
+				{
+					DispatchPool dispatch;
+					std::atomic<int> running{ 0 };
+					std::atomic<int> peak{ 0 };
+					std::atomic<int> ran{ 0 };
+					std::atomic<bool> finish{ false };
+
+					for (auto i = 0; i < MaxDispatchWorkers * 2; ++i)
+						dispatch.post([&running, &peak, &ran, &finish]()
+						{
+							const auto now = ++running;
+							auto seen = peak.load();
+							while (now > seen && !peak.compare_exchange_weak(seen, now));
+
+							while (!finish)
+								ThreadSleep(1);
+
+							--running;
+							++ran;
+						});
+
+					ThreadSleep(100);
+					ASSERT(peak == MaxDispatchWorkers);
+					ASSERT(dispatch.getBusy() == MaxDispatchWorkers * 2);
+
+					finish = true;
+					while (dispatch.getBusy())
+						ThreadSleep(1);
+					ASSERT(ran == MaxDispatchWorkers * 2);
+				}
+			}
+		}
+	};
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "testing.h"
+#include "../src/config.h"
+#include "../src/internoderouter.h"
+#include "../src/internodeframe.h"
+#include "../lib/sba/sba.h"
+
+inline Tests test_lib_internoderouter()
+{
+	// the mapper reads this node's id from the config
+	openset::config::CommandlineArgs args;
+	openset::globals::running = new openset::config::Config(args);
+	openset::globals::running->testMode = true;
+
+	return {
+		{
+			"internode router: scatter gather planning and hedging", []() {
+
+				using namespace openset::web;
+				using namespace openset::mapping;
+				namespace http = openset::http;
+
+				// two nodes on loopback frames, `slow` takes a second to answer
+				std::atomic<bool> running{ true };
+				std::vector<std::thread> workers;
+
+				// returns the node's (HTTP) port, frames are on port + InternodePortOffset
+				const auto makeNode = [&running, &workers](const std::string& name, const int delay) -> int
+				{
+					const auto server = new HttpServe(); // lives for the process, like the real server
+					const auto frames = new FrameServe(server, "127.0.0.1", 0);
+
+					workers.emplace_back([&running, server, name, delay]()
+					{
+						while (running)
+						{
+							const auto message = server->getQueuedMessage();
+							if (!message)
+							{
+								ThreadSleep(1);
+								continue;
+							}
+
+							ThreadSleep(delay);
+							message->reply(http::StatusCode::success_ok, name + ":" + message->getParamString("partitions"));
+						}
+					});
+
+					return frames->getPort() - InternodePortOffset;
+				};
+
+				const auto fastPort = makeNode("fast", 0);
+				const auto slowPort = makeNode("slow", 1000);
+
+				// a mapper of our own (on the heap, late requests may still reference it)
+				const auto testMapper = openset::globals::mapper;
+				const auto scatterMapper = new Mapper();
+				openset::globals::mapper = testMapper;
+
+				scatterMapper->addRoute("fast", 201, "127.0.0.1", fastPort);
+				scatterMapper->addRoute("slow", 202, "127.0.0.1", slowPort);
+
+				// each node owns two partitions and clones the other two
+				for (auto p = 0; p < 4; ++p)
+				{
+					scatterMapper->partitionMap.setState(p, p < 2 ? 201 : 202, NodeState_e::active_owner);
+					scatterMapper->partitionMap.setState(p, p < 2 ? 202 : 201, NodeState_e::active_clone);
+				}
+
+				std::vector<std::string> replies;
+				const auto collect = [&replies](Mapper::DataBlock& response)
+				{
+					replies.emplace_back(response.data, response.length);
+				};
+
+				// adaptive - once `fast` answers, `slow` is a straggler and its partitions go to `fast`
+				const auto started = Now();
+				auto result = scatterMapper->dispatchScatter("GET", "/v1/test", {}, nullptr, 0, {}, collect);
+
+				std::sort(replies.begin(), replies.end());
+				ASSERT(Now() - started < 1000);
+				ASSERT(result.hedged == 1);
+				ASSERT(!result.partial);
+				ASSERT(replies.size() == 2 && replies[0] == "fast:0,1" && replies[1] == "fast:2,3");
+
+				// with a timeout and no hedging we get a partial result
+				replies.clear();
+				Mapper::ScatterOptions_s options;
+				options.timeout = 100;
+				options.hedgeAfter = 0;
+
+				result = scatterMapper->dispatchScatter("GET", "/v1/test", {}, nullptr, 0, options, collect);
+
+				std::sort(result.missing.begin(), result.missing.end());
+				ASSERT(result.partial && result.hedged == 0);
+				ASSERT(result.missing == std::vector<int>({ 2, 3 }));
+				ASSERT(replies.size() == 1 && replies[0] == "fast:0,1");
+
+				// the request `slow` never answered in time is cancelled, it doesn't hold its worker
+				const auto abandoned = Now();
+				while (scatterMapper->dispatcher.getBusy() && Now() - abandoned < 2000)
+					ThreadSleep(10);
+				ASSERT(Now() - abandoned < 500);
+
+				running = false;
+				for (auto& worker : workers)
+					worker.join();
+
+				// planning - balanced loads read from owners
+				std::vector<int> unplanned;
+				auto plan = scatterMapper->planScatter(scatterMapper->partitionMap.getReadHolders(), true, unplanned);
+
+				std::sort(plan.begin(), plan.end(), [](const auto& a, const auto& b) { return a.route < b.route; });
+				for (auto& task : plan)
+					std::sort(task.partitions.begin(), task.partitions.end());
+
+				ASSERT(plan.size() == 2 && unplanned.empty());
+				ASSERT(plan[0].route == 201 && plan[0].partitions == std::vector<int>({ 0, 1 }));
+				ASSERT(plan[1].route == 202 && plan[1].partitions == std::vector<int>({ 2, 3 }));
+
+				// a busy node has its partitions read from clones
+				scatterMapper->setNodeLoad(201, 10);
+				plan = scatterMapper->planScatter(scatterMapper->partitionMap.getReadHolders(), true, unplanned);
+				ASSERT(plan.size() == 1 && plan[0].route == 202 && plan[0].partitions.size() == 4);
+
+				// unless replicas are off
+				plan = scatterMapper->planScatter(scatterMapper->partitionMap.getReadHolders(), false, unplanned);
+				ASSERT(plan.size() == 2);
+
+				// no route to either holder
+				scatterMapper->partitionMap.setState(9, 999, NodeState_e::active_owner);
+				scatterMapper->planScatter(scatterMapper->partitionMap.getReadHolders(), true, unplanned);
+				ASSERT(unplanned == std::vector<int>({ 9 }));
+			}
+		}
+	};
+}
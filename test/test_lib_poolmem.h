@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "testing.h"
+#include "../lib/sba/sba.h"
+
+inline Tests test_lib_poolmem()
+{
+	return {
+		{
+			"poolmem: thread caches", [] {
+
+				auto& pool = PoolMem::getPool();
+				pool.setThreadCaching(true);
+
+				// a bucket nothing else in the tests allocates from
+				const int64_t size = 14000;
+
+				const auto bucketStats = [&pool, size]()
+				{
+					for (const auto& stats : pool.getStats())
+						if (stats.maxSize >= size)
+							return stats;
+					return PoolMem::BucketStats_s{};
+				};
+
+				pool.flushThreadCache();
+				ASSERT(bucketStats().allocated == 0);
+
+				std::vector<char*> ptrs;
+				for (auto i = 0; i < 5; ++i)
+				{
+					const auto ptr = static_cast<char*>(pool.getPtr(size));
+					memset(ptr, i, size);
+					ptrs.push_back(ptr);
+				}
+
+				// kept alive on this thread until the end
+				const auto kept = ptrs.back();
+				ptrs.pop_back();
+
+				// the rest of this thread's refill goes back to the bucket
+				pool.flushThreadCache();
+				const auto allocated = bucketStats();
+				ASSERT(allocated.allocated == 5);
+
+				// freed on a thread other than the one that allocated them, they go
+				// into that thread's cache and still count as allocated until it
+				// exits and flushes them
+				PoolMem::BucketStats_s whileCached;
+
+				std::thread freer([&pool, &ptrs, &bucketStats, &whileCached]()
+				{
+					for (auto ptr : ptrs)
+						pool.freePtr(ptr);
+
+					whileCached = bucketStats();
+				});
+				freer.join();
+
+				ASSERT(whileCached.allocated == 5);
+				ASSERT(whileCached.free == allocated.free);
+
+				const auto afterExit = bucketStats();
+				ASSERT(afterExit.allocated == 1);
+				ASSERT(afterExit.free == allocated.free + static_cast<int64_t>(ptrs.size()));
+
+				// the bucket isn't reset while `kept` is live
+				ASSERT(afterExit.heapBytes > 0);
+				ASSERT(kept[size - 1] == 4);
+
+				// memory freed on the other thread is handed out again
+				const auto reused = static_cast<char*>(pool.getPtr(size));
+				ASSERT(std::find(ptrs.begin(), ptrs.end(), reused) != ptrs.end());
+
+				pool.freePtr(reused);
+				pool.freePtr(kept);
+
+				// still cached on this thread, so the bucket holds on to its heap
+				ASSERT(bucketStats().allocated > 0);
+				ASSERT(bucketStats().heapBytes > 0);
+
+				// the bucket resets once nothing is allocated or cached
+				pool.flushThreadCache();
+
+				const auto reset = bucketStats();
+				ASSERT(reset.allocated == 0);
+				ASSERT(reset.free == 0);
+				ASSERT(reset.heapBytes == 0);
+				ASSERT(reset.blocks == 0);
+			}
+		},
+		{
+			"poolmem: memory reclamation", []() {
+
+				auto& pool = PoolMem::getPool();
+				pool.setThreadCaching(false);
+
+				const auto bucketStats = [&pool]()
+				{
+					for (const auto& stats : pool.getStats())
+						if (stats.maxSize == 400)
+							return stats;
+					return PoolMem::BucketStats_s{};
+				};
+
+				const auto before = bucketStats();
+
+				// enough allocations to fill several heap blocks
+				std::vector<void*> ptrs;
+				for (auto i = 0; i < 3000; ++i)
+					ptrs.push_back(pool.getPtr(400));
+
+				ASSERT(bucketStats().blocks >= 4);
+
+				// keeping the first one alive stops the bucket resetting, but leaves whole blocks unused
+				for (auto i = 1; i < static_cast<int>(ptrs.size()); ++i)
+					pool.freePtr(ptrs[i]);
+
+				ASSERT(bucketStats().freeBlocks >= 3);
+
+				pool.trim();
+				const auto trimmed = bucketStats();
+				ASSERT(trimmed.reclaimedBytes > 0);
+				ASSERT(trimmed.allocated == before.allocated + 1);
+
+				// reclaimed pages fault back in as they are reused
+				for (auto i = 1; i < static_cast<int>(ptrs.size()); ++i)
+				{
+					ptrs[i] = pool.getPtr(400);
+					memset(ptrs[i], 0xff, 400);
+				}
+
+				ASSERT(bucketStats().reclaimedBytes < trimmed.reclaimedBytes);
+
+				for (auto ptr : ptrs)
+					pool.freePtr(ptr);
+
+				ASSERT(bucketStats().allocated == before.allocated);
+
+				pool.setThreadCaching(true);
+
+				// free blocks beyond the retention limit are released
+				auto& blockPool = HeapStackBlockPool::getPool();
+				blockPool.setMaxRetained(2);
+				const auto released = blockPool.getStats().released;
+
+				{
+					HeapStack heap;
+					for (auto i = 0; i < 5; ++i)
+						heap.newPtr(200000); // a block each
+				}
+
+				ASSERT(blockPool.getStats().retained <= 2);
+				ASSERT(blockPool.getStats().released >= released + 3);
+
+				// retained blocks that go unused between two trims are released
+				blockPool.trim();
+				blockPool.trim();
+				ASSERT(blockPool.getStats().retained == 0);
+
+				blockPool.setMaxRetained(MemConstants::HeapStackDefaultRetained);
+			}
+		}
+	};
+}
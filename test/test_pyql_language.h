@@ -655,6 +655,27 @@ inline Tests test_pyql_language()
 
 	)pyql");
 
+	auto test18_pyql = fixIndent(R"pyql(
+	agg:
+		median price as p50
+		percentile price 95 as p95
+		percentile price 0 as p0
+
+	match:
+		tally('all')
+	)pyql");
+
+	// test date functions in a time zone
+	auto test19_pyql = fixIndent(R"pyql(
+	agg:
+		count person
+
+	debug(get_hour(first_event))
+	debug(date_day(first_event))
+	debug(get_day_of_week(first_event))
+
+	)pyql");
+
 	/* In order to make the engine start there are a few required objects as 
 	 * they will get called in the background during testing:
 	 *   
@@ -1616,6 +1637,151 @@ inline Tests test_pyql_language()
 
 					ASSERTDEBUGLOG(interpreter->debugLog);
 				}
+			},
+			{
+				"test_pyql_language: percentile aggregators", [test18_pyql]
+				{
+					auto database = openset::globals::database;
+
+					auto table = database->getTable("__test003__");
+					auto parts = table->getPartitionObjects(0); // partition zero for test				
+
+					openset::query::Macro_s queryMacros; // this is our compiled code block
+					openset::query::QueryParser p;
+
+					// compile this
+					p.compileQuery(test18_pyql.c_str(), table->getColumns(), queryMacros);
+					ASSERTMSG(p.error.inError() == false, p.error.getErrorJSON());
+					ASSERT(queryMacros.vars.columnVars[1].percentile == 95.0);
+
+					// mount the compiled query to an interpretor
+					auto interpreter = new openset::query::Interpreter(queryMacros);
+
+					openset::result::ResultSet resultSet;
+					interpreter->setResultObject(&resultSet);
+					resultSet.setAccTypesFromMacros(queryMacros);
+
+					auto personRaw = parts->people.getmakePerson("user1@test.com"); // get a user			
+					ASSERT(personRaw != nullptr);
+					auto mappedColumns = interpreter->getReferencedColumns();
+
+					Person person; // Person overlay for personRaw;
+					person.mapTable(table, 0, mappedColumns);
+
+					person.mount(personRaw); // this tells the person object where the raw compressed data is
+					person.prepare(); // this actually decompresses
+
+					interpreter->mount(&person);
+
+					// run it
+					interpreter->exec();
+					ASSERTMSG(interpreter->error.inError() == false, interpreter->error.getErrorJSON());
+
+					// send it through the internode format so the sketch is serialized
+					std::vector<openset::result::ResultSet*> resultSets{ &resultSet };
+
+					int64_t bufferLength = 0;
+					const auto buffer = openset::result::ResultMuxDemux::multiSetToInternode(
+						queryMacros.vars.columnVars.size(), 1, resultSets, bufferLength);
+
+					auto internode = openset::result::ResultMuxDemux::internodeToResultSet(buffer, bufferLength);
+					std::vector<openset::result::ResultSet*> internodeSets{ internode };
+
+					cjson resultJSON;
+					openset::result::ResultMuxDemux::resultSetToJson(
+						queryMacros.vars.columnVars.size(), 1, internodeSets, &resultJSON);
+
+					// prices are 2.49, 5.55, 5.55, 9.95, 12.49
+					auto dataNodes = resultJSON.xPath("/_")->getNodes();
+					ASSERT(dataNodes.size() == 1);
+					auto values = cjson::Stringify(dataNodes[0]->xPath("/c"));
+					ASSERTMSG(values == "[5.5500000,12.4900000,2.4900000]", values);
+
+					delete internode;
+					PoolMem::getPool().freePtr(buffer);
+
+					// accuracy with many values spread over two merged sketches
+					using openset::sketch::TDigest;
+
+					uint8_t left[TDigest::Size];
+					uint8_t right[TDigest::Size];
+					TDigest::init(left, 0.5);
+					TDigest::init(right, 0.5);
+
+					for (auto i = 0; i < 100000; ++i)
+						TDigest::add((i * 7919) % 2 ? left : right, static_cast<double>((i * 7919) % 100000));
+
+					TDigest::merge(left, right);
+
+					const auto p50 = TDigest::quantile(left, 0.5);
+					const auto p99 = TDigest::quantile(left, 0.99);
+					ASSERT(p50 > 49000 && p50 < 51000);
+					ASSERT(p99 > 98800 && p99 < 99200);
+				}
+			},
+			{
+				"test_pyql_language: time zones", [test19_pyql]
+				{
+					auto database = openset::globals::database;
+
+					auto table = database->getTable("__test003__");
+					auto parts = table->getPartitionObjects(0); // partition zero for test
+
+					// runs the script with `timeZone` (nullptr is UTC) and returns the debug log
+					const auto run = [&](const TimeZone* timeZone) -> std::vector<cvar>
+					{
+						openset::query::Macro_s queryMacros;
+						openset::query::QueryParser p;
+
+						p.compileQuery(test19_pyql.c_str(), table->getColumns(), queryMacros);
+						ASSERTMSG(p.error.inError() == false, p.error.getErrorJSON());
+
+						queryMacros.timeZone = timeZone;
+
+						auto interpreter = new openset::query::Interpreter(queryMacros);
+
+						openset::result::ResultSet resultSet;
+						interpreter->setResultObject(&resultSet);
+
+						auto personRaw = parts->people.getmakePerson("user1@test.com");
+						ASSERT(personRaw != nullptr);
+						auto mappedColumns = interpreter->getReferencedColumns();
+
+						Person person;
+						person.mapTable(table, 0, mappedColumns);
+						person.mount(personRaw);
+						person.prepare();
+
+						interpreter->mount(&person);
+						interpreter->exec();
+						ASSERT(interpreter->error.inError() == false);
+
+						auto debug = interpreter->debugLog;
+						delete interpreter;
+						return debug;
+					};
+
+					// first event is 2016-03-24T12:00:30Z, a Thursday
+					auto debug = run(nullptr);
+					ASSERT(debug.size() == 3);
+					ASSERT(debug[0] == 12);
+					ASSERT(debug[1].getInt64() == 1458777600000LL);
+					ASSERT(debug[2] == 5);
+
+					// 17:30 in India, the day starts at 18:30 UTC the day before
+					debug = run(TimeZone::get("+05:30"));
+					ASSERT(debug.size() == 3);
+					ASSERT(debug[0] == 17);
+					ASSERT(debug[1].getInt64() == 1458757800000LL);
+					ASSERT(debug[2] == 5);
+
+					// 01:00 on Friday in Kiribati
+					debug = run(TimeZone::get("+13:00"));
+					ASSERT(debug.size() == 3);
+					ASSERT(debug[0] == 1);
+					ASSERT(debug[1].getInt64() == 1458817200000LL);
+					ASSERT(debug[2] == 6);
+				}
 			}
 
 	};
@@ -2,6 +2,14 @@
 
 #include "testing.h"
 #include "test_lib_var.h"
+#include "test_lib_flatmap.h"
+#include "test_lib_poolmem.h"
+#include "test_lib_heapstack.h"
+#include "test_lib_epoch.h"
+#include "test_lib_cjson.h"
+#include "test_lib_internodeframe.h"
+#include "test_lib_internoderouter.h"
+#include "test_lib_async.h"
 #include "test_db.h"
 #include "test_complex_events.h"
 #include "test_pyql_language.h"
@@ -22,6 +30,14 @@ bool unitTest()
 
 	// add test for var.h
 	add(test_lib_cvar());
+	add(test_lib_flatmap());
+	add(test_lib_poolmem());
+	add(test_lib_heapstack());
+	add(test_lib_epoch());
+	add(test_lib_cjson());
+	add(test_lib_internodeframe());
+	add(test_lib_internoderouter());
+	add(test_lib_async());
 	add(test_db());
 	add(test_complex_events());
 	add(test_pyql_language());